@@ -1,3 +1,11 @@
 #!/bin/bash
 
-curl --header "Content-Type: text/plain" --data-binary "@batch.data.hex" http://localhost:9999/batch/j2735/uper/xer > batch.log
\ No newline at end of file
+# Decode one large batch and check every line of the response against the expected XER.
+#
+# Prerequisites:
+#   * The app running in HTTP server mode on localhost:9999
+#   * acm_http_load built from this repository; set ACM_HTTP_LOAD if it is not in ../build
+
+ACM_HTTP_LOAD=${ACM_HTTP_LOAD:-../build/acm_http_load}
+
+$ACM_HTTP_LOAD -u localhost:9999 -F batch.data.hex -e batch -b 10000 -c 1 -n 1 "$@"
@@ -5,29 +5,14 @@
 # Prerequisites:
 #   * Docker
 #   * A Bash command line (for example Git Bash or WSL on Windows)
-#   * curl installed
+#   * acm_http_load built from this repository; set ACM_HTTP_LOAD if it is not in ../build
 #
-# This script sends large batches of message frames over 4 simultaneous HTTP connections.
+# This script sends large batches of message frames over 4 simultaneous keep-alive connections and checks
+# every decoded message against the expected XER.
 #
-# Run the app in server mode in Docker, and observe the container log for decoding errors
-# while running this script.  If intermittent/periodic decoding errors are seen with this
-# script, but a single threaded query does not cause errors, it indicates a problem with
-# thread safety.
+# Run the app in server mode in Docker while running this script.  Mismatches or HTTP errors under concurrent
+# load, when a single connection runs clean, indicate a problem with thread safety; the script exits non-zero.
 
+ACM_HTTP_LOAD=${ACM_HTTP_LOAD:-../build/acm_http_load}
 
-
-function send_batch {
-    for run in {1..20}; do
-        curl --header "Content-Type: text/plain" --data-binary "@batch.data.hex" http://localhost:9999/batch/j2735/uper/xer > $1;
-    done
-}
-
-echo "thread 1: start sending batches"
-send_batch "batch1.log" &
-echo "thread 2: start sending batches"
-send_batch "batch2.log" &
-echo "thread 3: start sending batches"
-send_batch "batch3.log" &
-echo "thread 4: start sending batches"
-send_batch "batch4.log" &
-
+$ACM_HTTP_LOAD -u localhost:9999 -F batch.data.hex -e batch -b 10000 -c 4 -n 80 -I 1 "$@"
@@ -69,8 +69,19 @@
 #include "pugixml.hpp"
 
 #include "acmLogger.hpp"
-
+#include "acm_metrics.hpp"
+#include "header_peek.hpp"
+#include "constraint_policy.hpp"
+#include "output_renderer.hpp"
+#include "json_envelope.hpp"
+
+#include <atomic>
+#include <chrono>
 #include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <utility>
 #include <tuple>
 #include <sstream>
@@ -98,6 +109,21 @@ enum class Asn1DataType : uint32_t {
     COUNT
 };
 
+// the text a decoder writes decoded structures in.
+enum class Text_Encoding : uint32_t {
+    XER = 0,
+    JSON,                   // json_encoder.hpp
+    COUNT
+};
+
+// where the key of an output record comes from; the partitioner picks its partition by the key.
+enum class Output_Key : uint32_t {
+    INPUT = 0,              // the input record's key.
+    ENTITY,                 // entity_key.hpp; the input record's key for messages without one.
+    NONE,
+    COUNT
+};
+
 // an enumeration that specifies which bit in a flag word is used to turn on and off certain operations.
 enum class Asn1OpsType : uint32_t {
 	IEEE1609DOT2 = 1,			// 1<<0
@@ -204,13 +230,148 @@ class Asn1CodecError : public std::runtime_error {
         }
 };
 
+/**
+ * The outcome of a step on the decode / encode hot path. Bad input is reported here instead of being thrown: under a
+ * flood of malformed records, unwinding cost an order of magnitude more than the decode itself. Each kind stands in
+ * for one of the exception types above, and raise() throws that exception where an API keeps throwing.
+ */
+class Asn1Status {
+    public:
+        enum class Kind { OK = 0, UNPARSEABLE_INPUT, MISSING_INPUT_ELEMENT, XPATH, CODEC, BUDGET };
+        static constexpr std::size_t kKinds = static_cast<std::size_t>(Kind::BUDGET) + 1;
+
+        bool ok() const { return kind_ == Kind::OK; }
+        Kind kind() const { return kind_; }
+        Asn1DataType data_type() const { return dt_; }
+        Asn1ErrorType error_type() const { return et_; }
+        const std::string& message() const { return message_; }
+        metrics::Stage stage() const { return stage_; }            ///< where the record failed; the envelope unless set.
+        uint64_t start_ns() const { return start_ns_; }            ///< when the message started, for budget.max_time_ns; 0 untimed.
+        long message_id() const { return message_id_; }            ///< of the MessageFrame decoded or encoded; -1 for none.
+        const std::string& entity_key() const { return entity_key_; }  ///< of that MessageFrame when keyed by entity; empty for none.
+
+        /**
+         * @brief Start a new message: its time budget, and nothing known about it yet. What a call learns about its
+         * message goes with the status of the call, not the codec, so threads sharing a codec (the HTTP and IPC
+         * servers) each have their own.
+         */
+        void start( uint64_t start_ns ) { start_ns_ = start_ns; message_id_ = -1; entity_key_.clear(); }
+        void set_message_id( long message_id ) { message_id_ = message_id; }
+        void set_entity_key( std::string entity_key ) { entity_key_ = std::move(entity_key); }
+
+        /**
+         * @brief Name the stage of the failure about to be recorded, e.g., return status.at(Stage::ASN_DECODE).codec(...).
+         */
+        Asn1Status& at( metrics::Stage stage ) { stage_ = stage; return *this; }
+
+        /**
+         * @brief The name of the exception type this status replaces; used in log messages.
+         */
+        const char* name() const;
+        static const char* name( Kind kind );
+
+        /**
+         * @brief Record a failure; always returns false so call sites can return status.fail(...).
+         */
+        bool fail( Kind kind, std::string message, Asn1DataType dt, Asn1ErrorType et );
+        bool unparseable( std::string message ) { return fail( Kind::UNPARSEABLE_INPUT, std::move(message), Asn1DataType::ODE, Asn1ErrorType::REQUEST ); }
+        bool missing( std::string message ) { return fail( Kind::MISSING_INPUT_ELEMENT, std::move(message), Asn1DataType::ODE, Asn1ErrorType::REQUEST ); }
+        bool codec( std::string message ) { return fail( Kind::CODEC, std::move(message), Asn1DataType::ODE, Asn1ErrorType::DATA ); }
+        bool budget( std::string message ) { return fail( Kind::BUDGET, std::move(message), Asn1DataType::ODE, Asn1ErrorType::DATA ); }
+
+        void clear();
+
+        /**
+         * @brief Throw the exception type matching kind(); must not be called when ok().
+         */
+        [[noreturn]] void raise() const;
+
+    private:
+        Kind kind_ = Kind::OK;
+        Asn1DataType dt_ = Asn1DataType::ODE;
+        Asn1ErrorType et_ = Asn1ErrorType::SUCCESS;
+        metrics::Stage stage_ = metrics::Stage::ENVELOPE_PARSE;
+        std::string message_;
+        uint64_t start_ns_ = 0;
+        long message_id_ = -1;
+        std::string entity_key_;
+};
+
+/**
+ * Per message limits on the codec work, so one pathological payload (e.g., a TIM or MAP with huge SEQUENCE OF counts)
+ * cannot stall a worker. A message over any limit fails with an Asn1Status::Kind::BUDGET status. 0 disables a limit.
+ */
+struct Codec_Budget {
+    std::size_t max_stack_bytes = 0;        ///< asn_codec_ctx_t max_stack_size for the binary and XML decoders.
+    std::size_t max_input_bytes = 0;        ///< bytes given to one decode: the binary payload, or the XML of an element to encode.
+    std::size_t max_output_bytes = 0;       ///< bytes one encoder may write: the XER of a decode, the binary of an encode.
+    uint64_t max_time_ns = 0;               ///< time for one message; checked between stages and while encoders write.
+};
+
+/**
+ * One consume, decode or encode, produce pipeline of a process running several (acm.pipelines). Every pipeline shares
+ * the process's producer and configuration; each worker has a consumer of its own in the pipeline's group.
+ */
+struct Pipeline_Config {
+    std::string name;
+    bool decode = true;                                     ///< acm.pipeline.<name>.type: decode or encode.
+    std::string consumer_topic;                             ///< acm.pipeline.<name>.topic.consumer
+    std::string producer_topic;                             ///< acm.pipeline.<name>.topic.producer
+    std::string group_id;                                   ///< acm.pipeline.<name>.group.id; defaults to <group.id>.<name>.
+    int workers = 1;                                        ///< acm.pipeline.<name>.workers: consume-produce threads.
+    std::map<std::string, std::string> routes;              ///< acm.pipeline.<name>.route.<key>; as acm.route.<key>.
+    std::map<std::string, std::string> outputs;             ///< acm.pipeline.<name>.outputs and .output.*; as acm.outputs and acm.output.*.
+};
+
+class Metrics_Server;
+class Dead_Letter_Producer;
+class Error_Rate_Limiter;
+class Topic_Router;
+
+/**
+ * Receives the librdkafka delivery reports for the output records and records produce to acknowledgement latency.
+ * Reports are only delivered while the producer is polled.
+ */
+class AcmDeliveryReportCb : public RdKafka::DeliveryReportCb {
+    public:
+        explicit AcmDeliveryReportCb( const std::shared_ptr<AcmLogger>& logger ) :
+            logger_{ logger }
+        {}
+
+        void dr_cb( RdKafka::Message& message ) override;
+
+    private:
+        const std::shared_ptr<AcmLogger>& logger_;                  ///> the owning ASN1_Codec's logger; set up after construction.
+};
+
+class ASN1_Codec;
+
+/**
+ * Takes the partition assignments of an ASN1_Codec's consumer: the codec counts the partitions for exit_eof and, when
+ * partition parallel (acm.kafka.partition.parallel), starts a worker for each assigned partition and drains and stops
+ * it before the partition is revoked.
+ */
+class AcmRebalanceCb : public RdKafka::RebalanceCb {
+    public:
+        explicit AcmRebalanceCb( ASN1_Codec& codec ) :
+            codec_{ codec }
+        {}
+
+        void rebalance_cb( RdKafka::KafkaConsumer* consumer, RdKafka::ErrorCode err, std::vector<RdKafka::TopicPartition*>& partitions ) override;
+
+    private:
+        ASN1_Codec& codec_;
+};
+
 class ASN1_Codec : public tool::Tool {
+    friend class AcmRebalanceCb;
 
     public:
 
         std::shared_ptr<AcmLogger> logger;
 
         static void sigterm (int sig);
+        static void toggle_stage_metrics (int sig);
 
         ASN1_Codec( const std::string& name, const std::string& description );
         ~ASN1_Codec();
@@ -220,9 +381,106 @@ class ASN1_Codec : public tool::Tool {
         bool configure();
         bool launch_consumer();
         bool launch_producer();
-        bool process_message(RdKafka::Message* message, std::stringstream& output_message_stream);
+        bool process_message(RdKafka::Message* message, std::stringstream& output_message_stream, Asn1Status& status);
         bool filetest();
         bool file_test(std::string file_path, std::ostream& os, bool encode = true);
+
+        /**
+         * @brief Run one ODE XML envelope held in memory through the encoder or decoder, bypassing Kafka.
+         *
+         * @param os receives the output document, or an error document on failure.
+         * @return true on success.
+         */
+        bool process_envelope(const char* data, std::size_t data_size, std::ostream& os, bool encode = true);
+
+        /**
+         * @brief Run one raw record held in memory through the encoder or decoder, as if it came with encodings in
+         * its acm.raw.header header.
+         *
+         * @param encodings the encoding stack, outermost first, e.g., Ieee1609Dot2Data:COER,MessageFrame:UPER
+         * @param os receives the decoded text or the encoded bytes, or an error document on failure.
+         * @return true on success.
+         */
+        bool process_raw(const char* data, std::size_t data_size, const std::string& encodings, std::ostream& os, bool encode = true);
+
+        /**
+         * @brief Take the logger, error template, and codec type of a configured codec, so this one can process
+         * envelopes in parallel with it without reading the configuration again.
+         */
+        void share_configuration(const ASN1_Codec& configured);
+
+        /**
+         * @brief The per-message codec limits (acm.budget.*); all zero when unlimited.
+         */
+        const Codec_Budget& codec_budget() const;
+        void set_codec_budget(const Codec_Budget& limits);
+
+        /**
+         * @brief When decoded structures are checked against their ASN.1 constraints (acm.constraints).
+         */
+        const Constraint_Policy& constraints() const;
+        void set_constraints(const Constraint_Policy& policy);
+
+        /**
+         * @brief true when the last input document was dropped by the pre-decode filter (acm.filter.*); nothing is
+         * written for it and it is not an error.
+         */
+        bool filtered() const;
+        void set_message_filter(const Message_Filter& filter);
+
+        /**
+         * @brief The messageId of the MessageFrame in the last input document; -1 when it held none or failed first.
+         */
+        long message_id() const;
+
+        /**
+         * @brief The entity key (acm.kafka.key=entity) of the MessageFrame in the last input document; empty when it
+         * held none, or when output records are keyed otherwise.
+         */
+        const std::string& entity_key() const;
+        void set_output_key(Output_Key key);
+
+        /**
+         * @brief Replace the fan-out outputs (acm.outputs); in Kafka mode each goes to the default output topic.
+         */
+        void set_outputs(const std::vector<Output_Renderer>& renderers);
+
+        /**
+         * @brief Append fan-out output number output of the last decoded input document to out.
+         *
+         * @return false when that output has nothing to render for the document.
+         */
+        bool render_output(std::size_t output, std::string& out) const;
+
+        /**
+         * @brief Read the acm.pipeline.<name>.* settings in properties of each pipeline named in names (acm.pipelines);
+         * a pipeline's group.id defaults to <group_id>.<name>.
+         */
+        bool configure_pipelines( const std::string& names, const std::unordered_map<std::string, std::string>& properties, const std::string& group_id );
+        const std::vector<Pipeline_Config>& pipeline_configs() const;
+
+        /**
+         * @brief false once a consumer error, a signal, or with exit_eof (-x) the end of every assigned partition stops
+         * consuming.
+         */
+        bool consuming() const;
+
+        /**
+         * @brief The assigned partitions with a worker of their own (acm.kafka.partition.parallel); read it on the
+         * consumer's thread, which starts and stops them.
+         */
+        std::size_t partition_worker_count() const;
+
+        /**
+         * @brief true when configured as a decoder (acm.type=decode or -T decode), false for an encoder.
+         */
+        bool decoding() const;
+
+        /**
+         * @brief What a decoder writes its output documents in (acm.format): the ODE XML envelope, or the same as JSON.
+         */
+        Text_Encoding output_encoding() const;
+        void set_output_encoding(Text_Encoding encoding);
         int operator()(void);
         const char* getEnvironmentVariable(const char* variableName);
 
@@ -244,14 +502,37 @@ class ASN1_Codec : public tool::Tool {
          */
         bool setup_logger_for_testing();
 
+        /**
+         * @brief Decode a hex or binary UPER MessageFrame into XER, or JSON, in xml_buffer.
+         *
+         * The status overloads report bad input in status and return false; the others throw Asn1CodecError.
+         */
+        bool decode_messageframe_data(std::string& data_as_hex, buffer_structure_t* xml_buffer, Asn1Status& status, Text_Encoding encoding = Text_Encoding::XER);
+        bool decode_messageframe_bytes(const char* data, std::size_t data_size, buffer_structure_t* xml_buffer, Asn1Status& status, Text_Encoding encoding = Text_Encoding::XER);
         bool decode_messageframe_data(std::string& data_as_hex, buffer_structure_t* xml_buffer);
+        bool decode_messageframe_bytes(const char* data, std::size_t data_size, buffer_structure_t* xml_buffer);
+
+        /**
+         * @brief Decode a binary COER Ieee1609Dot2Data and the UPER MessageFrame in its unsecuredData, signed or not,
+         * into XER, or JSON, in xml_buffer; the steps, budgets, and constraint checks of an envelope or raw record
+         * declaring the same encodings.
+         *
+         * @param is_signed set when the unsecuredData was inside signedData.
+         */
+        bool decode_1609dot2_messageframe_bytes(const char* data, std::size_t data_size, buffer_structure_t* xml_buffer, bool& is_signed, Asn1Status& status, Text_Encoding encoding = Text_Encoding::XER);
+
+        /**
+         * @brief Write the response for a failed status: errors in the input bytes are reported in the input document
+         * itself, anything else in a document rendered from the error template.
+         */
+        void write_error(const Asn1Status& status, std::ostream& os);
 
         bool hex_to_bytes_(const std::string& payload_hex, std::vector<char>& byte_buffer);
 
     private:
 
-        static bool bootstrap;                                          ///> flag indicating we need to bootstrap the consumer and producer
-        static bool data_available;                                     ///> flag to exit application; set via signals so static.
+        static std::atomic<bool> bootstrap;                             ///> flag to exit application; set via signals so static; read by every pipeline worker.
+        std::atomic<bool> data_available{ true };                       ///> flag to stop this codec's consumer on an error or EOF; its partition workers read it too.
 
         static constexpr std::size_t max_errbuf_size = 128;             ///> The length of error buffers for ASN.1 compiler.
 
@@ -265,8 +546,9 @@ class ASN1_Codec : public tool::Tool {
         static constexpr uint32_t ASDFRAME_IEEE1609DOT2_J2735MESSAGEFRAME = 7;
 
         bool exit_eof;                                                  ///> flag to cause the application to exit on stream eof.
-        int32_t eof_cnt;                                                ///> counts the number of eofs needed for exit_eof to work; each partition must end.
-        int32_t partition_cnt;                                          ///> TODO: the number of partitions being processed; currently 1.
+        std::size_t partition_cnt;                                      ///> the number of partitions assigned to the consumer; each must end for exit_eof.
+        std::set<std::pair<std::string, int32_t>> eof_partitions;       ///> assigned partitions at their end, by topic and partition.
+        std::mutex eof_mutex;                                           ///> guards partition_cnt and eof_partitions, which partition workers update.
 
         // bookkeeping.
         uint64_t msg_recv_count;                                        ///> Counter for the number of BSMs received.
@@ -276,6 +558,52 @@ class ASN1_Codec : public tool::Tool {
         uint64_t msg_send_bytes;                                        ///> Counter for the nubmer of BSM bytes published.
         uint64_t msg_filt_bytes;                                        ///> Counter for the nubmer of BSM bytes filtered/suppressed.
 
+        int metrics_port;                                               ///> Port for the /metrics endpoint in Kafka mode; 0 disables it.
+        int stage_log_seconds;                                          ///> How often per-stage latency percentiles are logged; 0 disables.
+        std::string processing_time_header;                             ///> Output record header carrying consume to produce microseconds; empty disables.
+        bool propagate_headers;                                         ///> Copy input record headers onto the output record.
+        std::string raw_header;                                         ///> acm.raw.header: names the encodings of a raw record; empty reads envelopes only.
+        Output_Key output_key;                                          ///> acm.kafka.key: what output records are keyed by.
+        bool partition_parallel;                                        ///> acm.kafka.partition.parallel: a worker for each assigned partition.
+        AcmRebalanceCb rebalance_cb;
+
+        /// An assigned partition of a partition parallel consumer: its queue, and the codec and thread serving it.
+        struct Partition_Worker {
+            std::unique_ptr<RdKafka::TopicPartition> position;          ///> the topic and partition; the offset to store after each record.
+            RdKafka::KafkaConsumer* consumer = nullptr;                 ///> the consumer assigned the partition; stores its offsets.
+            std::unique_ptr<RdKafka::Queue> queue;
+            std::unique_ptr<ASN1_Codec> codec;
+            std::atomic<bool> running{ true };
+            std::thread thread;
+        };
+        std::vector<std::unique_ptr<Partition_Worker>> partition_workers;
+
+        std::stringstream output_msg_stream;                            ///> the output of the record being handled; reused between records.
+        std::string output_msg_string;                                  ///> one rendering of that output, as produced.
+        Asn1Status codec_status;                                        ///> how the record being handled went.
+        std::chrono::steady_clock::time_point last_stage_log;
+        AcmDeliveryReportCb delivery_report_cb;
+        std::unique_ptr<Metrics_Server> metrics_server;
+        std::string dead_letter_topic;                                  ///> Topic for records that fail; empty sends error documents to the output topic.
+        double dead_letter_rate;                                        ///> Dead-letter records a second for each error class; 0 is unlimited.
+        double error_log_rate;                                          ///> Error log lines a second for each error class; 0 is unlimited.
+        std::shared_ptr<Dead_Letter_Producer> dead_letter;              ///> shared with the partition workers, as producer_ptr is.
+        std::unique_ptr<Error_Rate_Limiter> error_log_limiter;
+        Codec_Budget budget;
+        Constraint_Policy constraint_policy;                            ///> when decoded structures go through asn_check_constraints.
+        Message_Filter message_filter;                                  ///> drops or samples messages by messageId before decoding.
+        bool filtered_;                                                 ///> the last input document was dropped by message_filter.
+        long message_id_;                                               ///> messageId of the last input document's MessageFrame; -1 for none. Kafka and envelope paths only.
+        std::string entity_key_;                                        ///> entity_key of that MessageFrame when output_key is ENTITY; empty for none.
+        std::unique_ptr<Topic_Router> topic_router;                     ///> output topic by messageId or error class; null sends all to published_topic_name.
+        std::vector<Pipeline_Config> pipelines;                         ///> acm.pipelines; empty runs the single asn1.topic.* pipeline.
+        bool producer_shared;                                           ///> producer_ptr belongs to the process running this pipeline worker.
+        std::vector<std::size_t> route_slots;                           ///> route counter slot of each route of a pipeline worker; empty uses the route.
+        std::vector<Output_Renderer> outputs;                           ///> acm.outputs: renderings of each decoded record; empty writes the envelope alone.
+        std::vector<std::size_t> output_routes;                         ///> the topic_router route of each of outputs.
+        Text_Encoding text_encoding;                                    ///> acm.format: the text decoded documents are written in.
+        std::string pdu_json_;                                          ///> the MessageFrame last decoded, when text_encoding is JSON.
+
         // Logging.
         std::string mode;
         std::string debug;
@@ -288,25 +616,35 @@ class ASN1_Codec : public tool::Tool {
         // Kafka component pointers and variables.
         int consumer_timeout;
         std::string brokers;
-        int32_t partition;
         int64_t offset;
         std::string published_topic_name;                               ///> The topic we are publishing filtered BSM to.
         std::vector<std::string> consumed_topics;                       ///> consumer topics.
         std::shared_ptr<RdKafka::KafkaConsumer> consumer_ptr;
         std::shared_ptr<RdKafka::Producer> producer_ptr;
         std::shared_ptr<RdKafka::Topic> published_topic_ptr;
+        std::vector<std::shared_ptr<RdKafka::Topic>> route_topics;      ///> indexed by route; route 0 is published_topic_ptr.
 
         // ODE XML input XPath queries and parse options.
         pugi::xml_document input_doc;
+        Json_Envelope json_input;                                       ///> the input envelope, when it is JSON.
+        bool json_envelope_;                                            ///> the input envelope being processed is json_input, not input_doc.
+        pugi::xml_document payload_doc;                                 ///> payload/dataType and payload/data of a JSON envelope, for the codec.
+        std::string json_output_;                                       ///> json_input as written for the last record.
+        bool raw_record_;                                               ///> the record being processed is raw bytes or XER, with no envelope.
+        std::string raw_output_;                                        ///> the decoded text, or the encoded bytes, of the last raw record.
         pugi::xml_document internal_doc;
         pugi::xml_document error_doc;                                   ///> A base XML document to use in responding to input XML parse errors.
+        std::vector<std::string> error_template;                        ///> error_doc serialized once, split around the fields filled per error.
+        std::vector<int> error_template_fields;                         ///> which field goes after each error_template piece.
 
         unsigned int xml_parse_options;
         pugi::xpath_query ieee1609dot2_unsecuredData_query;
         pugi::xpath_query ode_payload_query;
         pugi::xpath_query ode_encodings_query;
 
-		bool add_error_xml( pugi::xml_document& doc, Asn1DataType dt, Asn1ErrorType et, std::string message, bool update_time = false );
+		bool add_error_xml( pugi::xml_document& doc, Asn1DataType dt, Asn1ErrorType et, const std::string& message, bool update_time = false );
+        bool build_error_template();
+        void render_error_template( std::ostream& os, Asn1DataType dt, Asn1ErrorType et, const std::string& message ) const;
 
         bool bytes_to_hex_(buffer_structure_t* buf_struct, std::string& payload_hex );
 
@@ -332,20 +670,190 @@ class ASN1_Codec : public tool::Tool {
         std::vector<std::tuple<std::string, std::string>> hex_data_;
 
         enum asn_transfer_syntax get_ats_transfer_syntax( const char* ats_type );
-        bool set_codec_requirements( pugi::xml_document& doc );
+        bool set_codec_requirements( pugi::xml_document& doc, Asn1Status& status );
+        bool set_codec_requirements( const Json_Envelope& envelope, Asn1Status& status );
+
+        /**
+         * @brief Set the codec the encodings header of a raw record asks for: comma separated elementType:encodingRule
+         * entries, outermost first.
+         */
+        bool set_codec_requirements( const std::string& encodings, Asn1Status& status );
+
+        /**
+         * @brief Add the codec one metadata encodings entry asks for.
+         *
+         * @param encoding_rule null when the entry has none; atstype, the rule of the entry before, applies then.
+         */
+        bool add_codec_requirement( const char* element_type, const char* encoding_rule, enum asn_transfer_syntax& atstype, Asn1Status& status );
+        void reset_codec_requirements();
+
+        /**
+         * @brief Give the codec the payload of the JSON envelope in json_input: the bytes to decode, or the XER to
+         * encode, in payload_doc; payload_node_ is its data node.
+         */
+        bool load_json_payload( Asn1Status& status );
+
+        /**
+         * @brief Write json_input to json_output_, with the payload data and dataType the codec left in payload_node_,
+         * or pdu_json_ for the data when a MessageFrame was decoded.
+         */
+        void write_json_envelope();
+
+        /**
+         * @brief Give the encoder the XER of a raw record in payload_doc; payload_node_ is its data node.
+         */
+        bool load_raw_payload( const char* data, std::size_t data_size, Asn1Status& status );
+
+        /**
+         * @brief Take the settings of a pipeline worker from the process's codec and the producer it shares.
+         *
+         * @return false when the worker's Kafka configuration could not be built.
+         */
+        bool configure_worker( const ASN1_Codec& process, const Pipeline_Config& pipeline );
+
+        /**
+         * @brief Create the producer and set its delivery report callback, and the dead-letter producer when there is a
+         * dead-letter topic; the output topics are created by launch_producer.
+         */
+        bool create_producer();
+
+        /**
+         * @brief Copy the Kafka settings a worker shares with the codec that starts it, and a copy of its Kafka
+         * configuration, without callbacks.
+         */
+        void share_kafka_configuration( const ASN1_Codec& process );
+
+        /**
+         * @brief Take everything a partition worker needs to decode or encode and produce as consumer does, and create
+         * its output topics.
+         */
+        bool configure_partition_worker( const ASN1_Codec& consumer );
+
+        /**
+         * @brief The consume, decode or encode, produce loop of one consumer; returns on SIGINT or SIGTERM.
+         */
+        void consume_produce();
+
+        /**
+         * @brief Decode or encode one consumed record and produce the output, or the error, for it; records that are
+         * consumer errors or events go to process_message alone.
+         *
+         * @return false when an output, or the dead-letter record, could not be queued; the record is not done.
+         */
+        bool handle_message( RdKafka::Message& msg, uint64_t consumed_ns );
 
-        bool decode_message( pugi::xml_node& payload_node, std::stringstream& output_message_stream );
+        /**
+         * @brief Store the offset after msg when it is done; otherwise rewind its partition so it is consumed again.
+         */
+        void store_offset( RdKafka::KafkaConsumer* consumer, RdKafka::TopicPartition& position, RdKafka::Message& msg, bool done );
+
+        /**
+         * @brief Serve delivery reports and log the stage latencies when due; never blocks.
+         */
+        void poll_producers();
+
+        /**
+         * @brief Follow the consumer's assignment: count the partitions and start or stop their workers, drain what
+         * is in flight on revoked partitions, and commit the stored offsets before they go.
+         */
+        void rebalance( RdKafka::KafkaConsumer* consumer, RdKafka::ErrorCode err, std::vector<RdKafka::TopicPartition*>& partitions );
+
+        /**
+         * @brief Start a partition worker, with a queue of its own, for each partition.
+         */
+        void start_partition_workers( RdKafka::KafkaConsumer* consumer, const std::vector<RdKafka::TopicPartition*>& partitions );
+
+        /**
+         * @brief Let the workers of partitions, or of all partitions when null, finish the record they hold and stop.
+         * Outside a revocation the partitions stay assigned, so their queues go back to the consumer's.
+         */
+        void stop_partition_workers( const std::vector<RdKafka::TopicPartition*>* partitions );
+
+        /**
+         * @brief The loop of one partition worker: records from its queue only, with the offset stored after each
+         * that is done.
+         */
+        void consume_partition( Partition_Worker& worker );
+
+        /**
+         * @brief Note that a partition reached its end, or did not; with exit_eof, consuming stops when all assigned
+         * partitions have.
+         */
+        void partition_eof( const std::string& topic, int32_t partition, bool eof );
+
+        /**
+         * @brief Produce value to the topic of route, with the input record's headers when they are propagated, and
+         * count it when it is queued.
+         */
+        bool produce_output( RdKafka::Message& input, std::size_t route, const std::string& value, uint64_t consumed_ns );
+
+        /**
+         * @brief Set up the fan-out outputs from settings read without their prefix: outputs, and
+         * output.<output>.format, .topic, and .fields. Each output topic becomes a route of topic_router.
+         */
+        bool configure_outputs( const std::map<std::string, std::string>& settings, std::string& error );
+
+        /**
+         * @brief Run every configured pipeline's workers on threads of their own until SIGINT or SIGTERM.
+         *
+         * @return false when a worker could not be configured; no pipeline runs then.
+         */
+        bool run_pipelines();
+        bool process_input_document( const char* data, std::size_t data_size, std::stringstream& output_message_stream, Asn1Status& status );
+        bool process_raw_record( const char* data, std::size_t data_size, const std::string& encodings, std::stringstream& output_message_stream, Asn1Status& status );
+
+        bool decode_message( pugi::xml_node& payload_node, std::stringstream& output_message_stream, Asn1Status& status );
         bool decode_message_legacy( pugi::xml_node& payload_node, std::stringstream& output_message_stream );
-        bool decode_1609dot2_data( std::string& data_as_hex, buffer_structure_t* xml_buffer );
+        bool decode_raw_record( const char* data, std::size_t data_size, std::stringstream& output_message_stream, Asn1Status& status );
+
+        /**
+         * @brief true when the header peek can read the messageId of the payload as its encodings were declared: a UPER
+         * MessageFrame, alone or inside a COER Ieee1609Dot2Data. Other payloads pass the pre-decode filter unread.
+         */
+        bool header_peekable() const;
+        bool decode_1609dot2_data( std::string& data_as_hex, buffer_structure_t* xml_buffer, Asn1Status& status );
+        bool decode_1609dot2_bytes_( const char* data, std::size_t data_size, buffer_structure_t* xml_buffer, Asn1Status& status );
+
+        /**
+         * @brief Replace data_as_hex with the unsecuredData of the IEEE 1609.2 XER in xml_buffer, which is freed.
+         */
+        bool unsecured_data_( buffer_structure_t* xml_buffer, std::string& data_as_hex, Asn1Status& status );
+        bool decode_messageframe_hex_( std::string& data_as_hex, buffer_structure_t* xml_buffer, Asn1Status& status, Text_Encoding encoding );
+        bool decode_messageframe_bytes_( const char* data, std::size_t data_size, buffer_structure_t* xml_buffer, Asn1Status& status, Text_Encoding encoding );
+
+        /**
+         * @brief Start the time budget of a new message in status.
+         */
+        void start_budget( Asn1Status& status );
+
+        /**
+         * @brief Record a budget failure at stage in status and count it.
+         *
+         * @return false, always.
+         */
+        bool budget_exceeded( Asn1Status& status, metrics::Stage stage, const std::string& message );
+        bool within_input_budget( std::size_t size, Asn1Status& status, metrics::Stage stage );
+        bool within_time_budget( Asn1Status& status, metrics::Stage stage );
+
+        /**
+         * @brief Check structure against the constraints of type when the constraint policy says to.
+         *
+         * @param message_id the MessageFrame messageId, for the violation counters; -1 for other PDUs.
+         * @return true when the structure passed or was not checked; the caller still owns it either way.
+         */
+        bool check_constraints( const asn_TYPE_descriptor_t* type, const void* structure, long message_id, bool encoding, Asn1Status& status );
         
 
-        bool encode_message( std::stringstream& output_message_stream );
-        void encode_frame_data(const std::string& data_as_xml, std::string& hex_string);
+        bool encode_message( std::stringstream& output_message_stream, Asn1Status& status );
+        bool encode_frame_data(const std::string& data_as_xml, std::string& hex_string, Asn1Status& status);
         bool j2735_2020_conformance_check(const std::string& messageFrameXml);
-        void encode_node_as_hex_string(bool replace = true);
-        void encode_for_protocol();
+        bool encode_node_as_hex_string(Asn1Status& status, bool replace = true);
+        bool encode_for_protocol(Asn1Status& status);
 
-        std::string get_current_time() const;
+        /**
+         * @brief The current UTC time in the ODE metadata format; formatted at most once a second per thread.
+         */
+        const std::string& get_current_time() const;
 
 };
 
@@ -49,11 +49,42 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifndef ACM_BLOB_PRODUCER_H
+#define ACM_BLOB_PRODUCER_H
+
 #include <librdkafka/rdkafkacpp.h>
 #include "tool.hpp"
 
 #include "acmLogger.hpp"
+#include "acm_metrics.hpp"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Counts delivery reports and the produce to acknowledgement latency for the load generator.
+ */
+class LoadDeliveryReportCb : public RdKafka::DeliveryReportCb {
+    public:
+        void dr_cb( RdKafka::Message& message ) override;
 
+        uint64_t acked = 0;                                             ///> delivered records.
+        uint64_t failed = 0;                                            ///> records librdkafka gave up on.
+        metrics::HistogramSnapshot ack_latency;                         ///> produce to ack in nanoseconds; reset every report.
+};
+
+/**
+ * Kafka load generator and end-to-end latency probe for a running ACM.
+ *
+ * In produce mode records from a corpus are sent to the ACM input topic, either open loop at a target rate or closed
+ * loop with a bounded number of unacknowledged records, each carrying its send time (microseconds since the epoch)
+ * in a header. In consume mode the ACM output topic is read and the time from that header to arrival is reported as
+ * end-to-end latency percentiles along with the throughput. The ACM copies input headers to its output records
+ * (acm.kafka.propagate.headers).
+ */
 class ACMBlobProducer : public tool::Tool {
 
     public:
@@ -68,6 +99,7 @@ class ACMBlobProducer : public tool::Tool {
         void print_configuration() const;
         bool configure();
         bool launch_producer();
+        bool launch_consumer();
         int operator()(void);
 
         /**
@@ -83,32 +115,62 @@ class ACMBlobProducer : public tool::Tool {
          */
         bool setup_logger( bool remove_files );
 
+        /**
+         * @brief Load the records to send.
+         *
+         * A directory contributes one record per regular file, in name order. A file contributes one record per
+         * non-empty line (e.g., ODE envelopes written by acm_corpus_gen -f ode) or, when a block size is given,
+         * one record per block.
+         *
+         * @return false if nothing could be loaded.
+         */
+        bool load_corpus();
+
     private:
 
         static bool data_available;                                     ///> flag to exit application; set via signals so static.
         
-        // If this buffer size is too small then an entire record will not be processed and things will FAIL!
-        // buffer for the ASN1 stuff.
         static constexpr std::size_t BUFSIZE = 1<<12;                   ///> 4k
-        uint8_t buf[BUFSIZE];
 
         // counters.
-        uint64_t msg_send_count;                                            ///> Counter for the number of BSMs published.
-        uint64_t msg_send_bytes;                                         ///> Counter for the number of BSM bytes published.
+        uint64_t msg_send_count;                                        ///> Counter for the number of records published.
+        uint64_t msg_send_bytes;                                        ///> Counter for the number of bytes published.
         
         std::string debug;
         std::string input_file;
-        std::size_t block_size;
+        std::size_t block_size;                                         ///> 0 means one record per line.
+
+        bool consume_mode;                                              ///> read the ACM output instead of producing input.
+        double rate;                                                    ///> open loop records per second; 0 is closed loop.
+        uint64_t window;                                                ///> closed loop limit on unacknowledged records.
+        uint64_t max_messages;                                          ///> stop after this many records; 0 is unlimited.
+        int duration_seconds;                                           ///> stop after this long; 0 is unlimited.
+        int report_seconds;                                             ///> interval between reports.
+        std::string send_time_header;                                   ///> header carrying the send time in microseconds.
+        std::string processing_time_header;                             ///> the ACM's consume to produce header; empty to ignore.
+
+        std::vector<std::string> corpus;
 
         int32_t partition;
-        std::string published_topic_name;                                    ///> The topic we are publishing filtered BSM to.
+        std::string published_topic_name;                               ///> The ACM input topic in produce mode; its output topic in consume mode.
 
         // configurations; global and topic (the names in these are fixed)
         std::unordered_map<std::string, std::string> mconf;
         RdKafka::Conf *conf;
         RdKafka::Conf *tconf;
 
+        LoadDeliveryReportCb delivery_report_cb;
+
         std::shared_ptr<RdKafka::Producer> producer_ptr;
         std::shared_ptr<RdKafka::Topic> published_topic_ptr;
+        std::shared_ptr<RdKafka::KafkaConsumer> consumer_ptr;
+
+        std::ofstream report_file;
+        std::ostream* report_os;                                        ///> JSON report lines; stdout unless a file is given.
+
+        int produce_load();
+        int consume_load();
+        void report( const std::string& json );
 };
 
+#endif
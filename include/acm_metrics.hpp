@@ -0,0 +1,402 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2017 US DOT - Joint Program Office
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ACM_METRICS_HPP
+#define ACM_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Process wide counters and latency histograms for the ACM.
+ *
+ * Every thread writes to its own shard, so recording is a handful of relaxed loads and stores with no locks and no
+ * contended cache lines. Readers (the /metrics endpoint) sum the shards; the totals they see may lag the writers by a
+ * few updates, which is fine for monitoring.
+ */
+namespace metrics {
+
+constexpr std::size_t kSubBucketBits = 3;                                   ///< 8 sub-buckets per power of two; <= 12.5% error.
+constexpr std::size_t kSubBuckets = 1 << kSubBucketBits;
+constexpr std::size_t kBucketCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+/**
+ * @brief Map a value onto its log-linear (HDR style) bucket.
+ */
+std::size_t bucket_index( uint64_t value );
+
+/**
+ * @brief The smallest value that maps onto bucket index.
+ */
+uint64_t bucket_lower( std::size_t index );
+
+/**
+ * @brief The largest value that maps onto bucket index.
+ */
+uint64_t bucket_upper( std::size_t index );
+
+/**
+ * @brief Current time from the monotonic clock in nanoseconds; the unit used for every latency in this namespace.
+ */
+inline uint64_t now_ns() {
+    return static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+/**
+ * A plain (single threaded) histogram; used for aggregation and by tools that own their data.
+ */
+class HistogramSnapshot {
+    public:
+        void record( uint64_t value );
+        void merge( const HistogramSnapshot& other );
+        void reset();
+
+        /**
+         * @brief The value at or below which the fraction p of the recorded values fall.
+         *
+         * @param p a fraction in [0,1], e.g., 0.99
+         * @return the midpoint of the bucket containing that rank; 0 when empty.
+         */
+        uint64_t percentile( double p ) const;
+        double mean() const;
+
+        std::array<uint64_t, kBucketCount> counts{};
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+};
+
+/**
+ * A histogram with exactly one writing thread and any number of readers.
+ */
+class Histogram {
+    public:
+        void record( uint64_t value ) {
+            bump( counts_[bucket_index(value)], 1 );
+            bump( count_, 1 );
+            bump( sum_, value );
+            if (value > max_.load(std::memory_order_relaxed)) max_.store(value, std::memory_order_relaxed);
+        }
+
+        void snapshot_into( HistogramSnapshot& snapshot ) const;
+
+    private:
+        // the single writer never races with itself, so a load/store pair avoids a locked read-modify-write.
+        static void bump( std::atomic<uint64_t>& a, uint64_t by ) {
+            a.store( a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed );
+        }
+
+        std::array<std::atomic<uint64_t>, kBucketCount> counts_{};
+        std::atomic<uint64_t> count_{0};
+        std::atomic<uint64_t> sum_{0};
+        std::atomic<uint64_t> max_{0};
+};
+
+enum class Counter : std::size_t {
+    MESSAGES_RECEIVED = 0,
+    MESSAGES_PUBLISHED,
+    MESSAGES_FILTERED,
+    BYTES_RECEIVED,
+    BYTES_PUBLISHED,
+    DELIVERY_FAILURES,
+    DEAD_LETTERS,
+    DEAD_LETTERS_SUPPRESSED,
+    ERROR_LOGS_SUPPRESSED,
+    BUDGET_EXCEEDED,
+    CONSTRAINT_CHECKS,
+    CONSTRAINT_CHECKS_SKIPPED,
+    COUNT
+};
+
+enum class Latency : std::size_t {
+    DECODE = 0,
+    ENCODE,
+    BROKER_TO_CONSUME,              ///< input record timestamp to consume; includes clock skew between hosts.
+    CONSUME_TO_PRODUCE,             ///< consume returned to produce accepted; the time the ACM owns the record.
+    PRODUCE_TO_ACK,                 ///< produce to delivery report, as measured by librdkafka.
+    COUNT
+};
+
+/**
+ * The steps a record passes through; a record only touches the stages its direction and encodings need.
+ */
+enum class Stage : std::size_t {
+    ENVELOPE_PARSE = 0,             ///< input XML envelope parse (load_buffer).
+    CODEC_REQUIREMENTS,             ///< set_codec_requirements.
+    HEX_CONVERSION,                 ///< hex to bytes and bytes to hex.
+    ASN_DECODE,                     ///< asn_decode of binary input.
+    CONSTRAINT_CHECK,               ///< asn_check_constraints.
+    XER_ENCODE,                     ///< struct to XER.
+    JSON_ENCODE,                    ///< struct to JSON.
+    XER_DECODE,                     ///< XER to struct.
+    ASN_ENCODE,                     ///< struct to binary.
+    XML_REPARSE,                    ///< decoded XER loaded back into a pugi document.
+    SERIALIZE,                      ///< pugi document or node written out as text.
+    PRODUCE,                        ///< hand off to the output transport.
+    COUNT
+};
+
+enum class Direction : std::size_t {
+    DECODE = 0,
+    ENCODE,
+    COUNT
+};
+
+const char* stage_name( Stage s );
+const char* direction_name( Direction d );
+
+/**
+ * @brief Whether per-stage timing is collected; cheap enough to check on every stage.
+ */
+bool stages_enabled();
+
+/**
+ * @brief Turn per-stage timing on or off. Async signal safe.
+ */
+void enable_stages( bool enabled );
+
+constexpr std::size_t kMaxErrorTypes = 8;           ///< slots for error counters; indexed by Asn1ErrorType.
+constexpr std::size_t kMaxMessageIds = 256;         ///< J2735 DSRCmsgIDs in use are below 256; larger ids share the last slot.
+constexpr std::size_t kMaxRoutes = 64;              ///< slots for per output topic counters; larger slots share the last.
+
+using StageTimes = std::array<uint64_t, static_cast<std::size_t>(Stage::COUNT)>;
+
+/**
+ * One histogram per stage for a single direction and message type.
+ */
+struct StageSet {
+    std::array<Histogram, static_cast<std::size_t>(Stage::COUNT)> stages;
+};
+
+constexpr std::size_t kStageSlots = static_cast<std::size_t>(Direction::COUNT) * (kMaxMessageIds + 1);
+
+/**
+ * The per thread slice of every metric.
+ */
+struct alignas(64) Shard {
+    ~Shard();
+
+    std::array<std::atomic<uint64_t>, static_cast<std::size_t>(Counter::COUNT)> counters{};
+    std::array<std::atomic<uint64_t>, kMaxErrorTypes> errors{};
+    std::array<std::atomic<uint64_t>, kMaxMessageIds + 1> message_ids{};
+    std::array<std::atomic<uint64_t>, kMaxMessageIds + 1> constraint_violations{};
+    std::array<std::atomic<uint64_t>, kMaxRoutes> route_messages{};
+    std::array<std::atomic<uint64_t>, kMaxRoutes> route_bytes{};
+    std::array<Histogram, static_cast<std::size_t>(Latency::COUNT)> latencies;
+
+    // allocated by the owning thread the first time it sees a direction/message type; most stay null.
+    std::array<std::atomic<StageSet*>, kStageSlots> stage_sets{};
+};
+
+class Registry {
+    public:
+        static Registry& instance();
+
+        void increment( Counter c, uint64_t by = 1 ) {
+            auto& a = local().counters[static_cast<std::size_t>(c)];
+            a.store( a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed );
+        }
+
+        void error( std::size_t error_type ) {
+            if (error_type >= kMaxErrorTypes) error_type = kMaxErrorTypes - 1;
+            auto& a = local().errors[error_type];
+            a.store( a.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed );
+        }
+
+        void message_id( long id ) {
+            std::size_t slot = (id >= 0 && id < static_cast<long>(kMaxMessageIds)) ? static_cast<std::size_t>(id) : kMaxMessageIds;
+            auto& a = local().message_ids[slot];
+            a.store( a.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed );
+        }
+
+        /// @param id the messageId of the MessageFrame that failed asn_check_constraints; -1 for other PDUs.
+        void constraint_violation( long id ) {
+            std::size_t slot = (id >= 0 && id < static_cast<long>(kMaxMessageIds)) ? static_cast<std::size_t>(id) : kMaxMessageIds;
+            auto& a = local().constraint_violations[slot];
+            a.store( a.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed );
+        }
+
+        /// @param route the output topic slot; 0 is the default output topic.
+        void routed( std::size_t route, uint64_t bytes ) {
+            if (route >= kMaxRoutes) route = kMaxRoutes - 1;
+            Shard& shard = local();
+            shard.route_messages[route].store( shard.route_messages[route].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed );
+            shard.route_bytes[route].store( shard.route_bytes[route].load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed );
+        }
+
+        void latency( Latency l, uint64_t ns ) {
+            local().latencies[static_cast<std::size_t>(l)].record(ns);
+        }
+
+        /**
+         * @brief Record the stage times of one finished record.
+         *
+         * @param seen bit i is set when Stage i ran for the record.
+         */
+        void stages( Direction d, long id, const StageTimes& times, uint32_t seen );
+
+        /**
+         * @brief Provide the label values used for the error counters; index i names error type i.
+         */
+        void set_error_names( const std::vector<std::string>& names );
+
+        /**
+         * @brief Provide the label values used for the route counters; index i names the topic of route i.
+         */
+        void set_route_names( const std::vector<std::string>& names );
+
+        uint64_t total( Counter c ) const;
+        uint64_t total_errors( std::size_t error_type ) const;
+        uint64_t total_message_id( long id ) const;
+        uint64_t total_constraint_violations( long id ) const;
+        uint64_t total_routed( std::size_t route ) const;
+        uint64_t total_routed_bytes( std::size_t route ) const;
+        HistogramSnapshot latency_snapshot( Latency l ) const;
+        HistogramSnapshot stage_snapshot( Direction d, long id, Stage s ) const;
+
+        /**
+         * @brief One line per direction, message type, and stage with the count and p50/p90/p99/max in microseconds.
+         */
+        std::vector<std::string> stage_report() const;
+
+        /**
+         * @brief Render every metric in the Prometheus text exposition format (version 0.0.4).
+         */
+        std::string prometheus() const;
+
+        /**
+         * @brief The shards allocated so far; threads that exit hand theirs on, so this follows the peak thread count.
+         */
+        std::size_t shard_count() const;
+
+    private:
+        Registry() = default;
+
+        /**
+         * Held by each thread that records; when the thread exits its shard goes to the free list with its counts.
+         */
+        struct Shard_Lease {
+            Shard* shard = nullptr;
+            ~Shard_Lease();
+        };
+
+        Shard& local() {
+            thread_local Shard* shard = nullptr;
+            if (!shard) shard = add_shard();
+            return *shard;
+        }
+
+        Shard* add_shard();
+        void release_shard( Shard* shard );
+        static std::size_t stage_slot( Direction d, long id );
+        bool stage_sets_in_use( std::size_t slot ) const;
+
+        mutable std::mutex mutex_;                          ///< guards shard registration and the label names only.
+        std::vector<std::unique_ptr<Shard>> shards_;        ///< never shrinks; counts from finished threads are kept.
+        std::vector<Shard*> free_shards_;                   ///< shards of finished threads, for the next thread to carry on.
+        std::vector<std::string> error_names_;
+        std::vector<std::string> route_names_;
+};
+
+/**
+ * Collects the stage times of the record the current thread is working on; the message type is usually not known until
+ * part way through, so times are held here and committed to the registry when the record is finished.
+ */
+class StageTrace {
+    public:
+        static StageTrace& local() {
+            thread_local StageTrace trace;
+            return trace;
+        }
+
+        /**
+         * @brief Start a new record; a no-op (and every later call too) when stage timing is disabled.
+         */
+        void begin() {
+            active_ = stages_enabled();
+            if (!active_) return;
+            times_.fill(0);
+            seen_ = 0;
+            message_id_ = -1;
+        }
+
+        bool active() const {
+            return active_;
+        }
+
+        void add( Stage s, uint64_t ns ) {
+            if (!active_) return;
+            times_[static_cast<std::size_t>(s)] += ns;
+            seen_ |= 1u << static_cast<uint32_t>(s);
+        }
+
+        /// The first MessageFrame seen names the record; nested frames do not change it.
+        void message_id( long id ) {
+            if (active_ && message_id_ < 0) message_id_ = id;
+        }
+
+        void commit( Direction d ) {
+            if (!active_) return;
+            Registry::instance().stages( d, message_id_, times_, seen_ );
+            active_ = false;
+        }
+
+        void discard() {
+            active_ = false;
+        }
+
+    private:
+        bool active_ = false;
+        uint32_t seen_ = 0;
+        long message_id_ = -1;
+        StageTimes times_{};
+};
+
+/**
+ * Times the enclosing scope as one stage of the current record.
+ */
+class ScopedStage {
+    public:
+        explicit ScopedStage( Stage s ) :
+            trace_{ StageTrace::local() }
+            , stage_{ s }
+            , start_{ trace_.active() ? now_ns() : 0 }
+        {}
+
+        ~ScopedStage() {
+            if (start_) trace_.add( stage_, now_ns() - start_ );
+        }
+
+        ScopedStage( const ScopedStage& ) = delete;
+        ScopedStage& operator=( const ScopedStage& ) = delete;
+
+    private:
+        StageTrace& trace_;
+        Stage stage_;
+        uint64_t start_;
+};
+
+}  // end namespace.
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef ACM_BULK_CONVERTER_H
+#define ACM_BULK_CONVERTER_H
+
+#include "acm.hpp"
+#include "acmLogger.hpp"
+#include "pcap_reader.hpp"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/**
+ * Offline conversion of archives: every file named on the command line (directories contribute the regular files
+ * they contain, in name order) is memory mapped, cut into blocks of whole records, converted in parallel, and
+ * written back out in input order.
+ *
+ * Input formats, one output line per record:
+ *
+ *     xml     each file is one ODE envelope (as with -F); output is the result or error document.
+ *     ode     one ODE envelope per line; output is the result or error document.
+ *     hex     one hex MessageFrame per line; output is the XER, or an empty line when it does not decode.
+ *     ndjson  one JSON object with a "hex" MessageFrame per line; output is the object with "xer" or "error" added.
+ *     bin     [uint32 length, network byte order][MessageFrame bytes] records; output as for hex.
+ *     uper    back to back UPER MessageFrames with no framing (a raw capture); output as for hex.
+ *     coer    back to back COER Ieee1609Dot2Data with no framing; output as for hex.
+ *     pcap    pcap or pcapng captures; every WSMP packet gives a JSON object with its packet number, capture
+ *             timestamp, PSID, and the MessageFrame XER from its 1609.2 payload (or "error"). Other packets are skipped.
+ *
+ * xml and ode follow the codec type (decode or encode); the other formats always decode. uper and coer files are
+ * decoded sequentially by a Stream_Decoder, so each is handled by a single worker.
+ */
+class Bulk_Converter {
+    public:
+        enum class Format { XML, ODE, HEX, NDJSON, BIN, UPER, COER, PCAP };
+
+        Bulk_Converter(ASN1_Codec& asn1_codec, Format input_format = Format::XML);    ///< -f overrides input_format.
+        ~Bulk_Converter();
+
+        /**
+         * @brief Configure the codec from its options and convert every operand.
+         *
+         * @return EXIT_SUCCESS when every record converted, EXIT_FAILURE otherwise.
+         */
+        int bulk_converter();
+
+        /**
+         * @brief Convert one record with worker and append the output line, including its newline, to output.
+         *
+         * @return false when the record did not convert; output still receives the error line.
+         */
+        bool convert_record(ASN1_Codec& worker, const char* data, std::size_t length, std::string& output);
+
+        static bool parse_format(const std::string& name, Format& format);
+        static bool line_format(Format format);     ///< one record per line.
+
+        static void sigterm(int sig);
+
+    private:
+        ASN1_Codec& codec;
+        AcmLogger logger;
+        static std::atomic<bool> running;
+
+        Format format;
+        int jobs = 0;                               ///< worker threads; 0 uses one per core.
+        std::string output_dir;                     ///< empty writes everything to stdout.
+
+        bool collect_inputs(const std::vector<std::string>& operands, std::vector<std::string>& files);
+        std::string output_path(const std::string& input) const;
+
+        /**
+         * @return the number of WSMP packets capture reads before file offset end, or of PDUs in the unframed stream
+         * data; errors counts the ones that did not decode, plus one for bad data or a truncated PDU that ends the
+         * stream early.
+         */
+        uint64_t convert_capture(ASN1_Codec& worker, pcap::Reader capture, std::size_t end, std::string& output, uint64_t& errors);
+        uint64_t convert_stream(const std::string& name, const char* data, std::size_t length, std::string& output, uint64_t& errors);
+};
+
+#endif
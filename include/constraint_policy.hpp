@@ -0,0 +1,43 @@
+#ifndef ACM_CONSTRAINT_POLICY_H
+#define ACM_CONSTRAINT_POLICY_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * When asn_check_constraints walks a decoded structure a second time. The UPER and OER decoders already reject values
+ * outside the PER and OER visible constraints while they read them, so for trusted binary feeds the walk seldom finds
+ * anything; XML input has no such checks, which is why ENCODE_ONLY keeps the walk for encoding.
+ */
+class Constraint_Policy {
+    public:
+        enum class Mode { FULL, SAMPLED, ENCODE_ONLY, OFF };
+
+        /**
+         * @param sample_every SAMPLED checks one structure in this many on each thread.
+         */
+        explicit Constraint_Policy( Mode mode = Mode::FULL, uint32_t sample_every = 100 );
+
+        /**
+         * @brief Parse full, sampled, encode-only, or off.
+         *
+         * @return false when name is none of these; mode is unchanged.
+         */
+        static bool parse( const std::string& name, Mode& mode );
+        static const char* name( Mode mode );
+
+        /**
+         * @param encoding true for a structure decoded from XML to be encoded, false for one decoded from binary.
+         * @return true when this structure should be checked.
+         */
+        bool check( bool encoding ) const;
+
+        Mode mode() const;
+        uint32_t sample_every() const;
+
+    private:
+        Mode mode_;
+        uint32_t sample_every_;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef ACM_DEAD_LETTER_H
+#define ACM_DEAD_LETTER_H
+
+#include "acm.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * Limits how often something happens for each class of error (Asn1Status::Kind) with a token bucket: up to per_second
+ * events a second, with bursts of up to one second's worth. Events over the limit are counted, so the next one that is
+ * allowed can say how many were dropped. Not thread safe; each consumer loop owns its limiters.
+ */
+class Error_Rate_Limiter {
+    public:
+        static constexpr std::size_t kErrorClasses = Asn1Status::kKinds;
+
+        /**
+         * @param per_second events allowed per second for each class; 0 allows everything.
+         */
+        explicit Error_Rate_Limiter( double per_second = 0 );
+
+        /**
+         * @return true when an event of this class may happen at now_ns; false when it is over the limit.
+         */
+        bool allow( Asn1Status::Kind kind, uint64_t now_ns );
+
+        /**
+         * @return the events of this class refused since the last call, and start counting again.
+         */
+        uint64_t take_suppressed( Asn1Status::Kind kind );
+
+        double rate() const;
+
+    private:
+        struct Bucket {
+            double tokens = 0;
+            uint64_t refilled_ns = 0;
+            uint64_t suppressed = 0;
+            bool started = false;
+        };
+
+        double per_second_;
+        std::array<Bucket, kErrorClasses> buckets_;
+};
+
+/**
+ * Publishes records that failed decoding or encoding to a dead-letter topic through a producer of their own, so error
+ * storms neither queue behind nor share the delivery reports of the output records. The record value is the input
+ * record's bytes, unchanged, and its key is the input key; headers say what went wrong:
+ *
+ *     acm.error.code       INVALID_REQUEST_TYPE_ERROR or INVALID_DATA_TYPE_ERROR
+ *     acm.error.class      the error class, e.g., Asn1CodecError
+ *     acm.error.stage      the processing stage that failed, e.g., asn_decode
+ *     acm.error.message    the error message
+ *     acm.source.topic     where the input record came from, so it can be replayed
+ *     acm.source.partition
+ *     acm.source.offset
+ *
+ * The partition workers of a consumer share its producer: publish, poll, and flush may be called from any thread.
+ */
+class Dead_Letter_Producer {
+    public:
+        static constexpr int kFlushTimeoutMs = 5000;    ///< how long the destructor waits for queued records.
+
+        /**
+         * @param per_second dead-letter records allowed per second for each error class; 0 allows everything.
+         */
+        Dead_Letter_Producer( const std::shared_ptr<AcmLogger>& logger, const std::string& topic, double per_second );
+
+        /**
+         * @brief Flush the queued records, waiting at most kFlushTimeoutMs, so the last owner need not.
+         */
+        ~Dead_Letter_Producer();
+
+        /**
+         * @brief Create the producer from a copy of the properties in conf; callbacks are not copied.
+         *
+         * @return false if the producer could not be created.
+         */
+        bool launch( RdKafka::Conf* conf );
+
+        /**
+         * @brief Queue the dead-letter record for input; the input record headers are kept when copy_headers is set.
+         *
+         * @return false when the record could not be produced; a record over the rate limit is dropped, not failed.
+         */
+        bool publish( RdKafka::Message& input, const Asn1Status& status, bool copy_headers, uint64_t now_ns );
+
+        /**
+         * @brief Serve delivery reports; never blocks.
+         */
+        void poll();
+        void flush( int timeout_ms );
+
+        const std::string& topic() const;
+
+    private:
+        class Delivery_Report_Cb : public RdKafka::DeliveryReportCb {
+            public:
+                explicit Delivery_Report_Cb( const std::shared_ptr<AcmLogger>& logger ) : logger_{ logger } {}
+                void dr_cb( RdKafka::Message& message ) override;
+
+            private:
+                std::shared_ptr<AcmLogger> logger_;
+        };
+
+        std::shared_ptr<AcmLogger> logger_;
+        std::string topic_;
+        Error_Rate_Limiter limiter_;
+        std::mutex limiter_mutex_;
+        Delivery_Report_Cb delivery_report_cb_;
+        std::unique_ptr<RdKafka::Producer> producer_;
+};
+
+#endif
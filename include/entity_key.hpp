@@ -0,0 +1,24 @@
+#ifndef ACM_ENTITY_KEY_H
+#define ACM_ENTITY_KEY_H
+
+#include "MessageFrame.h"
+
+#include <string>
+
+/**
+ * The key of the entity a MessageFrame is about, read from the structure the codec already decoded or encoded, so
+ * output records of one vehicle, person, or intersection share a key and the partitioner keeps them in order.
+ */
+namespace entity_key {
+
+/**
+ * @brief The TemporaryID of a BSM or PSM, as hex, e.g., 1E2A3B4C; the IntersectionReferenceID of the first
+ * intersection of a MAP or SPaT, as id or region.id, e.g., 1.12110. MAP and SPaT of one intersection get the same key.
+ *
+ * @return false, with key empty, for other messages and for those without the field.
+ */
+bool derive( const MessageFrame_t& frame, std::string& key );
+
+}  // end namespace.
+
+#endif
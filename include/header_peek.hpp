@@ -0,0 +1,78 @@
+#ifndef ACM_HEADER_PEEK_H
+#define ACM_HEADER_PEEK_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+/**
+ * Reads the few leading fields of an encoded PDU that routing and filtering need, straight from the bytes: no asn1c
+ * struct is allocated and nothing is validated beyond what it takes to find the fields. A PDU that peeks fine can still
+ * fail to decode.
+ */
+namespace peek {
+
+/**
+ * What the first bytes of a PDU say about it; -1 for anything they do not say or that could not be reached.
+ */
+struct Header {
+    long message_id = -1;               ///< J2735 MessageFrame messageId (DSRCmsgID).
+    int content = -1;                   ///< Ieee1609Dot2Content choice: 0 unsecuredData, 1 signedData, 2 encryptedData, ...
+    long long psid = -1;                ///< the signedData HeaderInfo psid.
+};
+
+/**
+ * @brief UPER MessageFrame: an extension bit, then the 15 bit messageId.
+ *
+ * @return false when size is under two bytes.
+ */
+bool messageframe( const uint8_t* data, std::size_t size, Header& header );
+
+/**
+ * @brief COER Ieee1609Dot2Data: the content choice, the messageId of a MessageFrame carried as unsecuredData (directly
+ * or inside signedData), and the psid of signedData. Fields past the end of data are left at -1, so a prefix of the
+ * PDU is enough for the content and messageId.
+ *
+ * @return false when data is not a version 3 Ieee1609Dot2Data.
+ */
+bool ieee1609dot2( const uint8_t* data, std::size_t size, Header& header );
+
+/**
+ * @brief Convert up to max_bytes from the start of a hex string; stops early at the first pair that is not hex.
+ *
+ * @return the number of bytes written to out.
+ */
+std::size_t hex_prefix( const std::string& hex, uint8_t* out, std::size_t max_bytes );
+
+}  // end namespace.
+
+/**
+ * The pre-decode filter: drops or samples messages by MessageFrame messageId before any decoding. Messages whose
+ * messageId is not known always pass, so the decoder can report what is wrong with them. Not thread safe; each codec
+ * owns its filter.
+ */
+class Message_Filter {
+    public:
+        enum class Action { PASS, DROP };
+
+        static constexpr std::size_t kMessageIds = 256;             ///< J2735 DSRCmsgIDs in use are below 256.
+
+        /**
+         * @brief Replace the rules.
+         *
+         * @param drop comma separated messageIds to drop, e.g., 18,19
+         * @param sample comma separated id:N pairs; keep one message in N of that id, e.g., 20:10
+         * @param error what is wrong with the rules when false is returned; the filter is unchanged then.
+         */
+        bool configure( const std::string& drop, const std::string& sample, std::string& error );
+
+        bool active() const;
+        Action decide( long message_id );
+
+    private:
+        std::array<uint32_t, kMessageIds> keep_every_{};            ///< 0 passes all, UINT32_MAX drops all, N keeps 1 in N.
+        std::array<uint32_t, kMessageIds> seen_{};
+        bool active_ = false;
+};
+
+#endif
@@ -10,8 +10,8 @@ class Http_Server {
         Http_Server(ASN1_Codec& asn1_codec);
         ~Http_Server();
         bool http_server();
-        crow::response post_single(const crow::request& req);
-        crow::response post_batch(const crow::request& req);
+        crow::response post_single(const crow::request& req, Text_Encoding encoding = Text_Encoding::XER);
+        crow::response post_batch(const crow::request& req, Text_Encoding encoding = Text_Encoding::XER);
     private:
         ASN1_Codec& codec;
         AcmLogger logger;
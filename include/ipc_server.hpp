@@ -0,0 +1,80 @@
+#ifndef ACM_IPC_SERVER_H
+#define ACM_IPC_SERVER_H
+
+#include "acm.hpp"
+#include "acmLogger.hpp"
+#include "shm_ring.hpp"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/**
+ * Local transport for producers running on the same host as the ACM.
+ *
+ * Unix domain socket framing (requests and responses use the same layout):
+ *
+ *     [uint32 body length, network byte order][uint8 code][body]
+ *
+ * A request code is an ipc::IpcCode operation; a response code is ipc::IpcCode::OK or ipc::IpcCode::ERROR. Frames
+ * are processed in order on each connection, so producers may pipeline requests. Each worker polls the connections
+ * it accepted, so any number of producers may stay connected.
+ *
+ * When ACM_IPC_SHM_NAME is set the server also creates a shared memory segment (see shm_ring.hpp) carrying the same
+ * code/body pairs in ring slots.
+ */
+class Ipc_Server {
+    public:
+        Ipc_Server(ASN1_Codec& asn1_codec);
+        ~Ipc_Server();
+        bool ipc_server();
+
+        /**
+         * @brief Run one request through the codec.
+         *
+         * @param code the request operation.
+         * @param data the request body.
+         * @param length the number of bytes in the body.
+         * @param response the response body; an XER document or an error message.
+         * @return the response code.
+         */
+        ipc::IpcCode process_frame(uint8_t code, const char* data, std::size_t length, std::string& response);
+
+        static void sigterm(int sig);
+
+    private:
+        ASN1_Codec& codec;
+        AcmLogger logger;
+        static const char* getEnvironmentVariable(std::string var);
+        static std::atomic<bool> running;
+
+        std::string socket_path = "/tmp/acm.sock";
+        int concurrency = 4;
+        uint32_t max_frame_size = 1 << 20;
+
+        std::string shm_name;
+        uint32_t shm_channels = 4;
+        uint32_t shm_slots = 256;
+        uint32_t shm_slot_size = 8192;
+
+        int listen_fd = -1;
+
+        /// A producer's socket and the bytes it sent that do not yet make a whole frame.
+        struct Connection {
+            int fd;
+            std::vector<char> buffer;
+        };
+
+        bool open_socket();
+        void socket_worker(int worker_id);
+
+        /**
+         * @brief Read what the producer sent and answer every whole frame in it.
+         *
+         * @return false when the connection is closed or must be dropped.
+         */
+        bool serve_connection(Connection& connection, std::string& response);
+        void shm_worker(ipc::ShmSegment& segment, int worker_id);
+};
+
+#endif
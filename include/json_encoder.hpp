@@ -0,0 +1,42 @@
+#ifndef ACM_JSON_ENCODER_H
+#define ACM_JSON_ENCODER_H
+
+#include "asn_application.h"
+#include "pugixml.hpp"
+
+#include <cstddef>
+#include <string>
+
+/**
+ * JSON output straight from the decoded asn1c structures, so a decoder that writes JSON never builds or parses XER.
+ * The values follow the JSON Encoding Rules (X.697): a SEQUENCE is an object of its present components, a CHOICE an
+ * object of its one alternative, a SEQUENCE OF an array, INTEGERs numbers, ENUMERATEDs their identifiers, BOOLEANs
+ * true or false, NULL null, and OCTET STRINGs hexadecimal strings. Two choices differ from JER and keep the XER shape
+ * that consumers of the XML output already know: an open type, e.g., MessageFrame value, is an object keyed by the
+ * name of the type it holds, and a BIT STRING is its string of 0s and 1s.
+ */
+namespace jer {
+
+/**
+ * @brief Encode structure, of type, as {"<type xml tag>":<value>}, giving the text to cb in pieces as xer_encode does.
+ *
+ * @return encoded is the number of bytes given to cb, or -1 when cb refused some or the structure is invalid.
+ */
+asn_enc_rval_t encode( const asn_TYPE_descriptor_t* type, const void* structure, asn_app_consume_bytes_f* cb, void* app_key );
+
+/**
+ * @brief Append text as a quoted JSON string.
+ */
+void append_string( std::string& out, const char* text, std::size_t size );
+void append_string( std::string& out, const char* text );
+
+/**
+ * @brief Append the value of an XML element, e.g., the ODE envelope, as JSON: an element with child elements is an
+ * object, with repeated names gathered in arrays; any other element is the string of its text. The value of the element
+ * splice is splice_json, written as is.
+ */
+void append_element( std::string& out, const pugi::xml_node& element, const pugi::xml_node& splice, const std::string& splice_json );
+
+}  // end namespace.
+
+#endif
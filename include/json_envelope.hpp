@@ -0,0 +1,84 @@
+#ifndef ACM_JSON_ENVELOPE_H
+#define ACM_JSON_ENVELOPE_H
+
+#include "rapidjson/document.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * An ODE envelope sent as JSON instead of OdeAsn1Data XML, e.g.,
+ *
+ *     {"metadata":{"encodings":[{"elementName":"unsecuredData","elementType":"MessageFrame","encodingRule":"UPER"}],...},
+ *      "payload":{"dataType":"us.dot.its.jpo.ode.model.OdeHexByteArray","data":{"bytes":"001480..."}}}
+ *
+ * optionally wrapped in {"OdeAsn1Data":...}. The input is parsed in situ, in a copy the envelope keeps, so its strings
+ * are never copied again; the parsed values live in a memory pool reused from one envelope to the next. Nothing is
+ * built for the envelope but the parsed values, which are written back, with the payload replaced, for the output.
+ */
+class Json_Envelope {
+    public:
+        /// One metadata.encodings entry; absent members are empty strings, as the XML text of an absent node is.
+        struct Encoding {
+            const char* element_type;
+            const char* encoding_rule;          ///< null when absent: the previous entry's rule applies, as in XML.
+        };
+
+        /// What write changes in the envelope; members left null are written as they came in.
+        struct Changes {
+            const char* payload_type = nullptr; ///< metadata.payloadType
+            const char* generated_at = nullptr; ///< metadata.generatedAt
+            const char* data_type = nullptr;    ///< payload.dataType
+            const std::string* data = nullptr;  ///< payload.data, as JSON text.
+        };
+
+        Json_Envelope();
+        Json_Envelope( const Json_Envelope& ) = delete;
+        Json_Envelope& operator=( const Json_Envelope& ) = delete;
+
+        /**
+         * @return true when data is a JSON envelope: its first character other than white space is {.
+         */
+        static bool detect( const char* data, std::size_t size );
+
+        /**
+         * @param error what is wrong with data when false is returned.
+         */
+        bool parse( const char* data, std::size_t size, std::string& error );
+
+        /**
+         * @return the metadata.encodings entries; null when there are none.
+         */
+        const std::vector<Encoding>* encodings() const;
+
+        /**
+         * @return payload.data.bytes, the hex to decode; null when absent.
+         */
+        const char* data_bytes() const;
+
+        /**
+         * @brief The XER of the element to encode: payload.data as a string, since there is no JSON decoder for the
+         * ASN.1 types.
+         *
+         * @return null when payload.data is not a string.
+         */
+        const char* data_text( std::size_t& size ) const;
+
+        /**
+         * @brief Append the envelope, with changes, to out.
+         */
+        void write( std::string& out, const Changes& changes ) const;
+
+    private:
+        std::vector<char> buffer_;                                      ///< the input, parsed in situ; the values' strings point into it.
+        std::vector<char> pool_;                                        ///< the first chunk of allocator_, kept between envelopes.
+        rapidjson::MemoryPoolAllocator<> allocator_;
+        rapidjson::Document document_;
+        const rapidjson::Value* envelope_;                              ///< the object holding metadata and payload.
+        const rapidjson::Value* data_;                                  ///< payload.data; null when absent.
+        std::vector<Encoding> encodings_;
+        bool has_encodings_;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef ACM_METRICS_SERVER_H
+#define ACM_METRICS_SERVER_H
+
+#include "acmLogger.hpp"
+
+#include <future>
+#include <memory>
+
+namespace crow {
+    template <typename... Middlewares> class Crow;
+}
+
+/**
+ * A minimal HTTP listener exposing the metrics registry at /metrics for modes that do not already run an HTTP server
+ * (Kafka). It runs on its own thread and leaves the process signal handlers alone.
+ */
+class Metrics_Server {
+    public:
+        Metrics_Server();
+        ~Metrics_Server();
+
+        /**
+         * @brief Start serving on port in the background.
+         *
+         * @return false if the server could not be started.
+         */
+        bool start(int port);
+        void stop();
+
+    private:
+        AcmLogger logger;
+        std::unique_ptr<crow::Crow<>> app;
+        std::future<void> runner;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef ACM_OUTPUT_RENDERER_H
+#define ACM_OUTPUT_RENDERER_H
+
+#include "pugixml.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * One rendering of a decoded record for the fan-out outputs (acm.outputs): the decode happens once, into the ODE
+ * document, and each output renders what it needs from that document. Renderers are copied between pipeline workers;
+ * rendering does not change the renderer, so copies share their compiled queries.
+ */
+class Output_Renderer {
+    public:
+        enum class Format {
+            ENVELOPE,                   ///< the whole ODE XER envelope, as the single output writes it.
+            MESSAGEFRAME,               ///< the decoded MessageFrame alone.
+            PROJECTION                  ///< a flat JSON object of selected MessageFrame XER fields.
+        };
+
+        static bool parse( const std::string& name, Format& format );
+        static const char* name( Format format );
+
+        /**
+         * @param fields for PROJECTION only: comma separated name=path pairs, where path is an XPath from the
+         * MessageFrame element, e.g., id=value/BasicSafetyMessage/coreData/id
+         * @param error what is wrong with the fields when false is returned.
+         */
+        bool configure( Format format, const std::string& fields, std::string& error );
+
+        Format format() const;
+
+        /**
+         * @brief Append this rendering of a decoded record to out.
+         *
+         * @param envelope the ODE document after decoding.
+         * @param payload its OdeAsn1Data/payload/data node, which holds the decoded PDU.
+         * @param pdu_json null when the decoder writes XER, which the payload node then holds. When it writes JSON
+         * (acm.format=json), the decoded PDU as JSON, or empty when nothing was decoded; envelope and messageframe
+         * outputs are written in JSON then.
+         * @return false when the record has nothing for this output, i.e., no decoded PDU.
+         */
+        bool render( const pugi::xml_document& envelope, const pugi::xml_node& payload, const std::string* pdu_json, std::string& out ) const;
+
+    private:
+        struct Field {
+            std::string name;
+            std::shared_ptr<const pugi::xpath_query> query;
+        };
+
+        Format format_ = Format::ENVELOPE;
+        std::vector<Field> fields_;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef ACM_PCAP_READER_H
+#define ACM_PCAP_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A native reader for pcap and pcapng capture files (no libpcap) and the WSMP (IEEE 1609.3) framing needed to pull
+ * WAVE Short Messages out of the captured frames. Everything works on a caller owned buffer, normally a memory mapped
+ * capture file, and nothing is copied.
+ */
+namespace pcap {
+
+// link layer header types (LINKTYPE_*) that can carry WSMP.
+constexpr uint32_t LINKTYPE_ETHERNET = 1;
+constexpr uint32_t LINKTYPE_IEEE802_11 = 105;
+constexpr uint32_t LINKTYPE_LINUX_SLL = 113;
+constexpr uint32_t LINKTYPE_IEEE802_11_RADIOTAP = 127;
+constexpr uint32_t LINKTYPE_LINUX_SLL2 = 276;
+
+constexpr uint16_t ETHERTYPE_WSMP = 0x88DC;
+
+struct Packet {
+    uint64_t number;                                ///< 1 based, in file order, as numbered by Wireshark.
+    uint64_t timestamp_ns;                          ///< capture time in nanoseconds since the epoch.
+    uint32_t link_type;
+    const uint8_t* data;
+    std::size_t length;                             ///< captured bytes; may be less than the frame was on the air.
+};
+
+/**
+ * Iterates over the packets in a pcap (microsecond or nanosecond, either byte order) or pcapng (any number of
+ * sections and interfaces, any if_tsresol) capture. A Reader is a small value; a copy continues independently from
+ * where the original was, which is how a capture is split into ranges for parallel work.
+ */
+class Reader {
+    public:
+        Reader(const char* data, std::size_t size);
+
+        /**
+         * @brief Read the next packet; blocks that are not packets are skipped.
+         *
+         * @return false at the end of the capture or when it is malformed, in which case ok() is false.
+         */
+        bool next(Packet& packet);
+
+        bool ok() const;
+        const std::string& error() const;
+        std::size_t position() const;               ///< file offset of the next record or block.
+
+    private:
+        struct Interface {
+            uint32_t link_type;
+            uint64_t units_per_second;
+        };
+
+        const uint8_t* base;
+        std::size_t size;
+        std::size_t pos = 0;
+        bool ng = false;
+        bool swapped = false;                       ///< the file byte order is not the host's.
+        uint32_t link_type = 0;                     ///< pcap only; pcapng has one per interface.
+        uint64_t units_per_second = 1000000;        ///< pcap only.
+        std::vector<Interface> interfaces;          ///< pcapng interfaces of the current section.
+        uint64_t packets = 0;
+        std::string error_;
+
+        bool fail(const std::string& reason);
+        uint16_t read16(std::size_t offset) const;
+        uint32_t read32(std::size_t offset) const;
+        bool section_header();
+        bool interface_description(std::size_t body, std::size_t body_length);
+};
+
+struct Wsm {
+    uint32_t psid;                                  ///< as written in its p-encoded form, e.g., 0x20 or 0xE0000017.
+    const uint8_t* data;                            ///< the WSM data, normally an Ieee1609Dot2Data.
+    std::size_t length;
+};
+
+/**
+ * @brief Find the WSMP header in a captured frame and return the WSM it carries.
+ *
+ * @return false when the frame is not a complete WSMP version 3 message on a supported link type.
+ */
+bool extract_wsm(const Packet& packet, Wsm& wsm);
+
+/**
+ * @return the capture time as ISO 8601 UTC with nanoseconds, e.g., 2024-05-01T12:00:00.123456789Z.
+ */
+std::string iso8601(uint64_t timestamp_ns);
+
+}  // end namespace pcap.
+
+#endif
@@ -0,0 +1,363 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2017 US DOT - Joint Program Office
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ACM_SHM_RING_HPP
+#define ACM_SHM_RING_HPP
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+/**
+ * Shared memory transport used by the IPC server for co-located producers.
+ *
+ * This header is self-contained so producers can include it without linking against the ACM.
+ *
+ * A segment is laid out as a SegmentHeader followed by channel_count channels. Each channel holds a request ring
+ * (producer -> ACM) and a response ring (ACM -> producer). Every ring is single-producer/single-consumer; several
+ * producers share one ACM by each claiming their own channel, which gives multiple-producer/single-consumer behavior
+ * without a contended CAS on the hot path.
+ */
+namespace ipc {
+
+constexpr uint32_t kShmMagic = 0x41434d31;          ///< "ACM1"
+constexpr uint32_t kShmVersion = 1;
+constexpr std::size_t kCacheLine = 64;
+
+/**
+ * Status / operation codes carried in the code byte of socket frames and ring slots.
+ */
+enum class IpcCode : uint8_t {
+    OK = 0,                         // response: success; request: ping (echo the payload).
+    DECODE_UPER_MESSAGEFRAME = 1,   // request: UPER MessageFrame bytes in, MessageFrame XER out.
+    ERROR = 0xFF                    // response: the body is an error message.
+};
+
+struct alignas(kCacheLine) RingIndex {
+    std::atomic<uint64_t> value;
+};
+
+struct RingControl {
+    RingIndex head;                 ///< next slot the producer writes; only the producer stores it.
+    RingIndex tail;                 ///< next slot the consumer reads; only the consumer stores it.
+};
+
+/**
+ * What SpscRing::peek found in the oldest slot. A slot written by another process is not trusted: one claiming more
+ * bytes than a slot holds is CORRUPT, and the ring cannot be read past it.
+ */
+enum class SlotState { EMPTY, READY, CORRUPT };
+
+struct SlotHeader {
+    uint32_t length;                ///< bytes used in the slot body.
+    uint8_t code;                   ///< IpcCode value.
+    uint8_t reserved[3];
+};
+
+/**
+ * A bounded single-producer/single-consumer ring of fixed size slots living in caller supplied (shared) memory.
+ * slot_count must be a power of two.
+ */
+class SpscRing {
+    public:
+        SpscRing() = default;
+
+        SpscRing( void* base, uint32_t slot_count, uint32_t slot_size ) :
+            control_{ static_cast<RingControl*>(base) }
+            , slots_{ static_cast<char*>(base) + sizeof(RingControl) }
+            , mask_{ slot_count - 1 }
+            , slot_size_{ slot_size }
+        {}
+
+        static std::size_t footprint( uint32_t slot_count, uint32_t slot_size ) {
+            return sizeof(RingControl) + static_cast<std::size_t>(slot_count) * slot_size;
+        }
+
+        /// Only the creator of the segment calls this; attaching processes must not.
+        void initialize() {
+            new (&control_->head.value) std::atomic<uint64_t>{0};
+            new (&control_->tail.value) std::atomic<uint64_t>{0};
+        }
+
+        uint32_t capacity() const {
+            return slot_size_ - sizeof(SlotHeader);
+        }
+
+        /// Only the producer of the ring may rely on the answer: the consumer can only make room.
+        bool full() const {
+            uint64_t head = control_->head.value.load(std::memory_order_relaxed);
+            uint64_t tail = control_->tail.value.load(std::memory_order_acquire);
+            return head - tail > mask_;
+        }
+
+        bool try_push( uint8_t code, const char* data, uint32_t length ) {
+            if (length > capacity()) return false;
+
+            uint64_t head = control_->head.value.load(std::memory_order_relaxed);
+            uint64_t tail = control_->tail.value.load(std::memory_order_acquire);
+            if (head - tail > mask_) return false;             // full.
+
+            char* slot = slots_ + (head & mask_) * slot_size_;
+            SlotHeader* hdr = reinterpret_cast<SlotHeader*>(slot);
+            hdr->length = length;
+            hdr->code = code;
+            if (length > 0) std::memcpy(slot + sizeof(SlotHeader), data, length);
+
+            control_->head.value.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Look at the oldest slot without removing it; the returned pointers remain valid until release() is called.
+         *
+         * @return EMPTY when the ring is empty; CORRUPT, with nothing returned, when the slot length exceeds capacity().
+         */
+        SlotState peek( uint8_t& code, const char*& data, uint32_t& length ) const {
+            uint64_t tail = control_->tail.value.load(std::memory_order_relaxed);
+            uint64_t head = control_->head.value.load(std::memory_order_acquire);
+            if (tail == head) return SlotState::EMPTY;
+
+            const char* slot = slots_ + (tail & mask_) * slot_size_;
+            const SlotHeader* hdr = reinterpret_cast<const SlotHeader*>(slot);
+            uint32_t slot_length = hdr->length;
+            if (slot_length > capacity()) return SlotState::CORRUPT;
+
+            code = hdr->code;
+            length = slot_length;
+            data = slot + sizeof(SlotHeader);
+            return SlotState::READY;
+        }
+
+        void release() {
+            uint64_t tail = control_->tail.value.load(std::memory_order_relaxed);
+            control_->tail.value.store(tail + 1, std::memory_order_release);
+        }
+
+        bool try_pop( uint8_t& code, std::string& out ) {
+            const char* data = nullptr;
+            uint32_t length = 0;
+            if (peek(code, data, length) != SlotState::READY) return false;
+            out.assign(data, length);
+            release();
+            return true;
+        }
+
+    private:
+        RingControl* control_ = nullptr;
+        char* slots_ = nullptr;
+        uint64_t mask_ = 0;
+        uint32_t slot_size_ = 0;
+};
+
+struct alignas(kCacheLine) SegmentHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t channel_count;
+    uint32_t slot_count;
+    uint32_t slot_size;
+};
+
+struct alignas(kCacheLine) ChannelHeader {
+    std::atomic<uint32_t> in_use;   ///< claimed by a producer.
+};
+
+/**
+ * A request/response ring pair owned by one producer.
+ */
+struct Channel {
+    ChannelHeader* header = nullptr;
+    SpscRing requests;
+    SpscRing responses;
+};
+
+/**
+ * A mapped shared memory segment; the ACM creates it and producers attach to it.
+ */
+class ShmSegment {
+    public:
+        ShmSegment() = default;
+        ShmSegment( const ShmSegment& ) = delete;
+        ShmSegment& operator=( const ShmSegment& ) = delete;
+
+        ~ShmSegment() {
+            unmap();
+            if (owner_ && !name_.empty()) shm_unlink(name_.c_str());
+        }
+
+        static std::size_t channel_footprint( uint32_t slot_count, uint32_t slot_size ) {
+            return sizeof(ChannelHeader) + 2 * SpscRing::footprint(slot_count, slot_size);
+        }
+
+        /**
+         * Create (or replace) the named segment and initialize every channel.
+         *
+         * @return false if the segment cannot be created or the geometry is invalid.
+         */
+        bool create( const std::string& name, uint32_t channel_count, uint32_t slot_count, uint32_t slot_size ) {
+            if (channel_count == 0 || slot_count == 0 || (slot_count & (slot_count - 1)) != 0) return false;
+            if (slot_size <= sizeof(SlotHeader) || slot_size % kCacheLine != 0) return false;   // keeps every ring cache line aligned.
+
+            std::size_t size = sizeof(SegmentHeader) + channel_count * channel_footprint(slot_count, slot_size);
+
+            shm_unlink(name.c_str());
+            int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+            if (fd < 0) return false;
+
+            if (ftruncate(fd, static_cast<off_t>(size)) != 0 || !map(fd, size)) {
+                close(fd);
+                shm_unlink(name.c_str());
+                return false;
+            }
+            close(fd);
+
+            name_ = name;
+            owner_ = true;
+
+            SegmentHeader* hdr = new (base_) SegmentHeader{};
+            hdr->channel_count = channel_count;
+            hdr->slot_count = slot_count;
+            hdr->slot_size = slot_size;
+            hdr->version = kShmVersion;
+
+            layout(hdr);
+            for (auto& ch : channels_) {
+                new (&ch.header->in_use) std::atomic<uint32_t>{0};
+                ch.requests.initialize();
+                ch.responses.initialize();
+            }
+
+            // publish last so attaching processes never see a half built segment.
+            std::atomic_thread_fence(std::memory_order_release);
+            hdr->magic = kShmMagic;
+            return true;
+        }
+
+        /**
+         * Attach to a segment created by the ACM.
+         *
+         * @return false if the segment does not exist or was built by an incompatible version.
+         */
+        bool attach( const std::string& name ) {
+            int fd = shm_open(name.c_str(), O_RDWR, 0);
+            if (fd < 0) return false;
+
+            struct stat st;
+            if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(SegmentHeader) || !map(fd, st.st_size)) {
+                close(fd);
+                return false;
+            }
+            close(fd);
+
+            SegmentHeader* hdr = static_cast<SegmentHeader*>(base_);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (hdr->magic != kShmMagic || hdr->version != kShmVersion || !fits(*hdr, size_)) {
+                unmap();
+                return false;
+            }
+
+            name_ = name;
+            layout(hdr);
+            return true;
+        }
+
+        /**
+         * Claim an unused channel for this producer.
+         *
+         * @return the channel index or -1 if every channel is in use.
+         */
+        int claim_channel() {
+            for (std::size_t i = 0; i < channels_.size(); ++i) {
+                uint32_t expected = 0;
+                if (channels_[i].header->in_use.compare_exchange_strong(expected, 1, std::memory_order_acq_rel)) {
+                    return static_cast<int>(i);
+                }
+            }
+            return -1;
+        }
+
+        void release_channel( int index ) {
+            channels_.at(index).header->in_use.store(0, std::memory_order_release);
+        }
+
+        Channel& channel( std::size_t index ) {
+            return channels_.at(index);
+        }
+
+        std::size_t channel_count() const {
+            return channels_.size();
+        }
+
+    private:
+        void* base_ = nullptr;
+        std::size_t size_ = 0;
+        std::string name_;
+        bool owner_ = false;
+        std::vector<Channel> channels_;
+
+        bool map( int fd, std::size_t size ) {
+            void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) return false;
+            base_ = p;
+            size_ = size;
+            return true;
+        }
+
+        void unmap() {
+            if (base_) munmap(base_, size_);
+            base_ = nullptr;
+            size_ = 0;
+            channels_.clear();
+        }
+
+        /// The geometry in hdr is valid and every channel it describes lies within size bytes.
+        static bool fits( const SegmentHeader& hdr, std::size_t size ) {
+            if (hdr.slot_count == 0 || (hdr.slot_count & (hdr.slot_count - 1)) != 0) return false;
+            if (hdr.slot_size <= sizeof(SlotHeader) || hdr.slot_size > size || hdr.slot_count > size / hdr.slot_size) return false;
+
+            // both factors are now bounded by size, so neither product overflows.
+            std::size_t footprint = channel_footprint(hdr.slot_count, hdr.slot_size);
+            return hdr.channel_count <= (size - sizeof(SegmentHeader)) / footprint;
+        }
+
+        void layout( SegmentHeader* hdr ) {
+            std::size_t ring_size = SpscRing::footprint(hdr->slot_count, hdr->slot_size);
+            char* p = static_cast<char*>(base_) + sizeof(SegmentHeader);
+
+            channels_.clear();
+            for (uint32_t i = 0; i < hdr->channel_count; ++i) {
+                Channel ch;
+                ch.header = reinterpret_cast<ChannelHeader*>(p);
+                ch.requests = SpscRing{ p + sizeof(ChannelHeader), hdr->slot_count, hdr->slot_size };
+                ch.responses = SpscRing{ p + sizeof(ChannelHeader) + ring_size, hdr->slot_count, hdr->slot_size };
+                channels_.push_back(ch);
+                p += channel_footprint(hdr->slot_count, hdr->slot_size);
+            }
+        }
+};
+
+}  // end namespace.
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef ACM_STREAM_DECODER_H
+#define ACM_STREAM_DECODER_H
+
+#include "acm.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Decodes a byte stream of back to back binary PDUs (raw radio logs, concatenated captures) one PDU at a time,
+ * using the bytes each decode consumed to find the start of the next PDU. Input can arrive in pieces of any size.
+ * A PDU that runs past the end of the input (RC_WMORE) is resumed where the decoder stopped for the restartable
+ * syntaxes (BER and OER). The asn1c PER decoder is not restartable, so for PER the PDU's bytes are kept and decoded
+ * again from its first byte, once the bytes held have doubled since the last try or the stream is finished.
+ *
+ * Bad data (RC_FAIL), or a PDU longer than the maximum PDU size, leaves no way to find the next PDU boundary, so it
+ * ends the stream. A PDU that decodes but fails its constraints check has a known length; it is reported and decoding
+ * continues after it.
+ */
+class Stream_Decoder {
+    public:
+        enum class Pdu { MESSAGEFRAME, IEEE1609DOT2 };
+
+        struct Output {
+            uint64_t offset;                        ///< stream offset of the PDU's first byte.
+            std::size_t length;                     ///< PDU length in bytes.
+            bool ok;
+            std::string text;                       ///< the PDU XER when ok, the reason otherwise.
+        };
+
+        using Emit = std::function<void(const Output& output)>;
+
+        static constexpr std::size_t kMaxPduSize = 64 * 1024;     ///< default limit on the bytes of one PDU.
+
+        /**
+         * @param syntax the transfer syntax of the stream, e.g., ATS_UNALIGNED_BASIC_PER for MessageFrames or
+         * ATS_CANONICAL_OER for Ieee1609Dot2Data.
+         */
+        Stream_Decoder(Pdu pdu, enum asn_transfer_syntax syntax);
+        ~Stream_Decoder();
+
+        // holds the structure of a PDU part way through decoding.
+        Stream_Decoder(const Stream_Decoder&) = delete;
+        Stream_Decoder& operator=(const Stream_Decoder&) = delete;
+
+        /**
+         * @brief Decode every PDU completed by data and pass each to emit, in stream order.
+         *
+         * @return the number of PDUs emitted; status fails when the stream holds bad data or a PDU longer than the
+         * maximum, and the decoder cannot be used after that.
+         */
+        std::size_t feed(const char* data, std::size_t size, const Emit& emit, Asn1Status& status);
+
+        /**
+         * @brief Mark the end of the stream; a PER PDU held for a retry is decoded now.
+         *
+         * @return false when the stream ends inside a PDU or holds bad data; status says which.
+         */
+        bool finish(const Emit& emit, Asn1Status& status);
+
+        /**
+         * @brief Check decoded PDUs against their ASN.1 constraints per policy; every PDU is checked by default.
+         */
+        void set_constraints(const Constraint_Policy& policy);
+
+        /**
+         * @brief Limit the bytes of one PDU; the bytes held for a PDU never grow past it. 0 restores the default.
+         */
+        void set_max_pdu_size(std::size_t bytes);
+
+        uint64_t offset() const;                    ///< stream offset of the first byte not yet decoded.
+        std::size_t pending() const;                ///< bytes of a PDU that needs more input, held or already decoded.
+
+    private:
+        asn_TYPE_descriptor_t* type;
+        enum asn_transfer_syntax syntax;
+        bool restartable;                           ///< the decoder resumes a PDU where it stopped (BER, OER).
+        void* pdu = nullptr;                        ///< the PDU a restartable decoder is part way through.
+        std::size_t pdu_consumed = 0;               ///< bytes of that PDU the decoder has already taken.
+        std::size_t retry_size = 0;                 ///< bytes to hold before PER decodes a held PDU again.
+        std::vector<char> partial;                  ///< bytes of a PDU that ran past the end of the last feed.
+        uint64_t position = 0;
+        std::size_t max_pdu_size = kMaxPduSize;
+        Constraint_Policy constraints;
+        bool failed = false;
+
+        /**
+         * @brief Decode, or go on decoding, the PDU at the start of data.
+         *
+         * @param consumed set to the bytes of data the decoder took, whether or not the PDU is complete.
+         * @return true when a PDU was completed and emitted.
+         */
+        bool decode_one(const char* data, std::size_t size, std::size_t& consumed, const Emit& emit, Asn1Status& status);
+
+        /**
+         * @brief Decode the PDUs in data, up to one that needs more input.
+         *
+         * @param used set to the bytes of data the decoder took.
+         * @return the number of PDUs emitted.
+         */
+        std::size_t decode_all(const char* data, std::size_t size, std::size_t& used, const Emit& emit, Asn1Status& status);
+
+        bool fail(Asn1Status& status, const std::string& reason);
+};
+
+#endif
@@ -85,6 +85,7 @@ namespace tool {
             bool optIsSet( char short_name );
 
             bool hasOperands() const;
+            const std::vector<std::string>& getOperands() const;
 
             int run();
             virtual int operator() ( void ) = 0;
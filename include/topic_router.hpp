@@ -0,0 +1,53 @@
+#ifndef ACM_TOPIC_ROUTER_H
+#define ACM_TOPIC_ROUTER_H
+
+#include "acm.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Picks the output topic of a record from what the codec already knows about it: the messageId of the MessageFrame it
+ * decoded or encoded, or the class of the error it failed with. Routes are numbered; route 0 is the default output
+ * topic, and every record without a rule of its own goes there. The same route numbers label the per topic counters.
+ */
+class Topic_Router {
+    public:
+        static constexpr std::size_t kDefaultRoute = 0;
+
+        explicit Topic_Router( const std::string& default_topic );
+
+        /**
+         * @brief Add a rule from an acm.route.<key>=<topic> property.
+         *
+         * @param key a messageId, e.g., 19; error for every failed record; or error.<class>, e.g., error.Asn1CodecError.
+         * @param error what is wrong with the rule when false is returned.
+         */
+        bool add( const std::string& key, const std::string& topic, std::string& error );
+
+        /**
+         * @brief The route of a topic written to by something other than a rule, e.g., a fan-out output; rules never
+         * pick it unless they name the same topic.
+         */
+        std::size_t output( const std::string& topic );
+
+        /**
+         * @param message_id -1 when the record held no MessageFrame.
+         */
+        std::size_t route( long message_id ) const;
+        std::size_t route( const Asn1Status& status ) const;
+
+        const std::string& topic( std::size_t route ) const;
+        const std::vector<std::string>& topics() const;                 ///< indexed by route.
+
+    private:
+        std::size_t route_of( const std::string& topic );
+
+        std::vector<std::string> topics_;
+        std::array<uint16_t, Message_Filter::kMessageIds> by_message_id_{};
+        std::array<uint16_t, Asn1Status::kKinds> by_error_{};
+};
+
+#endif
@@ -44,7 +44,14 @@
  */
 
 #include "acm.hpp"
-#include "http_server.hpp"
+#include "dead_letter.hpp"
+#include "topic_router.hpp"
+#include "output_renderer.hpp"
+#include "json_encoder.hpp"
+#include "json_envelope.hpp"
+#include "entity_key.hpp"
+#include "metrics_server.hpp"
+#include "acm_metrics.hpp"
 #include "utilities.hpp"
 #include <iomanip>
 
@@ -53,6 +60,9 @@
 #include <csignal>
 #include <chrono>
 #include <thread>
+#include <map>
+#include <list>
+#include <algorithm>
 #include <cstdio>
 
 // for both windows and linux.
@@ -134,8 +144,35 @@ static int dynamic_buffer_append(const void *buffer, size_t size, void *app_key)
     return 0;
 }
 
-bool ASN1_Codec::data_available = true;
-bool ASN1_Codec::bootstrap = true;
+/**
+ * An encoder output that stops the encoder, by failing the write, when the message goes over its output or time budget.
+ */
+struct budgeted_buffer_t {
+    buffer_structure_t *buffer;
+    size_t max_size;            // 0 is unlimited.
+    uint64_t deadline_ns;       // 0 is none.
+    unsigned writes;
+    bool exceeded;
+};
+
+static int budgeted_buffer_append(const void *buffer, size_t size, void *app_key) {
+    budgeted_buffer_t *bb = static_cast<budgeted_buffer_t *>(app_key);
+
+    // encoders make many small writes; the clock is read on every 64th.
+    if ( ( bb->max_size && bb->buffer->buffer_size + size > bb->max_size ) ||
+         ( bb->deadline_ns && ( ++bb->writes & 63 ) == 0 && metrics::now_ns() > bb->deadline_ns ) ) {
+        bb->exceeded = true;
+        return -1;
+    }
+
+    return dynamic_buffer_append(buffer, size, bb->buffer);
+}
+
+static budgeted_buffer_t budgeted_buffer(buffer_structure_t *xb, const Codec_Budget& budget, uint64_t start_ns) {
+    return budgeted_buffer_t{ xb, budget.max_output_bytes, budget.max_time_ns ? start_ns + budget.max_time_ns : 0, 0, false };
+}
+
+std::atomic<bool> ASN1_Codec::bootstrap{ true };
 
 const char* asn1errortypes[] = {
     [static_cast<int>(Asn1ErrorType::SUCCESS)] = "SUCCESS",
@@ -161,20 +198,92 @@ std::ostream& operator<<( std::ostream& os, Asn1DataType dt ) {
 	return os;
 }
 
+const char* Asn1Status::name() const {
+    return name( kind_ );
+}
+
+const char* Asn1Status::name( Kind kind ) {
+    switch (kind) {
+        case Kind::UNPARSEABLE_INPUT:       return "UnparseableInputError";
+        case Kind::MISSING_INPUT_ELEMENT:   return "MissingInputElementError";
+        case Kind::XPATH:                   return "pugi::xpath_exception";
+        case Kind::CODEC:                   return "Asn1CodecError";
+        case Kind::BUDGET:                  return "Asn1BudgetExceeded";
+        default:                            return "OK";
+    }
+}
+
+bool Asn1Status::fail( Kind kind, std::string message, Asn1DataType dt, Asn1ErrorType et ) {
+    kind_ = kind;
+    message_ = std::move(message);
+    dt_ = dt;
+    et_ = et;
+    return false;
+}
+
+void Asn1Status::clear() {
+    kind_ = Kind::OK;
+    message_.clear();
+    dt_ = Asn1DataType::ODE;
+    et_ = Asn1ErrorType::SUCCESS;
+    stage_ = metrics::Stage::ENVELOPE_PARSE;
+    start_ns_ = 0;
+    message_id_ = -1;
+    entity_key_.clear();
+}
+
+void Asn1Status::raise() const {
+    switch (kind_) {
+        case Kind::UNPARSEABLE_INPUT:       throw UnparseableInputError{ message_, dt_, et_ };
+        case Kind::MISSING_INPUT_ELEMENT:   throw MissingInputElementError{ message_, dt_, et_ };
+        default:                            throw Asn1CodecError{ message_, dt_, et_ };
+    }
+}
+
 ASN1_Codec::ASN1_Codec( const std::string& name, const std::string& description ) :
     Tool{ name, description }
     , exit_eof{true}
-    , eof_cnt{0}
-    , partition_cnt{1}
+    , partition_cnt{0}
+    , eof_partitions{}
     , msg_recv_count{0}
     , msg_send_count{0}
     , msg_filt_count{0}
     , msg_recv_bytes{0}
     , msg_send_bytes{0}
     , msg_filt_bytes{0}
+    , metrics_port{0}
+    , stage_log_seconds{60}
+    , processing_time_header{}
+    , propagate_headers{true}
+    , raw_header{}
+    , output_key{ Output_Key::INPUT }
+    , partition_parallel{false}
+    , rebalance_cb{ *this }
+    , partition_workers{}
+    , last_stage_log{ std::chrono::steady_clock::now() }
+    , delivery_report_cb{ logger }
+    , metrics_server{}
+    , dead_letter_topic{}
+    , dead_letter_rate{1000}
+    , error_log_rate{10}
+    , dead_letter{}
+    , error_log_limiter{ new Error_Rate_Limiter{} }
+    , budget{}
+    , constraint_policy{}
+    , message_filter{}
+    , filtered_{false}
+    , message_id_{-1}
+    , entity_key_{}
+    , topic_router{}
+    , pipelines{}
+    , producer_shared{false}
+    , route_slots{}
+    , outputs{}
+    , output_routes{}
+    , text_encoding{ Text_Encoding::XER }
+    , pdu_json_{}
     , pconf{}
     , brokers{"localhost"}
-    , partition{RdKafka::Topic::PARTITION_UA}
     , mode{""}
     , debug{""}
     , consumed_topics{}
@@ -187,6 +296,12 @@ ASN1_Codec::ASN1_Codec( const std::string& name, const std::string& description
     , producer_ptr{}
     , published_topic_ptr{}
     , input_doc{}
+    , json_input{}
+    , json_envelope_{ false }
+    , payload_doc{}
+    , json_output_{}
+    , raw_record_{ false }
+    , raw_output_{}
     , internal_doc{}
     , error_doc{}
     , xml_parse_options{ pugi::parse_default | pugi::parse_declaration | pugi::parse_doctype | pugi::parse_trim_pcdata }
@@ -203,6 +318,9 @@ ASN1_Codec::ASN1_Codec( const std::string& name, const std::string& description
 	, decode_asdframe_type{ATS_UNALIGNED_BASIC_PER}
     , logger{}
 {
+    std::vector<std::string> error_names;
+    for (int i = 0; i < static_cast<int>(Asn1ErrorType::COUNT); ++i) error_names.push_back( asn1errortypes[i] );
+    metrics::Registry::instance().set_error_names( error_names );
 }
 
 ASN1_Codec::~ASN1_Codec() 
@@ -211,30 +329,56 @@ ASN1_Codec::~ASN1_Codec()
         consumer_ptr->close();
     }
 
+    dead_letter.reset();
+
     // free raw librdkafka pointers.
     if (tconf) delete tconf;
     if (conf) delete conf;
 
     // TODO: This librdkafka item seems wrong...
-    RdKafka::wait_destroyed(5000);    // pause to let RdKafka reclaim resources.
+    // a codec sharing the producer ends while the process runs on; only the owner waits.
+    if (!producer_shared) RdKafka::wait_destroyed(5000);    // pause to let RdKafka reclaim resources.
 }
 
-std::string ASN1_Codec::get_current_time() const {
-	char buf[50];
-	std::time_t t = std::time(NULL);
+const std::string& ASN1_Codec::get_current_time() const {
+    // the format has one second resolution, so a thread only formats when the second changes.
+    thread_local std::time_t formatted_at = -1;
+    thread_local std::string formatted;
 
-	if ( std::strftime(buf, sizeof(buf), "%Y-%m-%dT%TZ[UTC]", std::gmtime(&t) ) ) {
-		return std::string{ buf };
-	}
+	std::time_t t = std::time(NULL);
+    if ( t != formatted_at ) {
+        char buf[50];
+        std::tm utc;
+        gmtime_r( &t, &utc );
+        formatted = std::strftime(buf, sizeof(buf), "%Y-%m-%dT%TZ[UTC]", &utc ) ? buf : "";
+        formatted_at = t;
+    }
 
-	return std::string{};
+	return formatted;
 }
 
 void ASN1_Codec::sigterm (int sig) {
-    data_available = false;
     bootstrap = false;
 }
 
+void AcmDeliveryReportCb::dr_cb( RdKafka::Message& message ) {
+    if ( message.err() != RdKafka::ERR_NO_ERROR ) {
+        metrics::Registry::instance().increment( metrics::Counter::DELIVERY_FAILURES );
+        if ( logger_ ) logger_->error("delivery of " + std::to_string(message.len()) + " bytes failed: " + message.errstr());
+        return;
+    }
+
+    // librdkafka reports microseconds, or -1 when latency is not available.
+    int64_t latency_us = message.latency();
+    if ( latency_us >= 0 ) {
+        metrics::Registry::instance().latency( metrics::Latency::PRODUCE_TO_ACK, static_cast<uint64_t>(latency_us) * 1000 );
+    }
+}
+
+void ASN1_Codec::toggle_stage_metrics (int) {
+    metrics::enable_stages( !metrics::stages_enabled() );
+}
+
 void ASN1_Codec::metadata_print (const std::string &topic, const RdKafka::Metadata *metadata) {
 
     std::string topics = topic.empty() ? "" : "all topics";
@@ -466,25 +610,21 @@ bool ASN1_Codec::configure() {
         return false;
     } 
 
+    if ( !build_error_template() ) {
+        logger->warn(fnname + ": the error template file lacks the expected fields; errors will be built from its DOM.");
+    }
+
     if ( optIsSet('b') ) {
         // broker specified.
         logger->info(fnname + ": setting kafka broker to: " + optString('b'));
         conf->set("metadata.broker.list", optString('b'), error_string);
     } 
 
-    if ( optIsSet('p') ) {
-        // number of partitions.
-        partition = optInt( 'p' );
-
-    } else {
-        auto search = pconf.find("asn1.kafka.partition");
-        if ( search != pconf.end() ) {
-            partition = std::stoi(search->second);              // throws.    
-        }  // otherwise leave at default; PARTITION_UA
+    // the consumer is assigned its partitions by its group, and the producer's partitioner picks the output's.
+    if ( optIsSet('p') || pconf.find("asn1.kafka.partition") != pconf.end() ) {
+        logger->warn(fnname + ": -p and asn1.kafka.partition are deprecated and ignored; the consumer group assigns the partitions.");
     }
 
-    logger->info(fnname + ": kafka partition: " + std::to_string(partition));
-
     // confluent cloud integration
     std::string kafkaType = getEnvironmentVariable("KAFKA_TYPE");
     if (kafkaType == "CONFLUENT") {
@@ -541,12 +681,20 @@ bool ASN1_Codec::configure() {
     // librdkafka defined configuration.
     conf->set("default_topic_conf", tconf, error_string);
 
+    // several pipelines replace the asn1.topic.* pipeline.
+    search = pconf.find("acm.pipelines");
+    if ( search != pconf.end() ) {
+        std::string group_id;
+        conf->get( "group.id", group_id );
+        if ( !configure_pipelines( search->second, pconf, group_id ) ) return false;
+    }
+
     search = pconf.find("asn1.topic.consumer");
     if ( search != pconf.end() ) {
         consumed_topics.push_back( search->second );
         logger->info(fnname + ": consumed topic: " + search->second);
 
-    } else {
+    } else if ( pipelines.empty() ) {
         
         logger->error(fnname + ": no consumer topic was specified; must fail.");
         return false;
@@ -561,7 +709,7 @@ bool ASN1_Codec::configure() {
         auto search = pconf.find("asn1.topic.producer");
         if ( search != pconf.end() ) {
             published_topic_name = search->second;
-        } else {
+        } else if ( pipelines.empty() ) {
             logger->error(fnname + ": no publisher topic was specified; must fail.");
             return false;
         }
@@ -578,19 +726,244 @@ bool ASN1_Codec::configure() {
         }
     }
 
+    // the environment wins so containers can expose the endpoint without editing the configuration file.
+    std::string metrics_port_string = getEnvironmentVariable("ACM_METRICS_PORT");
+    if ( metrics_port_string.empty() ) {
+        search = pconf.find("acm.metrics.port");
+        if ( search != pconf.end() ) metrics_port_string = search->second;
+    }
+
+    search = pconf.find("acm.metrics.stages");
+    if ( search != pconf.end() ) {
+        metrics::enable_stages( search->second == "true" );
+        logger->info(fnname + ": per-stage latency metrics: " + search->second);
+    }
+
+    search = pconf.find("acm.kafka.processing.time.header");
+    if ( search != pconf.end() ) {
+        processing_time_header = search->second;
+        logger->info(fnname + ": processing time header: " + processing_time_header);
+    }
+
+    search = pconf.find("acm.kafka.key");
+    if ( search != pconf.end() ) {
+        if ( search->second == "input" ) {
+            output_key = Output_Key::INPUT;
+        } else if ( search->second == "entity" ) {
+            output_key = Output_Key::ENTITY;
+        } else if ( search->second == "none" ) {
+            output_key = Output_Key::NONE;
+        } else {
+            logger->error(fnname + ": invalid output record key: " + search->second + "; use input, entity, or none.");
+            return false;
+        }
+        logger->info(fnname + ": output records are keyed by: " + search->second);
+    }
+
+    search = pconf.find("acm.kafka.partition.parallel");
+    if ( search != pconf.end() ) {
+        partition_parallel = ( search->second == "true" );
+        logger->info(fnname + ": a worker per assigned partition: " + search->second);
+    }
+
+    search = pconf.find("acm.raw.header");
+    if ( search != pconf.end() ) {
+        raw_header = search->second;
+        logger->info(fnname + ": raw records name their encodings in header: " + raw_header);
+    }
+
+    search = pconf.find("acm.kafka.propagate.headers");
+    if ( search != pconf.end() ) {
+        propagate_headers = ( search->second != "false" );
+        logger->info(fnname + ": propagate input record headers: " + search->second);
+    }
+
+    search = pconf.find("acm.dlq.topic");
+    if ( search != pconf.end() ) {
+        dead_letter_topic = search->second;
+        logger->info(fnname + ": dead-letter topic: " + dead_letter_topic);
+    }
+
+    search = pconf.find("acm.dlq.rate");
+    if ( search != pconf.end() ) {
+        try {
+            dead_letter_rate = std::stod( search->second );
+        } catch( std::exception& e ) {
+            logger->info(fnname + ": using the default dead-letter rate limit.");
+        }
+    }
+
+    search = pconf.find("acm.error.log.rate");
+    if ( search != pconf.end() ) {
+        try {
+            error_log_rate = std::stod( search->second );
+        } catch( std::exception& e ) {
+            logger->info(fnname + ": using the default error log rate limit.");
+        }
+    }
+
+    error_log_limiter.reset( new Error_Rate_Limiter{ error_log_rate } );
+
+    try {
+        search = pconf.find("acm.budget.stack.bytes");
+        if ( search != pconf.end() ) budget.max_stack_bytes = std::stoul( search->second );
+
+        search = pconf.find("acm.budget.input.bytes");
+        if ( search != pconf.end() ) budget.max_input_bytes = std::stoul( search->second );
+
+        search = pconf.find("acm.budget.output.bytes");
+        if ( search != pconf.end() ) budget.max_output_bytes = std::stoul( search->second );
+
+        search = pconf.find("acm.budget.time.ms");
+        if ( search != pconf.end() ) budget.max_time_ns = static_cast<uint64_t>( std::stod( search->second ) * 1000000 );
+
+    } catch( std::exception& e ) {
+        logger->error(fnname + ": invalid codec budget: " + search->first + " = " + search->second);
+        return false;
+    }
+
+    logger->info(fnname + ": codec budget: stack " + std::to_string(budget.max_stack_bytes) + " B, input " + std::to_string(budget.max_input_bytes)
+            + " B, output " + std::to_string(budget.max_output_bytes) + " B, time " + std::to_string(budget.max_time_ns / 1000) + " us (0 is unlimited)");
+
+    Constraint_Policy::Mode constraint_mode = constraint_policy.mode();
+    uint32_t constraint_sample = constraint_policy.sample_every();
+    search = pconf.find("acm.constraints");
+    if ( search != pconf.end() && !Constraint_Policy::parse( search->second, constraint_mode ) ) {
+        logger->error(fnname + ": invalid constraint policy: " + search->second + "; use full, sampled, encode-only, or off.");
+        return false;
+    }
+
+    search = pconf.find("acm.constraints.sample");
+    if ( search != pconf.end() ) {
+        try {
+            constraint_sample = static_cast<uint32_t>( std::stoul( search->second ) );
+        } catch( std::exception& e ) {
+            logger->error(fnname + ": invalid constraint sample: " + search->second);
+            return false;
+        }
+    }
+
+    constraint_policy = Constraint_Policy{ constraint_mode, constraint_sample };
+    logger->info(fnname + ": constraint policy: " + Constraint_Policy::name( constraint_mode )
+            + ( constraint_mode == Constraint_Policy::Mode::SAMPLED ? " 1 in " + std::to_string(constraint_policy.sample_every()) : std::string{} ));
+
+    search = pconf.find("acm.format");
+    if ( search != pconf.end() ) {
+        if ( search->second == "json" ) {
+            text_encoding = Text_Encoding::JSON;
+        } else if ( search->second == "xml" ) {
+            text_encoding = Text_Encoding::XER;
+        } else {
+            logger->error(fnname + ": invalid output format: " + search->second + "; use xml or json.");
+            return false;
+        }
+        logger->info(fnname + ": decoded documents are written in " + search->second);
+    }
+
+    std::string filter_drop, filter_sample, filter_error;
+    search = pconf.find("acm.filter.drop");
+    if ( search != pconf.end() ) filter_drop = search->second;
+    search = pconf.find("acm.filter.sample");
+    if ( search != pconf.end() ) filter_sample = search->second;
+    if ( !message_filter.configure( filter_drop, filter_sample, filter_error ) ) {
+        logger->error(fnname + ": invalid message filter: " + filter_error);
+        return false;
+    }
+    if ( message_filter.active() ) {
+        logger->info(fnname + ": message filter: drop [" + filter_drop + "], sample [" + filter_sample + "]");
+    }
+
+    // sorted, so route numbers (and counter labels) do not depend on the hash order.
+    std::map<std::string, std::string> routes;
+    const std::string route_prefix = "acm.route.";
+    for ( const auto& property : pconf ) {
+        if ( property.first.compare( 0, route_prefix.size(), route_prefix ) == 0 ) routes.insert( property );
+    }
+
+    topic_router.reset();
+    if ( !routes.empty() ) {
+        topic_router.reset( new Topic_Router{ published_topic_name } );
+        std::string route_error;
+        for ( const auto& route : routes ) {
+            if ( !topic_router->add( route.first.substr( route_prefix.size() ), route.second, route_error ) ) {
+                logger->error(fnname + ": invalid route: " + route_error);
+                return false;
+            }
+            logger->info(fnname + ": route " + route.first.substr( route_prefix.size() ) + " to topic: " + route.second);
+        }
+    }
+
+    std::map<std::string, std::string> output_settings;
+    for ( const auto& property : pconf ) {
+        if ( property.first == "acm.outputs" || property.first.compare( 0, 11, "acm.output." ) == 0 ) {
+            output_settings[ property.first.substr( 4 ) ] = property.second;
+        }
+    }
+
+    std::string output_error;
+    if ( !configure_outputs( output_settings, output_error ) ) {
+        logger->error(fnname + ": invalid fan-out output: " + output_error);
+        return false;
+    }
+    for ( std::size_t output = 0; output < outputs.size(); ++output ) {
+        logger->info(fnname + ": output " + Output_Renderer::name( outputs[output].format() ) + " to topic: " + topic_router->topic( output_routes[output] ));
+    }
+    metrics::Registry::instance().set_route_names( topic_router ? topic_router->topics() : std::vector<std::string>{ published_topic_name } );
+
+    search = pconf.find("acm.metrics.stages.log.seconds");
+    if ( search != pconf.end() ) {
+        try {
+            stage_log_seconds = std::stoi( search->second );
+        } catch( std::exception& e ) {
+            logger->info(fnname + ": using the default stage latency log interval.");
+        }
+    }
+
+    if ( !metrics_port_string.empty() ) {
+        try {
+            metrics_port = std::stoi( metrics_port_string );
+            logger->info(fnname + ": metrics port: " + std::to_string(metrics_port));
+        } catch( std::exception& e ) {
+            logger->error(fnname + ": invalid metrics port: " + metrics_port_string + "; metrics endpoint disabled.");
+            metrics_port = 0;
+        }
+    }
+
     logger->trace(fnname + ": finished.");
     return true;
 }
 
-bool ASN1_Codec::launch_producer() {
+bool ASN1_Codec::create_producer() {
     std::string error_string;
 
+    if ( conf->set("dr_cb", &delivery_report_cb, error_string) != RdKafka::Conf::CONF_OK ) {
+        logger->error("Failed to set the delivery report callback: " + error_string);
+    }
+
     producer_ptr = std::shared_ptr<RdKafka::Producer>( RdKafka::Producer::create(conf, error_string) );
     if ( !producer_ptr ) {
         logger->critical("Failed to create producer with error: " + error_string);
         return false;
     }
 
+    // pipeline and partition workers dead-letter through the producer of the codec that shares its producer with them.
+    if ( !dead_letter_topic.empty() && !dead_letter ) {
+        dead_letter.reset( new Dead_Letter_Producer{ logger, dead_letter_topic, dead_letter_rate } );
+        if ( !dead_letter->launch( conf ) ) {
+            dead_letter.reset();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ASN1_Codec::launch_producer() {
+    std::string error_string;
+
+    // a pipeline worker produces through the process's producer.
+    if ( !producer_shared && !create_producer() ) return false;
+
     published_topic_ptr = std::shared_ptr<RdKafka::Topic>( RdKafka::Topic::create(producer_ptr.get(), published_topic_name, tconf, error_string) );
     if ( !published_topic_ptr ) {
         logger->critical("Failed to create topic: " + published_topic_name + ". Error: " + error_string + ".");
@@ -598,6 +971,20 @@ bool ASN1_Codec::launch_producer() {
     } 
 
     logger->info("Producer: " + producer_ptr->name() + " created using topic: " + published_topic_name + ".");
+
+    route_topics.clear();
+    if ( topic_router ) {
+        route_topics.resize( topic_router->topics().size() );
+        route_topics[Topic_Router::kDefaultRoute] = published_topic_ptr;
+        for ( std::size_t route = 1; route < route_topics.size(); ++route ) {
+            route_topics[route].reset( RdKafka::Topic::create(producer_ptr.get(), topic_router->topic(route), tconf, error_string) );
+            if ( !route_topics[route] ) {
+                logger->critical("Failed to create topic: " + topic_router->topic(route) + ". Error: " + error_string + ".");
+                return false;
+            }
+        }
+    }
+
     return true;
 }
 
@@ -607,6 +994,16 @@ bool ASN1_Codec::launch_consumer(){
     // check if the consumer was previously created to avoid 
     // issues with consumers in a group not able to consume
     if(!consumer_ptr){
+        // assignments go through rebalance(), which starts and stops the partition workers and commits on revocation.
+        if ( conf->set("rebalance_cb", &rebalance_cb, error_string) != RdKafka::Conf::CONF_OK ) {
+            logger->error("Failed to set the rebalance callback: " + error_string);
+        }
+
+        // a partition worker stores the offset of a record once its output is queued; the consumer commits no other.
+        if ( partition_parallel && conf->set("enable.auto.offset.store", "false", error_string) != RdKafka::Conf::CONF_OK ) {
+            logger->error("Failed to disable the automatic offset store: " + error_string);
+        }
+
         consumer_ptr = std::shared_ptr<RdKafka::KafkaConsumer>( RdKafka::KafkaConsumer::create(conf, error_string) );
         if (!consumer_ptr) {
             logger->critical("Failed to create consumer with error: " + error_string);
@@ -618,7 +1015,7 @@ bool ASN1_Codec::launch_consumer(){
     // loop terminates with a signal (CTRL-C) or when all the topics are available.
     int tcount = 0;
     for ( auto& topic : consumed_topics ) {
-        while ( data_available && tcount < consumed_topics.size() ) {
+        while ( bootstrap && tcount < consumed_topics.size() ) {
             if ( topic_available(topic) ) {
                 logger->trace("Consumer topic: " + topic + " is available.");
                 // count it and attempt to get the next one if it exists.
@@ -755,7 +1152,7 @@ bool ASN1_Codec::setup_logger_for_testing() {
      * message: this string will be COPIED INTO the xml dom by pugixml.
      */
 
-bool ASN1_Codec::add_error_xml( pugi::xml_document& doc, Asn1DataType dt, Asn1ErrorType et, std::string message, bool update_time ) {
+bool ASN1_Codec::add_error_xml( pugi::xml_document& doc, Asn1DataType dt, Asn1ErrorType et, const std::string& message, bool update_time ) {
 	const std::string fnname = "add_error_xml()";
 	bool r = true;
 
@@ -822,6 +1219,177 @@ bool ASN1_Codec::add_error_xml( pugi::xml_document& doc, Asn1DataType dt, Asn1Er
 	return r;
 }
 
+namespace {
+
+// the error template fields, in the order add_error_xml sets them.
+enum ErrorField : int { RECEIVED_AT = 0, GENERATED_AT, DATA_TYPE, CODE, MESSAGE, FIELD_COUNT };
+
+const char* const error_field_markers[FIELD_COUNT] = {
+    "@ACM_ERROR_RECEIVED_AT@", "@ACM_ERROR_GENERATED_AT@", "@ACM_ERROR_DATA_TYPE@", "@ACM_ERROR_CODE@", "@ACM_ERROR_MESSAGE@"
+};
+
+/**
+ * Escape text as pugixml does for element content with format_raw, so a rendered error is byte for byte what
+ * add_error_xml and save would have produced.
+ */
+void write_escaped_pcdata( std::ostream& os, const std::string& text ) {
+    std::size_t start = 0;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>( text[i] );
+        const char* escape = nullptr;
+        char numeric[6];
+
+        if ( c == '&' ) {
+            escape = "&amp;";
+        } else if ( c == '<' ) {
+            escape = "&lt;";
+        } else if ( c == '>' ) {
+            escape = "&gt;";
+        } else if ( c < 32 && c != '\t' && c != '\n' && c != '\r' ) {
+            numeric[0] = '&'; numeric[1] = '#'; numeric[2] = static_cast<char>('0' + c / 10); numeric[3] = static_cast<char>('0' + c % 10); numeric[4] = ';'; numeric[5] = 0;
+            escape = numeric;
+        }
+
+        if ( escape ) {
+            os.write( text.data() + start, i - start );
+            os << escape;
+            start = i + 1;
+        }
+    }
+    os.write( text.data() + start, text.size() - start );
+}
+
+/**
+ * @return the message for a failed asn1c decode; what is, e.g., "binary decoding of element".
+ */
+std::string decode_failure( const char* what, const char* name, const asn_dec_rval_t& rval ) {
+    return std::string{ "failed ASN.1 " } + what + " " + name + ": " + ( rval.code == RC_FAIL ? "bad data." : "more data expected." )
+        + " Successfully decoded " + std::to_string( rval.consumed ) + " bytes.";
+}
+
+}  // end namespace.
+
+/**
+ * Serialize the error document once with a marker in every field add_error_xml sets, and keep the text between the
+ * markers; an error response is then a handful of writes instead of DOM updates and a save.
+ *
+ * @return false when the document does not have the fields; errors then fall back to add_error_xml.
+ */
+bool ASN1_Codec::build_error_template() {
+    error_template.clear();
+    error_template_fields.clear();
+
+    pugi::xml_document doc;
+    doc.reset( error_doc );
+
+    pugi::xml_node metadata_node = doc.child("OdeAsn1Data").child("metadata");
+    pugi::xml_node payload_node = doc.child("OdeAsn1Data").child("payload");
+    pugi::xml_node data_node = payload_node.child("data");
+    if ( !metadata_node || !payload_node || !data_node ||
+         !metadata_node.child("payloadType") || !metadata_node.child("receivedAt") || !metadata_node.child("generatedAt") || !payload_node.child("dataType") ) {
+        return false;
+    }
+
+    data_node.remove_child("bytes");
+    if ( !data_node.child("code") ) data_node.append_child("code");
+    if ( !data_node.child("message") ) data_node.append_child("message");
+
+    metadata_node.child("payloadType").text().set( asn1datatypes[static_cast<int>(Asn1DataType::PAYLOAD)] );
+    metadata_node.child("receivedAt").text().set( error_field_markers[RECEIVED_AT] );
+    metadata_node.child("generatedAt").text().set( error_field_markers[GENERATED_AT] );
+    payload_node.child("dataType").text().set( error_field_markers[DATA_TYPE] );
+    data_node.child("code").text().set( error_field_markers[CODE] );
+    data_node.child("message").text().set( error_field_markers[MESSAGE] );
+
+    std::ostringstream oss;
+    doc.save( oss, "", pugi::format_raw );
+    std::string serialized = oss.str();
+
+    // cut the serialized document at the markers, in document order.
+    std::size_t pos = 0;
+    for (;;) {
+        std::size_t next = std::string::npos;
+        int field = -1;
+        for (int f = 0; f < FIELD_COUNT; ++f) {
+            std::size_t at = serialized.find( error_field_markers[f], pos );
+            if ( at < next ) {
+                next = at;
+                field = f;
+            }
+        }
+
+        if ( field < 0 ) break;
+        error_template.push_back( serialized.substr( pos, next - pos ) );
+        error_template_fields.push_back( field );
+        pos = next + std::strlen( error_field_markers[field] );
+    }
+    error_template.push_back( serialized.substr( pos ) );
+
+    if ( error_template_fields.size() != FIELD_COUNT ) {
+        error_template.clear();
+        error_template_fields.clear();
+        return false;
+    }
+    return true;
+}
+
+void ASN1_Codec::render_error_template( std::ostream& os, Asn1DataType dt, Asn1ErrorType et, const std::string& message ) const {
+    const std::string& now = get_current_time();
+
+    for (std::size_t i = 0; i < error_template_fields.size(); ++i) {
+        os << error_template[i];
+        switch ( error_template_fields[i] ) {
+            case RECEIVED_AT:
+            case GENERATED_AT:
+                os << now;
+                break;
+            case DATA_TYPE:
+                os << asn1datatypes[static_cast<int>(dt)];
+                break;
+            case CODE:
+                os << asn1errortypes[static_cast<int>(et)];
+                break;
+            case MESSAGE:
+                write_escaped_pcdata( os, message );
+                break;
+        }
+    }
+    os << error_template.back();
+}
+
+void ASN1_Codec::write_error( const Asn1Status& status, std::ostream& os ) {
+    if ( json_envelope_ && ( status.kind() == Asn1Status::Kind::CODEC || status.kind() == Asn1Status::Kind::BUDGET ) ) {
+        // as add_error_xml does for an XML envelope.
+        std::string data{ "{\"code\":" };
+        jer::append_string( data, asn1errortypes[static_cast<int>(status.error_type())] );
+        data += ",\"message\":";
+        jer::append_string( data, status.message().data(), status.message().size() );
+        data += '}';
+
+        Json_Envelope::Changes changes;
+        changes.payload_type = asn1datatypes[static_cast<int>(Asn1DataType::PAYLOAD)];
+        changes.generated_at = get_current_time().c_str();
+        changes.data_type = asn1datatypes[static_cast<int>(status.data_type())];
+        changes.data = &data;
+
+        json_output_.clear();
+        json_input.write( json_output_, changes );
+        os << json_output_;
+
+    } else if ( !raw_record_ && ( status.kind() == Asn1Status::Kind::CODEC || status.kind() == Asn1Status::Kind::BUDGET ) ) {
+        // the input parsed, so the response is the input document with its bytes replaced by the error.
+        add_error_xml( input_doc, status.data_type(), status.error_type(), status.message(), false );
+        input_doc.save( os, "", pugi::format_raw );
+
+    } else if ( !error_template.empty() ) {
+        render_error_template( os, status.data_type(), status.error_type(), status.message() );
+
+    } else {
+        add_error_xml( error_doc, status.data_type(), status.error_type(), status.message(), true );
+        error_doc.save( os, "", pugi::format_raw );
+    }
+}
+
 bool ASN1_Codec::hex_to_bytes_(const std::string& payload_hex, std::vector<char>& buf) {
     uint8_t d = 0;
     int i = 0;          // so we can return -1;
@@ -926,13 +1494,10 @@ enum asn_transfer_syntax ASN1_Codec::get_ats_transfer_syntax( const char* ats )
     return r;
 }
 
-bool ASN1_Codec::process_message(RdKafka::Message* message, std::stringstream& output_message_stream ) {
+bool ASN1_Codec::process_message(RdKafka::Message* message, std::stringstream& output_message_stream, Asn1Status& status ) {
     const std::string fnname = "process_message()";
-    static std::string tsname;
-    static RdKafka::MessageTimestamp ts;
-    
-    // flags for type of decoding required.
-    pugi::xml_parse_result parse_result;
+    std::string tsname;
+    RdKafka::MessageTimestamp ts;
 
     size_t bytes_processed = 0;
 
@@ -952,8 +1517,11 @@ bool ASN1_Codec::process_message(RdKafka::Message* message, std::stringstream& o
             /* Real message */
             msg_recv_count++;
             msg_recv_bytes += message->len();
+            metrics::Registry::instance().increment( metrics::Counter::MESSAGES_RECEIVED );
+            metrics::Registry::instance().increment( metrics::Counter::BYTES_RECEIVED, message->len() );
 
             logger->trace(fnname + ": Read message at byte offset: " + std::to_string(message->offset()) + " with length " + std::to_string(message->len()));
+            partition_eof( message->topic_name(), message->partition(), false );
 
             ts = message->timestamp();
 
@@ -967,6 +1535,12 @@ bool ASN1_Codec::process_message(RdKafka::Message* message, std::stringstream& o
                 }
 
                 logger->trace(fnname + ": Message timestamp: " + tsname + ", type: " + std::to_string(ts.timestamp));
+
+                int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+                if ( now_ms >= ts.timestamp ) {
+                    // producer and broker clocks can run ahead of ours; those samples are skipped, not clamped.
+                    metrics::Registry::instance().latency( metrics::Latency::BROKER_TO_CONSUME, static_cast<uint64_t>(now_ms - ts.timestamp) * 1000000 );
+                }
             }
 
             if ( message->key() ) {
@@ -974,46 +1548,35 @@ bool ASN1_Codec::process_message(RdKafka::Message* message, std::stringstream& o
             }
 
             // already verified non-zero message length.
+            metrics::StageTrace::local().begin();
+
+            {
+                bool processed = false;
+                bool raw = false;
+
+                // a record naming its encodings in a header carries the bytes alone; any other is an envelope.
+                RdKafka::Headers* headers = raw_header.empty() ? nullptr : message->headers();
+                if ( headers ) {
+                    RdKafka::Headers::Header encodings = headers->get_last( raw_header );
+                    if ( encodings.err() == RdKafka::ERR_NO_ERROR && encodings.value() ) {
+                        raw = true;
+                        processed = process_raw_record( static_cast<const char*>( message->payload() ), message->len(), std::string{ static_cast<const char*>( encodings.value() ), encodings.value_size() }, output_message_stream, status );
+                    }
+                }
 
-            parse_result = input_doc.load_buffer((const void*) message->payload(), message->len(), xml_parse_options );
-
-
-            if (!parse_result) {
-                std::ostringstream erroross;
-                erroross.str("");
-                erroross << "Input file parse error: " << parse_result.description() << " at offset " << parse_result.offset;
-                throw UnparseableInputError{ erroross.str() };
-            } 
-
-            // examine the input xml encodings information and set the flags and requirements needed to properly parse
-            // the byte strings.
-            set_codec_requirements( input_doc );        // throws UnparseableInputErrors
-
-            payload_node_ = ode_payload_query.evaluate_node( input_doc ).node();
-
-            if ( !payload_node_ ) {
-                throw UnparseableInputError{ "Failed to find the OdeAsn1Data/payload/data field in the input file." };
-            }
+                if ( !raw ) {
+                    processed = process_input_document( static_cast<const char*>( message->payload() ), message->len(), output_message_stream, status );
+                }
 
-            if ( decode_functionality ) {
-                decode_message( payload_node_, output_message_stream );          // throws
-            } else {
-                encode_message( output_message_stream );          // throws
+                // this codec is the consumer's own; the output record is routed and keyed by these.
+                message_id_ = status.message_id();
+                entity_key_ = status.entity_key();
+                return processed;
             }
-                
-            return true;
-            break;
 
         case RdKafka::ERR__PARTITION_EOF:
             logger->info("ODE BSM consumer partition end of file, but ASN1_Codec still alive.");
-            if (exit_eof) {
-                eof_cnt++;
-
-                if (eof_cnt == partition_cnt) {
-                    logger->info("EOF reached for all " + std::to_string(partition_cnt) + " partition(s)");
-                    data_available = false;
-                }
-            }
+            partition_eof( message->topic_name(), message->partition(), true );
             break;
 
         case RdKafka::ERR__UNKNOWN_TOPIC:
@@ -1033,142 +1596,377 @@ bool ASN1_Codec::process_message(RdKafka::Message* message, std::stringstream& o
     return false;
 }
 
-bool ASN1_Codec::decode_message( pugi::xml_node& payload_node, std::stringstream& output_message_stream ) {
-    const std::string fnname = "decode_message()";
-    bool success = true;
+/**
+ * Parse an ODE envelope, XML into input_doc or JSON into json_input, and run its payload through the decoder or the
+ * encoder. Bad input fills status and returns false; nothing is written to output_message_stream in that case.
+ */
+bool ASN1_Codec::process_input_document( const char* data, std::size_t data_size, std::stringstream& output_message_stream, Asn1Status& status ) {
     pugi::xml_parse_result parse_result;
 
-    buffer_structure_t xb = {0, 0, 0};
+    start_budget( status );
+    filtered_ = false;
+    pdu_json_.clear();
+    raw_record_ = false;
+    json_envelope_ = Json_Envelope::detect( data, data_size );
 
-    logger->trace(fnname + ": starting...");
+    if ( json_envelope_ ) {
+        std::string error;
+        bool parsed;
+        {
+            metrics::ScopedStage stage{ metrics::Stage::ENVELOPE_PARSE };
+            parsed = json_input.parse( data, data_size, error );
+        }
 
-    if ( !decode_1609dot2 && !decode_messageframe ) {
-        // if neither of these is set, this function becomes a noop and nothing will be returned, so this is an
-        // exception.
-        throw MissingInputElementError{"An decoder was not specified in the encodingType tag that this module understands."};
-    }
+        if ( !parsed ) {
+            return status.unparseable( "Input JSON envelope parse error: " + error );
+        }
 
-    // access this directly because we remove the bytes branch.
-    pugi::xml_text text = payload_node.child("bytes").text();
+    } else {
+        {
+            metrics::ScopedStage stage{ metrics::Stage::ENVELOPE_PARSE };
+            parse_result = input_doc.load_buffer( static_cast<const void*>( data ), data_size, xml_parse_options );
+        }
 
-    if ( text ) {
-        // store the bytes and remove the bytes node since we replace it.
-        std::string hstr{ text.get() };
-        payload_node.remove_child("bytes");
+        if ( !parse_result ) {
+            return status.unparseable( std::string{ "Input file parse error: " } + parse_result.description() + " at offset " + std::to_string( parse_result.offset ) );
+        }
+    }
 
-        // Ieee 1609.2 is the outer frame.
-		if ( decode_1609dot2 ) {
+    try {
+        // examine the input encodings information and set the flags and requirements needed to properly parse
+        // the byte strings.
+        bool ready;
+        {
+            metrics::ScopedStage stage{ metrics::Stage::CODEC_REQUIREMENTS };
+            ready = json_envelope_ ? set_codec_requirements( json_input, status ) : set_codec_requirements( input_doc, status );
+        }
 
-			decode_1609dot2_data(hstr, &xb);            // throws.
+        if ( !ready ) return false;
 
-			// asssert success == true;
+        if ( json_envelope_ ) {
+            if ( !load_json_payload( status ) ) return false;
 
-			// pugi resets the document as part of load_buffer
-			parse_result = internal_doc.load_buffer(static_cast<const void *>( xb.buffer), xb.buffer_size );
+        } else {
+            payload_node_ = ode_payload_query.evaluate_node( input_doc ).node();
 
-			if ( !parse_result ) {
-			    std::ostringstream erroross;
-				erroross.str("");
-				erroross << "IEEE 1609.2 decoded XER cannot be parsed/loaded as a valid document: " << parse_result.description() << " at offset " << parse_result.offset;
-				throw Asn1CodecError{ erroross.str() };
-			}
+            if ( !payload_node_ ) {
+                return status.unparseable( "Failed to find path: OdeAsn1Data/payload/data in the input document." );
+            }
+        }
+
+        uint64_t start_ns = metrics::now_ns();
+
+        if ( decode_functionality ) {
+            if ( !decode_message( payload_node_, output_message_stream, status ) ) return false;
+            metrics::Registry::instance().latency( metrics::Latency::DECODE, metrics::now_ns() - start_ns );
+        } else {
+            if ( !encode_message( output_message_stream, status ) ) return false;
+            metrics::Registry::instance().latency( metrics::Latency::ENCODE, metrics::now_ns() - start_ns );
+        }
+
+    } catch ( const pugi::xpath_exception& e ) {
+        // the queries are compiled at startup; this is a library failure, not bad input, and stays exceptional.
+        return status.fail( Asn1Status::Kind::XPATH, e.what(), Asn1DataType::ODE, Asn1ErrorType::REQUEST );
+    }
+
+    return true;
+}
+
+/**
+ * Run a raw record through the decoder or the encoder: data is the encoded bytes, or the XER to encode, and encodings
+ * the stack the encodings header names. There is no envelope to parse and no hex to convert; the output is the
+ * decoded text, or the encoded bytes, alone.
+ */
+bool ASN1_Codec::process_raw_record( const char* data, std::size_t data_size, const std::string& encodings, std::stringstream& output_message_stream, Asn1Status& status ) {
+    start_budget( status );
+    filtered_ = false;
+    pdu_json_.clear();
+    json_envelope_ = false;
+    raw_record_ = true;
+    raw_output_.clear();
+
+    bool ready;
+    {
+        metrics::ScopedStage stage{ metrics::Stage::CODEC_REQUIREMENTS };
+        ready = set_codec_requirements( encodings, status );
+    }
+
+    if ( !ready ) return false;
+
+    uint64_t start_ns = metrics::now_ns();
+
+    if ( decode_functionality ) {
+        if ( !decode_raw_record( data, data_size, output_message_stream, status ) ) return false;
+        metrics::Registry::instance().latency( metrics::Latency::DECODE, metrics::now_ns() - start_ns );
+    } else {
+        if ( !load_raw_payload( data, data_size, status ) ) return false;
+        if ( !encode_message( output_message_stream, status ) ) return false;
+        metrics::Registry::instance().latency( metrics::Latency::ENCODE, metrics::now_ns() - start_ns );
+    }
+
+    return true;
+}
+
+bool ASN1_Codec::decode_message( pugi::xml_node& payload_node, std::stringstream& output_message_stream, Asn1Status& status ) {
+    const std::string fnname = "decode_message()";
+    bool success = true;
+    pugi::xml_parse_result parse_result;
+
+    buffer_structure_t xb = {0, 0, 0};
+
+    // a JSON envelope is answered in JSON, whatever acm.format says.
+    const Text_Encoding encoding = json_envelope_ ? Text_Encoding::JSON : text_encoding;
+
+    logger->trace(fnname + ": starting...");
+
+    if ( !decode_1609dot2 && !decode_messageframe ) {
+        // if neither of these is set, this function becomes a noop and nothing will be returned, so this is an
+        // error.
+        return status.missing( "An decoder was not specified in the encodingType tag that this module understands." );
+    }
+
+    // access this directly because we remove the bytes branch.
+    pugi::xml_text text = payload_node.child("bytes").text();
+
+    if ( text ) {
+        // store the bytes and remove the bytes node since we replace it.
+        std::string hstr{ text.get() };
+        payload_node.remove_child("bytes");
+
+        // the filter needs only the messageId, which the first few bytes hold; nothing is decoded for a dropped message.
+        if ( message_filter.active() && header_peekable() ) {
+            uint8_t prefix[32];
+            std::size_t prefix_size = peek::hex_prefix( hstr, prefix, sizeof(prefix) );
+            peek::Header header;
+            if ( decode_1609dot2 ) {
+                peek::ieee1609dot2( prefix, prefix_size, header );
+            } else {
+                peek::messageframe( prefix, prefix_size, header );
+            }
+
+            if ( message_filter.decide( header.message_id ) == Message_Filter::Action::DROP ) {
+                logger->trace(fnname + ": messageId " + std::to_string(header.message_id) + " dropped by the message filter.");
+                filtered_ = true;
+                return true;
+            }
+        }
 
-			// XPath search the IEEE structure for the unsecured data.
-			pugi::xpath_node unsecuredDataNode = ieee1609dot2_unsecuredData_query.evaluate_node( internal_doc );
-			text = unsecuredDataNode.node().text();
+        // Ieee 1609.2 is the outer frame.
+		if ( decode_1609dot2 ) {
 
-			if ( !text ) throw Asn1CodecError{"IEEE 1609.2 internal XER unsecuredData element could not be found."};
+			if ( !decode_1609dot2_data( hstr, &xb, status ) ) {
+				std::free( static_cast<void *>(xb.buffer) );
+				return false;
+			}
 
 			// replacing the original hex string, so the next processing step works.
-			hstr = std::string( text.get() );
-			internal_doc.reset();
-			std::free( static_cast<void *>(xb.buffer) );
-			xb = { 0,0,0 };                     // reset buffer;
+			if ( !unsecured_data_( &xb, hstr, status ) ) return false;
 		}
 
 		if ( success && decode_messageframe ) {
 
-			decode_messageframe_data( hstr, &xb );          // throws.
-
-			// asssert success == true;
+			if ( !decode_messageframe_hex_( hstr, &xb, status, encoding ) ) {
+				std::free( static_cast<void *>(xb.buffer) );
+				return false;
+			}
 
 			// eliminate the original hex string, so the new XML can be inserted.
 			payload_node.text().set("");
-			parse_result = internal_doc.load_buffer( static_cast<const void *>( xb.buffer), xb.buffer_size );
 
-			if ( !parse_result ) {
-			    std::ostringstream erroross;
-				erroross.str("");
-				erroross <<"J2735 decoded XER cannot be parsed/loaded as a valid document: "<< parse_result.description() << " at offset " << parse_result.offset;
-				throw Asn1CodecError{ erroross.str() };
-			}
+			if ( encoding == Text_Encoding::JSON ) {
+				// already text in its final form; the envelope is written around it, never loaded back.
+				pdu_json_.assign( xb.buffer, xb.buffer_size );
+				std::free( static_cast<void *>(xb.buffer) );
+			} else {
+				{
+					metrics::ScopedStage stage{ metrics::Stage::XML_REPARSE };
+					parse_result = internal_doc.load_buffer( static_cast<const void *>( xb.buffer), xb.buffer_size );
+				}
 
-			payload_node.append_copy( internal_doc.document_element() );
+				if ( !parse_result ) {
+					std::free( static_cast<void *>(xb.buffer) );
+					return status.at( metrics::Stage::XML_REPARSE ).codec( std::string{ "J2735 decoded XER cannot be parsed/loaded as a valid document: " } + parse_result.description() + " at offset " + std::to_string( parse_result.offset ) );
+				}
 
-			if ( !payload_node.parent().child("dataType").text().set( asn1datatypes[static_cast<int>(Asn1DataType::XML)] ) ) {
-				throw MissingInputElementError{"Could not update the dataType field of the payload section."};
+				payload_node.append_copy( internal_doc.document_element() );
+
+				std::free( static_cast<void *>(xb.buffer) );
 			}
 
-			std::free( static_cast<void *>(xb.buffer) );
+			if ( !payload_node.parent().child("dataType").text().set( asn1datatypes[static_cast<int>(Asn1DataType::XML)] ) ) {
+				return status.missing( "Could not update the dataType field of the payload section." );
+			}
 		}
 
     } else {
-        throw MissingInputElementError{"failure accessing input XML bytes node."};
+        return status.missing( "failure accessing input XML bytes node." );
+    }
+
+    // convert DOM to a RAW string representation: no spaces, no tabs. Fan-out outputs render from the DOM instead.
+    if ( json_envelope_ ) {
+        metrics::ScopedStage stage{ metrics::Stage::SERIALIZE };
+        write_json_envelope();
+        if ( outputs.empty() ) output_message_stream << json_output_;
+    } else if ( outputs.empty() && text_encoding == Text_Encoding::JSON ) {
+        metrics::ScopedStage stage{ metrics::Stage::SERIALIZE };
+        std::string json;
+        Output_Renderer{}.render( input_doc, payload_node, &pdu_json_, json );
+        output_message_stream << json;
+    } else if ( outputs.empty() ) {
+        metrics::ScopedStage stage{ metrics::Stage::SERIALIZE };
+        input_doc.save(output_message_stream,"",pugi::format_raw);
     }
-
-    // convert DOM to a RAW string representation: no spaces, no tabs.
-    input_doc.save(output_message_stream,"",pugi::format_raw);
     logger->trace(fnname + ": finished...");
     return success;
 } 
 
-void ASN1_Codec::encode_node_as_hex_string(bool replace) {
+bool ASN1_Codec::header_peekable() const {
+    return decode_messageframe_type == ATS_UNALIGNED_BASIC_PER && ( !decode_1609dot2 || decode_1609dot2_type == ATS_CANONICAL_OER );
+}
+
+bool ASN1_Codec::decode_raw_record( const char* data, std::size_t data_size, std::stringstream& output_message_stream, Asn1Status& status ) {
+    const std::string fnname = "decode_raw_record()";
+
+    buffer_structure_t xb = {0, 0, 0};
+
+    logger->trace(fnname + ": starting...");
+
+    if ( !decode_1609dot2 && !decode_messageframe ) {
+        return status.missing( "An decoder was not specified in the encodings header that this module understands." );
+    }
+
+    if ( message_filter.active() && header_peekable() ) {
+        peek::Header header;
+        if ( decode_1609dot2 ) {
+            peek::ieee1609dot2( reinterpret_cast<const uint8_t*>( data ), data_size, header );
+        } else {
+            peek::messageframe( reinterpret_cast<const uint8_t*>( data ), data_size, header );
+        }
+
+        if ( message_filter.decide( header.message_id ) == Message_Filter::Action::DROP ) {
+            logger->trace(fnname + ": messageId " + std::to_string(header.message_id) + " dropped by the message filter.");
+            filtered_ = true;
+            return true;
+        }
+    }
+
+    if ( decode_1609dot2 ) {
+        if ( !decode_1609dot2_bytes_( data, data_size, &xb, status ) ) {
+            std::free( static_cast<void *>(xb.buffer) );
+            return false;
+        }
+
+        if ( decode_messageframe ) {
+            // the unsecuredData comes out of the 1609.2 XER as hex, as it does for an envelope.
+            std::string hstr;
+            if ( !unsecured_data_( &xb, hstr, status ) ) return false;
+
+            if ( !decode_messageframe_hex_( hstr, &xb, status, text_encoding ) ) {
+                std::free( static_cast<void *>(xb.buffer) );
+                return false;
+            }
+        }
+
+    } else if ( !decode_messageframe_bytes_( data, data_size, &xb, status, text_encoding ) ) {
+        std::free( static_cast<void *>(xb.buffer) );
+        return false;
+    }
+
+    // the decoder's text is the output as it stands: there is no envelope to put it in, so no reparse.
+    raw_output_.assign( xb.buffer, xb.buffer_size );
+    std::free( static_cast<void *>(xb.buffer) );
+
+    if ( outputs.empty() ) output_message_stream << raw_output_;
+
+    logger->trace(fnname + ": finished...");
+    return true;
+}
+
+bool ASN1_Codec::unsecured_data_( buffer_structure_t* xml_buffer, std::string& data_as_hex, Asn1Status& status ) {
+    pugi::xml_parse_result parse_result;
+
+    // pugi resets the document as part of load_buffer
+    {
+        metrics::ScopedStage stage{ metrics::Stage::XML_REPARSE };
+        parse_result = internal_doc.load_buffer(static_cast<const void *>( xml_buffer->buffer), xml_buffer->buffer_size );
+    }
+
+    std::free( static_cast<void *>(xml_buffer->buffer) );
+    *xml_buffer = { 0,0,0 };                    // reset buffer;
+
+    if ( !parse_result ) {
+        return status.at( metrics::Stage::XML_REPARSE ).codec( std::string{ "IEEE 1609.2 decoded XER cannot be parsed/loaded as a valid document: " } + parse_result.description() + " at offset " + std::to_string( parse_result.offset ) );
+    }
+
+    // XPath search the IEEE structure for the unsecured data.
+    pugi::xpath_node unsecuredDataNode = ieee1609dot2_unsecuredData_query.evaluate_node( internal_doc );
+    pugi::xml_text text = unsecuredDataNode.node().text();
+
+    if ( !text ) {
+        return status.at( metrics::Stage::XML_REPARSE ).codec( "IEEE 1609.2 internal XER unsecuredData element could not be found." );
+    }
+
+    data_as_hex.assign( text.get() );
+    internal_doc.reset();
+    return true;
+}
+
+bool ASN1_Codec::encode_node_as_hex_string(Asn1Status& status, bool replace) {
     std::stringstream xml_stream;
     std::string hex_str;
 
     pugi::xml_node node = payload_node_.first_element_by_path(curr_node_path_.c_str());
 
     if (!node) {
-        throw MissingInputElementError{"Failed to find path: " + curr_node_path_ + "in the input document."};
+        return status.missing( "Failed to find path: " + curr_node_path_ + "in the input document." );
     }
 
     pugi::xml_node parent_node = node.parent();
 
     if (!parent_node) {
-        throw MissingInputElementError{"Failed to find parent node for: " + curr_node_path_ + "in the input document."};
+        return status.missing( "Failed to find parent node for: " + curr_node_path_ + "in the input document." );
     }
 
     // convert the child to string stream 
-    node.print(xml_stream, "", pugi::format_raw);
+    {
+        metrics::ScopedStage stage{ metrics::Stage::SERIALIZE };
+        node.print(xml_stream, "", pugi::format_raw);
+    }
 
     // remove the child node from parent
     if ( !parent_node.remove_child(node) ) {
-        throw MissingInputElementError{"Failed to find child node in the input document."};
+        return status.missing( "Failed to find child node in the input document." );
     }
 
     // do the encoding
-    encode_frame_data(xml_stream.str(), hex_str);
+    if ( !encode_frame_data(xml_stream.str(), hex_str, status) ) {
+        return false;
+    }
 
     std::string node_name(node.name());
     hex_data_.push_back(std::make_tuple(node_name, hex_str));
 
     if (!replace) {
-        return;
+        return true;
     }
 
     // append the hex bytes as a new node
     if ( !parent_node.text().set(hex_str.c_str()) ) {
-        throw MissingInputElementError{"Failure to append hex bytes to the output document."};
+        return status.missing( "Failure to append hex bytes to the output document." );
     }
+
+    return true;
 }
 
-void ASN1_Codec::encode_for_protocol() {
+bool ASN1_Codec::encode_for_protocol(Asn1Status& status) {
     for (auto& part : protocol_) {
         curr_op_ = std::get<0>(part);
         curr_decode_type_ = std::get<1>(part);
         curr_node_path_ = std::get<2>(part);
 
-        encode_node_as_hex_string(std::get<3>(part));
+        if ( !encode_node_as_hex_string(status, std::get<3>(part)) ) {
+            return false;
+        }
     }
 
     for (auto& data : hex_data_) {
@@ -1176,17 +1974,18 @@ void ASN1_Codec::encode_for_protocol() {
         std::string hex_str = std::get<1>(data);
 
         if ( !payload_node_.append_child(node_name.c_str()).append_child("bytes").text().set(hex_str.c_str()) ) {
-            throw MissingInputElementError{"Failure to append path: OdeAsn1Data/payload/data/" + node_name + "/bytes to the output document."};
+            return status.missing( "Failure to append path: OdeAsn1Data/payload/data/" + node_name + "/bytes to the output document." );
         }
     }
 
     if (!payload_node_.parent().child("dataType").text().set( asn1datatypes[static_cast<int>(Asn1DataType::HEX)] ) ) {
-            throw MissingInputElementError{"Failure to update path: OdeAsn1Data/payload/dataType in the output document."};
+            return status.missing( "Failure to update path: OdeAsn1Data/payload/dataType in the output document." );
     }
+
+    return true;
 }
 
-// throws MissingInputElementError or Asn1CodecError (from encode_messageframe_data call) ONLY!
-bool ASN1_Codec::encode_message( std::stringstream& output_message_stream ) {
+bool ASN1_Codec::encode_message( std::stringstream& output_message_stream, Asn1Status& status ) {
 
     const std::string fnname = "encode_message()";
 
@@ -1229,19 +2028,92 @@ bool ASN1_Codec::encode_message( std::stringstream& output_message_stream ) {
 
             break;
         default:
-            throw MissingInputElementError{"An encoder was not specified in the encodingType tag that this module understands."};
+            return status.missing( "An encoder was not specified in the encodingType tag that this module understands." );
 
     }
     
-    encode_for_protocol();
-    
+    if ( !encode_for_protocol(status) ) {
+        return false;
+    }
+
     // convert DOM to a RAW string representation: no spaces, no tabs.
     // for testing.
-    input_doc.save(output_message_stream, "", pugi::format_raw);
+    {
+        metrics::ScopedStage stage{ metrics::Stage::SERIALIZE };
+        if ( raw_record_ ) {
+            // the bytes of the outermost element, as encode_frame_data left them; there is no envelope.
+            output_message_stream.write( raw_output_.data(), raw_output_.size() );
+        } else if ( json_envelope_ ) {
+            write_json_envelope();
+            output_message_stream << json_output_;
+        } else {
+            input_doc.save(output_message_stream, "", pugi::format_raw);
+        }
+    }
 
     return true;
 }
 
+const Constraint_Policy& ASN1_Codec::constraints() const {
+    return constraint_policy;
+}
+
+void ASN1_Codec::set_constraints(const Constraint_Policy& policy) {
+    constraint_policy = policy;
+}
+
+bool ASN1_Codec::check_constraints( const asn_TYPE_descriptor_t* type, const void* structure, long message_id, bool encoding, Asn1Status& status ) {
+    metrics::Registry& registry = metrics::Registry::instance();
+
+    if ( !constraint_policy.check( encoding ) ) {
+        registry.increment( metrics::Counter::CONSTRAINT_CHECKS_SKIPPED );
+        return true;
+    }
+
+    char errbuf[max_errbuf_size];
+    std::size_t errlen(max_errbuf_size);
+    int constraint_rval;
+    {
+        metrics::ScopedStage stage{ metrics::Stage::CONSTRAINT_CHECK };
+        constraint_rval = asn_check_constraints( type, structure, errbuf, &errlen );
+    }
+    registry.increment( metrics::Counter::CONSTRAINT_CHECKS );
+
+    if ( constraint_rval == 0 ) return true;
+
+    registry.constraint_violation( message_id );
+    return status.at( metrics::Stage::CONSTRAINT_CHECK ).codec( std::string{ "failed ASN.1 constraints check of element " } + type->name + ": " + std::string{ errbuf, errlen } );
+}
+
+const Codec_Budget& ASN1_Codec::codec_budget() const {
+    return budget;
+}
+
+void ASN1_Codec::set_codec_budget(const Codec_Budget& limits) {
+    budget = limits;
+}
+
+void ASN1_Codec::start_budget( Asn1Status& status ) {
+    status.start( budget.max_time_ns ? metrics::now_ns() : 0 );
+}
+
+bool ASN1_Codec::budget_exceeded( Asn1Status& status, metrics::Stage stage, const std::string& message ) {
+    metrics::Registry::instance().increment( metrics::Counter::BUDGET_EXCEEDED );
+    return status.at( stage ).budget( message );
+}
+
+bool ASN1_Codec::within_input_budget( std::size_t size, Asn1Status& status, metrics::Stage stage ) {
+    if ( budget.max_input_bytes == 0 || size <= budget.max_input_bytes ) return true;
+    return budget_exceeded( status, stage, "input of " + std::to_string(size) + " bytes is over the budget of " + std::to_string(budget.max_input_bytes) + " bytes." );
+}
+
+bool ASN1_Codec::within_time_budget( Asn1Status& status, metrics::Stage stage ) {
+    if ( budget.max_time_ns == 0 ) return true;
+    uint64_t elapsed_ns = metrics::now_ns() - status.start_ns();
+    if ( elapsed_ns <= budget.max_time_ns ) return true;
+    return budget_exceeded( status, stage, "processing took " + std::to_string(elapsed_ns / 1000) + " us, over the budget of " + std::to_string(budget.max_time_ns / 1000) + " us." );
+}
+
 /** 
  * Decodes the IEEE 1609.2 ASN.1 bytes represented by the hex string according to the instance type variable:
  * decode_1609dot2_type into its C structure, then encodes the C structure into XML. The XML is put into the xml_buffer.
@@ -1253,10 +2125,47 @@ bool ASN1_Codec::encode_message( std::stringstream& output_message_stream ) {
  * Return false on failure: immediately use the input_doc to return what happened during decoding of 1609.2
  */
 
-// throws Asn1CodecError ONLY!
-bool ASN1_Codec::decode_1609dot2_data( std::string& data_as_hex, buffer_structure_t* xml_buffer ) {
+// reports CODEC failures ONLY!
+bool ASN1_Codec::decode_1609dot2_data( std::string& data_as_hex, buffer_structure_t* xml_buffer, Asn1Status& status ) {
     const std::string fnname = "decode_1609dot2_data()";
 
+    logger->trace(fnname + ": starting...");
+
+    // remove all spaces.
+    data_as_hex.erase( remove_if ( data_as_hex.begin(), data_as_hex.end(), isspace), data_as_hex.end());
+
+    if (data_as_hex.empty()) {
+        return status.at( metrics::Stage::HEX_CONVERSION ).codec( "failed attempt to decode IEEE 1609.2 hex string: string empty." );
+    }
+
+    if ( !within_input_budget( data_as_hex.size() / 2, status, metrics::Stage::HEX_CONVERSION ) ) {
+        return false;
+    }
+
+    logger->trace(fnname + ": success extracting " + asn_DEF_Ieee1609Dot2Data.name + " hex string: " + data_as_hex );
+
+    std::vector<char> byte_buffer;
+    bool converted;
+    {
+        metrics::ScopedStage stage{ metrics::Stage::HEX_CONVERSION };
+        converted = hex_to_bytes_(data_as_hex, byte_buffer);
+    }
+    if (!converted) {
+        return status.at( metrics::Stage::HEX_CONVERSION ).codec( "failed attempt to decode IEEE 1609.2 hex string: cannot convert to bytes." );
+    }
+
+    logger->trace(fnname + ": successful conversion to raw byte buffer." );
+
+    return decode_1609dot2_bytes_( byte_buffer.data(), byte_buffer.size(), xml_buffer, status );
+}
+
+/**
+ * Decodes an IEEE 1609.2 frame that is already in binary form; used by decode_1609dot2_data after hex conversion and
+ * directly for raw records.
+ */
+bool ASN1_Codec::decode_1609dot2_bytes_( const char* data, std::size_t data_size, buffer_structure_t* xml_buffer, Asn1Status& status ) {
+    const std::string fnname = "decode_1609dot2_bytes()";
+
     // enum asn_dec_rval_code_e {
     // 	RC_OK,		                                  // successful decoding.
     // 	RC_WMORE,	                                  // more data expected.
@@ -1277,80 +2186,69 @@ bool ASN1_Codec::decode_1609dot2_data( std::string& data_as_hex, buffer_structur
     // } asn_enc_rval_t;
     asn_enc_rval_t encode_rval;
 
-    std::size_t errlen(max_errbuf_size);
-
     Ieee1609Dot2Data_t *ieee1609data = 0;        // must initialize to 0 according to asn.1 instructions.
 
-    logger->trace(fnname + ": starting...");
-
-    // remove all spaces.
-    data_as_hex.erase( remove_if ( data_as_hex.begin(), data_as_hex.end(), isspace), data_as_hex.end());
-
-    if (data_as_hex.empty()) {
-        throw Asn1CodecError{"failed attempt to decode IEEE 1609.2 hex string: string empty."};
+    if (data_size == 0) {
+        return status.at( metrics::Stage::ASN_DECODE ).codec( "failed attempt to decode IEEE 1609.2 bytes: buffer empty." );
     }
 
-    logger->trace(fnname + ": success extracting " + asn_DEF_Ieee1609Dot2Data.name + " hex string: " + data_as_hex );
-
-    std::vector<char> byte_buffer;
-    if (!hex_to_bytes_(data_as_hex, byte_buffer)) {
-        throw Asn1CodecError{"failed attempt to decode IEEE 1609.2 hex string: cannot convert to bytes."};
+    if ( !within_input_budget( data_size, status, metrics::Stage::ASN_DECODE ) ) {
+        return false;
     }
 
-    logger->trace(fnname + ": successful conversion to raw byte buffer." );
-
     // Decode BAH Bytes (A 1609.2 Frame) into the appropriate structure.
-    decode_rval = asn_decode( 
-            0, 
-            decode_1609dot2_type, 
-            &asn_DEF_Ieee1609Dot2Data, 
-            (void **)&ieee1609data, 
-            byte_buffer.data(), 
-            byte_buffer.size() 
-            );
+    asn_codec_ctx_t codec_ctx{ budget.max_stack_bytes };   // asn1c measures stack use from this frame.
+    {
+        metrics::ScopedStage stage{ metrics::Stage::ASN_DECODE };
+        decode_rval = asn_decode( 
+                budget.max_stack_bytes ? &codec_ctx : 0, 
+                decode_1609dot2_type, 
+                &asn_DEF_Ieee1609Dot2Data, 
+                (void **)&ieee1609data, 
+                data, 
+                data_size 
+                );
+    }
 
     if ( decode_rval.code != RC_OK ) {
-        std::ostringstream erroross;
-        erroross.str("");
-        erroross << "failed ASN.1 binary decoding of element " << asn_DEF_Ieee1609Dot2Data.name << ": ";
-        if ( decode_rval.code == RC_FAIL ) {
-            erroross << "bad data.";
-        } else {
-            erroross << "more data expected.";
-        }
-        erroross << " Successfully decoded " << decode_rval.consumed << " bytes.";
-        throw Asn1CodecError{ erroross.str() };
+        ASN_STRUCT_FREE(asn_DEF_Ieee1609Dot2Data, ieee1609data);
+        return status.at( metrics::Stage::ASN_DECODE ).codec( decode_failure( "binary decoding of element", asn_DEF_Ieee1609Dot2Data.name, decode_rval ) );
     }
 
     logger->trace(fnname + ": ASN.1 binary decode success." );
 
+    if ( !within_time_budget( status, metrics::Stage::ASN_DECODE ) ) {
+        ASN_STRUCT_FREE(asn_DEF_Ieee1609Dot2Data, ieee1609data);
+        return false;
+    }
+
     // check the data in the returned structure against the ASN.1 specification constraints.
-    char errbuf[max_errbuf_size];
-    if (asn_check_constraints( &asn_DEF_Ieee1609Dot2Data, ieee1609data, errbuf, &errlen )) {
-        std::ostringstream erroross;
-        erroross.str("");
-        erroross << "failed ASN.1 constraints check of element " << asn_DEF_Ieee1609Dot2Data.name << ": ";
-        erroross.write( errbuf, errlen );
+    if ( !check_constraints( &asn_DEF_Ieee1609Dot2Data, ieee1609data, -1, false, status ) ) {
         ASN_STRUCT_FREE(asn_DEF_Ieee1609Dot2Data, ieee1609data);
-        throw Asn1CodecError{ erroross.str() };
+        return false;
     }
 
     // target form is always XML (for now).
-    encode_rval = xer_encode( 
-            &asn_DEF_Ieee1609Dot2Data, 
-            ieee1609data, 
-            XER_F_CANONICAL, 
-            dynamic_buffer_append, 
-            static_cast<void *>(xml_buffer) 
-            );
+    budgeted_buffer_t sink = budgeted_buffer( xml_buffer, budget, status.start_ns() );
+    {
+        metrics::ScopedStage stage{ metrics::Stage::XER_ENCODE };
+        encode_rval = xer_encode( 
+                &asn_DEF_Ieee1609Dot2Data, 
+                ieee1609data, 
+                XER_F_CANONICAL, 
+                budgeted_buffer_append, 
+                static_cast<void *>(&sink) 
+                );
+    }
 
     ASN_STRUCT_FREE(asn_DEF_Ieee1609Dot2Data, ieee1609data);
 
+    if ( sink.exceeded ) {
+        return budget_exceeded( status, metrics::Stage::XER_ENCODE, std::string{ "XML encoding of " } + asn_DEF_Ieee1609Dot2Data.name + " went over the output or time budget." );
+    }
+
     if ( encode_rval.encoded == -1 ) {
-        std::ostringstream erroross;
-        erroross.str("");
-        erroross << "failed ASN.1 XML encoding of Ieee1609Dot2Data element " << encode_rval.failed_type->name;
-        throw Asn1CodecError{ erroross.str() };
+        return status.at( metrics::Stage::XER_ENCODE ).codec( std::string{ "failed ASN.1 XML encoding of Ieee1609Dot2Data element " } + encode_rval.failed_type->name );
     }
 
     logger->trace(fnname + ": finished.");
@@ -1361,14 +2259,18 @@ bool ASN1_Codec::decode_1609dot2_data( std::string& data_as_hex, buffer_structur
  * TODO: This method should be generalizable to any type def and structure pointer -- tried but moved on.
  */
 bool ASN1_Codec::decode_messageframe_data( std::string& data_as_hex, buffer_structure_t* xml_buffer ) {
-    const std::string fnname = "decode_messageframe_data()";
-
-    asn_dec_rval_t decode_rval;
-    asn_enc_rval_t encode_rval;
+    Asn1Status status;
+    if ( !decode_messageframe_data( data_as_hex, xml_buffer, status ) ) status.raise();
+    return true;
+}
 
-    std::size_t errlen(max_errbuf_size);
+bool ASN1_Codec::decode_messageframe_data( std::string& data_as_hex, buffer_structure_t* xml_buffer, Asn1Status& status, Text_Encoding encoding ) {
+    start_budget( status );
+    return decode_messageframe_hex_( data_as_hex, xml_buffer, status, encoding );
+}
 
-    MessageFrame_t *messageframe = 0;           // must be initialized to 0.
+bool ASN1_Codec::decode_messageframe_hex_( std::string& data_as_hex, buffer_structure_t* xml_buffer, Asn1Status& status, Text_Encoding encoding ) {
+    const std::string fnname = "decode_messageframe_data()";
 
     logger->trace(fnname + ": starting...");
 
@@ -1376,84 +2278,164 @@ bool ASN1_Codec::decode_messageframe_data( std::string& data_as_hex, buffer_stru
     data_as_hex.erase( remove_if ( data_as_hex.begin(), data_as_hex.end(), isspace), data_as_hex.end());
 
     if (data_as_hex.empty()) {
-        throw Asn1CodecError{"failed attempt to decode MessageFrame hex string: string empty."};
+        return status.at( metrics::Stage::HEX_CONVERSION ).codec( "failed attempt to decode MessageFrame hex string: string empty." );
+    }
+
+    if ( !within_input_budget( data_as_hex.size() / 2, status, metrics::Stage::HEX_CONVERSION ) ) {
+        return false;
     }
 
     logger->trace(fnname + ": success extracting " + asn_DEF_MessageFrame.name + " hex string: " + data_as_hex);
 
     std::vector<char> byte_buffer;
-    if (!hex_to_bytes_(data_as_hex, byte_buffer)) {
-        throw Asn1CodecError{"failed attempt to decode MessageFrame hex string: cannot convert to bytes."};
+    bool converted;
+    {
+        metrics::ScopedStage stage{ metrics::Stage::HEX_CONVERSION };
+        converted = hex_to_bytes_(data_as_hex, byte_buffer);
+    }
+    if (!converted) {
+        return status.at( metrics::Stage::HEX_CONVERSION ).codec( "failed attempt to decode MessageFrame hex string: cannot convert to bytes." );
     }
 
     logger->trace(fnname + ": successful conversion to raw byte buffer.");
 
-    decode_rval = asn_decode( 
-            0, 
-            decode_messageframe_type, 
-            &asn_DEF_MessageFrame,
-            (void **)&messageframe,
-            byte_buffer.data(), 
-            byte_buffer.size() 
-            );
+    return decode_messageframe_bytes_( byte_buffer.data(), byte_buffer.size(), xml_buffer, status, encoding );
+}
 
-    if ( decode_rval.code != RC_OK ) {
-        std::ostringstream erroross;
-        erroross.str("");
-        erroross << "failed ASN.1 binary decoding of element " << asn_DEF_MessageFrame.name << ": ";
-        if ( decode_rval.code == RC_FAIL ) {
-            erroross << "bad data.";
-        } else {
-            erroross << "more data expected.";
-        }
-        erroross << " Successfully decoded " << decode_rval.consumed << " bytes.";
-        throw Asn1CodecError{ erroross.str() };
-    }
+/**
+ * Decodes a MessageFrame that is already in binary form; used directly by transports that do not hex encode their
+ * payloads (e.g., the IPC server) and by decode_messageframe_data after hex conversion.
+ */
+bool ASN1_Codec::decode_messageframe_bytes( const char* data, std::size_t data_size, buffer_structure_t* xml_buffer ) {
+    Asn1Status status;
+    if ( !decode_messageframe_bytes( data, data_size, xml_buffer, status ) ) status.raise();
+    return true;
+}
 
-    logger->trace(fnname + ": ASN.1 binary decode successful.");
+bool ASN1_Codec::decode_messageframe_bytes( const char* data, std::size_t data_size, buffer_structure_t* xml_buffer, Asn1Status& status, Text_Encoding encoding ) {
+    start_budget( status );
+    return decode_messageframe_bytes_( data, data_size, xml_buffer, status, encoding );
+}
 
-    char errbuf[max_errbuf_size];
-    if (asn_check_constraints( &asn_DEF_MessageFrame, messageframe, errbuf, &errlen )) {
-        std::ostringstream erroross;
-        erroross.str("");
-        erroross << "failed ASN.1 constraints check of element " << asn_DEF_MessageFrame.name << ": ";
-        erroross.write( errbuf, errlen );
-        ASN_STRUCT_FREE(asn_DEF_MessageFrame, messageframe);
-        throw Asn1CodecError{ erroross.str() };
-    }
+bool ASN1_Codec::decode_1609dot2_messageframe_bytes( const char* data, std::size_t data_size, buffer_structure_t* xml_buffer, bool& is_signed, Asn1Status& status, Text_Encoding encoding ) {
+    static const std::string signed_data_tag{ "<signedData>" };
 
-    // Encode the Ieee1609Dot2Data ASN.1 C struct into XML, so we can extract out the BSM.
-    encode_rval = xer_encode( 
-            &asn_DEF_MessageFrame, 
-            messageframe, 
-            XER_F_CANONICAL, 
-            dynamic_buffer_append, 
-            static_cast<void *>(xml_buffer) 
-            );
+    start_budget( status );
 
-    ASN_STRUCT_FREE(asn_DEF_MessageFrame, messageframe);
+    // the default encodings: COER Ieee1609Dot2Data around a UPER MessageFrame.
+    reset_codec_requirements();
 
-    if ( encode_rval.encoded == -1 ) {
-        std::ostringstream erroross;
-        erroross.str("");
-        erroross << "failed ASN.1 XML encoding of MessageFrame element " << encode_rval.failed_type->name;
-        throw Asn1CodecError{ erroross.str() };
-    }
+    if ( !decode_1609dot2_bytes_( data, data_size, xml_buffer, status ) ) return false;
 
-    logger->trace(fnname + ": finished.");
-    return true;
+    const char* xer = xml_buffer->buffer;
+    const char* xer_end = xer + xml_buffer->buffer_size;
+    is_signed = std::search( xer, xer_end, signed_data_tag.begin(), signed_data_tag.end() ) != xer_end;
+
+    // the unsecuredData comes out of the 1609.2 XER as hex, as it does for an envelope.
+    std::string hstr;
+    if ( !unsecured_data_( xml_buffer, hstr, status ) ) return false;
+
+    return decode_messageframe_hex_( hstr, xml_buffer, status, encoding );
 }
 
-        
-void ASN1_Codec::encode_frame_data(const std::string& data_as_xml, std::string& hex_string) {
-    const std::string fnname = "encode_frame_data()";
+bool ASN1_Codec::decode_messageframe_bytes_( const char* data, std::size_t data_size, buffer_structure_t* xml_buffer, Asn1Status& status, Text_Encoding encoding ) {
+    const std::string fnname = "decode_messageframe_bytes()";
 
     asn_dec_rval_t decode_rval;
     asn_enc_rval_t encode_rval;
 
-	// TODO: working toward a general solution for these function; first is passing in a ref to 
-	// these types of structures.
-	struct asn_TYPE_descriptor_s* data_struct;
+    MessageFrame_t *messageframe = 0;           // must be initialized to 0.
+
+    if (data_size == 0) {
+        return status.at( metrics::Stage::ASN_DECODE ).codec( "failed attempt to decode MessageFrame bytes: buffer empty." );
+    }
+
+    if ( !within_input_budget( data_size, status, metrics::Stage::ASN_DECODE ) ) {
+        return false;
+    }
+
+    asn_codec_ctx_t codec_ctx{ budget.max_stack_bytes };   // asn1c measures stack use from this frame.
+    {
+        metrics::ScopedStage stage{ metrics::Stage::ASN_DECODE };
+        decode_rval = asn_decode( 
+                budget.max_stack_bytes ? &codec_ctx : 0, 
+                decode_messageframe_type, 
+                &asn_DEF_MessageFrame,
+                (void **)&messageframe,
+                data, 
+                data_size 
+                );
+    }
+
+    if ( decode_rval.code != RC_OK ) {
+        ASN_STRUCT_FREE(asn_DEF_MessageFrame, messageframe);
+        return status.at( metrics::Stage::ASN_DECODE ).codec( decode_failure( "binary decoding of element", asn_DEF_MessageFrame.name, decode_rval ) );
+    }
+
+    logger->trace(fnname + ": ASN.1 binary decode successful.");
+    status.set_message_id( messageframe->messageId );
+    metrics::Registry::instance().message_id( messageframe->messageId );
+    metrics::StageTrace::local().message_id( messageframe->messageId );
+    if ( output_key == Output_Key::ENTITY ) {
+        std::string key;
+        entity_key::derive( *messageframe, key );
+        status.set_entity_key( std::move(key) );
+    }
+
+    if ( !within_time_budget( status, metrics::Stage::ASN_DECODE ) ) {
+        ASN_STRUCT_FREE(asn_DEF_MessageFrame, messageframe);
+        return false;
+    }
+
+    if ( !check_constraints( &asn_DEF_MessageFrame, messageframe, messageframe->messageId, false, status ) ) {
+        ASN_STRUCT_FREE(asn_DEF_MessageFrame, messageframe);
+        return false;
+    }
+
+    // Encode the MessageFrame ASN.1 C struct into XML, or JSON.
+    const bool json = encoding == Text_Encoding::JSON;
+    const metrics::Stage encode_stage = json ? metrics::Stage::JSON_ENCODE : metrics::Stage::XER_ENCODE;
+    budgeted_buffer_t sink = budgeted_buffer( xml_buffer, budget, status.start_ns() );
+    {
+        metrics::ScopedStage stage{ encode_stage };
+        if ( json ) {
+            encode_rval = jer::encode( &asn_DEF_MessageFrame, messageframe, budgeted_buffer_append, static_cast<void *>(&sink) );
+        } else {
+            encode_rval = xer_encode( 
+                    &asn_DEF_MessageFrame, 
+                    messageframe, 
+                    XER_F_CANONICAL, 
+                    budgeted_buffer_append, 
+                    static_cast<void *>(&sink) 
+                    );
+        }
+    }
+
+    ASN_STRUCT_FREE(asn_DEF_MessageFrame, messageframe);
+
+    if ( sink.exceeded ) {
+        return budget_exceeded( status, encode_stage, std::string{ json ? "JSON" : "XML" } + " encoding of " + asn_DEF_MessageFrame.name + " went over the output or time budget." );
+    }
+
+    if ( encode_rval.encoded == -1 ) {
+        return status.at( encode_stage ).codec( std::string{ json ? "failed ASN.1 JSON encoding of MessageFrame element " : "failed ASN.1 XML encoding of MessageFrame element " }
+                + ( encode_rval.failed_type ? encode_rval.failed_type->name : asn_DEF_MessageFrame.name ) );
+    }
+
+    logger->trace(fnname + ": finished.");
+    return true;
+}
+
+        
+bool ASN1_Codec::encode_frame_data(const std::string& data_as_xml, std::string& hex_string, Asn1Status& status) {
+    const std::string fnname = "encode_frame_data()";
+
+    asn_dec_rval_t decode_rval;
+    asn_enc_rval_t encode_rval;
+
+	// TODO: working toward a general solution for these function; first is passing in a ref to 
+	// these types of structures.
+	struct asn_TYPE_descriptor_s* data_struct;
     void *frame_data = 0;
 
     switch (curr_op_) {
@@ -1462,7 +2444,7 @@ void ASN1_Codec::encode_frame_data(const std::string& data_as_xml, std::string&
 
             // check that data conforms to the J2735 2020 standard
             if ( !j2735_2020_conformance_check( data_as_xml ) ) {
-                throw Asn1CodecError{"J2735 2020 conformance check failed."};
+                return status.at( metrics::Stage::XER_DECODE ).codec( "J2735 2020 conformance check failed." );
             }
 
             break;
@@ -1479,65 +2461,93 @@ void ASN1_Codec::encode_frame_data(const std::string& data_as_xml, std::string&
             break;
     }
 
-    std::size_t errlen(max_errbuf_size);
+    if ( !within_input_budget( data_as_xml.size(), status, metrics::Stage::XER_DECODE ) ) {
+        return false;
+    }
 
-    decode_rval = xer_decode( 
-            0 				// new parameter addition seems to work with nullptr.
-			, data_struct
-            , (void **)&frame_data
-            , data_as_xml.data()
-            , data_as_xml.size()
-            );
+    asn_codec_ctx_t codec_ctx{ budget.max_stack_bytes };   // asn1c measures stack use from this frame.
+    {
+        metrics::ScopedStage stage{ metrics::Stage::XER_DECODE };
+        decode_rval = xer_decode( 
+                budget.max_stack_bytes ? &codec_ctx : 0
+                , data_struct
+                , (void **)&frame_data
+                , data_as_xml.data()
+                , data_as_xml.size()
+                );
+    }
 
     if ( decode_rval.code != RC_OK ) {
-        std::ostringstream erroross;
-        erroross.str("");
-        erroross << "failed ASN.1 decoding of XML element " << data_struct->name << ": ";
-        if ( decode_rval.code == RC_FAIL ) {
-            erroross << "bad data.";
-        } else {
-            erroross << "more data expected.";
+        ASN_STRUCT_FREE(*data_struct, frame_data);
+        return status.at( metrics::Stage::XER_DECODE ).codec( decode_failure( "decoding of XML element", data_struct->name, decode_rval ) );
+    }
+
+    if (data_struct == &asn_DEF_MessageFrame) {
+        status.set_message_id( static_cast<MessageFrame_t*>(frame_data)->messageId );
+        metrics::Registry::instance().message_id( static_cast<MessageFrame_t*>(frame_data)->messageId );
+        metrics::StageTrace::local().message_id( static_cast<MessageFrame_t*>(frame_data)->messageId );
+        if ( output_key == Output_Key::ENTITY ) {
+            std::string key;
+            entity_key::derive( *static_cast<MessageFrame_t*>(frame_data), key );
+            status.set_entity_key( std::move(key) );
         }
-        erroross << " Successfully decoded " << decode_rval.consumed << " bytes.";
-        throw Asn1CodecError{ erroross.str() };
     }
 
-    char errbuf[max_errbuf_size];
-    if (asn_check_constraints( data_struct, frame_data, errbuf, &errlen )) {
-        std::ostringstream erroross;
-        erroross.str("");
-        erroross << "failed ASN.1 constraints check of element " << data_struct->name << ": ";
-        erroross.write( errbuf, errlen );
+    if ( !within_time_budget( status, metrics::Stage::XER_DECODE ) ) {
         ASN_STRUCT_FREE(*data_struct, frame_data);
-        throw Asn1CodecError{ erroross.str() };
+        return false;
     }
 
-    buffer_structure_t buffer = {0,0,0};
+    long message_id = data_struct == &asn_DEF_MessageFrame ? static_cast<MessageFrame_t*>(frame_data)->messageId : -1;
+    if ( !check_constraints( data_struct, frame_data, message_id, true, status ) ) {
+        ASN_STRUCT_FREE(*data_struct, frame_data);
+        return false;
+    }
 
-    encode_rval = asn_encode(
-        0,
-        curr_decode_type_,
-        data_struct,
-        frame_data, 
-        dynamic_buffer_append, 
-        static_cast<void *>(&buffer) 
-        );
+    buffer_structure_t buffer = {0,0,0};
+    budgeted_buffer_t sink = budgeted_buffer( &buffer, budget, status.start_ns() );
+
+    {
+        metrics::ScopedStage stage{ metrics::Stage::ASN_ENCODE };
+        encode_rval = asn_encode(
+            0,
+            curr_decode_type_,
+            data_struct,
+            frame_data, 
+            budgeted_buffer_append, 
+            static_cast<void *>(&sink) 
+            );
+    }
 
     ASN_STRUCT_FREE(*data_struct, frame_data);
 
+    if ( sink.exceeded ) {
+        std::free( static_cast<void *>(buffer.buffer) );
+        return budget_exceeded( status, metrics::Stage::ASN_ENCODE, std::string{ "ASN.1 encoding of " } + data_struct->name + " went over the output or time budget." );
+    }
+
     if ( encode_rval.encoded == -1 ) {
-        std::ostringstream erroross;
-        erroross.str("");
-        erroross << "failed ASN.1 encoding of SDWTIM element " << encode_rval.failed_type->name;
-        throw Asn1CodecError{ erroross.str() };
+        std::free( static_cast<void *>(buffer.buffer) );
+        return status.at( metrics::Stage::ASN_ENCODE ).codec( std::string{ "failed ASN.1 encoding of SDWTIM element " } + encode_rval.failed_type->name );
+    }
+
+    if ( raw_record_ ) {
+        // the protocol encodes the outermost element last, so its bytes are what is left here.
+        raw_output_.assign( buffer.buffer, buffer.buffer_size );
     }
 
-    if (!bytes_to_hex_(&buffer, hex_string)) {
+    bool converted;
+    {
+        metrics::ScopedStage stage{ metrics::Stage::HEX_CONVERSION };
+        converted = bytes_to_hex_(&buffer, hex_string);
+    }
+    if (!converted) {
         std::free( static_cast<void *>(buffer.buffer) );
-        throw Asn1CodecError{ "failed attempt to encode SDWTIM byte buffer into hex string." };
+        return status.at( metrics::Stage::HEX_CONVERSION ).codec( "failed attempt to encode SDWTIM byte buffer into hex string." );
     }
 
     std::free( static_cast<void *>(buffer.buffer) );
+    return true;
 }
 
 /**
@@ -1570,10 +2580,7 @@ bool ASN1_Codec::j2735_2020_conformance_check(const std::string& messageFrameXml
     return true;
 }
 
-bool ASN1_Codec::set_codec_requirements( pugi::xml_document& doc ) {
-    const std::string fnname = "set_codec_requirements()";
-
-    enum asn_transfer_syntax atstype = ATS_INVALID;
+void ASN1_Codec::reset_codec_requirements() {
 	opsflag = 0;
 
     // re-establish defaults.
@@ -1582,57 +2589,177 @@ bool ASN1_Codec::set_codec_requirements( pugi::xml_document& doc ) {
     decode_asdframe = false;
     decode_1609dot2_type = ATS_CANONICAL_OER;
     decode_messageframe_type = ATS_UNALIGNED_BASIC_PER;
+}
+
+bool ASN1_Codec::add_codec_requirement( const char* element_type, const char* encoding_rule, enum asn_transfer_syntax& atstype, Asn1Status& status ) {
+    if ( encoding_rule ) {
+        // the input contains the rule specification and we should use it.
+        atstype = get_ats_transfer_syntax( encoding_rule );
+    }
+
+    if ( atstype == ATS_INVALID ) {
+        return status.at( metrics::Stage::CODEC_REQUIREMENTS ).unparseable( "Invalid encoding rule in input file." );
+    }
+
+    // TODO: These strings ( must be detected as hard coded string or config parameters ).
+
+    if ( std::strcmp(element_type, "Ieee1609Dot2Data") == 0 ) {
+        opsflag |= static_cast<uint32_t>(Asn1OpsType::IEEE1609DOT2);
+        decode_1609dot2 = true;
+        decode_1609dot2_type = atstype;
+
+    } else if ( std::strcmp(element_type, "MessageFrame") == 0 ) {
+        opsflag |= static_cast<uint32_t>(Asn1OpsType::J2735MESSAGEFRAME);
+        decode_messageframe = true;
+        decode_messageframe_type = atstype;
+
+    } else if ( std::strcmp(element_type, "AdvisorySituationData") == 0 ) {
+        opsflag |= static_cast<uint32_t>(Asn1OpsType::ASDFRAME);
+        decode_asdframe = true;
+        decode_asdframe_type = atstype;
+    }
+
+    return true;
+}
+
+bool ASN1_Codec::set_codec_requirements( pugi::xml_document& doc, Asn1Status& status ) {
+    const std::string fnname = "set_codec_requirements()";
+
+    enum asn_transfer_syntax atstype = ATS_INVALID;
+    reset_codec_requirements();
 
 
     // Determine which decodings are needed.
     // TODO: Think aobut using a xpath_nodeset structure and iterating.
     pugi::xpath_node encodings_xpath_node = ode_encodings_query.evaluate_node( input_doc );
     if (!encodings_xpath_node) {
-        throw UnparseableInputError{"Failed to find path: OdeAsn1Data/metadata/encodings in the input file."};
+        return status.at( metrics::Stage::CODEC_REQUIREMENTS ).unparseable( "Failed to find path: OdeAsn1Data/metadata/encodings in the input file." );
     }
 
     for ( pugi::xml_node n = encodings_xpath_node.node().first_child(); n; n = n.next_sibling()) {
-
         pugi::xml_text ats_node = n.child("encodingRule").text();
-        if ( ats_node ) {
-            // the XML file contains the rule specification and we should use it.
-            atstype = get_ats_transfer_syntax( ats_node.get() );
+        if ( !add_codec_requirement( n.child("elementType").text().get(), ats_node ? ats_node.get() : nullptr, atstype, status ) ) {
+            return false;
         }
+    }
 
-		if ( atstype == ATS_INVALID ) {
-			throw UnparseableInputError{"Invalid encoding rule in input file."};
-		}
-        
-        // TODO: These strings ( must be detected as hard coded string or config parameters ).
+    if (!opsflag) {
+        return status.at( metrics::Stage::CODEC_REQUIREMENTS ).unparseable( "Input file did not specify any encoding/decoding operations." );
+    }
+
+    return true;
+}
+
+bool ASN1_Codec::set_codec_requirements( const Json_Envelope& envelope, Asn1Status& status ) {
+    enum asn_transfer_syntax atstype = ATS_INVALID;
+    reset_codec_requirements();
+
+    const std::vector<Json_Envelope::Encoding>* encodings = envelope.encodings();
+    if ( !encodings ) {
+        return status.at( metrics::Stage::CODEC_REQUIREMENTS ).unparseable( "Failed to find path: metadata/encodings in the input JSON envelope." );
+    }
+
+    for ( const Json_Envelope::Encoding& encoding : *encodings ) {
+        if ( !add_codec_requirement( encoding.element_type, encoding.encoding_rule, atstype, status ) ) {
+            return false;
+        }
+    }
+
+    if (!opsflag) {
+        return status.at( metrics::Stage::CODEC_REQUIREMENTS ).unparseable( "Input file did not specify any encoding/decoding operations." );
+    }
+
+    return true;
+}
+
+bool ASN1_Codec::load_json_payload( Asn1Status& status ) {
+    payload_doc.reset();
+    pugi::xml_node payload = payload_doc.append_child("payload");
+    payload.append_child("dataType");
+    payload_node_ = payload.append_child("data");
 
-        if ( std::strcmp(n.child("elementType").text().get(), "Ieee1609Dot2Data") == 0 ) {
-			opsflag |= static_cast<uint32_t>(Asn1OpsType::IEEE1609DOT2);
-            decode_1609dot2 = true;
-            decode_1609dot2_type = atstype;
+    if ( decode_functionality ) {
+        const char* bytes = json_input.data_bytes();
+        if ( !bytes ) {
+            return status.unparseable( "Failed to find path: payload/data/bytes in the input JSON envelope." );
+        }
+        payload_node_.append_child("bytes").text().set( bytes );
+        return true;
+    }
+
+    // there is no JSON decoder for the ASN.1 types; the element to encode comes as its XER.
+    std::size_t size = 0;
+    const char* xer = json_input.data_text( size );
+    if ( !xer ) {
+        return status.unparseable( "The payload/data of a JSON envelope to encode must be the XER of the element, as a string." );
+    }
 
-        } else if ( std::strcmp(n.child("elementType").text().get(), "MessageFrame") == 0 ) {
-			opsflag |= static_cast<uint32_t>(Asn1OpsType::J2735MESSAGEFRAME);
-            decode_messageframe = true;
-            decode_messageframe_type = atstype;
+    pugi::xml_parse_result parse_result = payload_node_.append_buffer( xer, size, xml_parse_options );
+    if ( !parse_result ) {
+        return status.unparseable( std::string{ "Input JSON envelope payload/data parse error: " } + parse_result.description() + " at offset " + std::to_string( parse_result.offset ) );
+    }
 
-        } else if ( std::strcmp(n.child("elementType").text().get(), "AdvisorySituationData") == 0 ) {
-			opsflag |= static_cast<uint32_t>(Asn1OpsType::ASDFRAME);
-            decode_asdframe = true;
-            decode_asdframe_type = atstype;
+    return true;
+}
+
+bool ASN1_Codec::set_codec_requirements( const std::string& encodings, Asn1Status& status ) {
+    enum asn_transfer_syntax atstype = ATS_INVALID;
+    reset_codec_requirements();
+
+    // elementType:encodingRule entries, outermost first, as the envelope lists them; an entry without a rule takes
+    // the rule of the one before.
+    for ( std::string entry : string_utilities::split( encodings, ',' ) ) {
+        string_utilities::strip( entry );
+        if ( entry.empty() ) continue;
+
+        std::size_t colon = entry.find( ':' );
+        if ( colon != std::string::npos ) {
+            entry[colon] = '\0';
+        }
+
+        if ( !add_codec_requirement( entry.c_str(), colon != std::string::npos ? entry.c_str() + colon + 1 : nullptr, atstype, status ) ) {
+            return false;
         }
     }
 
     if (!opsflag) {
-        throw UnparseableInputError{"Input file did not specify any encoding/decoding operations."};
+        return status.at( metrics::Stage::CODEC_REQUIREMENTS ).unparseable( "The encodings header did not specify any encoding/decoding operations." );
     }
 
     return true;
 }
 
+bool ASN1_Codec::load_raw_payload( const char* data, std::size_t data_size, Asn1Status& status ) {
+    payload_doc.reset();
+    pugi::xml_node payload = payload_doc.append_child("payload");
+    payload.append_child("dataType");
+    payload_node_ = payload.append_child("data");
+
+    pugi::xml_parse_result parse_result = payload_node_.append_buffer( data, data_size, xml_parse_options );
+    if ( !parse_result ) {
+        return status.unparseable( std::string{ "Input raw record XER parse error: " } + parse_result.description() + " at offset " + std::to_string( parse_result.offset ) );
+    }
+
+    return true;
+}
+
+void ASN1_Codec::write_json_envelope() {
+    std::string data;
+    if ( pdu_json_.empty() ) {
+        jer::append_element( data, payload_node_, pugi::xml_node{}, pdu_json_ );
+    }
+
+    Json_Envelope::Changes changes;
+    changes.data_type = payload_node_.parent().child("dataType").text().get();
+    changes.data = pdu_json_.empty() ? &data : &pdu_json_;
+
+    json_output_.clear();
+    json_input.write( json_output_, changes );
+}
+
 bool ASN1_Codec::file_test(std::string file_path, std::ostream& os, bool encode) {
     const std::string fnname = "file_test()";
 
-    std::stringstream output_msg_stream;
     bool r = true;
 
     std::FILE* ifile = std::fopen( file_path.c_str(), "r" );
@@ -1642,8 +2769,6 @@ bool ASN1_Codec::file_test(std::string file_path, std::ostream& os, bool encode)
         return EXIT_FAILURE;
     }
 
-    decode_functionality = !encode;
-
     // compute file size in bytes.
     std::fseek(ifile, 0, SEEK_END);
     std::size_t ifile_size = std::ftell(ifile);
@@ -1657,67 +2782,186 @@ bool ASN1_Codec::file_test(std::string file_path, std::ostream& os, bool encode)
         msg_recv_count++;
         msg_recv_bytes += consumed_xml_buffer.size();
 
-        try {
+        r = process_envelope( reinterpret_cast<const char*>(consumed_xml_buffer.data()), consumed_xml_buffer.size(), os, encode );
+        os << std::endl;
+    }
 
-            // pugi resets the document as part of load_buffer
-            pugi::xml_parse_result result = input_doc.load_buffer((const void*) consumed_xml_buffer.data(), consumed_xml_buffer.size(), xml_parse_options );
+    return r ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-            if (!result) {
-                std::ostringstream erroross;
-                erroross.str("");
-                erroross << "Input file parse error: " << result.description() << " at offset " << result.offset;
-                throw UnparseableInputError{ erroross.str() };
-            } 
+bool ASN1_Codec::process_raw( const char* data, std::size_t data_size, const std::string& encodings, std::ostream& os, bool encode ) {
+    const std::string fnname = "process_raw()";
 
-            // examine the input xml encodings information and set the flags and requirements needed to properly parse the byte strings.
-            set_codec_requirements( input_doc );            // throws.
+    std::stringstream output_msg_stream;
+    Asn1Status status;
 
-            // Retain this node reference. It is where the decoded result will be inserted.
+    decode_functionality = !encode;
 
-            payload_node_ = ode_payload_query.evaluate_node( input_doc ).node();
-            if ( !payload_node_ ) {
-                throw UnparseableInputError{ "Failed to find path: OdeAsn1Data/payload/data in the input document." };
-            } 
+    bool processed = process_raw_record( data, data_size, encodings, output_msg_stream, status );
+    message_id_ = status.message_id();
+    entity_key_ = status.entity_key();
 
-            if ( decode_functionality ) {
-                decode_message( payload_node_, output_msg_stream );
-            } else {
-                encode_message( output_msg_stream );
-            }
+    if ( !processed ) {
+        logger->error(fnname + ": " + status.name() + " " + status.message() );
+        write_error( status, output_msg_stream );
+    }
 
-        } catch (const UnparseableInputError& e) {
+    os << output_msg_stream.str();
+    return status.ok();
+}
 
-            r = false;
-            logger->error(fnname + ": UnparseableInputError " + e.what());
-            add_error_xml( error_doc, e.data_type(), e.error_type(), e.what(), true );
-            error_doc.save(output_msg_stream,"",pugi::format_raw);
+bool ASN1_Codec::process_envelope( const char* data, std::size_t data_size, std::ostream& os, bool encode ) {
+    const std::string fnname = "process_envelope()";
 
-        } catch (const MissingInputElementError& e) {
+    std::stringstream output_msg_stream;
+    Asn1Status status;
 
-            r = false;
-            logger->error(fnname + ": MissingInputElementError " + e.what() );
-            add_error_xml( error_doc, e.data_type(), e.error_type(), e.what(), true );
-            error_doc.save(output_msg_stream,"",pugi::format_raw);
+    decode_functionality = !encode;
 
-        } catch (const pugi::xpath_exception& e ) {
+    bool processed = process_input_document( data, data_size, output_msg_stream, status );
+    message_id_ = status.message_id();
+    entity_key_ = status.entity_key();
 
-            r = false;
-            logger->error(fnname + ": pugi::xpath_exception " + e.what() );
-            add_error_xml( error_doc, Asn1DataType::ODE, Asn1ErrorType::REQUEST, e.what(), true );
-            error_doc.save(output_msg_stream,"",pugi::format_raw);
+    if ( !processed ) {
+        logger->error(fnname + ": " + status.name() + " " + status.message() );
+        write_error( status, output_msg_stream );
+    }
 
-        } catch (const Asn1CodecError& e) {
+    os << output_msg_stream.str();
+    return status.ok();
+}
 
-            r = false;
-            logger->error(fnname + ": Asn1CodecError " + e.what() );
-            add_error_xml( input_doc, e.data_type(), e.error_type(), e.what(), false );
-            input_doc.save(output_msg_stream,"",pugi::format_raw);
+void ASN1_Codec::share_configuration( const ASN1_Codec& configured ) {
+    logger = configured.logger;
+    error_doc.reset( configured.error_doc );
+    error_template = configured.error_template;
+    error_template_fields = configured.error_template_fields;
+    decode_functionality = configured.decode_functionality;
+    budget = configured.budget;
+    constraint_policy = configured.constraint_policy;
+    message_filter = configured.message_filter;
+    text_encoding = configured.text_encoding;
+}
+
+bool ASN1_Codec::filtered() const {
+    return filtered_;
+}
+
+void ASN1_Codec::set_message_filter(const Message_Filter& filter) {
+    message_filter = filter;
+}
+
+void ASN1_Codec::set_outputs(const std::vector<Output_Renderer>& renderers) {
+    outputs = renderers;
+    output_routes.assign( outputs.size(), Topic_Router::kDefaultRoute );
+}
+
+bool ASN1_Codec::render_output(std::size_t output, std::string& out) const {
+    if ( raw_record_ ) {
+        // a raw record has no envelope: envelope and messageframe outputs are both the decoded text as it stands.
+        if ( outputs[output].format() == Output_Renderer::Format::PROJECTION ) return false;
+        out += raw_output_;
+        return !raw_output_.empty();
+    }
+
+    if ( json_envelope_ ) {
+        // the envelope was written once, as JSON, by the decode; projections select XER fields, which it has none of.
+        switch ( outputs[output].format() ) {
+            case Output_Renderer::Format::ENVELOPE:
+                out += json_output_;
+                return true;
+            case Output_Renderer::Format::MESSAGEFRAME:
+                out += pdu_json_;
+                return !pdu_json_.empty();
+            case Output_Renderer::Format::PROJECTION:
+                return false;
         }
+    }
+
+    metrics::ScopedStage stage{ metrics::Stage::SERIALIZE };
+    return outputs[output].render( input_doc, payload_node_, text_encoding == Text_Encoding::JSON ? &pdu_json_ : nullptr, out );
+}
 
-        os << output_msg_stream.str() << std::endl;
+bool ASN1_Codec::configure_outputs( const std::map<std::string, std::string>& settings, std::string& error ) {
+    outputs.clear();
+    output_routes.clear();
+
+    auto names = settings.find( "outputs" );
+    if ( names == settings.end() ) return true;
+
+    if ( !decode_functionality ) {
+        error = "outputs are renderings of decoded records; an encoder writes one.";
+        return false;
     }
 
-    return r ? EXIT_SUCCESS : EXIT_FAILURE;
+    for ( std::string name : string_utilities::split( names->second, ',' ) ) {
+        string_utilities::strip( name );
+        if ( name.empty() ) continue;
+
+        auto setting = [&]( const std::string& key ) {
+            auto it = settings.find( "output." + name + "." + key );
+            return it == settings.end() ? std::string{} : it->second;
+        };
+
+        Output_Renderer::Format format;
+        std::string format_name = setting( "format" );
+        if ( !Output_Renderer::parse( format_name.empty() ? "envelope" : format_name, format ) ) {
+            error = name + ": unknown format " + format_name + "; use envelope, messageframe, or projection.";
+            return false;
+        }
+
+        std::string topic = setting( "topic" );
+        if ( topic.empty() ) {
+            error = name + " has no topic.";
+            return false;
+        }
+
+        if ( format == Output_Renderer::Format::PROJECTION && text_encoding == Text_Encoding::JSON ) {
+            error = name + ": projections select XER fields; a decoder writing JSON has none.";
+            return false;
+        }
+
+        Output_Renderer renderer;
+        if ( !renderer.configure( format, setting( "fields" ), error ) ) {
+            error = name + ": " + error;
+            return false;
+        }
+
+        if ( !topic_router ) topic_router.reset( new Topic_Router{ published_topic_name } );
+        outputs.push_back( renderer );
+        output_routes.push_back( topic_router->output( topic ) );
+    }
+
+    if ( outputs.empty() ) {
+        error = "outputs names no outputs.";
+        return false;
+    }
+
+    return true;
+}
+
+const std::string& ASN1_Codec::entity_key() const {
+    return entity_key_;
+}
+
+void ASN1_Codec::set_output_key(Output_Key key) {
+    output_key = key;
+}
+
+long ASN1_Codec::message_id() const {
+    return message_id_;
+}
+
+bool ASN1_Codec::decoding() const {
+    return decode_functionality;
+}
+
+Text_Encoding ASN1_Codec::output_encoding() const {
+    return text_encoding;
+}
+
+void ASN1_Codec::set_output_encoding(Text_Encoding encoding) {
+    text_encoding = encoding;
 }
 
 /**
@@ -1768,103 +3012,267 @@ bool ASN1_Codec::filetest() {
         msg_recv_count++;
         msg_recv_bytes += consumed_xml_buffer.size();
 
-        try {
+        Asn1Status codec_status;
 
-            // pugi resets the document as part of load_buffer
-            pugi::xml_parse_result result = input_doc.load_buffer((const void*) consumed_xml_buffer.data(), consumed_xml_buffer.size(), xml_parse_options );
+        if ( !process_input_document( reinterpret_cast<const char*>( consumed_xml_buffer.data() ), consumed_xml_buffer.size(), output_msg_stream, codec_status ) ) {
+            r = false;
+            logger->error(fnname + ": " + codec_status.name() + " " + codec_status.message() );
+            write_error( codec_status, output_msg_stream );
+        }
 
-            if (!result) {
-                std::ostringstream erroross;
-                erroross.str("");
-                erroross << "Input file parse error: " << result.description() << " at offset " << result.offset;
-                throw UnparseableInputError{ erroross.str() };
-            } 
+        // one line for each fan-out output.
+        if ( codec_status.ok() ) {
+            for ( std::size_t output = 0; output < outputs.size(); ++output ) {
+                std::string rendered;
+                if ( render_output( output, rendered ) ) output_msg_stream << rendered << '\n';
+            }
+        }
 
-            // examine the input xml encodings information and set the flags and requirements needed to properly parse the byte strings.
-            set_codec_requirements( input_doc );            // throws.
+        logger->info(output_msg_stream.str());
 
-            // Retain this node reference. It is where the decoded result will be inserted.
-            payload_node_ = ode_payload_query.evaluate_node( input_doc ).node();
+        // Send output directly to stdout.
+        std::cout << output_msg_stream.str() << std::endl;
 
-            if ( !payload_node_ ) {
-                throw UnparseableInputError{ "Failed to find path: OdeAsn1Data/payload/data in the input document." };
-            } 
+    } else {
+        logger->trace("Read an empty file.");
+    }
+
+    // NOTE: good for troubleshooting, but bad for performance.
+    logger->trace(fnname + ": Finished.");
+    logger->flush();
+
+    return r ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+bool ASN1_Codec::configure_pipelines( const std::string& names, const std::unordered_map<std::string, std::string>& properties, const std::string& group_id ) {
+    const std::string fnname = "configure_pipelines()";
+
+    pipelines.clear();
+    for ( std::string name : string_utilities::split( names, ',' ) ) {
+        string_utilities::strip( name );
+        if ( name.empty() ) continue;
+
+        const std::string prefix = "acm.pipeline." + name + ".";
+        Pipeline_Config pipeline;
+        pipeline.name = name;
+        pipeline.group_id = group_id.empty() ? "asn1_codec." + name : group_id + "." + name;
 
-            if ( decode_functionality ) {
-                decode_message( payload_node_, output_msg_stream );
+        for ( const auto& property : properties ) {
+            if ( property.first.compare( 0, prefix.size(), prefix ) != 0 ) continue;
+
+            const std::string key = property.first.substr( prefix.size() );
+            const std::string& value = property.second;
+
+            if ( key == "type" ) {
+                if ( value != "decode" && value != "encode" ) {
+                    logger->error(fnname + ": " + property.first + " must be decode or encode, not " + value);
+                    return false;
+                }
+                pipeline.decode = value == "decode";
+            } else if ( key == "topic.consumer" ) {
+                pipeline.consumer_topic = value;
+            } else if ( key == "topic.producer" ) {
+                pipeline.producer_topic = value;
+            } else if ( key == "group.id" ) {
+                pipeline.group_id = value;
+            } else if ( key == "workers" ) {
+                try {
+                    pipeline.workers = std::stoi( value );
+                } catch ( std::exception& e ) {
+                    pipeline.workers = 0;
+                }
+                if ( pipeline.workers < 1 ) {
+                    logger->error(fnname + ": " + property.first + " must be a positive number of workers, not " + value);
+                    return false;
+                }
+            } else if ( key.compare( 0, 6, "route." ) == 0 ) {
+                pipeline.routes[ key.substr( 6 ) ] = value;
+            } else if ( key == "outputs" || key.compare( 0, 7, "output." ) == 0 ) {
+                pipeline.outputs[ key ] = value;
             } else {
-                encode_message( output_msg_stream );
+                logger->warn(fnname + ": unknown pipeline setting: " + property.first);
             }
+        }
 
-        } catch (const UnparseableInputError& e) {
+        if ( pipeline.consumer_topic.empty() || pipeline.producer_topic.empty() ) {
+            logger->error(fnname + ": pipeline " + name + " needs " + prefix + "topic.consumer and " + prefix + "topic.producer.");
+            return false;
+        }
 
-            r = false;
-            logger->error(fnname + ": UnparseableInputError " + std::string(e.what()));
-            add_error_xml( error_doc, e.data_type(), e.error_type(), e.what(), true );
-            error_doc.save(output_msg_stream,"",pugi::format_raw);
+        logger->info(fnname + ": pipeline " + name + ": " + ( pipeline.decode ? "decode " : "encode " ) + pipeline.consumer_topic
+                + " to " + pipeline.producer_topic + " with " + std::to_string( pipeline.workers ) + " worker(s) in group " + pipeline.group_id);
+        pipelines.push_back( std::move( pipeline ) );
+    }
 
-        } catch (const MissingInputElementError& e) {
+    if ( pipelines.empty() ) {
+        logger->error(fnname + ": acm.pipelines names no pipelines.");
+        return false;
+    }
 
-            r = false;
-            logger->error(fnname + ": MissingInputElementError " + std::string(e.what()));
-            add_error_xml( error_doc, e.data_type(), e.error_type(), e.what(), true );
-            error_doc.save(output_msg_stream,"",pugi::format_raw);
+    return true;
+}
 
-        } catch (const pugi::xpath_exception& e ) {
+const std::vector<Pipeline_Config>& ASN1_Codec::pipeline_configs() const {
+    return pipelines;
+}
 
-            r = false;
-            logger->error(fnname + ": pugi::xpath_exception " + std::string(e.what()));
-            add_error_xml( error_doc, Asn1DataType::ODE, Asn1ErrorType::REQUEST, e.what(), true );
-            error_doc.save(output_msg_stream,"",pugi::format_raw);
+bool ASN1_Codec::consuming() const {
+    return data_available && bootstrap;
+}
 
-        } catch (const Asn1CodecError& e) {
+std::size_t ASN1_Codec::partition_worker_count() const {
+    return partition_workers.size();
+}
 
-            r = false;
-            logger->error(fnname + ": Asn1CodecError " + std::string(e.what()));
-            add_error_xml( input_doc, e.data_type(), e.error_type(), e.what(), false );
-            input_doc.save(output_msg_stream,"",pugi::format_raw);
+bool ASN1_Codec::configure_worker( const ASN1_Codec& process, const Pipeline_Config& pipeline ) {
+    const std::string fnname = "configure_worker()";
+    std::string error_string;
 
-        }
+    share_configuration( process );
+    share_kafka_configuration( process );
+    decode_functionality = pipeline.decode;
+    consumed_topics = { pipeline.consumer_topic };
+    published_topic_name = pipeline.producer_topic;
 
-        logger->info(output_msg_stream.str());
+    if ( conf->set( "group.id", pipeline.group_id, error_string ) != RdKafka::Conf::CONF_OK ) {
+        logger->error(fnname + ": pipeline " + pipeline.name + ": cannot set group.id: " + error_string);
+        return false;
+    }
 
-        // Send output directly to stdout.
-        std::cout << output_msg_stream.str() << std::endl;
+    if ( !pipeline.routes.empty() ) {
+        topic_router.reset( new Topic_Router{ published_topic_name } );
+        for ( const auto& route : pipeline.routes ) {
+            if ( !topic_router->add( route.first, route.second, error_string ) ) {
+                logger->error(fnname + ": pipeline " + pipeline.name + ": invalid route: " + error_string);
+                return false;
+            }
+        }
+    }
 
-    } else {
-        logger->trace("Read an empty file.");
+    if ( !configure_outputs( pipeline.outputs, error_string ) ) {
+        logger->error(fnname + ": pipeline " + pipeline.name + ": invalid fan-out output: " + error_string);
+        return false;
     }
 
-    // NOTE: good for troubleshooting, but bad for performance.
-    logger->trace(fnname + ": Finished.");
-    logger->flush();
+    producer_ptr = process.producer_ptr;
+    producer_shared = true;
+    dead_letter = process.dead_letter;
+    return true;
+}
 
-    return r ? EXIT_SUCCESS : EXIT_FAILURE;
+void ASN1_Codec::share_kafka_configuration( const ASN1_Codec& process ) {
+    std::string error_string;
+
+    offset = process.offset;
+    exit_eof = process.exit_eof;
+    consumer_timeout = process.consumer_timeout;
+    processing_time_header = process.processing_time_header;
+    propagate_headers = process.propagate_headers;
+    raw_header = process.raw_header;
+    output_key = process.output_key;
+    partition_parallel = process.partition_parallel;
+    dead_letter_topic = process.dead_letter_topic;
+    dead_letter_rate = process.dead_letter_rate;
+    error_log_rate = process.error_log_rate;
+    error_log_limiter.reset( new Error_Rate_Limiter{ error_log_rate } );
+
+    // the consumer needs a configuration of its own for its group; callbacks are not copied.
+    conf = RdKafka::Conf::create( RdKafka::Conf::CONF_GLOBAL );
+    tconf = RdKafka::Conf::create( RdKafka::Conf::CONF_TOPIC );
+    for ( auto copy : { std::make_pair( process.conf, conf ), std::make_pair( process.tconf, tconf ) } ) {
+        std::unique_ptr<std::list<std::string>> properties{ copy.first->dump() };
+        for ( auto it = properties->begin(); it != properties->end(); ) {
+            const std::string& name = *it++;
+            if ( it == properties->end() ) break;
+            const std::string& value = *it++;
+            copy.second->set( name, value, error_string );          // read only and callback properties are refused.
+        }
+    }
+    conf->set( "default_topic_conf", tconf, error_string );
 }
 
+bool ASN1_Codec::configure_partition_worker( const ASN1_Codec& consumer ) {
+    share_configuration( consumer );
+    share_kafka_configuration( consumer );
+    decode_functionality = consumer.decode_functionality;
+    consumed_topics = consumer.consumed_topics;
+    published_topic_name = consumer.published_topic_name;
+    if ( consumer.topic_router ) topic_router.reset( new Topic_Router{ *consumer.topic_router } );
+    outputs = consumer.outputs;
+    output_routes = consumer.output_routes;
+    route_slots = consumer.route_slots;
+
+    // the consumer's codec logs the stage latencies; they are process wide.
+    stage_log_seconds = 0;
+    producer_ptr = consumer.producer_ptr;
+    producer_shared = true;
+    dead_letter = consumer.dead_letter;
+    return launch_producer();
+}
 
-int ASN1_Codec::operator()(void) {
-    const std::string fnname = "run()";
+bool ASN1_Codec::run_pipelines() {
+    const std::string fnname = "run_pipelines()";
 
-    RdKafka::ErrorCode status;
-    std::string error_string;
-    bool success = false;
+    // one producer, and one set of librdkafka producer threads, for every pipeline.
+    while ( bootstrap && !create_producer() ) {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1500 ) );
+    }
+    if ( !bootstrap ) return true;
 
-    std::stringstream output_msg_stream;
+    // every worker is configured before any starts, so a bad pipeline stops the process before it consumes anything.
+    std::vector<std::unique_ptr<ASN1_Codec>> workers;
+    for ( const auto& pipeline : pipelines ) {
+        for ( int i = 0; i < pipeline.workers; ++i ) {
+            std::unique_ptr<ASN1_Codec> worker{ new ASN1_Codec{ name(), description() } };
+            if ( !worker->configure_worker( *this, pipeline ) ) {
+                logger->critical(fnname + ": pipeline " + pipeline.name + " could not be configured; no pipeline runs.");
+                return false;
+            }
 
-    signal(SIGINT, sigterm);
-    signal(SIGTERM, sigterm);
-    
-    try {
+            // one worker logs the stage latencies; they are process wide.
+            worker->stage_log_seconds = workers.empty() ? stage_log_seconds : 0;
+            workers.push_back( std::move( worker ) );
+        }
+    }
 
-        // throws for a couple of options.
-        if ( !configure() ) return EXIT_FAILURE;
+    // the route counters are process wide: label them with every pipeline's topics.
+    std::vector<std::string> topics;
+    for ( auto& worker : workers ) {
+        const std::vector<std::string> routes = worker->topic_router ? worker->topic_router->topics() : std::vector<std::string>{ worker->published_topic_name };
+        for ( const auto& topic : routes ) {
+            auto it = std::find( topics.begin(), topics.end(), topic );
+            worker->route_slots.push_back( static_cast<std::size_t>( it - topics.begin() ) );
+            if ( it == topics.end() ) topics.push_back( topic );
+        }
+    }
+    metrics::Registry::instance().set_route_names( topics );
 
-    } catch ( std::exception& e ) {
-        logger->error(fnname + ": Fatal Exception: " + std::string(e.what()));
-        return EXIT_FAILURE;
+    std::vector<std::thread> threads;
+    for ( auto& worker : workers ) {
+        threads.emplace_back( [&worker]() { worker->consume_produce(); } );
     }
+    logger->info(fnname + ": " + std::to_string( workers.size() ) + " worker(s) running " + std::to_string( pipelines.size() ) + " pipeline(s).");
 
+    for ( auto& thread : threads ) thread.join();
+
+    for ( auto& worker : workers ) {
+        msg_recv_count += worker->msg_recv_count;
+        msg_recv_bytes += worker->msg_recv_bytes;
+        msg_send_count += worker->msg_send_count;
+        msg_send_bytes += worker->msg_send_bytes;
+        logger->info(fnname + ": " + worker->consumed_topics[0] + " to " + worker->published_topic_name + ": consumed "
+                + std::to_string( worker->msg_recv_count ) + " and published " + std::to_string( worker->msg_send_count ) + " blocks.");
+    }
+
+    return true;
+}
+
+/**
+ * Bootstrap the consumer and the output topics, then consume, decode or encode, and produce until a signal stops the
+ * process. A pipeline worker runs this on a thread of its own; everything it touches belongs to this codec except the
+ * shared producer, which librdkafka makes safe to produce to and poll from any thread.
+ */
+void ASN1_Codec::consume_produce() {
     while (bootstrap) {
         // reset flag here, or else nothing works below
         data_available = true;
@@ -1881,153 +3289,434 @@ int ASN1_Codec::operator()(void) {
             continue;
         }
 
-        // consume-produce loop.
-        while (data_available) {
+        // consume-produce loop. Partition workers take the records of their partitions from queues of their own;
+        // this loop then serves rebalances and consumer errors, and records of partitions without a worker.
+        while (data_available && bootstrap) {
 
             std::unique_ptr<RdKafka::Message> msg{ consumer_ptr->consume( consumer_timeout ) };
+            uint64_t consumed_ns = metrics::now_ns();
+
+            bool done = handle_message( *msg, consumed_ns );
+
+            if ( partition_parallel && msg->err() == RdKafka::ERR_NO_ERROR ) {
+                std::unique_ptr<RdKafka::TopicPartition> position{ RdKafka::TopicPartition::create( msg->topic_name(), msg->partition() ) };
+                store_offset( consumer_ptr.get(), *position, *msg, done );
+            }
 
-            try {
+            poll_producers();
+        }
 
-                success = process_message( msg.get(), output_msg_stream );          // throws.
+        stop_partition_workers( nullptr );
 
-            } catch (const UnparseableInputError& e) {
+        // with exit_eof, done once every assigned partition has been read to its end; errors bootstrap again.
+        std::lock_guard<std::mutex> lock{ eof_mutex };
+        if ( exit_eof && partition_cnt > 0 && eof_partitions.size() >= partition_cnt ) break;
+    }
 
-                logger->error(fnname + ": UnparseableInputError " + e.what() );
-                add_error_xml( error_doc, e.data_type(), e.error_type(), e.what(), true );
-                error_doc.save(output_msg_stream,"",pugi::format_raw);
+}
 
-            } catch (const MissingInputElementError& e) {
+bool ASN1_Codec::handle_message( RdKafka::Message& msg, uint64_t consumed_ns ) {
+    const std::string fnname = "run()";
 
-                logger->error(fnname + ": MissingInputElementError " + e.what() );
-                add_error_xml( error_doc, e.data_type(), e.error_type(), e.what(), true );
-                error_doc.save(output_msg_stream,"",pugi::format_raw);
+    codec_status.clear();
+    bool success = process_message( &msg, output_msg_stream, codec_status );
+    bool dead_lettered = false;
+    bool done = true;
 
-            } catch (const pugi::xpath_exception& e ) {
+    if ( success && filtered() ) {
+        msg_filt_count++;
+        msg_filt_bytes += msg.len();
+        metrics::Registry::instance().increment( metrics::Counter::MESSAGES_FILTERED );
+        metrics::StageTrace::local().discard();
+    }
 
-                logger->error(fnname + ": pugi::xpath_exception " + e.what() );
-                add_error_xml( error_doc, Asn1DataType::ODE, Asn1ErrorType::REQUEST, e.what(), true );
-                error_doc.save(output_msg_stream,"",pugi::format_raw);
+    if ( !codec_status.ok() ) {
+        if ( error_log_limiter->allow( codec_status.kind(), consumed_ns ) ) {
+            uint64_t suppressed = error_log_limiter->take_suppressed( codec_status.kind() );
+            logger->error(fnname + ": " + codec_status.name() + " " + codec_status.message()
+                    + ( suppressed ? " (" + std::to_string(suppressed) + " more suppressed)" : std::string{} ) );
+        } else {
+            metrics::Registry::instance().increment( metrics::Counter::ERROR_LOGS_SUPPRESSED );
+        }
 
-            } catch (const Asn1CodecError& e) {
+        metrics::StageTrace::local().discard();
+        metrics::Registry::instance().error( static_cast<std::size_t>(codec_status.error_type()) );
 
-                logger->error(fnname + ": Asn1CodecError " + e.what());
-                add_error_xml( input_doc, e.data_type(), e.error_type(), e.what(), false );
-                input_doc.save(output_msg_stream,"",pugi::format_raw);
+        if ( dead_letter ) {
+            // failures go to the dead-letter topic only; the output topic carries valid results.
+            done = dead_letter->publish( msg, codec_status, propagate_headers, consumed_ns );
+            dead_lettered = true;
+        } else {
+            write_error( codec_status, output_msg_stream );
+        }
+    }
+
+    if ( msg.len() > 0 && !dead_lettered && !( success && filtered() ) ) {
+
+        logger->trace(fnname + ": " + std::to_string(msg.len()) + " bytes consumed from topic: " + msg.topic_name() );
 
+        // one decode, any number of renderings: each fan-out output goes to its own topic.
+        bool fan_out = codec_status.ok() && !outputs.empty();
+        bool produced = false;
+
+        for ( std::size_t output = 0; output < ( fan_out ? outputs.size() : 1 ); ++output ) {
+            std::size_t route = Topic_Router::kDefaultRoute;
+
+            if ( fan_out ) {
+                output_msg_string.clear();
+                if ( !render_output( output, output_msg_string ) ) continue;
+                route = output_routes[output];
+            } else {
+                output_msg_string = output_msg_stream.str();
+                // the messageId was read by the decode or encode itself; routing costs no extra parsing.
+                if ( topic_router ) route = codec_status.ok() ? topic_router->route( codec_status.message_id() ) : topic_router->route( codec_status );
             }
 
-            if ( msg->len() > 0 ) {
+            if ( produce_output( msg, route, output_msg_string, consumed_ns ) ) {
+                produced = true;
+            } else {
+                done = false;
+            }
+        }
 
-                logger->trace(fnname + ": " + std::to_string(msg->len()) + " bytes consumed from topic: " + consumed_topics[0] );
+        if ( produced ) {
+            metrics::StageTrace::local().commit( decode_functionality ? metrics::Direction::DECODE : metrics::Direction::ENCODE );
+            metrics::Registry::instance().latency( metrics::Latency::CONSUME_TO_PRODUCE, metrics::now_ns() - consumed_ns );
+            logger->trace(fnname + ": successful encoding/decoding");
+        }
 
-                std::string output_msg_string = output_msg_stream.str();
-                status = producer_ptr->produce(published_topic_ptr.get(), partition, RdKafka::Producer::RK_MSG_COPY, (void *)output_msg_string.c_str(), output_msg_string.size(), NULL, NULL);
+        // clear out the stream
+        output_msg_stream.str("");
+        output_msg_stream.clear();
+    } 
 
-                if (status != RdKafka::ERR_NO_ERROR) {
-                    logger->error(fnname + ": Failure of XER encoding: " + RdKafka::err2str(status));
+    return done;
+}
 
-                } else {
-                    // successfully sent; update counters.
-                    msg_send_count++;
-                    msg_send_bytes += output_msg_string.size();
-                    logger->trace(fnname + ": successful encoding/decoding");
-                    logger->trace(fnname + ": " + std::to_string(output_msg_string.size()) + " bytes produced to topic: " + published_topic_ptr->name());
-                }
+void ASN1_Codec::store_offset( RdKafka::KafkaConsumer* consumer, RdKafka::TopicPartition& position, RdKafka::Message& msg, bool done ) {
+    const std::string fnname = "store_offset()";
+
+    if ( done ) {
+        // stored once the output is queued; the consumer commits stored offsets only.
+        std::vector<RdKafka::TopicPartition*> stored{ &position };
+        position.set_offset( msg.offset() + 1 );
+        consumer->offsets_store( stored );
+        return;
+    }
+
+    // a later offset would commit past this record too; consume it again instead, from the broker.
+    logger->warn(fnname + ": " + msg.topic_name() + "/" + std::to_string( msg.partition() ) + " offset " + std::to_string( msg.offset() )
+            + " could not be produced; consuming it again.");
+    position.set_offset( msg.offset() );
+    RdKafka::ErrorCode status = consumer->seek( position, 0 );
+    if ( status ) logger->error(fnname + ": seek failed: " + RdKafka::err2str( status ));
+}
+
+void ASN1_Codec::poll_producers() {
+    const std::string fnname = "run()";
 
-                // clear out the stream
-                output_msg_stream.str("");
-                output_msg_stream.clear();
-            } 
+    // serves delivery reports; never blocks.
+    producer_ptr->poll(0);
+    if ( dead_letter ) dead_letter->poll();
 
-            // NOTE: good for troubleshooting, but bad for performance.
-            logger->flush();
+    if ( stage_log_seconds > 0 && metrics::stages_enabled() ) {
+        auto now = std::chrono::steady_clock::now();
+        if ( now - last_stage_log >= std::chrono::seconds( stage_log_seconds ) ) {
+            for ( const auto& line : metrics::Registry::instance().stage_report() ) {
+                logger->info(fnname + ": stage latency " + line);
+            }
+            last_stage_log = now;
         }
     }
 
-    logger->info("ASN1_Codec operations complete; shutting down...");
-    logger->info("ASN1_Codec consumed  : " + std::to_string(msg_recv_count) + " blocks and " + std::to_string(msg_recv_bytes) + " bytes");
-    logger->info("ASN1_Codec published : " + std::to_string(msg_send_count) + " blocks and " + std::to_string(msg_send_bytes) + " bytes");
-    return EXIT_SUCCESS;
+    // NOTE: good for troubleshooting, but bad for performance.
+    logger->flush();
 }
 
-const char* ASN1_Codec::getEnvironmentVariable(const char* variableName) {
-    const char* toReturn = std::getenv(variableName);
-    if (!toReturn) {
-        toReturn = "";
+void AcmRebalanceCb::rebalance_cb( RdKafka::KafkaConsumer* consumer, RdKafka::ErrorCode err, std::vector<RdKafka::TopicPartition*>& partitions ) {
+    codec_.rebalance( consumer, err, partitions );
+}
+
+void ASN1_Codec::rebalance( RdKafka::KafkaConsumer* consumer, RdKafka::ErrorCode err, std::vector<RdKafka::TopicPartition*>& partitions ) {
+    const std::string fnname = "rebalance()";
+
+    // the cooperative protocol hands out and takes back a few partitions at a time; the eager one all of them.
+    const bool cooperative = consumer->rebalance_protocol() == "COOPERATIVE";
+
+    if ( err == RdKafka::ERR__ASSIGN_PARTITIONS ) {
+        logger->info(fnname + ": " + std::to_string( partitions.size() ) + " partition(s) assigned.");
+
+        // the queues are split off before assignment, so no record of a partition with a worker reaches the consumer's.
+        if ( partition_parallel ) start_partition_workers( consumer, partitions );
+
+        if ( cooperative ) {
+            std::unique_ptr<RdKafka::Error> error{ consumer->incremental_assign( partitions ) };
+            if ( error ) logger->error(fnname + ": incremental assign failed: " + error->str());
+        } else {
+            RdKafka::ErrorCode status = consumer->assign( partitions );
+            if ( status ) logger->error(fnname + ": assign failed: " + RdKafka::err2str( status ));
+        }
+
+        std::lock_guard<std::mutex> lock{ eof_mutex };
+        partition_cnt = cooperative ? partition_cnt + partitions.size() : partitions.size();
+        if ( !cooperative ) eof_partitions.clear();
+        return;
     }
-    return toReturn;
+
+    if ( err == RdKafka::ERR__REVOKE_PARTITIONS ) {
+        logger->info(fnname + ": " + std::to_string( partitions.size() ) + " partition(s) revoked.");
+
+        // the records taken from the revoked partitions are finished and their output delivered before the offsets
+        // are committed, so the next owner neither repeats nor skips any.
+        if ( partition_parallel ) stop_partition_workers( &partitions );
+        if ( producer_ptr ) producer_ptr->flush( 5000 );
+        if ( dead_letter ) dead_letter->flush( 5000 );
+
+        RdKafka::ErrorCode status = consumer->commitSync();
+        if ( status ) logger->trace(fnname + ": nothing committed: " + RdKafka::err2str( status ));
+
+        if ( cooperative ) {
+            std::unique_ptr<RdKafka::Error> error{ consumer->incremental_unassign( partitions ) };
+            if ( error ) logger->error(fnname + ": incremental unassign failed: " + error->str());
+        } else {
+            consumer->unassign();
+        }
+
+        std::lock_guard<std::mutex> lock{ eof_mutex };
+        for ( RdKafka::TopicPartition* partition : partitions ) {
+            eof_partitions.erase( std::make_pair( partition->topic(), static_cast<int32_t>( partition->partition() ) ) );
+        }
+        partition_cnt = cooperative && partition_cnt > partitions.size() ? partition_cnt - partitions.size() : 0;
+        return;
+    }
+
+    logger->error(fnname + ": rebalance failed: " + RdKafka::err2str( err ));
+    if ( partition_parallel ) stop_partition_workers( nullptr );
+    consumer->unassign();
+
+    std::lock_guard<std::mutex> lock{ eof_mutex };
+    eof_partitions.clear();
+    partition_cnt = 0;
 }
 
-#ifndef _ASN1_CODEC_TESTS
+void ASN1_Codec::start_partition_workers( RdKafka::KafkaConsumer* consumer, const std::vector<RdKafka::TopicPartition*>& partitions ) {
+    const std::string fnname = "start_partition_workers()";
 
-int main( int argc, char* argv[] )
-{
-    ASN1_Codec asn1_codec{"ASN1_Codec","ASN1 Processing Module"};
-
-    asn1_codec.addOption( 'c', "config", "Configuration file name and path.", true );
-    asn1_codec.addOption( 'C', "config-check", "Check the configuration file contents and output the settings.", false );
-    asn1_codec.addOption( 't', "produce-topic", "The name of the topic to produce.", true );
-    asn1_codec.addOption( 'p', "partition", "Consumer topic partition from which to read.", true );
-    asn1_codec.addOption( 'g', "group", "Consumer group identifier", true );
-    asn1_codec.addOption( 'b', "broker", "Broker address (localhost:9092)", true );
-    asn1_codec.addOption( 'o', "offset", "Byte offset to start reading in the consumed topic.", true );
-    asn1_codec.addOption( 'x', "exit", "Exit consumer when last message in partition has been received.", false );
-    asn1_codec.addOption( 'd', "debug", "debug level.", true );
-    asn1_codec.addOption( 'v', "log-level", "The info log level [trace,debug,info,warning,error,critical,off]", true );
-    asn1_codec.addOption( 'D', "log-dir", "Directory for the log files.", true );
-    asn1_codec.addOption( 'R', "log-rm", "Remove specified/default log files if they exist.", false );
-    asn1_codec.addOption( 'i', "log", "Log file name.", true );
-    asn1_codec.addOption( 'h', "help", "print out some help" );
-    asn1_codec.addOption( 'F', "infile", "accept a file and bypass kafka.", false );
-    asn1_codec.addOption( 'T', "codec-type", "The type of codec to use: decode or encode; defaults to decode", true );
-    asn1_codec.addOption( 'H', "http-server", "Run http server instead of Kafka.", false);
-
-    // debug for ASN.1
-    // opt_debug = 0;
-
-    if (!asn1_codec.parseArgs(argc, argv)) {
-        asn1_codec.usage();
-        std::exit( EXIT_FAILURE );
-    }
-
-    if (asn1_codec.optIsSet('h')) {
-        asn1_codec.help();
-        std::exit( EXIT_SUCCESS );
-    }
-
-    // can set levels if needed here.
-    if ( !asn1_codec.setup_logger( asn1_codec.optIsSet('R') )) {
-        std::exit( EXIT_FAILURE );
-    }
-
-    // configuration check.
-    if (asn1_codec.optIsSet('C')) {
-        try {
-            if (asn1_codec.configure()) {
-                asn1_codec.print_configuration();
-                std::exit( EXIT_SUCCESS );
-            } else {
-                asn1_codec.logger->error( "current configuration settings do not work; exiting." );
-                std::exit( EXIT_FAILURE );
+    for ( RdKafka::TopicPartition* partition : partitions ) {
+        const std::string name = partition->topic() + "/" + std::to_string( partition->partition() );
+
+        std::unique_ptr<Partition_Worker> worker{ new Partition_Worker };
+        worker->codec.reset( new ASN1_Codec{ this->name(), description() } );
+        if ( !worker->codec->configure_partition_worker( *this ) ) {
+            // its records stay on the consumer's queue, which this codec serves.
+            logger->error(fnname + ": no worker for partition " + name + "; the consumer serves it.");
+            continue;
+        }
+
+        worker->queue.reset( consumer->get_partition_queue( partition ) );
+        if ( !worker->queue ) {
+            logger->error(fnname + ": no queue for partition " + name + "; the consumer serves it.");
+            continue;
+        }
+
+        // the partition's records stay on its queue for its worker instead of going to the consumer's queue.
+        worker->queue->forward( nullptr );
+        worker->position.reset( RdKafka::TopicPartition::create( partition->topic(), partition->partition() ) );
+        worker->consumer = consumer;
+
+        Partition_Worker* serving = worker.get();
+        worker->thread = std::thread( [this, serving]() { consume_partition( *serving ); } );
+        partition_workers.push_back( std::move( worker ) );
+        logger->info(fnname + ": worker started for partition " + name + ".");
+    }
+}
+
+void ASN1_Codec::stop_partition_workers( const std::vector<RdKafka::TopicPartition*>* partitions ) {
+    const std::string fnname = "stop_partition_workers()";
+
+    auto revoked = [partitions]( const Partition_Worker& worker ) {
+        if ( !partitions ) return true;
+        for ( RdKafka::TopicPartition* partition : *partitions ) {
+            if ( partition->partition() == worker.position->partition() && partition->topic() == worker.position->topic() ) return true;
+        }
+        return false;
+    };
+
+    // all are told first, so they finish their records together.
+    for ( auto& worker : partition_workers ) {
+        if ( revoked( *worker ) ) worker->running = false;
+    }
+
+    for ( auto it = partition_workers.begin(); it != partition_workers.end(); ) {
+        Partition_Worker& worker = **it;
+        if ( worker.running ) {
+            ++it;
+            continue;
+        }
+
+        worker.thread.join();
+
+        // the consumer still holds the partition when it stops on an error; it serves the partition from here on.
+        if ( !partitions ) {
+            std::unique_ptr<RdKafka::Queue> consumer_queue{ worker.consumer->get_consumer_queue() };
+            worker.queue->forward( consumer_queue.get() );
+        }
+
+        msg_recv_count += worker.codec->msg_recv_count;
+        msg_recv_bytes += worker.codec->msg_recv_bytes;
+        msg_send_count += worker.codec->msg_send_count;
+        msg_send_bytes += worker.codec->msg_send_bytes;
+        msg_filt_count += worker.codec->msg_filt_count;
+        msg_filt_bytes += worker.codec->msg_filt_bytes;
+        logger->info(fnname + ": worker stopped for partition " + worker.position->topic() + "/" + std::to_string( worker.position->partition() )
+                + ": consumed " + std::to_string( worker.codec->msg_recv_count ) + " and published " + std::to_string( worker.codec->msg_send_count ) + " blocks.");
+
+        it = partition_workers.erase( it );
+    }
+}
+
+void ASN1_Codec::consume_partition( Partition_Worker& worker ) {
+    bool at_eof = false;
+
+    while ( worker.running && worker.codec->data_available && data_available && bootstrap ) {
+        std::unique_ptr<RdKafka::Message> msg{ worker.queue->consume( consumer_timeout ) };
+        if ( !msg ) continue;
+        uint64_t consumed_ns = metrics::now_ns();
+
+        switch ( msg->err() ) {
+            case RdKafka::ERR__TIMED_OUT:
+                break;
+
+            case RdKafka::ERR__PARTITION_EOF:
+                if ( !at_eof ) partition_eof( worker.position->topic(), worker.position->partition(), true );
+                at_eof = true;
+                break;
+
+            case RdKafka::ERR_NO_ERROR:
+                if ( at_eof ) partition_eof( worker.position->topic(), worker.position->partition(), false );
+                at_eof = false;
+
+                {
+                    bool done = worker.codec->handle_message( *msg, consumed_ns );
+                    worker.codec->store_offset( worker.consumer, *worker.position, *msg, done );
+                }
+                break;
+
+            default:
+                worker.codec->logger->error("partition " + worker.position->topic() + "/" + std::to_string( worker.position->partition() ) + ": " + msg->errstr());
+        }
+
+        worker.codec->poll_producers();
+    }
+}
+
+void ASN1_Codec::partition_eof( const std::string& topic, int32_t partition, bool eof ) {
+    if ( !exit_eof ) return;
+
+    std::lock_guard<std::mutex> lock{ eof_mutex };
+    if ( !eof ) {
+        eof_partitions.erase( std::make_pair( topic, partition ) );
+        return;
+    }
+
+    eof_partitions.insert( std::make_pair( topic, partition ) );
+    if ( partition_cnt > 0 && eof_partitions.size() >= partition_cnt ) {
+        logger->info("EOF reached for all " + std::to_string(partition_cnt) + " partition(s)");
+        data_available = false;
+    }
+}
+
+bool ASN1_Codec::produce_output( RdKafka::Message& input, std::size_t route, const std::string& value, uint64_t consumed_ns ) {
+    const std::string fnname = "run()";
+    const std::string& topic_name = route == Topic_Router::kDefaultRoute ? published_topic_name : topic_router->topic(route);
+    RdKafka::ErrorCode status;
+
+    {
+        metrics::ScopedStage stage{ metrics::Stage::PRODUCE };
+
+        RdKafka::Headers* input_headers = propagate_headers ? input.headers() : nullptr;
+
+        // no partition is given: the partitioner spreads records by key, and records with one key keep their order.
+        const void* key = nullptr;
+        std::size_t key_size = 0;
+        if ( output_key == Output_Key::ENTITY && !entity_key_.empty() ) {
+            key = entity_key_.data();
+            key_size = entity_key_.size();
+        } else if ( output_key != Output_Key::NONE && input.key_pointer() ) {
+            key = input.key_pointer();
+            key_size = input.key_len();
+        }
+
+        if ( processing_time_header.empty() && ( !input_headers || input_headers->size() == 0 ) ) {
+            RdKafka::Topic* topic = route == Topic_Router::kDefaultRoute ? published_topic_ptr.get() : route_topics[route].get();
+            status = producer_ptr->produce(topic, RdKafka::Topic::PARTITION_UA, RdKafka::Producer::RK_MSG_COPY, (void *)value.c_str(), value.size(), key, key_size, NULL);
+        } else {
+            // headers are only accepted by the topic name overload; on success librdkafka owns them.
+            RdKafka::Headers* headers = input_headers ? RdKafka::Headers::create( input_headers->get_all() ) : RdKafka::Headers::create();
+            if ( !processing_time_header.empty() ) {
+                headers->add( processing_time_header, std::to_string( (metrics::now_ns() - consumed_ns) / 1000 ) );
             }
-        } catch ( std::exception& e ) {
-            asn1_codec.logger->error("Fatal Exception: " + std::string(e.what()));
-            std::exit( EXIT_FAILURE );
+            status = producer_ptr->produce(topic_name, RdKafka::Topic::PARTITION_UA, RdKafka::Producer::RK_MSG_COPY, (void *)value.c_str(), value.size(), key, key_size, 0, headers, NULL);
+            if (status != RdKafka::ERR_NO_ERROR) delete headers;
         }
     }
 
-    if (asn1_codec.optIsSet('H')) {
-        // Run HTTP server
-        asn1_codec.logger->info("Run HTTP Server");
-        Http_Server server(asn1_codec);
-        std::exit( server.http_server() );
-    } else if (asn1_codec.optIsSet('F')) {
-        // Only used when an input file is specified.
-        std::exit( asn1_codec.filetest() );
+    if (status != RdKafka::ERR_NO_ERROR) {
+        logger->error(fnname + ": Failure of XER encoding: " + RdKafka::err2str(status));
+        return false;
+    }
+
+    // successfully sent; update counters.
+    msg_send_count++;
+    msg_send_bytes += value.size();
+    metrics::Registry::instance().increment( metrics::Counter::MESSAGES_PUBLISHED );
+    metrics::Registry::instance().increment( metrics::Counter::BYTES_PUBLISHED, value.size() );
+    metrics::Registry::instance().routed( route_slots.empty() ? route : route_slots[route], value.size() );
+    logger->trace(fnname + ": " + std::to_string(value.size()) + " bytes produced to topic: " + topic_name );
+    return true;
+}
+
+int ASN1_Codec::operator()(void) {
+    const std::string fnname = "run()";
+
+    signal(SIGINT, sigterm);
+    signal(SIGTERM, sigterm);
+    
+    try {
+
+        // throws for a couple of options.
+        if ( !configure() ) return EXIT_FAILURE;
+
+    } catch ( std::exception& e ) {
+        logger->error(fnname + ": Fatal Exception: " + std::string(e.what()));
+        return EXIT_FAILURE;
+    }
+
+    if ( metrics_port > 0 ) {
+        metrics_server.reset( new Metrics_Server{} );
+        if ( !metrics_server->start( metrics_port ) ) metrics_server.reset();
+    }
+
+    bool ran = true;
+    if ( pipelines.empty() ) {
+        consume_produce();
     } else {
-        // The module will run and when it terminates return an appropriate error code.
-        std::exit( asn1_codec.run() );
+        ran = run_pipelines();
     }
+
+    if ( producer_ptr ) producer_ptr->flush( 5000 );
+    if ( metrics_server ) metrics_server->stop();
+
+    logger->info("ASN1_Codec operations complete; shutting down...");
+    logger->info("ASN1_Codec consumed  : " + std::to_string(msg_recv_count) + " blocks and " + std::to_string(msg_recv_bytes) + " bytes");
+    logger->info("ASN1_Codec published : " + std::to_string(msg_send_count) + " blocks and " + std::to_string(msg_send_bytes) + " bytes");
+    return ran ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-#endif
+const char* ASN1_Codec::getEnvironmentVariable(const char* variableName) {
+    const char* toReturn = std::getenv(variableName);
+    if (!toReturn) {
+        toReturn = "";
+    }
+    return toReturn;
+}
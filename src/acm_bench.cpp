@@ -0,0 +1,449 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2017 US DOT - Joint Program Office
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Codec microbenchmarks over the bundled sample corpus.
+ *
+ * Every benchmark times each operation separately and writes one JSON object per line:
+ *
+ *     {"bench":"asn_decode","name":"BSM","pdu":"MessageFrame","encoding":"uper","bytes":187,"iterations":20000,
+ *      "ops_per_sec":...,"mb_per_sec":...,"mean_ns":...,"p50_ns":...,"p90_ns":...,"p99_ns":...,"p999_ns":...,"max_ns":...}
+ *
+ * Stages measured for each binary sample (data/bench/corpus.hex): hex_to_bytes, asn_decode, constraint_check,
+ * xer_encode, json_encode, xer_decode, asn_encode, and, for MessageFrames, the full decode_messageframe_bytes path. MessageFrames
+ * are re-encoded to COER at startup so both UPER and COER decode are covered.
+ *
+ * Stages measured for each ODE XML or JSON envelope (data/bench/envelopes.txt): envelope_parse, serialize, and the full
+ * decode_message or encode_message path through ASN1_Codec::process_envelope.
+ */
+
+#include "acm.hpp"
+#include "acm_metrics.hpp"
+#include "json_encoder.hpp"
+#include "json_envelope.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+int buffer_append(const void *buffer, size_t size, void *app_key) {
+    buffer_structure_t *xb = static_cast<buffer_structure_t *>(app_key);
+
+    if (xb->buffer_size + size + 1 > xb->allocated_size) {
+        size_t new_size = 2 * (xb->allocated_size ? xb->allocated_size : 64);
+        while (xb->buffer_size + size + 1 > new_size) new_size *= 2;
+        char *new_buf = static_cast<char *>(std::realloc(xb->buffer, new_size));
+        if (!new_buf) return -1;
+        xb->buffer = new_buf;
+        xb->allocated_size = new_size;
+    }
+
+    std::memcpy(xb->buffer + xb->buffer_size, buffer, size);
+    xb->buffer_size += size;
+    xb->buffer[xb->buffer_size] = '\0';
+    return 0;
+}
+
+struct CorpusSample {
+    std::string name;
+    std::string pdu;
+    std::string encoding;
+    asn_TYPE_descriptor_t* type;
+    enum asn_transfer_syntax syntax;
+    std::string hex;
+    std::vector<char> bytes;
+};
+
+struct Envelope {
+    std::string name;
+    bool encode;
+    std::string path;
+    std::string xml;
+};
+
+asn_TYPE_descriptor_t* pdu_type(const std::string& pdu) {
+    if (pdu == "MessageFrame") return &asn_DEF_MessageFrame;
+    if (pdu == "Ieee1609Dot2Data") return &asn_DEF_Ieee1609Dot2Data;
+    if (pdu == "AdvisorySituationData") return &asn_DEF_AdvisorySituationData;
+    return nullptr;
+}
+
+}  // end namespace.
+
+class ACMBench : public tool::Tool {
+    public:
+        ACMBench(const std::string& name, const std::string& description) :
+            Tool{ name, description, false }
+            , codec{ "acm_bench", "ASN1_Codec under benchmark" }
+        {}
+
+        int operator()(void) override;
+
+    private:
+        ASN1_Codec codec;
+        std::ostream* out = &std::cout;
+        std::string root = ".";
+        std::string filter;
+        int iterations = 10000;
+        int warmup = 200;
+        bool stage_metrics = false;
+
+        bool selected(const std::string& bench, const std::string& name) const;
+        bool load_samples(const std::string& path, std::vector<CorpusSample>& samples);
+        bool load_envelopes(const std::string& path, std::vector<Envelope>& envelopes);
+        void add_coer_samples(std::vector<CorpusSample>& samples);
+
+        template <typename Op>
+        void measure(const std::string& bench, const std::string& name, const std::string& pdu, const std::string& encoding, std::size_t bytes, Op&& op);
+
+        void report_error(const std::string& bench, const std::string& name, const std::string& message);
+
+        void bench_sample(const CorpusSample& s);
+        void bench_envelope(const Envelope& e);
+};
+
+bool ACMBench::selected(const std::string& bench, const std::string& name) const {
+    return filter.empty() || bench.find(filter) != std::string::npos || name.find(filter) != std::string::npos;
+}
+
+bool ACMBench::load_samples(const std::string& path, std::vector<CorpusSample>& samples) {
+    std::ifstream in{ path };
+    if (!in) {
+        std::cerr << "cannot open corpus: " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields{ line };
+        CorpusSample s;
+        fields >> s.name >> s.pdu >> s.encoding >> s.hex;
+
+        s.type = pdu_type(s.pdu);
+        if (!s.type || s.hex.empty()) {
+            report_error("load", s.name, "unknown pdu or missing hex: " + s.pdu);
+            continue;
+        }
+
+        s.syntax = (s.encoding == "coer") ? ATS_CANONICAL_OER : ATS_UNALIGNED_BASIC_PER;
+        if (!codec.hex_to_bytes_(s.hex, s.bytes)) {
+            report_error("load", s.name, "invalid hex");
+            continue;
+        }
+        samples.push_back(std::move(s));
+    }
+    return true;
+}
+
+bool ACMBench::load_envelopes(const std::string& path, std::vector<Envelope>& envelopes) {
+    std::ifstream in{ path };
+    if (!in) {
+        std::cerr << "cannot open envelope list: " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields{ line };
+        Envelope e;
+        std::string direction;
+        fields >> e.name >> direction >> e.path;
+        e.encode = (direction == "encode");
+
+        std::ifstream xml{ root + "/" + e.path };
+        if (!xml) {
+            report_error("load", e.name, "cannot open " + e.path);
+            continue;
+        }
+        std::ostringstream contents;
+        contents << xml.rdbuf();
+        e.xml = contents.str();
+        envelopes.push_back(std::move(e));
+    }
+    return true;
+}
+
+void ACMBench::add_coer_samples(std::vector<CorpusSample>& samples) {
+    std::vector<CorpusSample> coer;
+
+    for (const auto& s : samples) {
+        if (s.type != &asn_DEF_MessageFrame || s.syntax != ATS_UNALIGNED_BASIC_PER) continue;
+
+        void* structure = nullptr;
+        asn_dec_rval_t rval = asn_decode(0, s.syntax, s.type, &structure, s.bytes.data(), s.bytes.size());
+        if (rval.code != RC_OK) {
+            ASN_STRUCT_FREE(*s.type, structure);
+            continue;
+        }
+
+        buffer_structure_t xb = {0, 0, 0};
+        asn_enc_rval_t erval = asn_encode(0, ATS_CANONICAL_OER, s.type, structure, buffer_append, &xb);
+        ASN_STRUCT_FREE(*s.type, structure);
+
+        if (erval.encoded > 0) {
+            CorpusSample c = s;
+            c.encoding = "coer";
+            c.syntax = ATS_CANONICAL_OER;
+            c.bytes.assign(xb.buffer, xb.buffer + xb.buffer_size);
+            c.hex.clear();          // no hex conversion benchmark for derived samples.
+            coer.push_back(std::move(c));
+        }
+        std::free(xb.buffer);
+    }
+
+    samples.insert(samples.end(), coer.begin(), coer.end());
+}
+
+template <typename Op>
+void ACMBench::measure(const std::string& bench, const std::string& name, const std::string& pdu, const std::string& encoding, std::size_t bytes, Op&& op) {
+    if (!selected(bench, name)) return;
+
+    for (int i = 0; i < warmup; ++i) {
+        if (!op()) {
+            report_error(bench, name + "/" + encoding, "operation failed");
+            return;
+        }
+    }
+
+    metrics::HistogramSnapshot h;
+    uint64_t begin = metrics::now_ns();
+    for (int i = 0; i < iterations; ++i) {
+        uint64_t t0 = metrics::now_ns();
+        op();
+        h.record(metrics::now_ns() - t0);
+    }
+    double elapsed_s = static_cast<double>(metrics::now_ns() - begin) / 1e9;
+
+    std::ostringstream os;
+    os << "{\"bench\":\"" << bench << "\",\"name\":\"" << name << "\",\"pdu\":\"" << pdu << "\",\"encoding\":\"" << encoding
+       << "\",\"bytes\":" << bytes
+       << ",\"iterations\":" << iterations
+       << ",\"ops_per_sec\":" << (elapsed_s > 0 ? iterations / elapsed_s : 0.0)
+       << ",\"mb_per_sec\":" << (elapsed_s > 0 ? static_cast<double>(bytes) * iterations / elapsed_s / 1e6 : 0.0)
+       << ",\"mean_ns\":" << static_cast<uint64_t>(h.mean())
+       << ",\"p50_ns\":" << h.percentile(0.5)
+       << ",\"p90_ns\":" << h.percentile(0.9)
+       << ",\"p99_ns\":" << h.percentile(0.99)
+       << ",\"p999_ns\":" << h.percentile(0.999)
+       << ",\"max_ns\":" << h.max
+       << "}";
+    *out << os.str() << std::endl;
+}
+
+void ACMBench::report_error(const std::string& bench, const std::string& name, const std::string& message) {
+    *out << "{\"bench\":\"" << bench << "\",\"name\":\"" << name << "\",\"error\":\"" << message << "\"}" << std::endl;
+}
+
+void ACMBench::bench_sample(const CorpusSample& s) {
+    std::vector<char> scratch;
+
+    if (!s.hex.empty()) {
+        measure("hex_to_bytes", s.name, s.pdu, s.encoding, s.hex.size(), [&]() {
+            scratch.clear();
+            return codec.hex_to_bytes_(s.hex, scratch);
+        });
+    }
+
+    measure("asn_decode", s.name, s.pdu, s.encoding, s.bytes.size(), [&]() {
+        void* structure = nullptr;
+        asn_dec_rval_t rval = asn_decode(0, s.syntax, s.type, &structure, s.bytes.data(), s.bytes.size());
+        ASN_STRUCT_FREE(*s.type, structure);
+        return rval.code == RC_OK;
+    });
+
+    // the remaining stages work on one decoded structure.
+    void* decoded = nullptr;
+    if (asn_decode(0, s.syntax, s.type, &decoded, s.bytes.data(), s.bytes.size()).code != RC_OK) {
+        ASN_STRUCT_FREE(*s.type, decoded);
+        report_error("asn_decode", s.name + "/" + s.encoding, "sample does not decode");
+        return;
+    }
+
+    measure("constraint_check", s.name, s.pdu, s.encoding, s.bytes.size(), [&]() {
+        char errbuf[128];
+        std::size_t errlen = sizeof(errbuf);
+        return asn_check_constraints(s.type, decoded, errbuf, &errlen) == 0;
+    });
+
+    buffer_structure_t xer = {0, 0, 0};
+    xer_encode(s.type, decoded, XER_F_CANONICAL, buffer_append, &xer);
+
+    measure("xer_encode", s.name, s.pdu, s.encoding, xer.buffer_size, [&]() {
+        buffer_structure_t xb = {0, 0, 0};
+        asn_enc_rval_t rval = xer_encode(s.type, decoded, XER_F_CANONICAL, buffer_append, &xb);
+        std::free(xb.buffer);
+        return rval.encoded != -1;
+    });
+
+    buffer_structure_t json = {0, 0, 0};
+    jer::encode(s.type, decoded, buffer_append, &json);
+
+    measure("json_encode", s.name, s.pdu, s.encoding, json.buffer_size, [&]() {
+        buffer_structure_t xb = {0, 0, 0};
+        asn_enc_rval_t rval = jer::encode(s.type, decoded, buffer_append, &xb);
+        std::free(xb.buffer);
+        return rval.encoded != -1;
+    });
+    std::free(json.buffer);
+
+    measure("xer_decode", s.name, s.pdu, s.encoding, xer.buffer_size, [&]() {
+        void* structure = nullptr;
+        asn_dec_rval_t rval = xer_decode(0, s.type, &structure, xer.buffer, xer.buffer_size);
+        ASN_STRUCT_FREE(*s.type, structure);
+        return rval.code == RC_OK;
+    });
+
+    measure("asn_encode", s.name, s.pdu, s.encoding, s.bytes.size(), [&]() {
+        buffer_structure_t xb = {0, 0, 0};
+        asn_enc_rval_t rval = asn_encode(0, s.syntax, s.type, decoded, buffer_append, &xb);
+        std::free(xb.buffer);
+        return rval.encoded != -1;
+    });
+
+    std::free(xer.buffer);
+    ASN_STRUCT_FREE(*s.type, decoded);
+
+    // the codec entry point used by the HTTP and IPC servers; it always decodes UPER.
+    if (s.type == &asn_DEF_MessageFrame && s.syntax == ATS_UNALIGNED_BASIC_PER) {
+        measure("decode_messageframe_bytes", s.name, s.pdu, s.encoding, s.bytes.size(), [&]() {
+            buffer_structure_t xb = {0, 0, 0};
+            bool ok = false;
+            try {
+                ok = codec.decode_messageframe_bytes(s.bytes.data(), s.bytes.size(), &xb);
+            } catch (const std::exception&) {
+            }
+            std::free(xb.buffer);
+            return ok;
+        });
+    }
+}
+
+void ACMBench::bench_envelope(const Envelope& e) {
+    const std::string direction = e.encode ? "encode_message" : "decode_message";
+    const unsigned int options = pugi::parse_default | pugi::parse_declaration | pugi::parse_doctype | pugi::parse_trim_pcdata;
+
+    const bool json = Json_Envelope::detect(e.xml.data(), e.xml.size());
+    const char* format = json ? "json" : "xml";
+
+    pugi::xml_document doc;
+    Json_Envelope envelope;
+    std::string error;
+
+    measure("envelope_parse", e.name, "OdeAsn1Data", format, e.xml.size(), [&]() {
+        if (json) return envelope.parse(e.xml.data(), e.xml.size(), error);
+        return static_cast<bool>(doc.load_buffer(e.xml.data(), e.xml.size(), options));
+    });
+
+    measure("serialize", e.name, "OdeAsn1Data", format, e.xml.size(), [&]() {
+        if (json) {
+            std::string out;
+            envelope.write(out, Json_Envelope::Changes{});
+            return true;
+        }
+        std::ostringstream os;
+        doc.save(os, "", pugi::format_raw);
+        return true;
+    });
+
+    std::ostringstream check;
+    if (!codec.process_envelope(e.xml.data(), e.xml.size(), check, e.encode)) {
+        report_error(direction, e.name, "envelope is rejected by the codec");
+        return;
+    }
+
+    measure(direction, e.name, "OdeAsn1Data", format, e.xml.size(), [&]() {
+        std::ostringstream os;
+        return codec.process_envelope(e.xml.data(), e.xml.size(), os, e.encode);
+    });
+}
+
+int ACMBench::operator()(void) {
+    if (optIsSet('n')) iterations = std::stoi(optString('n'));
+    if (optIsSet('w')) warmup = std::stoi(optString('w'));
+    if (optIsSet('d')) root = optString('d');
+    if (optIsSet('f')) filter = optString('f');
+    stage_metrics = optIsSet('s');
+
+    std::ofstream file;
+    if (optIsSet('o')) {
+        file.open(optString('o'));
+        if (!file) {
+            std::cerr << "cannot open output file: " << optString('o') << std::endl;
+            return EXIT_FAILURE;
+        }
+        out = &file;
+    }
+
+    // logging would dominate the numbers; only failures are of interest here.
+    codec.logger = std::make_shared<AcmLogger>("acm_bench");
+    codec.logger->set_level(spdlog::level::off);
+
+    // stage timing is off in production by default, so it is off here too unless asked for.
+    metrics::enable_stages(stage_metrics);
+
+    std::vector<CorpusSample> samples;
+    std::vector<Envelope> envelopes;
+    if (!load_samples(root + "/data/bench/corpus.hex", samples)) return EXIT_FAILURE;
+    if (!load_envelopes(root + "/data/bench/envelopes.txt", envelopes)) return EXIT_FAILURE;
+    add_coer_samples(samples);
+
+    for (const auto& s : samples) bench_sample(s);
+    for (const auto& e : envelopes) bench_envelope(e);
+
+    if (stage_metrics) {
+        for (const auto& line : metrics::Registry::instance().stage_report()) {
+            std::cerr << line << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+    ACMBench acm_bench{"acm_bench", "ASN1_Codec microbenchmarks over the bundled sample corpus"};
+
+    acm_bench.addOption('n', "iterations", "Timed operations per benchmark (default 10000).", true);
+    acm_bench.addOption('w', "warmup", "Untimed operations before each benchmark (default 200).", true);
+    acm_bench.addOption('d', "data-root", "Directory containing data/ and unit-test-data/ (default .).", true);
+    acm_bench.addOption('f', "filter", "Only run benchmarks whose stage or sample name contains this string.", true);
+    acm_bench.addOption('o', "output", "Write the JSON lines to this file instead of stdout.", true);
+    acm_bench.addOption('s', "stage-metrics", "Also collect the ACM per-stage histograms and print them to stderr.", false);
+    acm_bench.addOption('h', "help", "print out some help");
+
+    if (!acm_bench.parseArgs(argc, argv)) {
+        acm_bench.usage();
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (acm_bench.optIsSet('h')) {
+        acm_bench.help();
+        std::exit(EXIT_SUCCESS);
+    }
+
+    std::exit(acm_bench.run());
+}
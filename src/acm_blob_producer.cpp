@@ -43,14 +43,17 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+
 #include "acm_blob_producer.hpp"
 #include "utilities.hpp"
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
 #include <csignal>
 #include <chrono>
 #include <thread>
 #include <cstdio>
+#include <sstream>
 
 // for both windows and linux.
 #include <sys/types.h>
@@ -58,6 +61,7 @@
 
 #ifndef _MSC_VER
 #include <sys/time.h>
+#include <dirent.h>
 #endif
 
 #ifdef _MSC_VER
@@ -70,6 +74,27 @@
 #include <unistd.h>
 #endif
 
+namespace {
+
+/**
+ * @brief Wall clock microseconds since the epoch; comparable between the producing and consuming hosts.
+ */
+int64_t epoch_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+std::string percentiles_json( const metrics::HistogramSnapshot& h, const std::string& prefix, uint64_t scale ) {
+    std::ostringstream os;
+    os << "\"" << prefix << "_p50\":" << h.percentile(0.5) / scale
+       << ",\"" << prefix << "_p90\":" << h.percentile(0.9) / scale
+       << ",\"" << prefix << "_p99\":" << h.percentile(0.99) / scale
+       << ",\"" << prefix << "_p999\":" << h.percentile(0.999) / scale
+       << ",\"" << prefix << "_max\":" << h.max / scale;
+    return os.str();
+}
+
+}  // end namespace.
+
 /**
  * @brief predicate indicating whether a file exists on the filesystem.
  *
@@ -104,38 +129,66 @@ bool dirExists( const std::string& s ) {
     return false;
 }
 
+void LoadDeliveryReportCb::dr_cb( RdKafka::Message& message ) {
+    if ( message.err() != RdKafka::ERR_NO_ERROR ) {
+        ++failed;
+        return;
+    }
+
+    ++acked;
+    int64_t latency_us = message.latency();
+    if ( latency_us >= 0 ) ack_latency.record( static_cast<uint64_t>( latency_us ) * 1000 );
+}
+
 bool ACMBlobProducer::data_available = true;
 
-void ACMBlobProducer::sigterm (int sig) {
+void ACMBlobProducer::sigterm (int) {
     data_available = false;
 }
 
 ACMBlobProducer::ACMBlobProducer( const std::string& name, const std::string& description ) :
-    Tool{ name, description },
+    Tool{ name, description, false },
+    logger{},
     msg_send_count{0},
     msg_send_bytes{0},
-    mconf{},
-    partition{RdKafka::Topic::PARTITION_UA},
     debug{""},
-    block_size{BUFSIZE},
+    block_size{0},
+    consume_mode{false},
+    rate{0},
+    window{1000},
+    max_messages{0},
+    duration_seconds{0},
+    report_seconds{5},
+    send_time_header{"acm-send-us"},
+    processing_time_header{},
+    corpus{},
+    partition{RdKafka::Topic::PARTITION_UA},
     published_topic_name{},
+    mconf{},
     conf{nullptr},
     tconf{nullptr},
+    delivery_report_cb{},
     producer_ptr{},
     published_topic_ptr{},
-    logger{}
+    consumer_ptr{},
+    report_file{},
+    report_os{&std::cout}
 {
 }
 
 ACMBlobProducer::~ACMBlobProducer() 
 {
-    //if (consumer_ptr) consumer_ptr->close();
+    if (consumer_ptr) consumer_ptr->close();
+
+    // the handles must go before their configurations.
+    published_topic_ptr.reset();
+    producer_ptr.reset();
+    consumer_ptr.reset();
 
     // free raw librdkafka pointers.
     if (tconf) delete tconf;
     if (conf) delete conf;
 
-    // TODO: This librdkafka item seems wrong...
     RdKafka::wait_destroyed(5000);    // pause to let RdKafka reclaim resources.
 }
 
@@ -178,13 +231,9 @@ void ACMBlobProducer::print_configuration() const
  * The following configuration settings are processed by configure:
  *
  asn1.j2735.kafka.partition
- asn1.j2735.topic.consumer
- asn1.j2735.topic.producer
- asn1.j2735.consumer.timeout.ms
-
-JMC: TODO: All the ASN1C variables that are normally setup do here!
-
-*/
+ asn1.j2735.topic.producer  (or the ACM's asn1.topic.consumer) : the topic load is produced to.
+ asn1.topic.producer                                           : the topic consumed with -M consume.
+ */
 bool ACMBlobProducer::configure() {
 
     if ( optIsSet('v') ) {
@@ -217,35 +266,67 @@ bool ACMBlobProducer::configure() {
     conf  = RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL);
     tconf = RdKafka::Conf::create(RdKafka::Conf::CONF_TOPIC);
 
-    // must use a configuration file.
-    if ( !optIsSet('F') ) {
-        logger->error( "Must specify the path to an input binary file." );
-        return false;
+    if ( optIsSet('M') ) {
+        if ( optString('M') == "consume" ) {
+            consume_mode = true;
+        } else if ( optString('M') != "produce" ) {
+            logger->error( "unknown mode: " + optString('M') + "; use produce or consume." );
+            return false;
+        }
     }
 
-    input_file = optString('F');
+    if ( !consume_mode ) {
+        // must use an input corpus.
+        if ( !optIsSet('F') ) {
+            logger->error( "Must specify the path to an input file or directory." );
+            return false;
+        }
 
-    if ( !fileExists( input_file ) ) {
-        logger->error( "The input file: " + input_file + " does not exist.");
-        return false;
-    }
+        input_file = optString('F');
 
-    logger->info("using input file: " + input_file );
+        if ( !fileExists( input_file ) && !dirExists( input_file ) ) {
+            logger->error( "The input file: " + input_file + " does not exist.");
+            return false;
+        }
 
-    if ( optIsSet('B') ) {
-        try {
-            block_size = optInt('B');
-        } catch ( std::exception& e ) {
-            block_size = BUFSIZE;
+        logger->info("using input: " + input_file );
+
+        if ( optIsSet('B') ) {
+            try {
+                block_size = optInt('B');
+            } catch ( std::exception& e ) {
+                block_size = BUFSIZE;
+            }
         }
     }
 
-    if ( !fileExists( input_file ) ) {
-        logger->error( "The input file: " + input_file + " does not exist.");
+    try {
+        if ( optIsSet('r') ) rate = std::stod( optString('r') );
+        if ( optIsSet('w') ) window = std::stoull( optString('w') );
+        if ( optIsSet('n') ) max_messages = std::stoull( optString('n') );
+        if ( optIsSet('T') ) duration_seconds = optInt('T');
+        if ( optIsSet('I') ) report_seconds = optInt('I');
+    } catch ( std::exception& e ) {
+        logger->error( "numeric option expected: " + std::string( e.what() ) );
         return false;
     }
 
-    logger->info("using input file: " + input_file);
+    if ( rate < 0 || window == 0 || report_seconds <= 0 ) {
+        logger->error( "rate must be >= 0, window > 0, and the report interval > 0." );
+        return false;
+    }
+
+    if ( optIsSet('H') ) send_time_header = optString('H');
+    if ( optIsSet('P') ) processing_time_header = optString('P');
+
+    if ( optIsSet('o') ) {
+        report_file.open( optString('o') );
+        if ( !report_file ) {
+            logger->error( "cannot open report file: " + optString('o') );
+            return false;
+        }
+        report_os = &report_file;
+    }
 
     // must use a configuration file.
     if ( !optIsSet('c') ) {
@@ -315,7 +396,7 @@ bool ACMBlobProducer::configure() {
         }  // otherwise leave at default; PARTITION_UA
     }
 
-    logger->info("kafka partition: " + partition);
+    logger->info("kafka partition: " + std::to_string(partition));
 
     if ( getOption('g').isSet() && conf->set("group.id", optString('g'), error_string) != RdKafka::Conf::CONF_OK) {
         // NOTE: there are some checks in librdkafka that require this to be present and set.
@@ -323,34 +404,107 @@ bool ACMBlobProducer::configure() {
         return false;
     }
 
+    std::string group_id;
+    if ( consume_mode && ( conf->get("group.id", group_id) != RdKafka::Conf::CONF_OK || group_id.empty() ) ) {
+        // the ACM's group must not be reused; the probe would steal its partitions.
+        conf->set("group.id", "acm-load-probe", error_string);
+    }
+
     if (optIsSet('d') && conf->set("debug", optString('d'), error_string) != RdKafka::Conf::CONF_OK) {
         logger->error("kafka error setting configuration parameter debug: " + error_string);
         return false;
     }
 
+    if ( !consume_mode && conf->set("dr_cb", &delivery_report_cb, error_string) != RdKafka::Conf::CONF_OK ) {
+        logger->error("kafka error setting the delivery report callback: " + error_string);
+        return false;
+    }
+
     // librdkafka defined configuration.
     conf->set("default_topic_conf", tconf, error_string);
 
     if (optIsSet('t')) {
-        // this is the produced (filtered) topic.
+        // this is the produced (or consumed) topic.
         published_topic_name = optString( 't' );
 
     } else {
-        // maybe it was specified in the configuration file.
-        auto search = mconf.find("asn1.j2735.topic.producer");
-        if ( search != mconf.end() ) {
-            published_topic_name = search->second;
-        } else {
-            logger->error("no publisher topic was specified; must fail.");
+        // maybe it was specified in the configuration file; an ACM configuration names both ends.
+        std::vector<std::string> keys = consume_mode
+            ? std::vector<std::string>{ "asn1.topic.producer" }
+            : std::vector<std::string>{ "asn1.j2735.topic.producer", "asn1.topic.consumer" };
+
+        for ( const auto& key : keys ) {
+            auto search = mconf.find( key );
+            if ( search != mconf.end() ) {
+                published_topic_name = search->second;
+                break;
+            }
+        }
+
+        if ( published_topic_name.empty() ) {
+            logger->error("no topic was specified; must fail.");
             return false;
         }
     }
 
-    logger->info("published topic: " + published_topic_name);
+    logger->info(std::string( consume_mode ? "consumed" : "published" ) + " topic: " + published_topic_name);
     logger->trace("ending configure()");
     return true;
 }
 
+bool ACMBlobProducer::load_corpus()
+{
+    std::vector<std::string> files;
+
+    if ( dirExists( input_file ) ) {
+        DIR* dir = opendir( input_file.c_str() );
+        if ( !dir ) {
+            logger->error( "cannot read the directory: " + input_file );
+            return false;
+        }
+
+        for ( struct dirent* entry = readdir( dir ); entry; entry = readdir( dir ) ) {
+            std::string path = input_file + "/" + entry->d_name;
+            if ( fileExists( path ) ) files.push_back( path );
+        }
+        closedir( dir );
+
+        std::sort( files.begin(), files.end() );
+    } else {
+        files.push_back( input_file );
+    }
+
+    for ( const auto& path : files ) {
+        std::ifstream ifs{ path, std::ios::binary };
+        if ( !ifs ) {
+            logger->warn( "skipping unreadable file: " + path );
+            continue;
+        }
+
+        if ( files.size() > 1 ) {
+            // a directory of samples; each file is one record.
+            std::ostringstream contents;
+            contents << ifs.rdbuf();
+            if ( contents.tellp() > 0 ) corpus.push_back( contents.str() );
+
+        } else if ( block_size > 0 ) {
+            std::string block( block_size, '\0' );
+            while ( ifs.read( &block[0], block_size ) || ifs.gcount() > 0 ) {
+                corpus.push_back( block.substr( 0, static_cast<std::size_t>( ifs.gcount() ) ) );
+            }
+
+        } else {
+            std::string line;
+            while ( std::getline( ifs, line ) ) {
+                if ( !string_utilities::strip( line ).empty() ) corpus.push_back( line );
+            }
+        }
+    }
+
+    logger->info( "loaded " + std::to_string( corpus.size() ) + " records from " + input_file );
+    return !corpus.empty();
+}
+
 /**
  *
  *
@@ -371,7 +525,27 @@ bool ACMBlobProducer::launch_producer()
         return false;
     } 
 
-    logger->info("Producer: " +  producer_ptr->name() + " created using topic: {}." + published_topic_name);
+    logger->info("Producer: " +  producer_ptr->name() + " created using topic: " + published_topic_name);
+    return true;
+}
+
+bool ACMBlobProducer::launch_consumer()
+{
+    std::string error_string;
+
+    consumer_ptr = std::shared_ptr<RdKafka::KafkaConsumer>( RdKafka::KafkaConsumer::create(conf, error_string) );
+    if ( !consumer_ptr ) {
+        logger->critical("Failed to create consumer with error: " + error_string );
+        return false;
+    }
+
+    RdKafka::ErrorCode status = consumer_ptr->subscribe( { published_topic_name } );
+    if ( status != RdKafka::ERR_NO_ERROR ) {
+        logger->critical("Failed to subscribe to: " + published_topic_name + ". Error: " + RdKafka::err2str( status ) + ".");
+        return false;
+    }
+
+    logger->info("Consumer: " +  consumer_ptr->name() + " subscribed to topic: " + published_topic_name);
     return true;
 }
 
@@ -414,7 +588,7 @@ bool ACMBlobProducer::setup_logger( bool remove_files )
 
     if ( remove_files && fileExists( logname ) ) {
         if ( std::remove( logname.c_str() ) != 0 ) {
-            std::err << "Error removing the previous information log file." << std::endl; // do not use logger since it is not yet initialized.
+            std::cerr << "Error removing the previous information log file." << std::endl; // do not use logger since it is not yet initialized.
             return false;
         }
     }
@@ -424,93 +598,262 @@ bool ACMBlobProducer::setup_logger( bool remove_files )
     return true;
 }
 
-int ACMBlobProducer::operator()(void) {
+void ACMBlobProducer::report( const std::string& json )
+{
+    *report_os << json << std::endl;
+}
+
+int ACMBlobProducer::produce_load()
+{
+    using clock = std::chrono::steady_clock;
 
-    std::string error_string;
     RdKafka::ErrorCode status;
-    FILE *source;
-    std::size_t bytes_read = 0;
-    int file_round = 0;
+    uint64_t queue_full = 0;
+    uint64_t late = 0;                                  // open loop sends that started behind schedule.
+
+    const auto start = clock::now();
+    const auto stop = start + std::chrono::seconds( duration_seconds );
+    const auto period = rate > 0 ? std::chrono::nanoseconds( static_cast<int64_t>( 1e9 / rate ) ) : std::chrono::nanoseconds( 0 );
+    const int64_t start_us = epoch_us();
+
+    auto next_report = start + std::chrono::seconds( report_seconds );
+    uint64_t reported_sent = 0;
+
+    while ( data_available ) {
+        auto now = clock::now();
+
+        if ( ( max_messages > 0 && msg_send_count >= max_messages ) || ( duration_seconds > 0 && now >= stop ) ) break;
+
+        // the send time is the scheduled time in open loop, so a stalled producer cannot hide latency.
+        int64_t send_us;
+        if ( rate > 0 ) {
+            auto scheduled = start + period * static_cast<int64_t>( msg_send_count );
+            if ( scheduled > now ) {
+                producer_ptr->poll( 0 );
+                std::this_thread::sleep_until( std::min( scheduled, next_report ) );
+                continue;
+            }
+            if ( now - scheduled > period ) ++late;
+            send_us = start_us + std::chrono::duration_cast<std::chrono::microseconds>( scheduled - start ).count();
 
-    signal(SIGINT, sigterm);
-    signal(SIGTERM, sigterm);
-    
-    try {
+        } else {
+            uint64_t in_flight = msg_send_count - delivery_report_cb.acked - delivery_report_cb.failed;
+            if ( in_flight >= window ) {
+                producer_ptr->poll( 1 );
+                continue;
+            }
+            send_us = epoch_us();
+        }
 
-        // throws for mapfile and other items.
-        if ( !configure() ) return EXIT_FAILURE;
+        const std::string& record = corpus[ msg_send_count % corpus.size() ];
 
-    } catch ( std::exception& e ) {
+        // headers are only accepted by the topic name overload; on success librdkafka owns them.
+        RdKafka::Headers* headers = RdKafka::Headers::create();
+        headers->add( send_time_header, std::to_string( send_us ) );
+        status = producer_ptr->produce( published_topic_name, partition, RdKafka::Producer::RK_MSG_COPY, (void *)record.data(), record.size(), NULL, 0, 0, headers, NULL );
 
-        // don't use logger in case we cannot configure it correctly.
-        std::cerr << "Fatal Exception: " << e.what() << '\n';
-        return EXIT_FAILURE;
+        if ( status == RdKafka::ERR__QUEUE_FULL ) {
+            delete headers;
+            ++queue_full;
+            producer_ptr->poll( 10 );
+            continue;
+
+        } else if ( status != RdKafka::ERR_NO_ERROR ) {
+            delete headers;
+            logger->error("Production failure code " + RdKafka::err2str( status ) + " for a record of " + std::to_string( record.size() ) + " bytes.");
+            break;
+        }
+
+        // successfully sent; update counters.
+        msg_send_count++;
+        msg_send_bytes += record.size();
+        producer_ptr->poll( 0 );
+
+        if ( clock::now() >= next_report ) {
+            double elapsed = std::chrono::duration<double>( clock::now() - start ).count();
+            std::ostringstream os;
+            os << "{\"mode\":\"produce\",\"elapsed_s\":" << elapsed
+               << ",\"sent\":" << msg_send_count
+               << ",\"acked\":" << delivery_report_cb.acked
+               << ",\"failed\":" << delivery_report_cb.failed
+               << ",\"interval_msgs_per_sec\":" << ( msg_send_count - reported_sent ) / static_cast<double>( report_seconds )
+               << ",\"target_rate\":" << rate
+               << ",\"late\":" << late
+               << ",\"queue_full\":" << queue_full
+               << "," << percentiles_json( delivery_report_cb.ack_latency, "ack_us", 1000 )
+               << "}";
+            report( os.str() );
+
+            delivery_report_cb.ack_latency.reset();
+            reported_sent = msg_send_count;
+            next_report += std::chrono::seconds( report_seconds );
+        }
     }
 
-    if ( !launch_producer() ) return false;
+    producer_ptr->flush( 10000 );
+    double elapsed = std::chrono::duration<double>( clock::now() - start ).count();
+
+    std::ostringstream os;
+    os << "{\"mode\":\"produce\",\"summary\":true,\"elapsed_s\":" << elapsed
+       << ",\"sent\":" << msg_send_count
+       << ",\"bytes\":" << msg_send_bytes
+       << ",\"acked\":" << delivery_report_cb.acked
+       << ",\"failed\":" << delivery_report_cb.failed
+       << ",\"msgs_per_sec\":" << ( elapsed > 0 ? msg_send_count / elapsed : 0.0 )
+       << ",\"mb_per_sec\":" << ( elapsed > 0 ? msg_send_bytes / elapsed / 1e6 : 0.0 )
+       << ",\"target_rate\":" << rate
+       << ",\"late\":" << late
+       << ",\"queue_full\":" << queue_full
+       << "}";
+    report( os.str() );
+
+    return delivery_report_cb.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-    while (data_available) {
-        // data_available changed via interupt SIGINT or SIGTERM
+int ACMBlobProducer::consume_load()
+{
+    using clock = std::chrono::steady_clock;
 
-        // Process
-        // 1. Read in the uper file.
-        // 2. "Produce" some sized blocks of the file to the kafka topic with size indicated.
+    metrics::HistogramSnapshot interval_latency, total_latency, interval_processing, total_processing;
+    uint64_t received = 0, received_bytes = 0, missing = 0;
+    uint64_t reported_received = 0, reported_bytes = 0;
 
-        source = fopen( input_file.c_str(), "rb" );
+    const auto start = clock::now();
+    const auto stop = start + std::chrono::seconds( duration_seconds );
+    auto next_report = start + std::chrono::seconds( report_seconds );
 
-        if ( !source ) {
-            logger->error("No file: " + input_file + "; cannot be opened for decoding.");
+    auto header_value = []( RdKafka::Headers* headers, const std::string& key, int64_t& value ) {
+        if ( !headers || key.empty() ) return false;
+        RdKafka::Headers::Header h = headers->get_last( key );
+        if ( h.err() != RdKafka::ERR_NO_ERROR || !h.value() ) return false;
+        try {
+            value = std::stoll( std::string( static_cast<const char*>( h.value() ), h.value_size() ) );
+        } catch ( std::exception& ) {
             return false;
-        } 
+        }
+        return true;
+    };
 
-        while ( !feof( source ) ) {
+    while ( data_available ) {
+        auto now = clock::now();
+        if ( ( max_messages > 0 && received >= max_messages ) || ( duration_seconds > 0 && now >= stop ) ) break;
 
-            // attempt to read 1K bytes into buffer.
-            bytes_read = fread( buf, sizeof buf[0], block_size, source );
+        std::unique_ptr<RdKafka::Message> msg{ consumer_ptr->consume( 100 ) };
 
-            if ( bytes_read > 0 ) {
+        if ( msg->err() == RdKafka::ERR_NO_ERROR ) {
+            int64_t arrived_us = epoch_us();
+            ++received;
+            received_bytes += msg->len();
 
-                status = producer_ptr->produce(published_topic_ptr.get(), partition, RdKafka::Producer::RK_MSG_COPY, (void *)buf, bytes_read, NULL, NULL);
+            int64_t value;
+            if ( header_value( msg->headers(), send_time_header, value ) ) {
+                uint64_t latency_us = arrived_us > value ? static_cast<uint64_t>( arrived_us - value ) : 0;
+                interval_latency.record( latency_us );
+                total_latency.record( latency_us );
+            } else {
+                ++missing;
+            }
 
-                if (status != RdKafka::ERR_NO_ERROR) {
-                    logger->error("Production failure code " + RdKafka::err2str( status ) + " after reading " + std::to_string(bytes_read) + " bytes.");
-                    break;
+            if ( header_value( msg->headers(), processing_time_header, value ) && value >= 0 ) {
+                interval_processing.record( static_cast<uint64_t>( value ) );
+                total_processing.record( static_cast<uint64_t>( value ) );
+            }
 
-                } else {
-                    // successfully sent; update counters.
-                    msg_send_count++;
-                    msg_send_bytes += bytes_read;
-                    logger->trace("Production success of " + std::to_string(bytes_read) + " bytes.");
-                }
+        } else if ( msg->err() != RdKafka::ERR__TIMED_OUT && msg->err() != RdKafka::ERR__PARTITION_EOF ) {
+            logger->error( "consume failure: " + msg->errstr() );
+        }
 
-                logger->trace("Bytes from file: " + std::to_string(bytes_read) + ". Successfully produced to: " + published_topic_name);
-            }
+        if ( clock::now() >= next_report ) {
+            double elapsed = std::chrono::duration<double>( clock::now() - start ).count();
+            std::ostringstream os;
+            os << "{\"mode\":\"consume\",\"elapsed_s\":" << elapsed
+               << ",\"received\":" << received
+               << ",\"missing_header\":" << missing
+               << ",\"interval_msgs_per_sec\":" << ( received - reported_received ) / static_cast<double>( report_seconds )
+               << ",\"interval_mb_per_sec\":" << ( received_bytes - reported_bytes ) / static_cast<double>( report_seconds ) / 1e6
+               << "," << percentiles_json( interval_latency, "e2e_us", 1 );
+            if ( !processing_time_header.empty() ) os << "," << percentiles_json( interval_processing, "acm_us", 1 );
+            os << "}";
+            report( os.str() );
+
+            interval_latency.reset();
+            interval_processing.reset();
+            reported_received = received;
+            reported_bytes = received_bytes;
+            next_report += std::chrono::seconds( report_seconds );
         }
+    }
 
-        fclose( source );
-        logger->info( "Finished producing the entire file.");
-        logger->info("Sleeping for 5 seconds after file round " + std::to_string(++file_round) + "\n");
-        std::this_thread::sleep_for( std::chrono::seconds(5) ); 
+    double elapsed = std::chrono::duration<double>( clock::now() - start ).count();
+
+    std::ostringstream os;
+    os << "{\"mode\":\"consume\",\"summary\":true,\"elapsed_s\":" << elapsed
+       << ",\"received\":" << received
+       << ",\"bytes\":" << received_bytes
+       << ",\"missing_header\":" << missing
+       << ",\"msgs_per_sec\":" << ( elapsed > 0 ? received / elapsed : 0.0 )
+       << ",\"mb_per_sec\":" << ( elapsed > 0 ? received_bytes / elapsed / 1e6 : 0.0 )
+       << ",\"e2e_us_mean\":" << static_cast<uint64_t>( total_latency.mean() )
+       << "," << percentiles_json( total_latency, "e2e_us", 1 );
+    if ( !processing_time_header.empty() ) os << "," << percentiles_json( total_processing, "acm_us", 1 );
+    os << "}";
+    report( os.str() );
+
+    return EXIT_SUCCESS;
+}
+
+int ACMBlobProducer::operator()(void) {
+
+    signal(SIGINT, sigterm);
+    signal(SIGTERM, sigterm);
+    
+    try {
+
+        // throws for mapfile and other items.
+        if ( !configure() ) return EXIT_FAILURE;
+
+    } catch ( std::exception& e ) {
+
+        // don't use logger in case we cannot configure it correctly.
+        std::cerr << "Fatal Exception: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    int result;
+
+    if ( consume_mode ) {
+        if ( !launch_consumer() ) return EXIT_FAILURE;
+        result = consume_load();
+
+    } else {
+        if ( !load_corpus() ) {
+            logger->error( "no records could be loaded from: " + input_file );
+            return EXIT_FAILURE;
+        }
+        if ( !launch_producer() ) return EXIT_FAILURE;
+        result = produce_load();
+
+        logger->info("ACMBlobProducer published : " + std::to_string(msg_send_count) + " records for " + std::to_string(msg_send_bytes) + " bytes.");
     }
 
     logger->info("ACMBlobProducer operations complete; shutting down...");
-    logger->info("ACMBlobProducer published : " + std::to_string(msg_send_count) + " binary blocks of size: " + std::to_string(block_size) + " for " + std::to_string(msg_send_bytes) + " bytes.");
     
     // NOTE: good for troubleshooting, but bad for performance.
     logger->flush();
-    return EXIT_SUCCESS;
+    return result;
 }
 
 #ifndef _ASN1_CODEC_TESTS
 
 int main(int argc, char* argv[])
 {
-    ACMBlobProducer acm_blob_producer{"ACMBlobProducer","ASN1 Processing Module"};
+    ACMBlobProducer acm_blob_producer{"ACMBlobProducer","Kafka load generator and end-to-end latency probe for the ACM"};
 
     acm_blob_producer.addOption('c', "config", "Configuration file name and path.", true);
     acm_blob_producer.addOption('C', "config-check", "Check the configuration file contents and output the settings.", false);
-    acm_blob_producer.addOption('t', "produce-topic", "The name of the topic to produce.", true);
-    acm_blob_producer.addOption('p', "partition", "Consumer topic partition from which to read.", true);
+    acm_blob_producer.addOption('M', "mode", "produce (default) load onto the ACM input topic, or consume its output and report latency.", true);
+    acm_blob_producer.addOption('t', "topic", "The topic to produce to, or to consume from with -M consume.", true);
+    acm_blob_producer.addOption('p', "partition", "Topic partition to produce to.", true);
     acm_blob_producer.addOption('g', "group", "Consumer group identifier", true);
     acm_blob_producer.addOption('b', "broker", "Broker address (localhost:9092)", true);
     acm_blob_producer.addOption('d', "debug", "debug level.", true);
@@ -518,8 +861,16 @@ int main(int argc, char* argv[])
     acm_blob_producer.addOption('D', "log-dir", "Directory for the log files.", true);
     acm_blob_producer.addOption('R', "log-rm", "Remove specified/default log files if they exist.", false);
     acm_blob_producer.addOption('i', "log", "Log file name.", true);
-    acm_blob_producer.addOption('F', "file", "Input binary file", true);
-    acm_blob_producer.addOption('B', "blocksize", "The block size to read and write.", true);
+    acm_blob_producer.addOption('F', "file", "Corpus: a file with one record per line, or a directory with one record per file.", true);
+    acm_blob_producer.addOption('B', "blocksize", "Cut the input file into records of this many bytes instead of lines.", true);
+    acm_blob_producer.addOption('r', "rate", "Open loop target records per second; 0 (default) sends as fast as the window allows.", true);
+    acm_blob_producer.addOption('w', "window", "Closed loop limit on unacknowledged records (default 1000).", true);
+    acm_blob_producer.addOption('n', "count", "Stop after this many records.", true);
+    acm_blob_producer.addOption('T', "duration", "Stop after this many seconds.", true);
+    acm_blob_producer.addOption('I', "interval", "Seconds between reports (default 5).", true);
+    acm_blob_producer.addOption('H', "send-header", "Header carrying the send time in microseconds (default acm-send-us).", true);
+    acm_blob_producer.addOption('P', "processing-header", "The ACM's acm.kafka.processing.time.header; reported with -M consume.", true);
+    acm_blob_producer.addOption('o', "output", "Write the JSON report lines to this file instead of stdout.", true);
     acm_blob_producer.addOption('h', "help", "print out some help");
 
     if (!acm_blob_producer.parseArgs(argc, argv)) {
@@ -0,0 +1,659 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2017 US DOT - Joint Program Office
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Synthetic corpus generator.
+ *
+ * Builds J2735 MessageFrames with the asn1c random fill support (asn_random_fill / *_rfill.c), keeps the ones that
+ * pass the constraint check and decode again after encoding, and writes them in one of these forms:
+ *
+ * - hex: `<name> <pdu> <encoding> <hex>` lines; the acm_bench corpus format (data/bench/corpus.hex).
+ * - bin: `[uint32 length, network byte order][bytes]` records.
+ * - xer: one canonical XER document per line.
+ * - ode: one ODE OdeAsn1Data decode envelope per line; the input accepted by the ACM in decode mode.
+ *
+ * A frame may be wrapped in an unsecured IEEE 1609.2 Ieee1609Dot2Data (COER, with the UPER MessageFrame as the
+ * unsecuredData), as the ODE does for messages received over the air.
+ */
+
+#include "tool.hpp"
+
+#include "MessageFrame.h"
+#include "Ieee1609Dot2Data.h"
+#include "OPEN_TYPE.h"
+#include "asn_application.h"
+#include "asn_random_fill.h"
+#include "constr_CHOICE.h"
+#include "constr_SEQUENCE.h"
+
+#include <arpa/inet.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Buffer {
+    std::vector<char> bytes;
+};
+
+int buffer_append(const void *buffer, size_t size, void *app_key) {
+    Buffer* b = static_cast<Buffer*>(app_key);
+    const char* p = static_cast<const char*>(buffer);
+    b->bytes.insert(b->bytes.end(), p, p + size);
+    return 0;
+}
+
+std::string to_hex(const std::vector<char>& bytes) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(bytes.size() * 2);
+    for (char c : bytes) {
+        unsigned char u = static_cast<unsigned char>(c);
+        hex.push_back(digits[u >> 4]);
+        hex.push_back(digits[u & 0x0f]);
+    }
+    return hex;
+}
+
+/**
+ * Set the presence index of a CHOICE (or open type) structure.
+ */
+void set_present(const asn_TYPE_descriptor_t* td, void* sptr, unsigned present) {
+    const asn_CHOICE_specifics_t* specs = static_cast<const asn_CHOICE_specifics_t*>(td->specifics);
+    char* p = static_cast<char*>(sptr) + specs->pres_offset;
+    switch (specs->pres_size) {
+        case sizeof(int): *reinterpret_cast<int*>(p) = static_cast<int>(present); break;
+        case sizeof(short): *reinterpret_cast<short*>(p) = static_cast<short>(present); break;
+        case sizeof(char): *reinterpret_cast<char*>(p) = static_cast<char>(present); break;
+        default: break;
+    }
+}
+
+/**
+ * @brief Random fill the open type member of parent_sptr with the type selected by the members already filled.
+ *
+ * asn1c has no random fill for open types (asn_OP_OPEN_TYPE.random_fill is null), and J2735 uses them for every
+ * MessageFrame value and regional extension; the information object set decides the type, e.g., from messageId.
+ *
+ * @return ARFILL_SKIPPED when the set has no type for the selecting value.
+ */
+asn_random_fill_result_t fill_open_type(const asn_TYPE_member_t& member, const asn_TYPE_descriptor_t* parent, void* parent_sptr, size_t max_length) {
+    asn_random_fill_result_t skipped = { asn_random_fill_result_t::ARFILL_SKIPPED, 0 };
+
+    asn_type_selector_result_t selected = member.type_selector(parent, parent_sptr);
+    if (!selected.type_descriptor || selected.presence_index == 0 || (member.flags & ATF_POINTER)) return skipped;
+
+    void* holder = static_cast<char*>(parent_sptr) + member.memb_offset;
+    const asn_TYPE_member_t& alternative = member.type->elements[selected.presence_index - 1];
+
+    void* memb_ptr;
+    void** memb_ptr2;
+    if (alternative.flags & ATF_POINTER) {
+        memb_ptr2 = reinterpret_cast<void**>(static_cast<char*>(holder) + alternative.memb_offset);
+    } else {
+        memb_ptr = static_cast<char*>(holder) + alternative.memb_offset;
+        memb_ptr2 = &memb_ptr;
+    }
+
+    asn_random_fill_result_t result = selected.type_descriptor->op->random_fill(selected.type_descriptor, memb_ptr2, &alternative.encoding_constraints, max_length);
+    if (result.code == asn_random_fill_result_t::ARFILL_OK) set_present(member.type, holder, selected.presence_index);
+    return result;
+}
+
+constexpr int kMemberAttempts = 8;
+
+void ignore_constraint_failure(void*, const asn_TYPE_descriptor_t*, const void*, const char*, ...) {}
+
+/**
+ * @brief Fill one SEQUENCE member, refilling it until it satisfies its own constraints.
+ *
+ * asn1c fills members independently and deliberately strays outside SIZE constraints, so a large message nearly always
+ * has some member out of range; retrying per member keeps whole frames from being rejected for one bad field.
+ *
+ * @return ARFILL_SKIPPED when the member could not be filled validly; it is left empty.
+ */
+asn_random_fill_result_t fill_member(const asn_TYPE_descriptor_t* td, void* st, const asn_TYPE_member_t* elm, size_t max_length) {
+    asn_random_fill_result_t result_skipped = { asn_random_fill_result_t::ARFILL_SKIPPED, 0 };
+
+    void* memb_ptr = static_cast<char*>(st) + elm->memb_offset;
+    void** memb_ptr2 = (elm->flags & ATF_POINTER) ? reinterpret_cast<void**>(memb_ptr) : &memb_ptr;
+
+    asn_constr_check_f* check = elm->encoding_constraints.general_constraints
+        ? elm->encoding_constraints.general_constraints
+        : elm->type->encoding_constraints.general_constraints;
+
+    for (int attempt = 0; attempt < kMemberAttempts; ++attempt) {
+        asn_random_fill_result_t res = elm->type_selector
+            ? fill_open_type(*elm, td, st, max_length)
+            : elm->type->op->random_fill(elm->type, memb_ptr2, &elm->encoding_constraints, max_length);
+        if (res.code != asn_random_fill_result_t::ARFILL_OK) return res;
+
+        if (!check || check(elm->type, *memb_ptr2, ignore_constraint_failure, nullptr) == 0) return res;
+
+        if (elm->flags & ATF_POINTER) {
+            ASN_STRUCT_FREE(*elm->type, *memb_ptr2);
+            *memb_ptr2 = nullptr;
+        } else {
+            ASN_STRUCT_RESET(*elm->type, memb_ptr);
+        }
+    }
+    return result_skipped;
+}
+
+/**
+ * SEQUENCE_random_fill with open type members filled through fill_open_type and every member checked by
+ * fill_member. A SEQUENCE with a mandatory member that cannot be filled is skipped, so an optional parent leaves it
+ * out and a SEQUENCE OF drops it, rather than encoding an invalid value.
+ */
+asn_random_fill_result_t sequence_random_fill(const asn_TYPE_descriptor_t* td, void** sptr, const asn_encoding_constraints_t* constraints, size_t max_length) {
+    (void)constraints;
+
+    const asn_SEQUENCE_specifics_t* specs = static_cast<const asn_SEQUENCE_specifics_t*>(td->specifics);
+    asn_random_fill_result_t result_ok = { asn_random_fill_result_t::ARFILL_OK, 0 };
+    asn_random_fill_result_t result_failed = { asn_random_fill_result_t::ARFILL_FAILED, 0 };
+    asn_random_fill_result_t result_skipped = { asn_random_fill_result_t::ARFILL_SKIPPED, 0 };
+
+    if (max_length == 0) return result_skipped;
+
+    void* st = *sptr;
+    if (!st) {
+        st = std::calloc(1, specs->struct_size);
+        if (!st) return result_failed;
+    }
+
+    for (unsigned edx = 0; edx < td->elements_count; ++edx) {
+        const asn_TYPE_member_t* elm = &td->elements[edx];
+
+        // as asn1c does: sometimes decide not to fill the optional value.
+        if (elm->optional && asn_random_between(0, 4) == 2) continue;
+
+        // an exhausted budget only drops optional members; mandatory ones still get the smallest fill.
+        size_t remaining = max_length > result_ok.length ? max_length - result_ok.length : 0;
+        if (!elm->optional && remaining == 0) remaining = 1;
+
+        asn_random_fill_result_t tmpres = fill_member(td, st, elm, remaining);
+        if (tmpres.code == asn_random_fill_result_t::ARFILL_OK) {
+            result_ok.length += tmpres.length;
+            continue;
+        }
+        if (tmpres.code == asn_random_fill_result_t::ARFILL_SKIPPED && elm->optional) continue;
+
+        if (st == *sptr) {
+            ASN_STRUCT_RESET(*td, st);
+        } else {
+            ASN_STRUCT_FREE(*td, st);
+        }
+        return tmpres.code == asn_random_fill_result_t::ARFILL_FAILED ? tmpres : result_skipped;
+    }
+
+    *sptr = st;
+    return result_ok;
+}
+
+/**
+ * The size of the structure a SEQUENCE or CHOICE type decodes into; 0 for other types.
+ */
+std::size_t struct_size(const asn_TYPE_descriptor_t* td) {
+    if (td->op == &asn_OP_SEQUENCE) return static_cast<const asn_SEQUENCE_specifics_t*>(td->specifics)->struct_size;
+    if (td->op == &asn_OP_CHOICE) return static_cast<const asn_CHOICE_specifics_t*>(td->specifics)->struct_size;
+    return 0;
+}
+
+/**
+ * CHOICE_random_fill restricted to the alternatives whose type fits the CHOICE union. The generated NodeOffsetPointXY
+ * replaces its regional alternative with a smaller stub structure, which the stock fill would overrun.
+ */
+asn_random_fill_result_t choice_random_fill(const asn_TYPE_descriptor_t* td, void** sptr, const asn_encoding_constraints_t* constraints, size_t max_length) {
+    (void)constraints;
+
+    const asn_CHOICE_specifics_t* specs = static_cast<const asn_CHOICE_specifics_t*>(td->specifics);
+    asn_random_fill_result_t result_failed = { asn_random_fill_result_t::ARFILL_FAILED, 0 };
+    asn_random_fill_result_t result_skipped = { asn_random_fill_result_t::ARFILL_SKIPPED, 0 };
+
+    if (max_length == 0) return result_skipped;
+
+    std::vector<unsigned> candidates;
+    for (unsigned i = 0; i < td->elements_count; ++i) {
+        const asn_TYPE_member_t& elm = td->elements[i];
+        if ((elm.flags & ATF_POINTER) || elm.memb_offset + struct_size(elm.type) <= specs->struct_size) candidates.push_back(i + 1);
+    }
+    if (candidates.empty()) return result_skipped;
+
+    void* st = *sptr;
+    if (!st) {
+        st = std::calloc(1, specs->struct_size);
+        if (!st) return result_failed;
+    }
+
+    unsigned present = candidates[asn_random_between(0, candidates.size() - 1)];
+    const asn_TYPE_member_t* elm = &td->elements[present - 1];
+
+    void* memb_ptr;
+    void** memb_ptr2;
+    if (elm->flags & ATF_POINTER) {
+        memb_ptr2 = reinterpret_cast<void**>(static_cast<char*>(st) + elm->memb_offset);
+    } else {
+        memb_ptr = static_cast<char*>(st) + elm->memb_offset;
+        memb_ptr2 = &memb_ptr;
+    }
+
+    asn_random_fill_result_t res = elm->type->op->random_fill(elm->type, memb_ptr2, &elm->encoding_constraints, max_length);
+    set_present(td, st, present);
+    if (res.code == asn_random_fill_result_t::ARFILL_OK) {
+        *sptr = st;
+    } else if (st == *sptr) {
+        ASN_STRUCT_RESET(*td, st);
+    } else {
+        ASN_STRUCT_FREE(*td, st);
+    }
+    return res;
+}
+
+asn_random_fill_result_t open_type_random_fill(const asn_TYPE_descriptor_t*, void**, const asn_encoding_constraints_t*, size_t) {
+    // only reachable without the enclosing SEQUENCE, which holds the value that selects the type.
+    return { asn_random_fill_result_t::ARFILL_SKIPPED, 0 };
+}
+
+/**
+ * The approximate length limit handed to asn_random_fill; asn1c treats it as a budget in units close to bytes, so it
+ * shapes rather than fixes the encoded size.
+ */
+class SizeDistribution {
+    public:
+        /**
+         * @param spec `fixed:N`, `uniform:MIN:MAX`, or `lognormal:MEDIAN:SIGMA`.
+         * @throws std::invalid_argument for any other spec.
+         */
+        explicit SizeDistribution(const std::string& spec) {
+            std::vector<std::string> parts;
+            std::istringstream in{ spec };
+            for (std::string part; std::getline(in, part, ':'); ) parts.push_back(part);
+
+            if (parts.size() == 2 && parts[0] == "fixed") {
+                kind = FIXED;
+                a = std::stod(parts[1]);
+            } else if (parts.size() == 3 && parts[0] == "uniform") {
+                kind = UNIFORM;
+                a = std::stod(parts[1]);
+                b = std::stod(parts[2]);
+            } else if (parts.size() == 3 && parts[0] == "lognormal") {
+                kind = LOGNORMAL;
+                a = std::stod(parts[1]);
+                b = std::stod(parts[2]);
+            } else {
+                throw std::invalid_argument{ "invalid size distribution: " + spec };
+            }
+
+            if (a < 1 || (kind == UNIFORM && b < a) || (kind == LOGNORMAL && b < 0)) {
+                throw std::invalid_argument{ "invalid size distribution: " + spec };
+            }
+        }
+
+        std::size_t operator()(std::mt19937_64& rng) const {
+            double v = a;
+            if (kind == UNIFORM) {
+                v = std::uniform_real_distribution<double>{ a, b }(rng);
+            } else if (kind == LOGNORMAL) {
+                v = std::lognormal_distribution<double>{ std::log(a), b }(rng);
+            }
+            return v < 1 ? 1 : static_cast<std::size_t>(v);
+        }
+
+    private:
+        enum { FIXED, UNIFORM, LOGNORMAL } kind = FIXED;
+        double a = 0;
+        double b = 0;
+};
+
+}  // end namespace.
+
+class ACMCorpusGen : public tool::Tool {
+    public:
+        ACMCorpusGen(const std::string& name, const std::string& description) :
+            Tool{ name, description, false }
+        {}
+
+        int operator()(void) override;
+
+    private:
+        std::vector<long> ids;
+        std::vector<double> weights;
+        std::string encoding = "uper";
+        std::string format = "hex";
+        bool wrap_1609 = false;
+        std::string output;
+        std::map<long, std::unique_ptr<std::ofstream>> outputs;
+        Buffer frame_bytes;
+        Buffer wrapped;
+        Buffer xer;
+
+        bool parse_ids(const std::string& spec);
+        std::ostream& sink(long id);
+
+        /**
+         * @brief Randomly fill a MessageFrame for messageId id.
+         *
+         * @return the frame (the caller owns it) or nullptr if asn1c could not fill or constrain it.
+         */
+        MessageFrame_t* random_frame(long id, std::size_t max_length);
+
+        /**
+         * @brief Fill, encode, and optionally wrap one message into frame_bytes, wrapped, and xer.
+         *
+         * @return false if this attempt produced nothing usable.
+         */
+        bool generate(long id, std::size_t max_length, enum asn_transfer_syntax syntax, std::string& name);
+
+        bool encode(asn_TYPE_descriptor_t* td, const void* sptr, enum asn_transfer_syntax syntax, Buffer& out);
+
+        /**
+         * @brief Whether the encoding decodes again; asn1c can encode some random extension values, most often in COER,
+         * that its own decoder rejects.
+         */
+        bool decodes(asn_TYPE_descriptor_t* td, enum asn_transfer_syntax syntax, const Buffer& in);
+        bool wrap(const Buffer& frame, Buffer& out);
+        std::string ode_envelope(const std::string& hex, uint64_t record) const;
+        void write(long id, const std::string& name, const Buffer& encoded, uint64_t record);
+};
+
+bool ACMCorpusGen::parse_ids(const std::string& spec) {
+    std::istringstream in{ spec };
+    for (std::string item; std::getline(in, item, ','); ) {
+        std::size_t colon = item.find(':');
+        try {
+            ids.push_back(std::stol(item.substr(0, colon)));
+            weights.push_back(colon == std::string::npos ? 1.0 : std::stod(item.substr(colon + 1)));
+        } catch (const std::exception&) {
+            return false;
+        }
+        if (weights.back() <= 0) return false;
+    }
+    return !ids.empty();
+}
+
+std::ostream& ACMCorpusGen::sink(long id) {
+    if (output.empty()) return std::cout;
+
+    // one file per messageId when the path names it, otherwise everything goes to the same file.
+    std::size_t placeholder = output.find("{id}");
+    long key = (placeholder == std::string::npos) ? -1 : id;
+
+    auto it = outputs.find(key);
+    if (it == outputs.end()) {
+        std::string path = output;
+        if (placeholder != std::string::npos) path.replace(placeholder, 4, std::to_string(id));
+
+        std::ios::openmode mode = std::ios::out | std::ios::trunc;
+        if (format == "bin") mode |= std::ios::binary;
+
+        it = outputs.emplace(key, std::unique_ptr<std::ofstream>{ new std::ofstream{ path, mode } }).first;
+        if (!*it->second) {
+            throw std::runtime_error{ "cannot open output file: " + path };
+        }
+    }
+    return *it->second;
+}
+
+MessageFrame_t* ACMCorpusGen::random_frame(long id, std::size_t max_length) {
+    MessageFrame_t* frame = static_cast<MessageFrame_t*>(std::calloc(1, sizeof(MessageFrame_t)));
+    if (!frame) return nullptr;
+    frame->messageId = id;
+
+    // the value type follows from messageId, so fill it directly rather than through a random messageId.
+    asn_random_fill_result_t filled = fill_open_type(asn_DEF_MessageFrame.elements[1], &asn_DEF_MessageFrame, frame, max_length);
+    if (filled.code != asn_random_fill_result_t::ARFILL_OK) {
+        ASN_STRUCT_FREE(asn_DEF_MessageFrame, frame);
+        return nullptr;
+    }
+
+    // random fill honors PER/OER visible constraints only; table and user constraints can still fail.
+    char errbuf[256];
+    std::size_t errlen = sizeof(errbuf);
+    if (asn_check_constraints(&asn_DEF_MessageFrame, frame, errbuf, &errlen) != 0) {
+        ASN_STRUCT_FREE(asn_DEF_MessageFrame, frame);
+        return nullptr;
+    }
+
+    return frame;
+}
+
+bool ACMCorpusGen::generate(long id, std::size_t max_length, enum asn_transfer_syntax syntax, std::string& name) {
+    MessageFrame_t* frame = random_frame(id, max_length);
+    if (!frame) return false;
+
+    name = asn_DEF_MessageFrame.elements[1].type->elements[frame->value.present - 1].name;
+
+    bool ok = encode(&asn_DEF_MessageFrame, frame, syntax, frame_bytes) && decodes(&asn_DEF_MessageFrame, syntax, frame_bytes);
+    if (ok && format == "xer" && !wrap_1609) {
+        xer.bytes.clear();
+        ok = xer_encode(&asn_DEF_MessageFrame, frame, XER_F_CANONICAL, buffer_append, &xer).encoded != -1;
+    }
+    ASN_STRUCT_FREE(asn_DEF_MessageFrame, frame);
+    if (!ok || !wrap_1609) return ok;
+
+    if (!wrap(frame_bytes, wrapped)) return false;
+    if (format != "xer") return true;
+
+    // render the wrapper from its encoding so the XER matches the binary record.
+    void* data = nullptr;
+    ok = asn_decode(0, ATS_CANONICAL_OER, &asn_DEF_Ieee1609Dot2Data, &data, wrapped.bytes.data(), wrapped.bytes.size()).code == RC_OK;
+    xer.bytes.clear();
+    ok = ok && xer_encode(&asn_DEF_Ieee1609Dot2Data, data, XER_F_CANONICAL, buffer_append, &xer).encoded != -1;
+    ASN_STRUCT_FREE(asn_DEF_Ieee1609Dot2Data, data);
+    return ok;
+}
+
+bool ACMCorpusGen::encode(asn_TYPE_descriptor_t* td, const void* sptr, enum asn_transfer_syntax syntax, Buffer& out) {
+    out.bytes.clear();
+    asn_enc_rval_t rval = asn_encode(0, syntax, td, sptr, buffer_append, &out);
+    return rval.encoded != -1;
+}
+
+bool ACMCorpusGen::decodes(asn_TYPE_descriptor_t* td, enum asn_transfer_syntax syntax, const Buffer& in) {
+    void* structure = nullptr;
+    asn_dec_rval_t rval = asn_decode(0, syntax, td, &structure, in.bytes.data(), in.bytes.size());
+    ASN_STRUCT_FREE(*td, structure);
+    return rval.code == RC_OK && rval.consumed == in.bytes.size();
+}
+
+bool ACMCorpusGen::wrap(const Buffer& frame, Buffer& out) {
+    Ieee1609Dot2Data_t* data = static_cast<Ieee1609Dot2Data_t*>(std::calloc(1, sizeof(Ieee1609Dot2Data_t)));
+    if (!data) return false;
+
+    data->protocolVersion = 3;
+    data->content = static_cast<Ieee1609Dot2Content*>(std::calloc(1, sizeof(Ieee1609Dot2Content)));
+    bool ok = data->content != nullptr;
+    if (ok) {
+        data->content->present = Ieee1609Dot2Content_PR_unsecuredData;
+        ok = OCTET_STRING_fromBuf(&data->content->choice.unsecuredData, frame.bytes.data(), static_cast<int>(frame.bytes.size())) == 0
+            && encode(&asn_DEF_Ieee1609Dot2Data, data, ATS_CANONICAL_OER, out);
+    }
+
+    ASN_STRUCT_FREE(asn_DEF_Ieee1609Dot2Data, data);
+    return ok;
+}
+
+std::string ACMCorpusGen::ode_envelope(const std::string& hex, uint64_t record) const {
+    std::ostringstream os;
+    os << "<OdeAsn1Data><metadata><payloadType>us.dot.its.jpo.ode.model.OdeAsn1Payload</payloadType>"
+       << "<serialId><streamId>acm-corpus-gen</streamId><bundleSize>1</bundleSize><bundleId>0</bundleId>"
+       << "<recordId>" << record << "</recordId><serialNumber>" << record << "</serialNumber></serialId>"
+       << "<encodings><encodings><elementName>unsecuredData</elementName><elementType>MessageFrame</elementType>"
+       << "<encodingRule>" << (wrap_1609 || encoding == "uper" ? "UPER" : "COER") << "</encodingRule></encodings>";
+    if (wrap_1609) {
+        os << "<encodings><elementName>root</elementName><elementType>Ieee1609Dot2Data</elementType><encodingRule>COER</encodingRule></encodings>";
+    }
+    os << "</encodings></metadata>"
+       << "<payload><dataType>us.dot.its.jpo.ode.model.OdeHexByteArray</dataType><data><bytes>" << hex << "</bytes></data></payload>"
+       << "</OdeAsn1Data>";
+    return os.str();
+}
+
+void ACMCorpusGen::write(long id, const std::string& name, const Buffer& encoded, uint64_t record) {
+    std::ostream& os = sink(id);
+
+    if (format == "bin") {
+        uint32_t length = htonl(static_cast<uint32_t>(encoded.bytes.size()));
+        os.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        os.write(encoded.bytes.data(), encoded.bytes.size());
+    } else if (format == "xer") {
+        os.write(xer.bytes.data(), xer.bytes.size());
+        os << '\n';
+    } else if (format == "ode") {
+        os << ode_envelope(to_hex(encoded.bytes), record) << '\n';
+    } else {
+        os << name << ' ' << (wrap_1609 ? "Ieee1609Dot2Data" : "MessageFrame") << ' ' << (wrap_1609 ? "coer" : encoding) << ' ' << to_hex(encoded.bytes) << '\n';
+    }
+}
+
+int ACMCorpusGen::operator()(void) {
+    uint64_t count = 1000;
+    uint64_t max_bytes = 0;
+    uint64_t seed = std::random_device{}();
+    int max_attempts = 100;
+
+    try {
+        if (!parse_ids(optIsSet('m') ? optString('m') : "20")) {
+            std::cerr << "invalid messageId list: " << optString('m') << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (optIsSet('c')) count = std::stoull(optString('c'));
+        if (optIsSet('b')) max_bytes = std::stoull(optString('b'));
+        if (optIsSet('s')) seed = std::stoull(optString('s'));
+        if (optIsSet('a')) max_attempts = std::stoi(optString('a'));
+    } catch (const std::exception&) {
+        std::cerr << "numeric option expected" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (optIsSet('e')) encoding = optString('e');
+    if (optIsSet('f')) format = optString('f');
+    if (optIsSet('o')) output = optString('o');
+    wrap_1609 = optIsSet('w');
+
+    if (encoding != "uper" && encoding != "coer") {
+        std::cerr << "encoding must be uper or coer: " << encoding << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (format != "hex" && format != "bin" && format != "xer" && format != "ode") {
+        std::cerr << "format must be hex, bin, xer, or ode: " << format << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (wrap_1609 && encoding != "uper") {
+        // the ODE and the ACM expect the MessageFrame inside 1609.2 unsecuredData in UPER.
+        std::cerr << "1609.2 wrapping always uses a UPER MessageFrame; ignoring -e " << encoding << std::endl;
+        encoding = "uper";
+    }
+
+    std::unique_ptr<SizeDistribution> sizes;
+    try {
+        sizes.reset(new SizeDistribution{ optIsSet('z') ? optString('z') : "uniform:16:1024" });
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    asn_OP_SEQUENCE.random_fill = sequence_random_fill;
+    asn_OP_CHOICE.random_fill = choice_random_fill;
+    asn_OP_OPEN_TYPE.random_fill = open_type_random_fill;
+
+    // asn_random_fill draws from random(); seed both so a corpus can be regenerated exactly.
+    std::mt19937_64 rng{ seed };
+    srandom(static_cast<unsigned int>(seed));
+    std::discrete_distribution<std::size_t> pick{ weights.begin(), weights.end() };
+
+    const enum asn_transfer_syntax syntax = (encoding == "coer") ? ATS_CANONICAL_OER : ATS_UNALIGNED_BASIC_PER;
+
+    std::map<long, uint64_t> generated;
+    uint64_t rejected = 0;
+    uint64_t written_bytes = 0;
+
+    try {
+        for (uint64_t record = 0; record < count && (max_bytes == 0 || written_bytes < max_bytes); ++record) {
+            long id = ids[pick(rng)];
+
+            std::string name;
+            bool ok = false;
+            for (int attempt = 0; !ok && attempt < max_attempts; ++attempt) {
+                ok = generate(id, (*sizes)(rng), syntax, name);
+                if (!ok) ++rejected;
+            }
+            if (!ok) {
+                std::cerr << "no valid MessageFrame for messageId " << id << " after " << max_attempts << " attempts" << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            const Buffer& encoded = wrap_1609 ? wrapped : frame_bytes;
+            write(id, name, encoded, record);
+            written_bytes += encoded.bytes.size();
+            ++generated[id];
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    for (auto& out : outputs) out.second->flush();
+
+    std::cerr << "seed " << seed << ", " << written_bytes << " encoded bytes, " << rejected << " rejected fills" << std::endl;
+    for (const auto& g : generated) {
+        std::cerr << "messageId " << g.first << ": " << g.second << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+    ACMCorpusGen gen{"acm_corpus_gen", "Generate random, constraint valid J2735 MessageFrame corpora"};
+
+    gen.addOption('m', "message-ids", "Comma separated messageIds with optional weights, e.g., 20:8,19,31 (default 20).", true);
+    gen.addOption('c', "count", "Number of messages to generate (default 1000).", true);
+    gen.addOption('b', "max-bytes", "Stop once this many encoded bytes have been written.", true);
+    gen.addOption('z', "size", "Random fill size budget: fixed:N, uniform:MIN:MAX, or lognormal:MEDIAN:SIGMA (default uniform:16:1024).", true);
+    gen.addOption('e', "encoding", "MessageFrame encoding: uper or coer (default uper).", true);
+    gen.addOption('f', "format", "Output form: hex, bin, xer, or ode (default hex).", true);
+    gen.addOption('w', "wrap-1609", "Wrap each MessageFrame in an unsecured Ieee1609Dot2Data.", false);
+    gen.addOption('o', "output", "Output file; {id} in the name writes one file per messageId (default stdout).", true);
+    gen.addOption('s', "seed", "Random seed; the same seed and options reproduce the same corpus.", true);
+    gen.addOption('a', "attempts", "Random fills to try per message before giving up (default 100).", true);
+    gen.addOption('h', "help", "print out some help");
+
+    if (!gen.parseArgs(argc, argv)) {
+        gen.usage();
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (gen.optIsSet('h')) {
+        gen.help();
+        std::exit(EXIT_SUCCESS);
+    }
+
+    std::exit(gen.run());
+}
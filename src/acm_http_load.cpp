@@ -0,0 +1,675 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2017 US DOT - Joint Program Office
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Load generator for the ACM HTTP server (ACM_HTTP_SERVER mode).
+ *
+ * Each of -c connections is a thread with its own keep-alive HTTP/1.1 connection that POSTs hex MessageFrames from a
+ * corpus to /j2735/uper/xer, or batches of them to /batch/j2735/uper/xer, and checks every response body against the
+ * XER expected for those MessageFrames. The expected XER is computed at startup with the same ASN1_Codec the server
+ * runs, or read from a file (-x) with one XER line per corpus line when the server under test is a different build.
+ *
+ * With -r the load is open loop: request i is scheduled at i / rate seconds and its latency is measured from that
+ * scheduled time, so a stalled server is charged for the requests it delayed. Without -r every connection sends its
+ * next request as soon as the previous response arrives.
+ *
+ * Reports are JSON lines, one per interval and a summary:
+ *
+ *     {"endpoint":"single","elapsed_s":5.0,"requests":...,"messages":...,"interval_req_per_sec":...,
+ *      "interval_msgs_per_sec":...,"errors":0,"http_errors":0,"mismatches":0,"latency_us_p50":...,...}
+ */
+
+#include "acm.hpp"
+#include "acm_metrics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+/**
+ * One keep-alive HTTP/1.1 client connection; only what the ACM server needs (Content-Length framed responses).
+ */
+class HttpConnection {
+    public:
+        HttpConnection(const std::string& host, const std::string& port, int timeout_ms) :
+            host_{ host }, port_{ port }, timeout_ms_{ timeout_ms }
+        {}
+
+        ~HttpConnection() { close(); }
+
+        HttpConnection(const HttpConnection&) = delete;
+        HttpConnection& operator=(const HttpConnection&) = delete;
+
+        /**
+         * @brief POST body to path and read the response.
+         *
+         * @return false on a transport or framing error, with the reason in error; the connection is then closed and
+         * reopened by the next call.
+         */
+        bool post(const std::string& path, const std::string& content_type, const std::string& body, int& status, std::string& response, std::string& error);
+
+        void close() {
+            if (fd_ >= 0) ::close(fd_);
+            fd_ = -1;
+            buffer_.clear();
+        }
+
+    private:
+        bool connect(std::string& error);
+        bool send_all(const std::string& data, std::string& error);
+        bool fill(std::string& error);
+
+        std::string host_;
+        std::string port_;
+        int timeout_ms_;
+        int fd_ = -1;
+        std::string buffer_;                        ///< bytes read past the end of the last response.
+};
+
+bool HttpConnection::connect(std::string& error) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* addresses = nullptr;
+    int rc = ::getaddrinfo(host_.c_str(), port_.c_str(), &hints, &addresses);
+    if (rc != 0) {
+        error = std::string{ "cannot resolve " } + host_ + ": " + ::gai_strerror(rc);
+        return false;
+    }
+
+    for (addrinfo* a = addresses; a; a = a->ai_next) {
+        fd_ = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd_ < 0) continue;
+        if (::connect(fd_, a->ai_addr, a->ai_addrlen) == 0) break;
+        ::close(fd_);
+        fd_ = -1;
+    }
+    ::freeaddrinfo(addresses);
+
+    if (fd_ < 0) {
+        error = "cannot connect to " + host_ + ":" + port_ + ": " + std::strerror(errno);
+        return false;
+    }
+
+    // requests are written in one piece; do not let Nagle hold the tail of one back.
+    int one = 1;
+    ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    timeval tv{ timeout_ms_ / 1000, (timeout_ms_ % 1000) * 1000 };
+    ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ::setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    return true;
+}
+
+bool HttpConnection::send_all(const std::string& data, std::string& error) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            error = std::string{ "send failed: " } + std::strerror(errno);
+            return false;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool HttpConnection::fill(std::string& error) {
+    char chunk[16384];
+    for (;;) {
+        ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+            buffer_.append(chunk, static_cast<std::size_t>(n));
+            return true;
+        }
+        if (n == 0) {
+            error = "connection closed by the server";
+            return false;
+        }
+        if (errno == EINTR) continue;
+        error = (errno == EAGAIN || errno == EWOULDBLOCK) ? std::string{ "response timed out" } : std::string{ "recv failed: " } + std::strerror(errno);
+        return false;
+    }
+}
+
+bool HttpConnection::post(const std::string& path, const std::string& content_type, const std::string& body, int& status, std::string& response, std::string& error) {
+    if (fd_ < 0 && !connect(error)) return false;
+
+    std::string request;
+    request.reserve(body.size() + 160);
+    request += "POST " + path + " HTTP/1.1\r\nHost: " + host_ + ":" + port_
+        + "\r\nContent-Type: " + content_type
+        + "\r\nContent-Length: " + std::to_string(body.size())
+        + "\r\nConnection: keep-alive\r\n\r\n";
+    request += body;
+
+    if (!send_all(request, error)) {
+        close();
+        return false;
+    }
+
+    std::size_t header_end;
+    while ((header_end = buffer_.find("\r\n\r\n")) == std::string::npos) {
+        if (!fill(error)) {
+            close();
+            return false;
+        }
+    }
+
+    // status line, then the two headers that matter; names are case insensitive.
+    std::string headers = buffer_.substr(0, header_end);
+    for (auto& c : headers) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+    if (headers.compare(0, 5, "http/") != 0 || headers.find(' ') == std::string::npos) {
+        error = "malformed status line";
+        close();
+        return false;
+    }
+    status = std::atoi(headers.c_str() + headers.find(' ') + 1);
+
+    std::size_t length_at = headers.find("\r\ncontent-length:");
+    if (length_at == std::string::npos) {
+        error = "response without Content-Length";
+        close();
+        return false;
+    }
+    std::size_t content_length = std::strtoul(headers.c_str() + length_at + 17, nullptr, 10);
+    bool server_closes = headers.find("\r\nconnection: close") != std::string::npos;
+
+    std::size_t body_start = header_end + 4;
+    while (buffer_.size() < body_start + content_length) {
+        if (!fill(error)) {
+            close();
+            return false;
+        }
+    }
+
+    response.assign(buffer_, body_start, content_length);
+    buffer_.erase(0, body_start + content_length);
+
+    if (server_closes) close();
+    return true;
+}
+
+int buffer_append(const void *buffer, size_t size, void *app_key) {
+    buffer_structure_t *xb = static_cast<buffer_structure_t *>(app_key);
+
+    if (xb->buffer_size + size + 1 > xb->allocated_size) {
+        size_t new_size = 2 * (xb->allocated_size ? xb->allocated_size : 64);
+        while (xb->buffer_size + size + 1 > new_size) new_size *= 2;
+        char *new_buf = static_cast<char *>(std::realloc(xb->buffer, new_size));
+        if (!new_buf) return -1;
+        xb->buffer = new_buf;
+        xb->allocated_size = new_size;
+    }
+
+    std::memcpy(xb->buffer + xb->buffer_size, buffer, size);
+    xb->buffer_size += size;
+    xb->buffer[xb->buffer_size] = '\0';
+    return 0;
+}
+
+std::string percentiles_json(const metrics::HistogramSnapshot& h, const std::string& prefix) {
+    std::ostringstream os;
+    os << "\"" << prefix << "_p50\":" << h.percentile(0.5) / 1000
+       << ",\"" << prefix << "_p90\":" << h.percentile(0.9) / 1000
+       << ",\"" << prefix << "_p99\":" << h.percentile(0.99) / 1000
+       << ",\"" << prefix << "_p999\":" << h.percentile(0.999) / 1000
+       << ",\"" << prefix << "_max\":" << h.max / 1000;
+    return os.str();
+}
+
+/**
+ * What one connection has done; the reporter merges and resets the interval part under the lock.
+ */
+struct WorkerStats {
+    std::mutex lock;
+    metrics::HistogramSnapshot interval;
+    metrics::HistogramSnapshot total;
+    uint64_t requests = 0;
+    uint64_t messages = 0;
+    uint64_t errors = 0;                    ///< transport failures: refused, reset, timed out.
+    uint64_t http_errors = 0;               ///< responses with a status other than 200.
+    uint64_t mismatches = 0;                ///< 200 responses whose body is not the expected XER.
+    uint64_t late = 0;                      ///< open loop requests sent more than one period behind schedule.
+};
+
+}  // end namespace.
+
+class ACMHttpLoad : public tool::Tool {
+    public:
+        ACMHttpLoad(const std::string& name, const std::string& description) :
+            Tool{ name, description, false }
+            , codec{ "acm_http_load", "ASN1_Codec computing the expected responses" }
+        {}
+
+        int operator()(void) override;
+
+    private:
+        ASN1_Codec codec;
+        std::ostream* out = &std::cout;
+        std::string host = "localhost";
+        std::string port = "9999";
+        bool batch = false;
+        bool verify = true;
+        int connections = 4;
+        int batch_size = 100;
+        int timeout_ms = 10000;
+        double rate = 0.0;                  ///< requests per second over all connections; 0 is closed loop.
+        uint64_t max_requests = 0;
+        int duration_seconds = 0;
+        int report_seconds = 5;
+
+        std::vector<std::string> corpus;    ///< hex MessageFrames.
+        std::vector<std::string> expected;  ///< the canonical XER for each corpus entry.
+
+        std::atomic<uint64_t> issued{ 0 };
+        std::atomic<bool> stopping{ false };
+        std::atomic<uint64_t> logged_failures{ 0 };
+
+        bool load_corpus(const std::string& path);
+        bool load_expected(const std::string& path);
+        bool compute_expected();
+
+        bool check(uint64_t first, int count, const std::string& body, std::string& reason) const;
+        void log_failure(const std::string& what);
+        void worker(std::size_t id, WorkerStats& stats, clock_type::time_point start);
+        void report(std::vector<std::unique_ptr<WorkerStats>>& workers, double elapsed, double interval, bool summary);
+
+        uint64_t reported_requests = 0;
+        uint64_t reported_messages = 0;
+};
+
+bool ACMHttpLoad::load_corpus(const std::string& path) {
+    std::ifstream in{ path };
+    if (!in) {
+        std::cerr << "cannot open corpus: " << path << std::endl;
+        return false;
+    }
+
+    // a hex MessageFrame per line; lines with several fields (e.g., data/bench/corpus.hex) use the last one.
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields{ line };
+        std::string field, hex;
+        while (fields >> field) hex = field;
+        if (!hex.empty()) corpus.push_back(hex);
+    }
+
+    if (corpus.empty()) {
+        std::cerr << "corpus is empty: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ACMHttpLoad::load_expected(const std::string& path) {
+    std::ifstream in{ path };
+    if (!in) {
+        std::cerr << "cannot open expected responses: " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        expected.push_back(line);
+    }
+
+    if (expected.size() != corpus.size()) {
+        std::cerr << "expected responses has " << expected.size() << " lines for " << corpus.size() << " corpus entries." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ACMHttpLoad::compute_expected() {
+    std::vector<std::string> decodable;
+
+    for (auto& hex : corpus) {
+        std::string input{ hex };
+        buffer_structure_t xb = { 0, 0, 0 };
+        bool ok = false;
+        try {
+            ok = codec.decode_messageframe_data(input, &xb);
+        } catch (const std::exception& e) {
+            std::cerr << "skipping a corpus entry that does not decode (" << e.what() << "): " << hex.substr(0, 32) << "..." << std::endl;
+        }
+        if (ok) {
+            decodable.push_back(hex);
+            expected.emplace_back(xb.buffer, xb.buffer_size);
+        }
+        std::free(xb.buffer);
+    }
+
+    corpus.swap(decodable);
+    if (corpus.empty()) {
+        std::cerr << "no corpus entry decodes as a MessageFrame." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The single endpoint returns the XER itself; the batch endpoint returns one XER line per input line.
+ */
+bool ACMHttpLoad::check(uint64_t first, int count, const std::string& body, std::string& reason) const {
+    if (!batch) {
+        const std::string& want = expected[first % expected.size()];
+        if (body == want) return true;
+        reason = "response differs from the expected XER for corpus entry " + std::to_string(first % expected.size());
+        return false;
+    }
+
+    std::size_t at = 0;
+    for (int i = 0; i < count; ++i) {
+        std::size_t eol = body.find('\n', at);
+        if (eol == std::string::npos) {
+            reason = "batch response has " + std::to_string(i) + " of " + std::to_string(count) + " lines";
+            return false;
+        }
+        const std::string& want = expected[(first + i) % expected.size()];
+        if (body.compare(at, eol - at, want) != 0) {
+            reason = "batch line " + std::to_string(i) + " differs from the expected XER for corpus entry " + std::to_string((first + i) % expected.size());
+            return false;
+        }
+        at = eol + 1;
+    }
+
+    if (at != body.size()) {
+        reason = "batch response has more than " + std::to_string(count) + " lines";
+        return false;
+    }
+    return true;
+}
+
+void ACMHttpLoad::log_failure(const std::string& what) {
+    // the first few are useful, thousands of copies of the same one are not.
+    if (logged_failures.fetch_add(1, std::memory_order_relaxed) < 10) {
+        std::cerr << what << std::endl;
+    }
+}
+
+void ACMHttpLoad::worker(std::size_t id, WorkerStats& stats, clock_type::time_point start) {
+    HttpConnection connection{ host, port, timeout_ms };
+    const std::string path = batch ? "/batch/j2735/uper/xer" : "/j2735/uper/xer";
+    const int per_request = batch ? batch_size : 1;
+    const auto period = rate > 0 ? std::chrono::nanoseconds{ static_cast<int64_t>(1e9 / rate) } : std::chrono::nanoseconds{ 0 };
+
+    std::string body, response, error, reason;
+    int status = 0;
+
+    while (!stopping.load(std::memory_order_relaxed)) {
+        uint64_t n = issued.fetch_add(1, std::memory_order_relaxed);
+        if (max_requests > 0 && n >= max_requests) break;
+
+        // latency runs from the schedule in open loop and from the send in closed loop.
+        clock_type::time_point from = clock_type::now();
+        bool late = false;
+        if (rate > 0) {
+            auto scheduled = start + period * static_cast<int64_t>(n);
+            if (scheduled > from) {
+                std::this_thread::sleep_until(scheduled);
+            } else if (from - scheduled > period) {
+                late = true;
+            }
+            from = scheduled;
+        }
+
+        uint64_t first = n * static_cast<uint64_t>(per_request);
+        body.clear();
+        for (int i = 0; i < per_request; ++i) {
+            body += corpus[(first + i) % corpus.size()];
+            if (batch) body += '\n';
+        }
+
+        bool sent = connection.post(path, "text/plain", body, status, response, error);
+        uint64_t latency = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - from).count());
+
+        bool mismatch = false;
+        if (sent && status == 200 && verify && !check(first, per_request, response, reason)) {
+            mismatch = true;
+            log_failure("connection " + std::to_string(id) + ": " + reason);
+        } else if (!sent) {
+            log_failure("connection " + std::to_string(id) + ": " + error);
+        } else if (status != 200) {
+            log_failure("connection " + std::to_string(id) + ": HTTP " + std::to_string(status) + ": " + response.substr(0, 200));
+        }
+
+        {
+            std::lock_guard<std::mutex> guard{ stats.lock };
+            if (late) ++stats.late;
+            if (sent) {
+                ++stats.requests;
+                stats.messages += static_cast<uint64_t>(per_request);
+                stats.interval.record(latency);
+                stats.total.record(latency);
+                if (status != 200) ++stats.http_errors;
+                if (mismatch) ++stats.mismatches;
+            } else {
+                ++stats.errors;
+            }
+        }
+
+        // a server that is down fails every request at once; back off rather than spin through -n.
+        if (!sent) std::this_thread::sleep_for(std::chrono::milliseconds{ 100 });
+    }
+}
+
+void ACMHttpLoad::report(std::vector<std::unique_ptr<WorkerStats>>& workers, double elapsed, double interval, bool summary) {
+    metrics::HistogramSnapshot latency;
+    uint64_t requests = 0, messages = 0, errors = 0, http_errors = 0, mismatches = 0, late = 0;
+
+    for (auto& w : workers) {
+        std::lock_guard<std::mutex> guard{ w->lock };
+        latency.merge(summary ? w->total : w->interval);
+        w->interval.reset();
+        requests += w->requests;
+        messages += w->messages;
+        errors += w->errors;
+        http_errors += w->http_errors;
+        mismatches += w->mismatches;
+        late += w->late;
+    }
+
+    std::ostringstream os;
+    os << "{\"endpoint\":\"" << (batch ? "batch" : "single") << "\"";
+    if (summary) os << ",\"summary\":true";
+    os << ",\"connections\":" << connections
+       << ",\"elapsed_s\":" << elapsed
+       << ",\"requests\":" << requests
+       << ",\"messages\":" << messages;
+    if (summary) {
+        os << ",\"req_per_sec\":" << (elapsed > 0 ? requests / elapsed : 0.0)
+           << ",\"msgs_per_sec\":" << (elapsed > 0 ? messages / elapsed : 0.0);
+    } else {
+        os << ",\"interval_req_per_sec\":" << (requests - reported_requests) / interval
+           << ",\"interval_msgs_per_sec\":" << (messages - reported_messages) / interval;
+    }
+    os << ",\"target_rate\":" << rate
+       << ",\"late\":" << late
+       << ",\"errors\":" << errors
+       << ",\"http_errors\":" << http_errors
+       << ",\"mismatches\":" << mismatches
+       << "," << percentiles_json(latency, "latency_us")
+       << "}";
+    *out << os.str() << std::endl;
+
+    reported_requests = requests;
+    reported_messages = messages;
+}
+
+int ACMHttpLoad::operator()(void) {
+    if (optIsSet('u')) {
+        std::string server = optString('u');
+        std::size_t colon = server.rfind(':');
+        if (colon == std::string::npos) {
+            host = server;
+        } else {
+            host = server.substr(0, colon);
+            port = server.substr(colon + 1);
+        }
+    }
+    if (optIsSet('e')) {
+        if (optString('e') == "batch") {
+            batch = true;
+        } else if (optString('e') != "single") {
+            std::cerr << "unknown endpoint: " << optString('e') << "; use single or batch." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (optIsSet('c')) connections = std::stoi(optString('c'));
+    if (optIsSet('b')) batch_size = std::stoi(optString('b'));
+    if (optIsSet('r')) rate = std::stod(optString('r'));
+    if (optIsSet('n')) max_requests = std::stoull(optString('n'));
+    if (optIsSet('T')) duration_seconds = std::stoi(optString('T'));
+    if (optIsSet('I')) report_seconds = std::stoi(optString('I'));
+    if (optIsSet('t')) timeout_ms = std::stoi(optString('t'));
+    verify = !optIsSet('N');
+
+    if (connections <= 0 || batch_size <= 0 || rate < 0 || report_seconds <= 0 || timeout_ms <= 0) {
+        std::cerr << "connections, batch size, report interval, and timeout must be > 0; rate must be >= 0." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // without a stopping condition, run for a fixed time rather than forever.
+    if (max_requests == 0 && duration_seconds == 0) duration_seconds = 30;
+
+    if (!optIsSet('F')) {
+        std::cerr << "Must specify a corpus of hex MessageFrames with -F." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!load_corpus(optString('F'))) return EXIT_FAILURE;
+
+    // logging would dominate the numbers; only failures are of interest here.
+    codec.logger = std::make_shared<AcmLogger>("acm_http_load");
+    codec.logger->set_level(spdlog::level::off);
+
+    if (verify) {
+        if (optIsSet('x')) {
+            if (!load_expected(optString('x'))) return EXIT_FAILURE;
+        } else if (!compute_expected()) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::ofstream file;
+    if (optIsSet('o')) {
+        file.open(optString('o'));
+        if (!file) {
+            std::cerr << "cannot open output file: " << optString('o') << std::endl;
+            return EXIT_FAILURE;
+        }
+        out = &file;
+    }
+
+    std::vector<std::unique_ptr<WorkerStats>> workers;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < connections; ++i) workers.emplace_back(new WorkerStats);
+
+    const auto start = clock_type::now();
+    for (int i = 0; i < connections; ++i) {
+        threads.emplace_back(&ACMHttpLoad::worker, this, static_cast<std::size_t>(i), std::ref(*workers[i]), start);
+    }
+
+    // the main thread only reports and watches the clock; workers stop themselves on -n.
+    const auto stop = start + std::chrono::seconds{ duration_seconds };
+    auto next_report = start + std::chrono::seconds{ report_seconds };
+    for (;;) {
+        bool all_issued = max_requests > 0 && issued.load(std::memory_order_relaxed) >= max_requests;
+        auto now = clock_type::now();
+        if (all_issued || (duration_seconds > 0 && now >= stop)) break;
+
+        auto wake = next_report;
+        if (duration_seconds > 0 && stop < wake) wake = stop;
+        std::this_thread::sleep_until(std::min(wake, now + std::chrono::milliseconds{ 100 }));
+
+        if (clock_type::now() >= next_report) {
+            report(workers, std::chrono::duration<double>(clock_type::now() - start).count(), report_seconds, false);
+            next_report += std::chrono::seconds{ report_seconds };
+        }
+    }
+
+    stopping.store(true);
+    for (auto& t : threads) t.join();
+
+    report(workers, std::chrono::duration<double>(clock_type::now() - start).count(), report_seconds, true);
+
+    for (auto& w : workers) {
+        if (w->errors || w->http_errors || w->mismatches) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+    ACMHttpLoad acm_http_load{"acm_http_load", "Load and correctness test for the ACM HTTP server"};
+
+    acm_http_load.addOption('u', "server", "host:port of the ACM HTTP server (default localhost:9999).", true);
+    acm_http_load.addOption('e', "endpoint", "single (default) posts one MessageFrame to /j2735/uper/xer; batch posts -b to /batch/j2735/uper/xer.", true);
+    acm_http_load.addOption('F', "corpus", "File of hex MessageFrames, one per line.", true);
+    acm_http_load.addOption('x', "expected", "File of the expected XER, one line per corpus line (default: decode the corpus locally).", true);
+    acm_http_load.addOption('N', "no-verify", "Do not check the response bodies.", false);
+    acm_http_load.addOption('c', "connections", "Concurrent keep-alive connections, one thread each (default 4).", true);
+    acm_http_load.addOption('r', "rate", "Open loop target in requests per second over all connections (default: closed loop).", true);
+    acm_http_load.addOption('b', "batch-size", "MessageFrames per batch request (default 100).", true);
+    acm_http_load.addOption('n', "requests", "Stop after this many requests.", true);
+    acm_http_load.addOption('T', "duration", "Stop after this many seconds (default 30 when -n is not given).", true);
+    acm_http_load.addOption('I', "interval", "Seconds between reports (default 5).", true);
+    acm_http_load.addOption('t', "timeout", "Milliseconds to wait on a socket before counting an error (default 10000).", true);
+    acm_http_load.addOption('o', "output", "Write the JSON report lines to this file instead of stdout.", true);
+    acm_http_load.addOption('h', "help", "print out some help");
+
+    if (!acm_http_load.parseArgs(argc, argv)) {
+        acm_http_load.usage();
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (acm_http_load.optIsSet('h')) {
+        acm_http_load.help();
+        std::exit(EXIT_SUCCESS);
+    }
+
+    std::exit(acm_http_load.run());
+}
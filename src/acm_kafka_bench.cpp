@@ -0,0 +1,522 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2017 US DOT - Joint Program Office
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * End-to-end benchmark of the ACM Kafka pipeline against the librdkafka in-process mock cluster.
+ *
+ * A producer created with test.mock.num.brokers owns the mock cluster; the input and output topics are created on it,
+ * and the unmodified ASN1_Codec consume, decode or encode, produce loop runs in a thread against its bootstrap servers.
+ * No broker, Docker, or network beyond loopback is needed.
+ *
+ * Two modes:
+ *
+ * - backlog (default): -n ODE envelopes are produced to the input topic before the ACM starts, and the time the ACM
+ *   takes to drain them gives the sustained throughput.
+ * - rate (-r): envelopes are produced at a fixed rate while the ACM runs. Each carries its scheduled send time in a
+ *   header that the ACM copies to its output, so the probe consumer on the output topic measures the end-to-end latency
+ *   on one clock.
+ *
+ * In both modes the ACM's own consume to produce latency is read from the metrics registry. Reports are JSON lines:
+ *
+ *     {"bench":"kafka_pipeline","mode":"backlog","type":"decode","elapsed_s":...,"produced":...,"published":...,
+ *      "outputs":...,"errors":...,"interval_msgs_per_sec":...,"acm_us_p50":...,...}
+ */
+
+#include "acm.hpp"
+#include "acm_metrics.hpp"
+
+#include <librdkafka/rdkafka_mock.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+#include <unistd.h>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+const std::string kInputTopic = "acm.bench.input";
+const std::string kOutputTopic = "acm.bench.output";
+const std::string kSendHeader = "acm-bench-ns";            ///< the monotonic now_ns() at the scheduled send.
+
+std::string percentiles_json(const metrics::HistogramSnapshot& h, const std::string& prefix) {
+    std::ostringstream os;
+    os << "\"" << prefix << "_p50\":" << h.percentile(0.5) / 1000
+       << ",\"" << prefix << "_p90\":" << h.percentile(0.9) / 1000
+       << ",\"" << prefix << "_p99\":" << h.percentile(0.99) / 1000
+       << ",\"" << prefix << "_p999\":" << h.percentile(0.999) / 1000
+       << ",\"" << prefix << "_max\":" << h.max / 1000;
+    return os.str();
+}
+
+uint64_t total_errors() {
+    uint64_t errors = 0;
+    for (std::size_t i = 0; i < metrics::kMaxErrorTypes; ++i) errors += metrics::Registry::instance().total_errors(i);
+    return errors;
+}
+
+}  // end namespace.
+
+class ACMKafkaBench : public tool::Tool {
+    public:
+        ACMKafkaBench(const std::string& name, const std::string& description) :
+            Tool{ name, description, false }
+            , codec{ "acm_kafka_bench", "ASN1_Codec under benchmark" }
+        {}
+
+        ~ACMKafkaBench() {
+            if (!config_path.empty()) std::remove(config_path.c_str());
+        }
+
+        int operator()(void) override;
+
+    private:
+        ASN1_Codec codec;
+        std::ostream* out = &std::cout;
+        std::string root = ".";
+        std::string type = "decode";
+        std::string config_path;
+        uint64_t messages = 100000;
+        double rate = 0.0;                      ///< envelopes per second in rate mode; 0 selects backlog mode.
+        int partitions = 1;
+        int brokers = 1;
+        int report_seconds = 5;
+        int idle_seconds = 30;                  ///< give up when no output arrives for this long.
+
+        std::vector<std::string> corpus;
+        std::shared_ptr<RdKafka::Producer> producer;
+        std::shared_ptr<RdKafka::KafkaConsumer> probe;
+        std::string bootstraps;
+
+        std::atomic<uint64_t> produced{ 0 };
+        std::atomic<bool> producing{ false };
+
+        bool load_corpus();
+        bool start_cluster();
+        bool write_config();
+        bool start_probe();
+        bool produce_one(const std::string& record, uint64_t send_ns);
+        void produce_at_rate(clock_type::time_point start);
+        bool start_codec();
+
+        /**
+         * @param interval the report interval, or for the summary the time to the first output.
+         */
+        void report(double elapsed, double interval, uint64_t outputs, uint64_t interval_outputs,
+                const metrics::HistogramSnapshot& e2e, const metrics::HistogramSnapshot& acm, bool summary);
+};
+
+/**
+ * The corpus is a file of ODE envelopes, one per line (e.g., acm_corpus_gen -f ode), or the bench envelopes for the
+ * selected direction from data/bench/envelopes.txt.
+ */
+bool ACMKafkaBench::load_corpus() {
+    std::string line;
+
+    if (optIsSet('F')) {
+        std::ifstream in{ optString('F') };
+        if (!in) {
+            std::cerr << "cannot open corpus: " << optString('F') << std::endl;
+            return false;
+        }
+        while (std::getline(in, line)) {
+            if (!line.empty()) corpus.push_back(line);
+        }
+
+    } else {
+        std::ifstream in{ root + "/data/bench/envelopes.txt" };
+        if (!in) {
+            std::cerr << "cannot open envelope list: " << root << "/data/bench/envelopes.txt" << std::endl;
+            return false;
+        }
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream fields{ line };
+            std::string name, direction, path;
+            fields >> name >> direction >> path;
+            if (direction != type) continue;
+
+            std::ifstream xml{ root + "/" + path };
+            if (!xml) {
+                std::cerr << "cannot open envelope: " << path << std::endl;
+                continue;
+            }
+            std::ostringstream contents;
+            contents << xml.rdbuf();
+            corpus.push_back(contents.str());
+        }
+    }
+
+    if (corpus.empty()) {
+        std::cerr << "no envelopes to send." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ACMKafkaBench::start_cluster() {
+    std::string error_string;
+    std::unique_ptr<RdKafka::Conf> conf{ RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL) };
+
+    if (conf->set("test.mock.num.brokers", std::to_string(brokers), error_string) != RdKafka::Conf::CONF_OK
+            || conf->set("queue.buffering.max.messages", "1000000", error_string) != RdKafka::Conf::CONF_OK
+            || conf->set("linger.ms", "5", error_string) != RdKafka::Conf::CONF_OK) {
+        std::cerr << "kafka error configuring the mock cluster producer: " << error_string << std::endl;
+        return false;
+    }
+
+    producer.reset(RdKafka::Producer::create(conf.get(), error_string));
+    if (!producer) {
+        std::cerr << "cannot create the mock cluster producer: " << error_string << std::endl;
+        return false;
+    }
+
+    rd_kafka_mock_cluster_t* cluster = rd_kafka_handle_mock_cluster(producer->c_ptr());
+    if (!cluster) {
+        std::cerr << "this librdkafka does not provide a mock cluster." << std::endl;
+        return false;
+    }
+    bootstraps = rd_kafka_mock_cluster_bootstraps(cluster);
+
+    if (rd_kafka_mock_topic_create(cluster, kInputTopic.c_str(), partitions, 1) != RD_KAFKA_RESP_ERR_NO_ERROR
+            || rd_kafka_mock_topic_create(cluster, kOutputTopic.c_str(), 1, 1) != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        std::cerr << "cannot create the benchmark topics on the mock cluster." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The ACM reads its settings from a file; write one that points it at the mock cluster, then append -c.
+ */
+bool ACMKafkaBench::write_config() {
+    char path[] = "/tmp/acm_kafka_bench.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        std::cerr << "cannot create a temporary configuration file." << std::endl;
+        return false;
+    }
+    close(fd);
+    config_path = path;
+
+    std::ofstream config{ config_path };
+    config << "acm.type=" << type << "\n"
+           << "acm.error.template=" << root << "/config/Output.error.xml\n"
+           << "asn1.topic.consumer=" << kInputTopic << "\n"
+           << "asn1.topic.producer=" << kOutputTopic << "\n"
+           << "asn1.consumer.timeout.ms=100\n"
+           << "metadata.broker.list=" << bootstraps << "\n"
+           << "group.id=acm-kafka-bench\n"
+           << "auto.offset.reset=earliest\n";
+
+    if (optIsSet('c')) {
+        std::ifstream extra{ optString('c') };
+        if (!extra) {
+            std::cerr << "cannot open configuration file: " << optString('c') << std::endl;
+            return false;
+        }
+        config << extra.rdbuf();
+    }
+    return static_cast<bool>(config);
+}
+
+bool ACMKafkaBench::start_probe() {
+    std::string error_string;
+    std::unique_ptr<RdKafka::Conf> conf{ RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL) };
+
+    if (conf->set("metadata.broker.list", bootstraps, error_string) != RdKafka::Conf::CONF_OK
+            || conf->set("group.id", "acm-kafka-bench-probe", error_string) != RdKafka::Conf::CONF_OK
+            || conf->set("auto.offset.reset", "earliest", error_string) != RdKafka::Conf::CONF_OK) {
+        std::cerr << "kafka error configuring the output probe: " << error_string << std::endl;
+        return false;
+    }
+
+    probe.reset(RdKafka::KafkaConsumer::create(conf.get(), error_string));
+    if (!probe) {
+        std::cerr << "cannot create the output probe: " << error_string << std::endl;
+        return false;
+    }
+
+    RdKafka::ErrorCode status = probe->subscribe({ kOutputTopic });
+    if (status != RdKafka::ERR_NO_ERROR) {
+        std::cerr << "cannot subscribe to " << kOutputTopic << ": " << RdKafka::err2str(status) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ACMKafkaBench::produce_one(const std::string& record, uint64_t send_ns) {
+    for (;;) {
+        // headers are only accepted by the topic name overload; on success librdkafka owns them.
+        RdKafka::Headers* headers = nullptr;
+        if (send_ns > 0) {
+            headers = RdKafka::Headers::create();
+            headers->add(kSendHeader, std::to_string(send_ns));
+        }
+        RdKafka::ErrorCode status = producer->produce(kInputTopic, RdKafka::Topic::PARTITION_UA, RdKafka::Producer::RK_MSG_COPY,
+                (void *)record.data(), record.size(), NULL, 0, 0, headers, NULL);
+
+        if (status == RdKafka::ERR_NO_ERROR) {
+            produced.fetch_add(1, std::memory_order_relaxed);
+            producer->poll(0);
+            return true;
+        }
+
+        delete headers;
+        if (status != RdKafka::ERR__QUEUE_FULL) {
+            std::cerr << "cannot produce to " << kInputTopic << ": " << RdKafka::err2str(status) << std::endl;
+            return false;
+        }
+        producer->poll(10);
+    }
+}
+
+/**
+ * Open loop: envelope i is stamped with, and sent at, start + i / rate, so a slow pipeline shows up as latency.
+ */
+void ACMKafkaBench::produce_at_rate(clock_type::time_point start) {
+    const auto period = std::chrono::nanoseconds{ static_cast<int64_t>(1e9 / rate) };
+    const uint64_t start_ns = metrics::now_ns();
+
+    for (uint64_t i = 0; i < messages && producing.load(std::memory_order_relaxed); ++i) {
+        auto scheduled = start + period * static_cast<int64_t>(i);
+        if (scheduled > clock_type::now()) std::this_thread::sleep_until(scheduled);
+
+        uint64_t send_ns = start_ns + static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(scheduled - start).count());
+        if (!produce_one(corpus[i % corpus.size()], send_ns)) break;
+    }
+    producer->flush(10000);
+}
+
+bool ACMKafkaBench::start_codec() {
+    // the options ASN1_Codec::configure() looks up; getopt must be reset for the second parse in this process.
+    codec.addOption('c', "config", "Configuration file name and path.", true);
+    codec.addOption('g', "group", "Consumer group identifier", true);
+    codec.addOption('o', "offset", "Byte offset to start reading in the consumed topic.", true);
+    codec.addOption('x', "exit", "Exit consumer when last message in partition has been received.", false);
+    codec.addOption('v', "log-level", "The info log level [trace,debug,info,warning,error,critical,off]", true);
+
+    std::string level = optIsSet('v') ? optString('v') : std::string{ "OFF" };
+    std::vector<std::string> args{ "acm_kafka_bench", "-c", config_path, "-v", level };
+    std::vector<char*> argv;
+    for (auto& a : args) argv.push_back(&a[0]);
+    argv.push_back(nullptr);
+
+    optind = 0;
+    if (!codec.parseArgs(static_cast<int>(args.size()), argv.data())) return false;
+
+    codec.logger = std::make_shared<AcmLogger>("acm_kafka_bench");
+    return true;
+}
+
+void ACMKafkaBench::report(double elapsed, double interval, uint64_t outputs, uint64_t interval_outputs,
+        const metrics::HistogramSnapshot& e2e, const metrics::HistogramSnapshot& acm, bool summary) {
+    metrics::Registry& registry = metrics::Registry::instance();
+
+    std::ostringstream os;
+    os << "{\"bench\":\"kafka_pipeline\",\"mode\":\"" << (rate > 0 ? "rate" : "backlog") << "\""
+       << ",\"type\":\"" << type << "\"";
+    if (summary) os << ",\"summary\":true";
+    os << ",\"brokers\":" << brokers
+       << ",\"partitions\":" << partitions
+       << ",\"elapsed_s\":" << elapsed
+       << ",\"produced\":" << produced.load()
+       << ",\"consumed\":" << registry.total(metrics::Counter::MESSAGES_RECEIVED)
+       << ",\"published\":" << registry.total(metrics::Counter::MESSAGES_PUBLISHED)
+       << ",\"outputs\":" << outputs
+       << ",\"errors\":" << total_errors();
+    if (summary) {
+        os << ",\"startup_s\":" << interval
+           << ",\"msgs_per_sec\":" << (elapsed > 0 ? outputs / elapsed : 0.0)
+           << ",\"mb_per_sec\":" << (elapsed > 0 ? registry.total(metrics::Counter::BYTES_RECEIVED) / elapsed / 1e6 : 0.0);
+    } else {
+        os << ",\"interval_msgs_per_sec\":" << interval_outputs / interval;
+    }
+    if (rate > 0) os << ",\"target_rate\":" << rate << "," << percentiles_json(e2e, "e2e_us");
+    os << "," << percentiles_json(acm, "acm_us") << "}";
+    *out << os.str() << std::endl;
+}
+
+int ACMKafkaBench::operator()(void) {
+    if (optIsSet('d')) root = optString('d');
+    if (optIsSet('t')) type = optString('t');
+    if (optIsSet('n')) messages = std::stoull(optString('n'));
+    if (optIsSet('r')) rate = std::stod(optString('r'));
+    if (optIsSet('p')) partitions = std::stoi(optString('p'));
+    if (optIsSet('k')) brokers = std::stoi(optString('k'));
+    if (optIsSet('I')) report_seconds = std::stoi(optString('I'));
+    if (optIsSet('W')) idle_seconds = std::stoi(optString('W'));
+    metrics::enable_stages(optIsSet('s'));
+
+    if ((type != "decode" && type != "encode") || messages == 0 || rate < 0 || partitions <= 0 || brokers <= 0 || report_seconds <= 0 || idle_seconds <= 0) {
+        std::cerr << "type must be decode or encode; messages, partitions, brokers, interval, and idle timeout must be > 0; rate must be >= 0." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream file;
+    if (optIsSet('o')) {
+        file.open(optString('o'));
+        if (!file) {
+            std::cerr << "cannot open output file: " << optString('o') << std::endl;
+            return EXIT_FAILURE;
+        }
+        out = &file;
+    }
+
+    if (!load_corpus() || !start_cluster() || !write_config() || !start_probe() || !start_codec()) return EXIT_FAILURE;
+
+    // backlog mode times the drain only, so the input is in the cluster before the ACM starts.
+    if (rate == 0) {
+        for (uint64_t i = 0; i < messages; ++i) {
+            if (!produce_one(corpus[i % corpus.size()], 0)) return EXIT_FAILURE;
+        }
+        producer->flush(60000);
+    }
+
+    const auto start = clock_type::now();
+    int codec_status = EXIT_SUCCESS;
+    std::thread acm{ [this, &codec_status]() { codec_status = codec.run(); } };
+
+    std::thread feeder;
+    if (rate > 0) {
+        producing.store(true);
+        feeder = std::thread{ &ACMKafkaBench::produce_at_rate, this, start };
+    }
+
+    metrics::HistogramSnapshot interval_e2e, total_e2e, previous_acm;
+    uint64_t outputs = 0, reported_outputs = 0;
+    auto next_report = start + std::chrono::seconds{ report_seconds };
+    auto first_output = start;
+    auto last_output = start;
+    bool idle = false;
+
+    while (outputs < messages) {
+        std::unique_ptr<RdKafka::Message> msg{ probe->consume(100) };
+        auto now = clock_type::now();
+
+        if (msg->err() == RdKafka::ERR_NO_ERROR) {
+            if (outputs++ == 0) first_output = now;
+            last_output = now;
+
+            RdKafka::Headers* headers = msg->headers();
+            if (rate > 0 && headers) {
+                RdKafka::Headers::Header h = headers->get_last(kSendHeader);
+                if (h.err() == RdKafka::ERR_NO_ERROR && h.value()) {
+                    uint64_t sent_ns = std::strtoull(std::string(static_cast<const char*>(h.value()), h.value_size()).c_str(), nullptr, 10);
+                    uint64_t now_ns = metrics::now_ns();
+                    uint64_t latency = now_ns > sent_ns ? now_ns - sent_ns : 0;
+                    interval_e2e.record(latency);
+                    total_e2e.record(latency);
+                }
+            }
+        } else if (now - last_output > std::chrono::seconds{ idle_seconds }) {
+            std::cerr << "no output for " << idle_seconds << " seconds; stopping with " << outputs << " of " << messages << "." << std::endl;
+            idle = true;
+            break;
+        }
+
+        if (now >= next_report) {
+            // the registry only offers running totals; the interval is the difference of the counts.
+            metrics::HistogramSnapshot acm = metrics::Registry::instance().latency_snapshot(metrics::Latency::CONSUME_TO_PRODUCE);
+            metrics::HistogramSnapshot interval_acm = acm;
+            for (std::size_t i = 0; i < metrics::kBucketCount; ++i) interval_acm.counts[i] -= previous_acm.counts[i];
+            interval_acm.count -= previous_acm.count;
+            interval_acm.sum -= previous_acm.sum;
+            interval_acm.max = 0;
+            for (std::size_t i = metrics::kBucketCount; i-- > 0;) {
+                if (interval_acm.counts[i] > 0) {
+                    interval_acm.max = std::min(metrics::bucket_upper(i), acm.max);
+                    break;
+                }
+            }
+
+            report(std::chrono::duration<double>(now - start).count(), report_seconds, outputs, outputs - reported_outputs, interval_e2e, interval_acm, false);
+
+            previous_acm = acm;
+            interval_e2e.reset();
+            reported_outputs = outputs;
+            next_report += std::chrono::seconds{ report_seconds };
+        }
+    }
+
+    // a backlog drain is timed from the first output to the last, leaving out the consumer group join; a fixed rate
+    // run is timed from the start.
+    double elapsed = std::chrono::duration<double>(last_output - (rate > 0 ? start : first_output)).count();
+    double startup = std::chrono::duration<double>(first_output - start).count();
+
+    producing.store(false);
+    if (feeder.joinable()) feeder.join();
+    ASN1_Codec::sigterm(SIGTERM);
+    acm.join();
+    probe->close();
+
+    report(elapsed, startup, outputs, 0, total_e2e, metrics::Registry::instance().latency_snapshot(metrics::Latency::CONSUME_TO_PRODUCE), true);
+
+    if (optIsSet('s')) {
+        for (const auto& line : metrics::Registry::instance().stage_report()) {
+            std::cerr << line << std::endl;
+        }
+    }
+
+    return (idle || codec_status != EXIT_SUCCESS || total_errors() > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+    ACMKafkaBench acm_kafka_bench{"acm_kafka_bench", "ACM Kafka pipeline benchmark on the librdkafka mock cluster"};
+
+    acm_kafka_bench.addOption('t', "type", "decode (default) or encode; selects the ACM acm.type and the bench envelopes.", true);
+    acm_kafka_bench.addOption('F', "corpus", "File of ODE envelopes, one per line (default: data/bench/envelopes.txt for the type).", true);
+    acm_kafka_bench.addOption('n', "messages", "Envelopes to send (default 100000).", true);
+    acm_kafka_bench.addOption('r', "rate", "Send at this many envelopes per second while the ACM runs (default: preload a backlog).", true);
+    acm_kafka_bench.addOption('p', "partitions", "Partitions of the input topic (default 1).", true);
+    acm_kafka_bench.addOption('k', "brokers", "Mock cluster brokers (default 1).", true);
+    acm_kafka_bench.addOption('c', "config", "Extra ACM or librdkafka properties appended to the generated configuration.", true);
+    acm_kafka_bench.addOption('d', "data-root", "Directory containing data/ and config/ (default .).", true);
+    acm_kafka_bench.addOption('I', "interval", "Seconds between reports (default 5).", true);
+    acm_kafka_bench.addOption('W', "idle", "Stop when no output arrives for this many seconds (default 30).", true);
+    acm_kafka_bench.addOption('v', "log-level", "The ACM log level (default off).", true);
+    acm_kafka_bench.addOption('o', "output", "Write the JSON lines to this file instead of stdout.", true);
+    acm_kafka_bench.addOption('s', "stage-metrics", "Also collect the ACM per-stage histograms and print them to stderr.", false);
+    acm_kafka_bench.addOption('h', "help", "print out some help");
+
+    if (!acm_kafka_bench.parseArgs(argc, argv)) {
+        acm_kafka_bench.usage();
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (acm_kafka_bench.optIsSet('h')) {
+        acm_kafka_bench.help();
+        std::exit(EXIT_SUCCESS);
+    }
+
+    std::exit(acm_kafka_bench.run());
+}
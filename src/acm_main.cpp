@@ -0,0 +1,122 @@
+/** 
+ * @copyright Copyright 2017 US DOT - Joint Program Office
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *    Oak Ridge National Laboratory, Center for Trustworthy Embedded Systems, UT Battelle.
+ */
+
+// The acm executable: the codec itself is in acm_core, which its tests and tools link as well.
+
+#include "acm.hpp"
+#include "acm_metrics.hpp"
+#include "http_server.hpp"
+#include "ipc_server.hpp"
+#include "bulk_converter.hpp"
+
+#include <csignal>
+#include <cstdlib>
+#include <string>
+
+int main( int argc, char* argv[] )
+{
+    ASN1_Codec asn1_codec{"ASN1_Codec","ASN1 Processing Module"};
+
+    asn1_codec.addOption( 'c', "config", "Configuration file name and path.", true );
+    asn1_codec.addOption( 'C', "config-check", "Check the configuration file contents and output the settings.", false );
+    asn1_codec.addOption( 't', "produce-topic", "The name of the topic to produce.", true );
+    asn1_codec.addOption( 'p', "partition", "Deprecated and ignored; the consumer group assigns the partitions.", true );
+    asn1_codec.addOption( 'g', "group", "Consumer group identifier", true );
+    asn1_codec.addOption( 'b', "broker", "Broker address (localhost:9092)", true );
+    asn1_codec.addOption( 'o', "offset", "Byte offset to start reading in the consumed topic.", true );
+    asn1_codec.addOption( 'x', "exit", "Exit consumer when last message in partition has been received.", false );
+    asn1_codec.addOption( 'd', "debug", "debug level.", true );
+    asn1_codec.addOption( 'v', "log-level", "The info log level [trace,debug,info,warning,error,critical,off]", true );
+    asn1_codec.addOption( 'D', "log-dir", "Directory for the log files.", true );
+    asn1_codec.addOption( 'R', "log-rm", "Remove specified/default log files if they exist.", false );
+    asn1_codec.addOption( 'i', "log", "Log file name.", true );
+    asn1_codec.addOption( 'h', "help", "print out some help" );
+    asn1_codec.addOption( 'F', "infile", "accept a file and bypass kafka.", false );
+    asn1_codec.addOption( 'T', "codec-type", "The type of codec to use: decode or encode; defaults to decode", true );
+    asn1_codec.addOption( 'H', "http-server", "Run http server instead of Kafka.", false);
+    asn1_codec.addOption( 'I', "ipc-server", "Run the Unix domain socket / shared memory IPC server instead of Kafka.", false);
+    asn1_codec.addOption( 'B', "bulk", "Convert the files and directories given as operands offline instead of Kafka.", false);
+    asn1_codec.addOption( 'f', "format", "Bulk input format: xml, ode, hex, ndjson, bin, uper, coer, or pcap; defaults to xml.", true);
+    asn1_codec.addOption( 'j', "jobs", "Bulk conversion threads; defaults to one per core.", true);
+    asn1_codec.addOption( 'O', "output-dir", "Bulk output directory, one file per input; defaults to stdout.", true);
+
+    // debug for ASN.1
+    // opt_debug = 0;
+
+    if (!asn1_codec.parseArgs(argc, argv)) {
+        asn1_codec.usage();
+        std::exit( EXIT_FAILURE );
+    }
+
+    if (asn1_codec.optIsSet('h')) {
+        asn1_codec.help();
+        std::exit( EXIT_SUCCESS );
+    }
+
+    // can set levels if needed here.
+    if ( !asn1_codec.setup_logger( asn1_codec.optIsSet('R') )) {
+        std::exit( EXIT_FAILURE );
+    }
+
+    // per-stage timing can be flipped on a running process: kill -USR2 <pid>.
+    if (std::string{ asn1_codec.getEnvironmentVariable("ACM_METRICS_STAGES") } == "true") {
+        metrics::enable_stages( true );
+    }
+    signal(SIGUSR2, ASN1_Codec::toggle_stage_metrics);
+
+    // configuration check.
+    if (asn1_codec.optIsSet('C')) {
+        try {
+            if (asn1_codec.configure()) {
+                asn1_codec.print_configuration();
+                std::exit( EXIT_SUCCESS );
+            } else {
+                asn1_codec.logger->error( "current configuration settings do not work; exiting." );
+                std::exit( EXIT_FAILURE );
+            }
+        } catch ( std::exception& e ) {
+            asn1_codec.logger->error("Fatal Exception: " + std::string(e.what()));
+            std::exit( EXIT_FAILURE );
+        }
+    }
+
+    if (asn1_codec.optIsSet('H')) {
+        // Run HTTP server
+        asn1_codec.logger->info("Run HTTP Server");
+        Http_Server server(asn1_codec);
+        std::exit( server.http_server() );
+    } else if (asn1_codec.optIsSet('I')) {
+        // Run IPC server for co-located producers.
+        asn1_codec.logger->info("Run IPC Server");
+        Ipc_Server server(asn1_codec);
+        std::exit( server.ipc_server() );
+    } else if (asn1_codec.optIsSet('B')) {
+        // Offline conversion of files and directories.
+        asn1_codec.logger->info("Run Bulk Conversion");
+        Bulk_Converter converter(asn1_codec);
+        std::exit( converter.bulk_converter() );
+    } else if (asn1_codec.optIsSet('F')) {
+        // Only used when an input file is specified.
+        std::exit( asn1_codec.filetest() );
+    } else {
+        // The module will run and when it terminates return an appropriate error code.
+        std::exit( asn1_codec.run() );
+    }
+}
+
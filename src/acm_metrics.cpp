@@ -0,0 +1,458 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2017 US DOT - Joint Program Office
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "acm_metrics.hpp"
+
+#include <sstream>
+
+namespace metrics {
+
+namespace {
+
+// indexed by Counter and Latency; keep in enum order.
+const char* counter_names[] = {
+    "acm_messages_received_total",
+    "acm_messages_published_total",
+    "acm_messages_filtered_total",
+    "acm_bytes_received_total",
+    "acm_bytes_published_total",
+    "acm_delivery_failures_total",
+    "acm_dead_letters_total",
+    "acm_dead_letters_suppressed_total",
+    "acm_error_logs_suppressed_total",
+    "acm_budget_exceeded_total",
+    "acm_constraint_checks_total",
+    "acm_constraint_checks_skipped_total"
+};
+
+const char* counter_help[] = {
+    "Messages received from any transport.",
+    "Messages successfully handed to the output transport.",
+    "Messages dropped or suppressed before processing.",
+    "Bytes received from any transport.",
+    "Bytes successfully handed to the output transport.",
+    "Produced messages whose delivery report carried an error.",
+    "Failed records queued to the dead-letter topic.",
+    "Failed records not sent to the dead-letter topic: over the rate limit or refused by the producer.",
+    "Error log lines dropped by the error log rate limit.",
+    "Messages stopped for going over a per message codec budget.",
+    "Decoded structures checked with asn_check_constraints.",
+    "Decoded structures not checked, by the constraint policy (acm.constraints)."
+};
+
+const char* latency_names[] = {
+    "acm_decode_latency_seconds",
+    "acm_encode_latency_seconds",
+    "acm_broker_to_consume_latency_seconds",
+    "acm_consume_to_produce_latency_seconds",
+    "acm_produce_to_ack_latency_seconds"
+};
+
+const char* latency_help[] = {
+    "Time to decode one message.",
+    "Time to encode one message.",
+    "Input record Kafka timestamp to consume.",
+    "Consume to produce of the output record.",
+    "Produce to broker acknowledgement of the output record."
+};
+
+const char* stage_names[] = {
+    "envelope_parse",
+    "codec_requirements",
+    "hex_conversion",
+    "asn_decode",
+    "constraint_check",
+    "xer_encode",
+    "json_encode",
+    "xer_decode",
+    "asn_encode",
+    "xml_reparse",
+    "serialize",
+    "produce"
+};
+
+const char* direction_names[] = {
+    "decode",
+    "encode"
+};
+
+// Prometheus bucket boundaries: 1us doubling to ~1s; the HDR buckets are folded into these.
+constexpr int kExportedBuckets = 21;
+
+// quantiles exported for the stage summaries.
+constexpr double kStageQuantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+std::atomic<bool> stage_timing{ false };
+
+std::string message_id_label( std::size_t slot ) {
+    return slot < kMaxMessageIds ? std::to_string(slot) : std::string{"other"};
+}
+
+}  // end namespace.
+
+const char* stage_name( Stage s ) {
+    return stage_names[static_cast<std::size_t>(s)];
+}
+
+const char* direction_name( Direction d ) {
+    return direction_names[static_cast<std::size_t>(d)];
+}
+
+bool stages_enabled() {
+    return stage_timing.load(std::memory_order_relaxed);
+}
+
+void enable_stages( bool enabled ) {
+    stage_timing.store(enabled, std::memory_order_relaxed);
+}
+
+std::size_t bucket_index( uint64_t value ) {
+    if (value < kSubBuckets) return static_cast<std::size_t>(value);
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - static_cast<int>(kSubBucketBits);
+    return static_cast<std::size_t>(shift + 1) * kSubBuckets + ((value >> shift) & (kSubBuckets - 1));
+}
+
+uint64_t bucket_lower( std::size_t index ) {
+    if (index < kSubBuckets) return index;
+    std::size_t shift = index / kSubBuckets - 1;
+    return (static_cast<uint64_t>(kSubBuckets) + index % kSubBuckets) << shift;
+}
+
+uint64_t bucket_upper( std::size_t index ) {
+    if (index < kSubBuckets) return index;
+    std::size_t shift = index / kSubBuckets - 1;
+    return bucket_lower(index) + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+void HistogramSnapshot::record( uint64_t value ) {
+    ++counts[bucket_index(value)];
+    ++count;
+    sum += value;
+    if (value > max) max = value;
+}
+
+void HistogramSnapshot::merge( const HistogramSnapshot& other ) {
+    for (std::size_t i = 0; i < kBucketCount; ++i) counts[i] += other.counts[i];
+    count += other.count;
+    sum += other.sum;
+    if (other.max > max) max = other.max;
+}
+
+void HistogramSnapshot::reset() {
+    counts.fill(0);
+    count = 0;
+    sum = 0;
+    max = 0;
+}
+
+uint64_t HistogramSnapshot::percentile( double p ) const {
+    if (count == 0) return 0;
+    if (p <= 0.0) p = 0.0;
+    if (p >= 1.0) return max;
+
+    uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(count)) + 1;
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBucketCount; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint64_t mid = bucket_lower(i) + (bucket_upper(i) - bucket_lower(i)) / 2;
+            return mid < max ? mid : max;
+        }
+    }
+    return max;
+}
+
+double HistogramSnapshot::mean() const {
+    return count ? static_cast<double>(sum) / static_cast<double>(count) : 0.0;
+}
+
+void Histogram::snapshot_into( HistogramSnapshot& snapshot ) const {
+    for (std::size_t i = 0; i < kBucketCount; ++i) snapshot.counts[i] += counts_[i].load(std::memory_order_relaxed);
+    snapshot.count += count_.load(std::memory_order_relaxed);
+    snapshot.sum += sum_.load(std::memory_order_relaxed);
+    uint64_t m = max_.load(std::memory_order_relaxed);
+    if (m > snapshot.max) snapshot.max = m;
+}
+
+Shard::~Shard() {
+    for (auto& set : stage_sets) delete set.load(std::memory_order_relaxed);
+}
+
+Registry& Registry::instance() {
+    static Registry registry;
+    return registry;
+}
+
+Registry::Shard_Lease::~Shard_Lease() {
+    if (shard) Registry::instance().release_shard(shard);
+}
+
+Shard* Registry::add_shard() {
+    // constructed on the first call from each thread only; local() keeps the shard in a plain pointer after that.
+    thread_local Shard_Lease lease;
+
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    if (!free_shards_.empty()) {
+        // the counts are totals, so the shard of a finished thread goes on counting for this one.
+        lease.shard = free_shards_.back();
+        free_shards_.pop_back();
+    } else {
+        shards_.push_back( std::unique_ptr<Shard>( new Shard{} ) );
+        lease.shard = shards_.back().get();
+    }
+    return lease.shard;
+}
+
+void Registry::release_shard( Shard* shard ) {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    free_shards_.push_back(shard);
+}
+
+std::size_t Registry::shard_count() const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    return shards_.size();
+}
+
+std::size_t Registry::stage_slot( Direction d, long id ) {
+    std::size_t slot = (id >= 0 && id < static_cast<long>(kMaxMessageIds)) ? static_cast<std::size_t>(id) : kMaxMessageIds;
+    return static_cast<std::size_t>(d) * (kMaxMessageIds + 1) + slot;
+}
+
+void Registry::stages( Direction d, long id, const StageTimes& times, uint32_t seen ) {
+    auto& slot = local().stage_sets[stage_slot(d, id)];
+
+    StageSet* set = slot.load(std::memory_order_relaxed);        // only this thread stores it.
+    if (!set) {
+        set = new StageSet{};
+        slot.store(set, std::memory_order_release);
+    }
+
+    for (std::size_t s = 0; s < static_cast<std::size_t>(Stage::COUNT); ++s) {
+        if (seen & (1u << s)) set->stages[s].record(times[s]);
+    }
+}
+
+bool Registry::stage_sets_in_use( std::size_t slot ) const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    for (const auto& shard : shards_) {
+        if (shard->stage_sets[slot].load(std::memory_order_acquire)) return true;
+    }
+    return false;
+}
+
+HistogramSnapshot Registry::stage_snapshot( Direction d, long id, Stage s ) const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    HistogramSnapshot snapshot;
+    std::size_t slot = stage_slot(d, id);
+    for (const auto& shard : shards_) {
+        const StageSet* set = shard->stage_sets[slot].load(std::memory_order_acquire);
+        if (set) set->stages[static_cast<std::size_t>(s)].snapshot_into(snapshot);
+    }
+    return snapshot;
+}
+
+std::vector<std::string> Registry::stage_report() const {
+    std::vector<std::string> lines;
+
+    for (std::size_t d = 0; d < static_cast<std::size_t>(Direction::COUNT); ++d) {
+        for (std::size_t id = 0; id <= kMaxMessageIds; ++id) {
+            if (!stage_sets_in_use(stage_slot(static_cast<Direction>(d), static_cast<long>(id)))) continue;
+
+            for (std::size_t st = 0; st < static_cast<std::size_t>(Stage::COUNT); ++st) {
+                HistogramSnapshot h = stage_snapshot(static_cast<Direction>(d), static_cast<long>(id), static_cast<Stage>(st));
+                if (h.count == 0) continue;
+
+                std::ostringstream os;
+                os << direction_names[d] << " messageId=" << message_id_label(id) << ' ' << stage_names[st]
+                   << ": n=" << h.count
+                   << " p50=" << h.percentile(0.5) / 1000.0
+                   << "us p90=" << h.percentile(0.9) / 1000.0
+                   << "us p99=" << h.percentile(0.99) / 1000.0
+                   << "us max=" << h.max / 1000.0 << "us";
+                lines.push_back(os.str());
+            }
+        }
+    }
+
+    return lines;
+}
+
+void Registry::set_error_names( const std::vector<std::string>& names ) {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    error_names_ = names;
+}
+
+void Registry::set_route_names( const std::vector<std::string>& names ) {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    route_names_ = names;
+}
+
+uint64_t Registry::total( Counter c ) const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    uint64_t t = 0;
+    for (const auto& s : shards_) t += s->counters[static_cast<std::size_t>(c)].load(std::memory_order_relaxed);
+    return t;
+}
+
+uint64_t Registry::total_errors( std::size_t error_type ) const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    uint64_t t = 0;
+    if (error_type >= kMaxErrorTypes) error_type = kMaxErrorTypes - 1;
+    for (const auto& s : shards_) t += s->errors[error_type].load(std::memory_order_relaxed);
+    return t;
+}
+
+uint64_t Registry::total_message_id( long id ) const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    std::size_t slot = (id >= 0 && id < static_cast<long>(kMaxMessageIds)) ? static_cast<std::size_t>(id) : kMaxMessageIds;
+    uint64_t t = 0;
+    for (const auto& s : shards_) t += s->message_ids[slot].load(std::memory_order_relaxed);
+    return t;
+}
+
+uint64_t Registry::total_constraint_violations( long id ) const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    std::size_t slot = (id >= 0 && id < static_cast<long>(kMaxMessageIds)) ? static_cast<std::size_t>(id) : kMaxMessageIds;
+    uint64_t t = 0;
+    for (const auto& s : shards_) t += s->constraint_violations[slot].load(std::memory_order_relaxed);
+    return t;
+}
+
+uint64_t Registry::total_routed( std::size_t route ) const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    if (route >= kMaxRoutes) route = kMaxRoutes - 1;
+    uint64_t t = 0;
+    for (const auto& s : shards_) t += s->route_messages[route].load(std::memory_order_relaxed);
+    return t;
+}
+
+uint64_t Registry::total_routed_bytes( std::size_t route ) const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    if (route >= kMaxRoutes) route = kMaxRoutes - 1;
+    uint64_t t = 0;
+    for (const auto& s : shards_) t += s->route_bytes[route].load(std::memory_order_relaxed);
+    return t;
+}
+
+HistogramSnapshot Registry::latency_snapshot( Latency l ) const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    HistogramSnapshot snapshot;
+    for (const auto& s : shards_) s->latencies[static_cast<std::size_t>(l)].snapshot_into(snapshot);
+    return snapshot;
+}
+
+std::string Registry::prometheus() const {
+    std::ostringstream os;
+
+    for (std::size_t c = 0; c < static_cast<std::size_t>(Counter::COUNT); ++c) {
+        os << "# HELP " << counter_names[c] << ' ' << counter_help[c] << '\n';
+        os << "# TYPE " << counter_names[c] << " counter\n";
+        os << counter_names[c] << ' ' << total(static_cast<Counter>(c)) << '\n';
+    }
+
+    std::vector<std::string> names, routes;
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        names = error_names_;
+        routes = route_names_;
+    }
+
+    os << "# HELP acm_errors_total Messages that failed, by error type.\n";
+    os << "# TYPE acm_errors_total counter\n";
+    for (std::size_t e = 0; e < kMaxErrorTypes; ++e) {
+        uint64_t t = total_errors(e);
+        if (t == 0) continue;
+        os << "acm_errors_total{type=\"" << (e < names.size() ? names[e] : std::to_string(e)) << "\"} " << t << '\n';
+    }
+
+    os << "# HELP acm_messages_by_id_total Messages processed, by J2735 MessageFrame messageId.\n";
+    os << "# TYPE acm_messages_by_id_total counter\n";
+    for (std::size_t id = 0; id <= kMaxMessageIds; ++id) {
+        uint64_t t = total_message_id(static_cast<long>(id));
+        if (t == 0) continue;
+        os << "acm_messages_by_id_total{message_id=\"" << message_id_label(id) << "\"} " << t << '\n';
+    }
+
+    os << "# HELP acm_constraint_violations_total Structures that failed asn_check_constraints, by J2735 MessageFrame messageId.\n";
+    os << "# TYPE acm_constraint_violations_total counter\n";
+    for (std::size_t id = 0; id <= kMaxMessageIds; ++id) {
+        uint64_t t = total_constraint_violations(static_cast<long>(id));
+        if (t == 0) continue;
+        os << "acm_constraint_violations_total{message_id=\"" << message_id_label(id) << "\"} " << t << '\n';
+    }
+
+    os << "# HELP acm_routed_messages_total Messages handed to the output transport, by output topic.\n";
+    os << "# TYPE acm_routed_messages_total counter\n";
+    for (std::size_t r = 0; r < kMaxRoutes; ++r) {
+        uint64_t t = total_routed(r);
+        if (t == 0) continue;
+        os << "acm_routed_messages_total{topic=\"" << (r < routes.size() ? routes[r] : std::to_string(r)) << "\"} " << t << '\n';
+    }
+
+    os << "# HELP acm_routed_bytes_total Bytes handed to the output transport, by output topic.\n";
+    os << "# TYPE acm_routed_bytes_total counter\n";
+    for (std::size_t r = 0; r < kMaxRoutes; ++r) {
+        uint64_t t = total_routed_bytes(r);
+        if (t == 0) continue;
+        os << "acm_routed_bytes_total{topic=\"" << (r < routes.size() ? routes[r] : std::to_string(r)) << "\"} " << t << '\n';
+    }
+
+    for (std::size_t l = 0; l < static_cast<std::size_t>(Latency::COUNT); ++l) {
+        HistogramSnapshot h = latency_snapshot(static_cast<Latency>(l));
+        os << "# HELP " << latency_names[l] << ' ' << latency_help[l] << '\n';
+        os << "# TYPE " << latency_names[l] << " histogram\n";
+
+        uint64_t boundary_ns = 1000;
+        uint64_t cumulative = 0;
+        std::size_t i = 0;
+        for (int b = 0; b < kExportedBuckets; ++b, boundary_ns *= 2) {
+            // a bucket belongs under the first boundary that covers its largest value.
+            while (i < kBucketCount && bucket_upper(i) <= boundary_ns) cumulative += h.counts[i++];
+            os << latency_names[l] << "_bucket{le=\"" << static_cast<double>(boundary_ns) / 1e9 << "\"} " << cumulative << '\n';
+        }
+        os << latency_names[l] << "_bucket{le=\"+Inf\"} " << h.count << '\n';
+        os << latency_names[l] << "_sum " << static_cast<double>(h.sum) / 1e9 << '\n';
+        os << latency_names[l] << "_count " << h.count << '\n';
+    }
+
+    os << "# HELP acm_stage_latency_seconds Time spent in each processing stage, by direction and messageId.\n";
+    os << "# TYPE acm_stage_latency_seconds summary\n";
+    for (std::size_t d = 0; d < static_cast<std::size_t>(Direction::COUNT); ++d) {
+        for (std::size_t id = 0; id <= kMaxMessageIds; ++id) {
+            if (!stage_sets_in_use(stage_slot(static_cast<Direction>(d), static_cast<long>(id)))) continue;
+
+            for (std::size_t st = 0; st < static_cast<std::size_t>(Stage::COUNT); ++st) {
+                HistogramSnapshot h = stage_snapshot(static_cast<Direction>(d), static_cast<long>(id), static_cast<Stage>(st));
+                if (h.count == 0) continue;
+
+                std::string labels = "direction=\"" + std::string{ direction_names[d] } + "\",message_id=\"" + message_id_label(id)
+                    + "\",stage=\"" + stage_names[st] + "\"";
+                for (double q : kStageQuantiles) {
+                    os << "acm_stage_latency_seconds{" << labels << ",quantile=\"" << q << "\"} " << static_cast<double>(h.percentile(q)) / 1e9 << '\n';
+                }
+                os << "acm_stage_latency_seconds_sum{" << labels << "} " << static_cast<double>(h.sum) / 1e9 << '\n';
+                os << "acm_stage_latency_seconds_count{" << labels << "} " << h.count << '\n';
+            }
+        }
+    }
+
+    return os.str();
+}
+
+}  // end namespace.
@@ -0,0 +1,733 @@
+#include "bulk_converter.hpp"
+#include "stream_decoder.hpp"
+#include "pcap_reader.hpp"
+#include "SignedData.h"
+#include "ToBeSignedData.h"
+#include "SignedDataPayload.h"
+#include "acmLogger.hpp"
+#include "acm_metrics.hpp"
+#include "nlohmann/json.hpp"
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace nlohmann;
+
+std::atomic<bool> Bulk_Converter::running{ true };
+
+namespace {
+
+constexpr std::size_t kBlockBytes = 1 << 20;        // input handed to a worker at a time; ends on a record boundary.
+constexpr uint64_t kBlocksPerJob = 4;               // converted blocks allowed to wait for the writer, per worker.
+constexpr int kProgressSeconds = 5;
+
+/**
+ * A read only, private mapping of a whole file; empty files map to nothing.
+ */
+class MappedFile {
+    public:
+        explicit MappedFile(const string& path) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                error = strerror(errno);
+                return;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                error = strerror(errno);
+                close(fd);
+                return;
+            }
+
+            size = static_cast<size_t>(st.st_size);
+            if (size > 0) {
+                void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) {
+                    error = strerror(errno);
+                    size = 0;
+                } else {
+                    data = static_cast<const char*>(p);
+                    madvise(p, size, MADV_SEQUENTIAL);
+                }
+            }
+            close(fd);
+        }
+
+        ~MappedFile() {
+            if (data) munmap(const_cast<char*>(data), size);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool ok() const { return error.empty(); }
+
+        const char* data = nullptr;
+        size_t size = 0;
+        string error;
+};
+
+struct Block {
+    shared_ptr<MappedFile> file;                    // keeps the mapping alive until the last block is converted.
+    size_t file_index = 0;
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    shared_ptr<pcap::Reader> capture;               // pcap only: the reader state at begin.
+};
+
+struct Result {
+    size_t file_index = 0;
+    string output;
+    uint64_t records = 0;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+};
+
+/**
+ * Hands out blocks of whole records in input order, mapping each file when it is reached. The caller holds the lock.
+ */
+class BlockCursor {
+    public:
+        BlockCursor(const vector<string>& files, Bulk_Converter::Format format, AcmLogger& logger) :
+            files_{ files }, format_{ format }, logger_{ logger }
+        {}
+
+        bool next(Block& block);
+
+        uint64_t failed_files = 0;                  // could not be mapped or ended in a truncated record.
+
+    private:
+        const vector<string>& files_;
+        Bulk_Converter::Format format_;
+        AcmLogger& logger_;
+        size_t index_ = 0;
+        shared_ptr<MappedFile> mapped_;
+        shared_ptr<pcap::Reader> capture_;
+        size_t pos_ = 0;
+};
+
+bool BlockCursor::next(Block& block) {
+    while (index_ < files_.size()) {
+        if (!mapped_) {
+            mapped_ = make_shared<MappedFile>(files_[index_]);
+            if (!mapped_->ok()) {
+                logger_.error("cannot map " + files_[index_] + ": " + mapped_->error);
+                ++failed_files;
+                mapped_.reset();
+                ++index_;
+                continue;
+            }
+            pos_ = 0;
+
+            if (format_ == Bulk_Converter::Format::PCAP && mapped_->size > 0) {
+                capture_ = make_shared<pcap::Reader>(mapped_->data, mapped_->size);
+                if (!capture_->ok()) {
+                    logger_.error(files_[index_] + ": " + capture_->error());
+                    ++failed_files;
+                    mapped_.reset();
+                    ++index_;
+                    continue;
+                }
+                pos_ = capture_->position();
+            }
+        }
+
+        const char* data = mapped_->data;
+        const size_t size = mapped_->size;
+
+        if (pos_ >= size) {
+            mapped_.reset();
+            capture_.reset();
+            ++index_;
+            continue;
+        }
+
+        size_t end = size;
+        if (format_ == Bulk_Converter::Format::BIN) {
+            end = pos_;
+            while (end < size && end - pos_ < kBlockBytes) {
+                uint32_t length;
+                if (size - end < sizeof(length)) break;
+                memcpy(&length, data + end, sizeof(length));
+                length = ntohl(length);
+                if (size - end - sizeof(length) < length) break;
+                end += sizeof(length) + length;
+            }
+
+            if (end == pos_) {
+                logger_.error(files_[index_] + " ends in a truncated record at byte " + to_string(pos_) + "; skipping the rest.");
+                ++failed_files;
+                pos_ = size;
+                continue;
+            }
+
+        } else if (format_ == Bulk_Converter::Format::PCAP) {
+            // walk the record headers only; the worker reads the packets again from a copy of this state.
+            block.capture = make_shared<pcap::Reader>(*capture_);
+            pcap::Packet packet;
+            while (capture_->position() - pos_ < kBlockBytes && capture_->next(packet)) {}
+            end = capture_->position();
+
+            if (!capture_->ok()) {
+                logger_.error(files_[index_] + ": " + capture_->error() + "; skipping the rest.");
+                ++failed_files;
+            }
+            if (end == pos_) {
+                pos_ = size;
+                continue;
+            }
+
+        } else if (Bulk_Converter::line_format(format_) && size - pos_ > kBlockBytes) {
+            const char* newline = static_cast<const char*>(memchr(data + pos_ + kBlockBytes, '\n', size - pos_ - kBlockBytes));
+            end = newline ? static_cast<size_t>(newline - data) + 1 : size;
+        }
+
+        block.file = mapped_;
+        block.file_index = index_;
+        block.begin = data + pos_;
+        block.end = data + end;
+        pos_ = capture_ && !capture_->ok() ? size : end;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Decode one MessageFrame, hex or binary, into xer or a reason in error.
+ */
+bool decode_frame(ASN1_Codec& worker, const char* data, size_t length, bool hex, string& xer, string& error) {
+    buffer_structure_t xb = {0, 0, 0};
+    Asn1Status status;
+    bool ok;
+
+    if (hex) {
+        string hex_string(data, length);
+        ok = worker.decode_messageframe_data(hex_string, &xb, status);
+    } else {
+        ok = worker.decode_messageframe_bytes(data, length, &xb, status);
+    }
+    if (!ok) error = status.message();
+
+    if (ok) xer.assign(xb.buffer, xb.buffer_size);
+    free(xb.buffer);
+    return ok;
+}
+
+/**
+ * Decode the Ieee1609Dot2Data in a WSM and the MessageFrame it carries, unsecured or signed, into xer.
+ */
+bool decode_wsm(ASN1_Codec& worker, const pcap::Wsm& wsm, string& security, string& xer, string& error) {
+    buffer_structure_t xb = {0, 0, 0};
+    Asn1Status status;
+    bool is_signed = false;
+
+    bool ok = worker.decode_1609dot2_messageframe_bytes(reinterpret_cast<const char*>(wsm.data), wsm.length, &xb, is_signed, status);
+    if (ok) {
+        security = is_signed ? "signed" : "unsecured";
+        xer.assign(xb.buffer, xb.buffer_size);
+    } else {
+        error = status.message();
+    }
+
+    free(xb.buffer);
+    return ok;
+}
+
+bool is_directory(const string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool is_regular_file(const string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+string progress_line(size_t files_done, size_t files, uint64_t records, uint64_t errors, uint64_t bytes, double seconds) {
+    ostringstream os;
+    os << fixed << setprecision(1)
+       << files_done << "/" << files << " files, "
+       << records << " records, "
+       << errors << " errors, "
+       << bytes / 1e6 << " MB in "
+       << seconds << " s ("
+       << (seconds > 0 ? records / seconds : 0.0) << " records/s, "
+       << (seconds > 0 ? bytes / 1e6 / seconds : 0.0) << " MB/s)";
+    return os.str();
+}
+
+}  // end namespace.
+
+Bulk_Converter::Bulk_Converter(ASN1_Codec& asn1_codec, Format input_format) :
+    codec(asn1_codec),
+    logger("bulk_converter"),
+    format(input_format)
+{
+}
+
+Bulk_Converter::~Bulk_Converter()
+{
+}
+
+void Bulk_Converter::sigterm(int) {
+    running = false;
+}
+
+bool Bulk_Converter::parse_format(const string& name, Format& format) {
+    if (name == "xml") format = Format::XML;
+    else if (name == "ode") format = Format::ODE;
+    else if (name == "hex") format = Format::HEX;
+    else if (name == "ndjson") format = Format::NDJSON;
+    else if (name == "bin") format = Format::BIN;
+    else if (name == "uper") format = Format::UPER;
+    else if (name == "coer") format = Format::COER;
+    else if (name == "pcap") format = Format::PCAP;
+    else return false;
+    return true;
+}
+
+bool Bulk_Converter::line_format(Format format) {
+    return format == Format::ODE || format == Format::HEX || format == Format::NDJSON;
+}
+
+bool Bulk_Converter::collect_inputs(const vector<string>& operands, vector<string>& files) {
+    for (const auto& operand : operands) {
+        if (is_regular_file(operand)) {
+            files.push_back(operand);
+            continue;
+        }
+
+        if (!is_directory(operand)) {
+            logger.error("bulk input " + operand + " is neither a file nor a directory.");
+            return false;
+        }
+
+        DIR* dir = opendir(operand.c_str());
+        if (!dir) {
+            logger.error("cannot read directory " + operand + ": " + strerror(errno));
+            return false;
+        }
+
+        vector<string> entries;
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] == '.') continue;
+            string path = operand + "/" + entry->d_name;
+            if (is_regular_file(path)) entries.push_back(path);
+        }
+        closedir(dir);
+
+        // readdir order is arbitrary; name order makes the output order repeatable.
+        sort(entries.begin(), entries.end());
+        files.insert(files.end(), entries.begin(), entries.end());
+    }
+    return true;
+}
+
+string Bulk_Converter::output_path(const string& input) const {
+    size_t slash = input.find_last_of('/');
+    string name = slash == string::npos ? input : input.substr(slash + 1);
+
+    switch (format) {
+        case Format::XML:
+        case Format::ODE:
+            return output_dir + "/" + name + ".out.xml";
+        case Format::NDJSON:
+        case Format::PCAP:
+            return output_dir + "/" + name + ".out.ndjson";
+        default:
+            return output_dir + "/" + name + ".xer";
+    }
+}
+
+bool Bulk_Converter::convert_record(ASN1_Codec& worker, const char* data, size_t length, string& output) {
+    metrics::Registry& registry = metrics::Registry::instance();
+    registry.increment(metrics::Counter::MESSAGES_RECEIVED);
+    registry.increment(metrics::Counter::BYTES_RECEIVED, length);
+
+    bool ok = false;
+    size_t start = output.size();
+    string xer, error;
+
+    switch (format) {
+        case Format::XML:
+        case Format::ODE: {
+            ostringstream os;
+            ok = worker.process_envelope(data, length, os, !worker.decoding());
+            if (ok && worker.filtered()) {
+                registry.increment(metrics::Counter::MESSAGES_FILTERED);
+                return true;
+            }
+            output += os.str();
+            break;
+        }
+
+        case Format::HEX:
+        case Format::BIN:
+            ok = decode_frame(worker, data, length, format == Format::HEX, xer, error);
+            if (ok) {
+                output += xer;
+            } else {
+                logger.error("Error decoding MessageFrame: " + error);
+            }
+            break;
+
+        case Format::NDJSON: {
+            json record;
+            try {
+                record = json::parse(data, data + length);
+                if (!record.is_object() || !record.contains("hex") || !record["hex"].is_string()) {
+                    error = "record has no \"hex\" string.";
+                } else {
+                    const string& hex = record["hex"].get_ref<const string&>();
+                    ok = decode_frame(worker, hex.data(), hex.size(), true, xer, error);
+                }
+            } catch (const json::exception& e) {
+                record = json::object();
+                error = e.what();
+            }
+
+            if (ok) {
+                record["xer"] = xer;
+            } else {
+                logger.error("Error converting ndjson record: " + error);
+                record["error"] = error;
+            }
+            output += record.dump();
+            break;
+        }
+
+        case Format::UPER:
+        case Format::COER:
+        case Format::PCAP:
+            // convert_stream and convert_capture find the record boundaries of these as they decode.
+            logger.error("Error converting record: streamed formats are not per-record.");
+            break;
+    }
+
+    output += '\n';
+
+    if (ok) {
+        registry.increment(metrics::Counter::MESSAGES_PUBLISHED);
+        registry.increment(metrics::Counter::BYTES_PUBLISHED, output.size() - start);
+    } else {
+        registry.error(static_cast<size_t>(Asn1ErrorType::DATA));
+    }
+    return ok;
+}
+
+uint64_t Bulk_Converter::convert_stream(const string& name, const char* data, size_t length, string& output, uint64_t& errors) {
+    metrics::Registry& registry = metrics::Registry::instance();
+    Stream_Decoder decoder{ format == Format::UPER ? Stream_Decoder::Pdu::MESSAGEFRAME : Stream_Decoder::Pdu::IEEE1609DOT2,
+                            format == Format::UPER ? ATS_UNALIGNED_BASIC_PER : ATS_CANONICAL_OER };
+    decoder.set_constraints(codec.constraints());
+    decoder.set_max_pdu_size(codec.codec_budget().max_input_bytes);
+    uint64_t records = 0;
+
+    auto emit = [&](const Stream_Decoder::Output& pdu) {
+        registry.increment(metrics::Counter::MESSAGES_RECEIVED);
+        registry.increment(metrics::Counter::BYTES_RECEIVED, pdu.length);
+        ++records;
+
+        if (pdu.ok) {
+            output += pdu.text;
+            registry.increment(metrics::Counter::MESSAGES_PUBLISHED);
+            registry.increment(metrics::Counter::BYTES_PUBLISHED, pdu.text.size() + 1);
+        } else {
+            logger.error(name + " PDU at byte " + to_string(pdu.offset) + ": " + pdu.text);
+            registry.error(static_cast<size_t>(Asn1ErrorType::DATA));
+            ++errors;
+        }
+        output += '\n';
+    };
+
+    Asn1Status status;
+    decoder.feed(data, length, emit, status);
+    if (status.ok()) decoder.finish(emit, status);
+
+    if (!status.ok()) {
+        // there is no way to find the next PDU after bad data; the rest of the file is skipped.
+        logger.error(name + ": " + status.message() + " Skipping the remaining " + to_string(length - decoder.offset()) + " bytes.");
+        registry.error(static_cast<size_t>(status.error_type()));
+        ++errors;
+    }
+
+    return records;
+}
+
+uint64_t Bulk_Converter::convert_capture(ASN1_Codec& worker, pcap::Reader capture, size_t end, string& output, uint64_t& errors) {
+    metrics::Registry& registry = metrics::Registry::instance();
+    uint64_t records = 0;
+    pcap::Packet packet;
+    pcap::Wsm wsm;
+
+    while (capture.position() < end && capture.next(packet)) {
+        if (!pcap::extract_wsm(packet, wsm)) continue;     // not WSMP; beacons, management, other traffic.
+
+        registry.increment(metrics::Counter::MESSAGES_RECEIVED);
+        registry.increment(metrics::Counter::BYTES_RECEIVED, wsm.length);
+        ++records;
+
+        string security, xer, error;
+        json record;
+        record["packet"] = packet.number;
+        record["timestamp"] = pcap::iso8601(packet.timestamp_ns);
+        record["psid"] = wsm.psid;
+
+        if (decode_wsm(worker, wsm, security, xer, error)) {
+            record["security"] = security;
+            record["xer"] = xer;
+        } else {
+            logger.error("packet " + to_string(packet.number) + ": " + error);
+            record["error"] = error;
+        }
+
+        size_t start = output.size();
+        output += record.dump();
+        output += '\n';
+
+        if (error.empty()) {
+            registry.increment(metrics::Counter::MESSAGES_PUBLISHED);
+            registry.increment(metrics::Counter::BYTES_PUBLISHED, output.size() - start);
+        } else {
+            registry.error(static_cast<size_t>(Asn1ErrorType::DATA));
+            ++errors;
+        }
+    }
+
+    return records;
+}
+
+int Bulk_Converter::bulk_converter() {
+    signal(SIGINT, sigterm);
+    signal(SIGTERM, sigterm);
+
+    try {
+        if (!codec.configure()) return EXIT_FAILURE;
+    } catch (const exception& e) {
+        logger.error("Fatal Exception: " + string(e.what()));
+        return EXIT_FAILURE;
+    }
+
+    if (codec.optIsSet('f') && !parse_format(codec.optString('f'), format)) {
+        logger.error("unknown bulk format: " + codec.optString('f') + "; use xml, ode, hex, ndjson, bin, uper, coer, or pcap.");
+        return EXIT_FAILURE;
+    }
+
+    if (format != Format::XML && format != Format::ODE && !codec.decoding()) {
+        logger.error("only the xml and ode formats can be encoded; the others hold binary PDUs and can only be decoded.");
+        return EXIT_FAILURE;
+    }
+
+    if (codec.optIsSet('j')) jobs = codec.optInt('j');
+    if (jobs <= 0) jobs = max(1u, thread::hardware_concurrency());
+
+    if (codec.optIsSet('O')) {
+        output_dir = codec.optString('O');
+        if (!is_directory(output_dir) && mkdir(output_dir.c_str(), 0755) != 0) {
+            logger.error("cannot create output directory " + output_dir + ": " + strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    vector<string> files;
+    if (!collect_inputs(codec.getOperands(), files)) return EXIT_FAILURE;
+    if (files.empty()) {
+        logger.error("bulk mode needs at least one input file or directory.");
+        return EXIT_FAILURE;
+    }
+
+    {
+        ostringstream msg;
+        msg << "Converting " << files.size() << " files using " << jobs << " threads.";
+        logger.info(msg.str());
+    }
+
+    // the codec keeps per message state, so every worker gets its own.
+    vector<unique_ptr<ASN1_Codec>> workers;
+    for (int i = 0; i < jobs; ++i) {
+        workers.emplace_back(new ASN1_Codec{ "bulk_worker", "ASN1_Codec bulk conversion worker" });
+        workers.back()->share_configuration(codec);
+    }
+
+    mutex lock;
+    condition_variable changed;
+    BlockCursor cursor{ files, format, logger };
+    map<uint64_t, Result> finished;                 // converted blocks waiting for their turn to be written.
+    uint64_t next_sequence = 0;
+    uint64_t written = 0;
+    int active = jobs;
+    const uint64_t window = kBlocksPerJob * static_cast<uint64_t>(jobs);
+
+    auto work = [&](ASN1_Codec& worker) {
+        for (;;) {
+            Block block;
+            uint64_t sequence;
+            {
+                unique_lock<mutex> guard{ lock };
+                changed.wait(guard, [&]() { return next_sequence < written + window || !running; });
+                if (!running || !cursor.next(block)) break;
+                sequence = next_sequence++;
+            }
+
+            Result result;
+            result.file_index = block.file_index;
+            result.bytes = static_cast<uint64_t>(block.end - block.begin);
+            result.output.reserve(static_cast<size_t>(result.bytes) * 2);
+
+            if (format == Format::XML) {
+                ++result.records;
+                if (!convert_record(worker, block.begin, result.bytes, result.output)) ++result.errors;
+
+            } else if (format == Format::PCAP) {
+                result.records = convert_capture(worker, *block.capture, block.end - block.file->data, result.output, result.errors);
+
+            } else if (format == Format::UPER || format == Format::COER) {
+                result.records = convert_stream(files[block.file_index], block.begin, result.bytes, result.output, result.errors);
+
+            } else if (format == Format::BIN) {
+                for (const char* p = block.begin; p < block.end;) {
+                    uint32_t length;
+                    memcpy(&length, p, sizeof(length));
+                    length = ntohl(length);
+                    p += sizeof(length);
+                    ++result.records;
+                    if (!convert_record(worker, p, length, result.output)) ++result.errors;
+                    p += length;
+                }
+
+            } else {
+                for (const char* p = block.begin; p < block.end;) {
+                    const char* newline = static_cast<const char*>(memchr(p, '\n', block.end - p));
+                    const char* line_end = newline ? newline : block.end;
+                    size_t length = line_end - p;
+                    if (length > 0 && p[length - 1] == '\r') --length;
+                    if (length > 0) {
+                        ++result.records;
+                        if (!convert_record(worker, p, length, result.output)) ++result.errors;
+                    }
+                    p = line_end + 1;
+                }
+            }
+
+            {
+                lock_guard<mutex> guard{ lock };
+                finished.emplace(sequence, move(result));
+            }
+            changed.notify_all();
+        }
+
+        {
+            lock_guard<mutex> guard{ lock };
+            --active;
+        }
+        changed.notify_all();
+    };
+
+    vector<thread> threads;
+    for (auto& worker : workers) threads.emplace_back(work, ref(*worker));
+
+    // this thread writes the blocks in sequence, switching output files as the input files change.
+    const auto start = chrono::steady_clock::now();
+    auto next_progress = start + chrono::seconds{ kProgressSeconds };
+    uint64_t records = 0, errors = 0, bytes = 0;
+    size_t files_started = 0;
+    size_t current_file = files.size();
+    ofstream file_out;
+    ostream* out = &cout;
+    bool write_failed = false;
+
+    for (;;) {
+        Result result;
+        bool popped = false;
+        {
+            unique_lock<mutex> guard{ lock };
+            bool ready = changed.wait_for(guard, chrono::milliseconds{ 500 }, [&]() {
+                return finished.count(written) > 0 || (active == 0 && finished.empty());
+            });
+
+            if (ready && finished.count(written) == 0) break;
+
+            if (ready) {
+                auto it = finished.find(written);
+                result = move(it->second);
+                finished.erase(it);
+                popped = true;
+            }
+        }
+
+        // a block with nothing to write, e.g., only blank lines or no WSMP packets, still takes its turn.
+        if (popped && (!result.output.empty() || result.records > 0)) {
+            if (result.file_index != current_file) {
+                current_file = result.file_index;
+                ++files_started;
+                if (!output_dir.empty()) {
+                    file_out.close();
+                    file_out.open(output_path(files[current_file]), ios::binary | ios::trunc);
+                    if (!file_out) {
+                        logger.error("cannot open output file " + output_path(files[current_file]));
+                        write_failed = true;
+                        running = false;
+                    }
+                    out = &file_out;
+                }
+            }
+
+            out->write(result.output.data(), static_cast<streamsize>(result.output.size()));
+            if (!*out && !write_failed) {
+                logger.error("write failed for the output of " + files[current_file]);
+                write_failed = true;
+                running = false;
+            }
+        }
+
+        if (popped) {
+            records += result.records;
+            errors += result.errors;
+            bytes += result.bytes;
+
+            {
+                lock_guard<mutex> guard{ lock };
+                ++written;
+            }
+            changed.notify_all();
+        }
+
+        auto now = chrono::steady_clock::now();
+        if (now >= next_progress) {
+            cerr << "bulk: " << progress_line(files_started, files.size(), records, errors, bytes, chrono::duration<double>(now - start).count()) << endl;
+            next_progress += chrono::seconds{ kProgressSeconds };
+        }
+    }
+
+    for (auto& t : threads) t.join();
+    file_out.close();
+    cout.flush();
+
+    const string summary = progress_line(files_started, files.size(), records, errors, bytes, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    cerr << "bulk finished: " << summary << endl;
+    logger.info("Bulk conversion finished: " + summary);
+
+    if (!running && !write_failed) logger.warn("Bulk conversion was interrupted; the output is incomplete.");
+
+    bool success = running && !write_failed && errors == 0 && cursor.failed_files == 0;
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,51 @@
+#include "constraint_policy.hpp"
+
+Constraint_Policy::Constraint_Policy( Mode mode, uint32_t sample_every ) :
+    mode_{ mode }
+    , sample_every_{ sample_every ? sample_every : 1 }
+{
+}
+
+bool Constraint_Policy::parse( const std::string& name, Mode& mode ) {
+    if ( name == "full" ) mode = Mode::FULL;
+    else if ( name == "sampled" ) mode = Mode::SAMPLED;
+    else if ( name == "encode-only" ) mode = Mode::ENCODE_ONLY;
+    else if ( name == "off" ) mode = Mode::OFF;
+    else return false;
+    return true;
+}
+
+const char* Constraint_Policy::name( Mode mode ) {
+    switch ( mode ) {
+        case Mode::FULL: return "full";
+        case Mode::SAMPLED: return "sampled";
+        case Mode::ENCODE_ONLY: return "encode-only";
+        case Mode::OFF: return "off";
+    }
+    return "full";
+}
+
+bool Constraint_Policy::check( bool encoding ) const {
+    switch ( mode_ ) {
+        case Mode::FULL:
+            return true;
+        case Mode::SAMPLED: {
+            // per thread, so concurrent codecs neither race nor share a cache line.
+            thread_local uint64_t seen = 0;
+            return seen++ % sample_every_ == 0;
+        }
+        case Mode::ENCODE_ONLY:
+            return encoding;
+        case Mode::OFF:
+            return false;
+    }
+    return true;
+}
+
+Constraint_Policy::Mode Constraint_Policy::mode() const {
+    return mode_;
+}
+
+uint32_t Constraint_Policy::sample_every() const {
+    return sample_every_;
+}
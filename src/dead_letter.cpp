@@ -0,0 +1,147 @@
+#include "dead_letter.hpp"
+
+#include <algorithm>
+#include <list>
+
+extern const char* asn1errortypes[];                // acm.cpp; indexed by Asn1ErrorType.
+
+Error_Rate_Limiter::Error_Rate_Limiter( double per_second ) :
+    per_second_{ per_second > 0 ? per_second : 0 }
+{
+}
+
+double Error_Rate_Limiter::rate() const {
+    return per_second_;
+}
+
+bool Error_Rate_Limiter::allow( Asn1Status::Kind kind, uint64_t now_ns ) {
+    if ( per_second_ == 0 ) return true;
+
+    Bucket& bucket = buckets_[ std::min( static_cast<std::size_t>(kind), kErrorClasses - 1 ) ];
+
+    if ( !bucket.started ) {
+        bucket.tokens = per_second_;
+        bucket.refilled_ns = now_ns;
+        bucket.started = true;
+    } else if ( now_ns > bucket.refilled_ns ) {
+        bucket.tokens = std::min( per_second_, bucket.tokens + per_second_ * static_cast<double>(now_ns - bucket.refilled_ns) / 1e9 );
+        bucket.refilled_ns = now_ns;
+    }
+
+    if ( bucket.tokens < 1 ) {
+        ++bucket.suppressed;
+        return false;
+    }
+
+    bucket.tokens -= 1;
+    return true;
+}
+
+uint64_t Error_Rate_Limiter::take_suppressed( Asn1Status::Kind kind ) {
+    Bucket& bucket = buckets_[ std::min( static_cast<std::size_t>(kind), kErrorClasses - 1 ) ];
+    uint64_t suppressed = bucket.suppressed;
+    bucket.suppressed = 0;
+    return suppressed;
+}
+
+void Dead_Letter_Producer::Delivery_Report_Cb::dr_cb( RdKafka::Message& message ) {
+    if ( message.err() != RdKafka::ERR_NO_ERROR ) {
+        metrics::Registry::instance().increment( metrics::Counter::DELIVERY_FAILURES );
+        if ( logger_ ) logger_->error("delivery of a " + std::to_string(message.len()) + " byte dead-letter record failed: " + message.errstr());
+    }
+}
+
+Dead_Letter_Producer::Dead_Letter_Producer( const std::shared_ptr<AcmLogger>& logger, const std::string& topic, double per_second ) :
+    logger_{ logger }
+    , topic_{ topic }
+    , limiter_{ per_second }
+    , delivery_report_cb_{ logger }
+{
+}
+
+Dead_Letter_Producer::~Dead_Letter_Producer()
+{
+    if ( !producer_ ) return;
+
+    // records still queued after the timeout are lost with the producer; say so.
+    RdKafka::ErrorCode status = producer_->flush( kFlushTimeoutMs );
+    if ( status != RdKafka::ERR_NO_ERROR && logger_ ) {
+        logger_->error("dead-letter records to " + topic_ + " were not all delivered: " + RdKafka::err2str( status ));
+    }
+}
+
+const std::string& Dead_Letter_Producer::topic() const {
+    return topic_;
+}
+
+bool Dead_Letter_Producer::launch( RdKafka::Conf* conf ) {
+    std::string error_string;
+
+    // a conf holds the output producer's delivery report callback; copy the properties only.
+    std::unique_ptr<RdKafka::Conf> dlq_conf{ RdKafka::Conf::create( RdKafka::Conf::CONF_GLOBAL ) };
+    std::unique_ptr<std::list<std::string>> properties{ conf->dump() };
+    for ( auto it = properties->begin(); it != properties->end(); ) {
+        const std::string& name = *it++;
+        if ( it == properties->end() ) break;
+        const std::string& value = *it++;
+        dlq_conf->set( name, value, error_string );                  // read only and callback properties are refused.
+    }
+
+    if ( dlq_conf->set( "dr_cb", &delivery_report_cb_, error_string ) != RdKafka::Conf::CONF_OK ) {
+        logger_->error("Failed to set the dead-letter delivery report callback: " + error_string);
+    }
+
+    producer_.reset( RdKafka::Producer::create( dlq_conf.get(), error_string ) );
+    if ( !producer_ ) {
+        logger_->critical("Failed to create the dead-letter producer with error: " + error_string);
+        return false;
+    }
+
+    logger_->info("Dead-letter producer: " + producer_->name() + " created using topic: " + topic_ + ".");
+    return true;
+}
+
+bool Dead_Letter_Producer::publish( RdKafka::Message& input, const Asn1Status& status, bool copy_headers, uint64_t now_ns ) {
+    if ( !producer_ ) return false;
+
+    bool allowed;
+    {
+        std::lock_guard<std::mutex> lock{ limiter_mutex_ };
+        allowed = limiter_.allow( status.kind(), now_ns );
+    }
+    if ( !allowed ) {
+        metrics::Registry::instance().increment( metrics::Counter::DEAD_LETTERS_SUPPRESSED );
+        return true;
+    }
+
+    RdKafka::Headers* input_headers = copy_headers ? input.headers() : nullptr;
+    RdKafka::Headers* headers = input_headers ? RdKafka::Headers::create( input_headers->get_all() ) : RdKafka::Headers::create();
+    headers->add( "acm.error.code", asn1errortypes[static_cast<int>(status.error_type())] );
+    headers->add( "acm.error.class", status.name() );
+    headers->add( "acm.error.stage", metrics::stage_name( status.stage() ) );
+    headers->add( "acm.error.message", status.message() );
+    headers->add( "acm.source.topic", input.topic_name() );
+    headers->add( "acm.source.partition", std::to_string( input.partition() ) );
+    headers->add( "acm.source.offset", std::to_string( input.offset() ) );
+
+    // on success librdkafka owns the headers.
+    RdKafka::ErrorCode rc = producer_->produce( topic_, RdKafka::Topic::PARTITION_UA, RdKafka::Producer::RK_MSG_COPY,
+            input.payload(), input.len(), input.key_pointer(), input.key_len(), 0, headers, NULL );
+
+    if ( rc != RdKafka::ERR_NO_ERROR ) {
+        delete headers;
+        metrics::Registry::instance().increment( metrics::Counter::DEAD_LETTERS_SUPPRESSED );
+        return false;
+    }
+
+    metrics::Registry::instance().increment( metrics::Counter::DEAD_LETTERS );
+    return true;
+}
+
+void Dead_Letter_Producer::poll() {
+    if ( producer_ ) producer_->poll( 0 );
+}
+
+void Dead_Letter_Producer::flush( int timeout_ms ) {
+    if ( producer_ ) producer_->flush( timeout_ms );
+}
@@ -0,0 +1,65 @@
+#include "entity_key.hpp"
+
+#include "IntersectionGeometry.h"
+#include "IntersectionGeometryList.h"
+#include "IntersectionState.h"
+#include "IntersectionStateList.h"
+
+namespace {
+
+void append_hex( std::string& key, const OCTET_STRING_t& id ) {
+    static const char digits[] = "0123456789ABCDEF";
+    for ( std::size_t i = 0; i < id.size; ++i ) {
+        key += digits[id.buf[i] >> 4];
+        key += digits[id.buf[i] & 0x0F];
+    }
+}
+
+void append_intersection( std::string& key, const IntersectionReferenceID_t& id ) {
+    if ( id.region ) {
+        key += std::to_string( *id.region );
+        key += '.';
+    }
+    key += std::to_string( id.id );
+}
+
+}  // end namespace.
+
+namespace entity_key {
+
+bool derive( const MessageFrame_t& frame, std::string& key ) {
+    key.clear();
+
+    switch ( frame.value.present ) {
+        case MessageFrame__value_PR_BasicSafetyMessage:
+            append_hex( key, frame.value.choice.BasicSafetyMessage.coreData.id );
+            break;
+
+        case MessageFrame__value_PR_PersonalSafetyMessage:
+            append_hex( key, frame.value.choice.PersonalSafetyMessage.id );
+            break;
+
+        case MessageFrame__value_PR_MapData: {
+            const IntersectionGeometryList* intersections = frame.value.choice.MapData.intersections;
+            if ( intersections && intersections->list.count > 0 ) {
+                append_intersection( key, intersections->list.array[0]->id );
+            }
+            break;
+        }
+
+        case MessageFrame__value_PR_SPAT: {
+            const IntersectionStateList_t& intersections = frame.value.choice.SPAT.intersections;
+            if ( intersections.list.count > 0 ) {
+                append_intersection( key, intersections.list.array[0]->id );
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    return !key.empty();
+}
+
+}  // end namespace.
@@ -0,0 +1,243 @@
+#include "header_peek.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+namespace peek {
+
+namespace {
+
+constexpr int kMaxNesting = 4;                  ///< signedData carrying signedData ...; real traffic nests once.
+
+/**
+ * A bounds checked cursor over COER octets.
+ */
+class Reader {
+    public:
+        Reader( const uint8_t* data, std::size_t size ) : data_{ data }, size_{ size } {}
+
+        bool byte( uint8_t& b ) {
+            if (pos_ >= size_) return false;
+            b = data_[pos_++];
+            return true;
+        }
+
+        /// COER length determinant: the length itself below 0x80, else 0x80 | the count of big endian length octets.
+        bool length( std::size_t& length ) {
+            uint8_t b;
+            if (!byte(b)) return false;
+            if (!(b & 0x80)) {
+                length = b;
+                return true;
+            }
+
+            std::size_t octets = b & 0x7F;
+            if (octets == 0 || octets > sizeof(std::size_t)) return false;
+
+            length = 0;
+            while (octets--) {
+                if (!byte(b)) return false;
+                length = (length << 8) | b;
+            }
+            return true;
+        }
+
+        bool skip( std::size_t n ) {
+            if (n > size_ - pos_) return false;
+            pos_ += n;
+            return true;
+        }
+
+        const uint8_t* here() const { return data_ + pos_; }
+        std::size_t left() const { return size_ - pos_; }
+
+    private:
+        const uint8_t* data_;
+        std::size_t size_;
+        std::size_t pos_ = 0;
+};
+
+/// HashedData: the root choice is a 32 octet hash; extension choices are open types.
+bool skip_hashed_data( Reader& r ) {
+    uint8_t tag;
+    if (!r.byte(tag)) return false;
+    if ((tag & 0x3F) == 0) return r.skip(32);
+
+    std::size_t length;
+    return r.length(length) && r.skip(length);
+}
+
+/// The extension additions of a SEQUENCE: a presence bitmap, then one open type for each bit set.
+bool skip_extensions( Reader& r ) {
+    std::size_t length;
+    uint8_t unused;
+    if (!r.length(length) || length == 0 || !r.byte(unused)) return false;
+
+    std::size_t present = 0;
+    for (std::size_t i = 1; i < length; ++i) {
+        uint8_t bits;
+        if (!r.byte(bits)) return false;
+        present += static_cast<std::size_t>(__builtin_popcount(bits));
+    }
+
+    while (present--) {
+        if (!r.length(length) || !r.skip(length)) return false;
+    }
+    return true;
+}
+
+bool read_content( Reader& r, Header& header, int nesting );
+
+/// SignedData: hashId, then ToBeSignedData { SignedDataPayload, HeaderInfo }; HeaderInfo starts with the psid.
+bool read_signed_data( Reader& r, Header& header, int nesting ) {
+    uint8_t hash_id, preamble;
+    if (!r.byte(hash_id) || !r.byte(preamble)) return false;
+
+    // SignedDataPayload preamble: extension bit, data present, extDataHash present.
+    if ((preamble & 0x40) && (nesting >= kMaxNesting || !read_content(r, header, nesting + 1))) return false;
+    if ((preamble & 0x20) && !skip_hashed_data(r)) return false;
+    if ((preamble & 0x80) && !skip_extensions(r)) return false;
+
+    // HeaderInfo preamble, then Psid ::= INTEGER (0..MAX): length prefixed, big endian.
+    std::size_t length;
+    if (!r.byte(preamble) || !r.length(length) || length == 0 || length >= sizeof(long long)) return false;
+
+    long long psid = 0;
+    while (length--) {
+        uint8_t b;
+        if (!r.byte(b)) return false;
+        psid = (psid << 8) | b;
+    }
+    header.psid = psid;
+    return true;
+}
+
+/// Ieee1609Dot2Data: protocolVersion 3, then the Ieee1609Dot2Content choice; the outermost choice names the PDU.
+bool read_content( Reader& r, Header& header, int nesting ) {
+    uint8_t version, tag;
+    if (!r.byte(version) || version != 3 || !r.byte(tag) || (tag & 0xC0) != 0x80) return false;
+
+    int choice = tag & 0x3F;
+    if (header.content < 0) header.content = choice;
+
+    switch (choice) {
+        case 0: {
+            // unsecuredData: an Opaque holding the MessageFrame.
+            std::size_t length;
+            if (!r.length(length)) return false;
+            if (header.message_id < 0) messageframe( r.here(), std::min(length, r.left()), header );
+            return r.skip(length);
+        }
+        case 1:
+            return read_signed_data(r, header, nesting);
+        default:
+            return false;
+    }
+}
+
+int nibble( char c ) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+}  // end namespace.
+
+bool messageframe( const uint8_t* data, std::size_t size, Header& header ) {
+    if (size < 2) return false;
+    header.message_id = (static_cast<long>(data[0] & 0x7F) << 8) | data[1];
+    return true;
+}
+
+bool ieee1609dot2( const uint8_t* data, std::size_t size, Header& header ) {
+    if (size < 2 || data[0] != 3 || (data[1] & 0xC0) != 0x80) return false;
+
+    Reader r{ data, size };
+    read_content(r, header, 0);                 // stops quietly where data ends or an unknown choice starts.
+    return true;
+}
+
+std::size_t hex_prefix( const std::string& hex, uint8_t* out, std::size_t max_bytes ) {
+    std::size_t n = 0;
+    while (n < max_bytes && 2 * n + 1 < hex.size()) {
+        int high = nibble(hex[2 * n]);
+        int low = nibble(hex[2 * n + 1]);
+        if (high < 0 || low < 0) break;
+        out[n++] = static_cast<uint8_t>((high << 4) | low);
+    }
+    return n;
+}
+
+}  // end namespace.
+
+bool Message_Filter::configure( const std::string& drop, const std::string& sample, std::string& error ) {
+    std::array<uint32_t, kMessageIds> keep_every{};
+    bool active = false;
+
+    auto message_id = [&]( const std::string& item, std::size_t& id ) {
+        try {
+            std::size_t used;
+            id = std::stoul( item, &used );
+            if (used == item.size() && id < kMessageIds) return true;
+        } catch (std::exception&) {
+        }
+        error = "bad messageId: " + item;
+        return false;
+    };
+
+    std::istringstream drops{ drop };
+    std::string item;
+    while (std::getline(drops, item, ',')) {
+        item.erase(std::remove(item.begin(), item.end(), ' '), item.end());
+        if (item.empty()) continue;
+
+        std::size_t id;
+        if (!message_id(item, id)) return false;
+        keep_every[id] = std::numeric_limits<uint32_t>::max();
+        active = true;
+    }
+
+    std::istringstream samples{ sample };
+    while (std::getline(samples, item, ',')) {
+        item.erase(std::remove(item.begin(), item.end(), ' '), item.end());
+        if (item.empty()) continue;
+
+        std::size_t colon = item.find(':');
+        std::size_t id;
+        if (colon == std::string::npos) {
+            error = "expected id:N, not " + item;
+            return false;
+        }
+        if (!message_id(item.substr(0, colon), id)) return false;
+
+        try {
+            unsigned long every = std::stoul( item.substr(colon + 1) );
+            if (every == 0 || every >= std::numeric_limits<uint32_t>::max()) throw std::out_of_range{ item };
+            keep_every[id] = static_cast<uint32_t>(every);
+        } catch (std::exception&) {
+            error = "bad sample rate: " + item;
+            return false;
+        }
+        active = true;
+    }
+
+    keep_every_ = keep_every;
+    seen_.fill(0);
+    active_ = active;
+    return true;
+}
+
+bool Message_Filter::active() const {
+    return active_;
+}
+
+Message_Filter::Action Message_Filter::decide( long message_id ) {
+    if (!active_ || message_id < 0 || message_id >= static_cast<long>(kMessageIds)) return Action::PASS;
+
+    uint32_t keep_every = keep_every_[message_id];
+    if (keep_every == 0) return Action::PASS;
+    if (keep_every == std::numeric_limits<uint32_t>::max()) return Action::DROP;
+    return seen_[message_id]++ % keep_every == 0 ? Action::PASS : Action::DROP;
+}
@@ -1,5 +1,6 @@
 #include "http_server.hpp"
 #include "acmLogger.hpp"
+#include "acm_metrics.hpp"
 #include "nlohmann/json.hpp"
 
 using namespace std;
@@ -74,6 +75,10 @@ const char* Http_Server::getEnvironmentVariable(std::string variableName) {
  * 
  *     /j2735/uper/xer
  *     /batch/j2735/uper/xer
+ *     /j2735/uper/jer
+ *     /batch/j2735/uper/jer
+ *
+ * and GET /metrics for monitoring.
  *     
  */
 bool Http_Server::http_server() {
@@ -143,6 +148,31 @@ bool Http_Server::http_server() {
             return post_batch(req);
         });
 
+    /**
+     * The same endpoints, returning each MessageFrame as JSON, e.g., {"MessageFrame":{"messageId":20,...}}, instead of XER.
+     */
+    CROW_ROUTE(app, "/j2735/uper/jer")
+        .methods("POST"_method)
+        ([this](const crow::request& req) {
+            return post_single(req, Text_Encoding::JSON);
+        });
+
+    CROW_ROUTE(app, "/batch/j2735/uper/jer")
+        .methods("POST"_method)
+        ([this](const crow::request& req){
+            return post_batch(req, Text_Encoding::JSON);
+        });
+
+    /**
+     * Endpoint exposing the ACM counters and latency histograms in the Prometheus text format.
+     */
+    CROW_ROUTE(app, "/metrics")
+        ([]() {
+            crow::response res{ metrics::Registry::instance().prometheus() };
+            res.set_header("Content-Type", "text/plain; version=0.0.4");
+            return res;
+        });
+
 
     ostringstream msg;
     msg << "Starting HTTP server on port " << port << ", using " << concurrency << " threads.";
@@ -156,35 +186,47 @@ bool Http_Server::http_server() {
     return EXIT_SUCCESS;
 }
 
-crow::response Http_Server::post_single(const crow::request &req) {
+crow::response Http_Server::post_single(const crow::request &req, Text_Encoding encoding) {
+    metrics::Registry& registry = metrics::Registry::instance();
+    registry.increment(metrics::Counter::MESSAGES_RECEIVED);
+    registry.increment(metrics::Counter::BYTES_RECEIVED, req.body.size());
+
     string hex_line(req.body);
     buffer_structure_t xb = {0, 0, 0};
-    bool decodeOk = codec.decode_messageframe_data(hex_line, &xb);
-    if (!decodeOk) {
+    metrics::StageTrace::local().begin();
+    uint64_t start_ns = metrics::now_ns();
+    Asn1Status status;
+    if (!codec.decode_messageframe_data(hex_line, &xb, status, encoding)) {
         free(xb.buffer);
-        string msg("Error decoding uper: ");
-        string err_msg = msg + hex_line;
-        logger.error(err_msg);
+        registry.error(static_cast<size_t>(status.error_type()));
+        // clients match on the payload echoed back, as they always have; the reason goes to the log.
+        string err_msg = "Error decoding uper: " + hex_line;
+        logger.error(err_msg + ": " + status.message());
         return crow::response(400, "text/plain", err_msg);
     }
+    registry.latency(metrics::Latency::DECODE, metrics::now_ns() - start_ns);
+    metrics::StageTrace::local().commit(metrics::Direction::DECODE);
     string xml_line(xb.buffer, xb.buffer_size);
     free(xb.buffer);
-    return crow::response("application/xml", xml_line);
+    registry.increment(metrics::Counter::MESSAGES_PUBLISHED);
+    registry.increment(metrics::Counter::BYTES_PUBLISHED, xml_line.size());
+    return crow::response(encoding == Text_Encoding::JSON ? "application/json" : "application/xml", xml_line);
 }
 
-crow::response Http_Server::post_batch(const crow::request &req) {
+crow::response Http_Server::post_batch(const crow::request &req, Text_Encoding encoding) {
+    metrics::Registry& registry = metrics::Registry::instance();
     string content_type = req.get_header_value("Content-Type");
     const bool is_json = content_type.find("json") != string::npos;
     {
         ostringstream msg;
         msg << "Content-Type: " << content_type << ", is json: " << is_json;
-        logger.info(msg.str());
+        logger.trace(msg.str());
     }
     long t1millis = get_epoch_milliseconds();
     {
         ostringstream msg;
         msg << "Start decoding at " << t1millis;
-        logger.info(msg.str());
+        logger.trace(msg.str());
     }
 
     istringstream infile(req.body);
@@ -195,11 +237,14 @@ crow::response Http_Server::post_batch(const crow::request &req) {
     json json_value;
     long timestamp;
     string message_type;
+    Asn1Status status;
 
     while (getline(infile, line)) {
         try {
             if (line == "") continue;
             ++msgCount;
+            registry.increment(metrics::Counter::MESSAGES_RECEIVED);
+            registry.increment(metrics::Counter::BYTES_RECEIVED, line.size());
 
             if (is_json) {
                 try {
@@ -208,6 +253,7 @@ crow::response Http_Server::post_batch(const crow::request &req) {
                     message_type = json_value["type"];
                     hex_line = json_value["hex"];
                 } catch (json::parse_error& ex) {
+                    registry.error(static_cast<size_t>(Asn1ErrorType::REQUEST));
                     logger.error("json parse error in line " + line);
                     continue;
                 }
@@ -216,14 +262,21 @@ crow::response Http_Server::post_batch(const crow::request &req) {
             }
 
             buffer_structure_t xb = {0, 0, 0};
-            bool decodeOk = codec.decode_messageframe_data(hex_line, &xb);
-            if (!decodeOk) {
+            metrics::StageTrace::local().begin();
+            uint64_t start_ns = metrics::now_ns();
+            status.clear();
+            if (!codec.decode_messageframe_data(hex_line, &xb, status, encoding)) {
                 free(xb.buffer);
-                logger.error("Error decoding uper: " + hex_line);
+                registry.error(static_cast<size_t>(status.error_type()));
+                logger.error("Error decoding uper: " + status.message() + " " + hex_line);
                 continue;
             }
+            registry.latency(metrics::Latency::DECODE, metrics::now_ns() - start_ns);
+            metrics::StageTrace::local().commit(metrics::Direction::DECODE);
             string xml_line(xb.buffer, xb.buffer_size);
             free(xb.buffer);
+            registry.increment(metrics::Counter::MESSAGES_PUBLISHED);
+            registry.increment(metrics::Counter::BYTES_PUBLISHED, xml_line.size());
 
             // If json, write additional info on line before decoded xml
             if (is_json) {
@@ -232,6 +285,7 @@ crow::response Http_Server::post_batch(const crow::request &req) {
 
             outfile << xml_line << endl;
         } catch (exception& ex) {
+            registry.error(static_cast<size_t>(Asn1ErrorType::FAILURE));
             logger.error(ex.what());
         }
     }
@@ -0,0 +1,399 @@
+#include "ipc_server.hpp"
+#include "acmLogger.hpp"
+#include "acm_metrics.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+std::atomic<bool> Ipc_Server::running{ true };
+
+namespace {
+
+constexpr std::size_t kFrameHeaderSize = 5;         // uint32 length + uint8 code.
+constexpr int kPollTimeoutMs = 500;                 // how often blocked workers check for shutdown.
+constexpr int kSpinRounds = 2048;                   // empty polls before a shared memory worker starts yielding.
+constexpr std::size_t kReadChunk = 64 * 1024;       // bytes read from a connection at a time.
+constexpr int kSendTimeoutSeconds = 5;              // a producer that stops reading its responses is dropped.
+
+bool write_frame(int fd, uint8_t code, const std::string& body) {
+    char header[kFrameHeaderSize];
+    uint32_t nlen = htonl(static_cast<uint32_t>(body.size()));
+    std::memcpy(header, &nlen, sizeof(nlen));
+    header[4] = static_cast<char>(code);
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = kFrameHeaderSize;
+    iov[1].iov_base = const_cast<char*>(body.data());
+    iov[1].iov_len = body.size();
+
+    std::size_t remaining = kFrameHeaderSize + body.size();
+    int iovcnt = 2;
+    struct iovec* iovp = iov;
+
+    // one syscall in the normal case; loop only for short writes.
+    while (remaining > 0) {
+        ssize_t n = writev(fd, iovp, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        remaining -= static_cast<std::size_t>(n);
+        while (n > 0 && iovcnt > 0) {
+            if (static_cast<std::size_t>(n) >= iovp->iov_len) {
+                n -= iovp->iov_len;
+                ++iovp;
+                --iovcnt;
+            } else {
+                iovp->iov_base = static_cast<char*>(iovp->iov_base) + n;
+                iovp->iov_len -= n;
+                n = 0;
+            }
+        }
+    }
+    return true;
+}
+
+}  // end namespace.
+
+Ipc_Server::Ipc_Server(ASN1_Codec& asn1_codec) :
+    codec(asn1_codec),
+    logger("ipc_server")
+{
+    std::string path_string = getEnvironmentVariable("ACM_IPC_SOCKET_PATH");
+    std::string concurrency_string = getEnvironmentVariable("ACM_IPC_CONCURRENCY");
+    std::string max_frame_string = getEnvironmentVariable("ACM_IPC_MAX_FRAME_SIZE");
+
+    if (!path_string.empty()) {
+        socket_path = path_string;
+    } else {
+        logger.warn("WARNING: ACM_IPC_SOCKET_PATH env variable is not set, using default: " + socket_path);
+    }
+
+    if (!concurrency_string.empty()) {
+        concurrency = std::stoi(concurrency_string);
+    } else {
+        logger.warn("WARNING: ACM_IPC_CONCURRENCY env variable is not set, using default: " + std::to_string(concurrency));
+    }
+
+    if (!max_frame_string.empty()) {
+        max_frame_size = static_cast<uint32_t>(std::stoul(max_frame_string));
+    }
+
+    // shared memory mode is optional; only enabled when a segment name is given.
+    shm_name = getEnvironmentVariable("ACM_IPC_SHM_NAME");
+    std::string channels_string = getEnvironmentVariable("ACM_IPC_SHM_CHANNELS");
+    std::string slots_string = getEnvironmentVariable("ACM_IPC_SHM_SLOTS");
+    std::string slot_size_string = getEnvironmentVariable("ACM_IPC_SHM_SLOT_SIZE");
+
+    if (!channels_string.empty()) shm_channels = static_cast<uint32_t>(std::stoul(channels_string));
+    if (!slots_string.empty()) shm_slots = static_cast<uint32_t>(std::stoul(slots_string));
+    if (!slot_size_string.empty()) shm_slot_size = static_cast<uint32_t>(std::stoul(slot_size_string));
+}
+
+Ipc_Server::~Ipc_Server()
+{
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+}
+
+const char* Ipc_Server::getEnvironmentVariable(std::string variableName) {
+    char* variableValue = getenv(variableName.c_str());
+    if (variableValue == NULL) {
+        return "";
+    }
+    return variableValue;
+}
+
+void Ipc_Server::sigterm(int) {
+    running = false;
+}
+
+ipc::IpcCode Ipc_Server::process_frame(uint8_t code, const char* data, std::size_t length, std::string& response) {
+    switch (static_cast<ipc::IpcCode>(code)) {
+        case ipc::IpcCode::OK:
+            // ping: echo the body so producers can measure the transport by itself.
+            response.assign(data, length);
+            return ipc::IpcCode::OK;
+
+        case ipc::IpcCode::DECODE_UPER_MESSAGEFRAME: {
+            metrics::Registry& registry = metrics::Registry::instance();
+            registry.increment(metrics::Counter::MESSAGES_RECEIVED);
+            registry.increment(metrics::Counter::BYTES_RECEIVED, length);
+
+            buffer_structure_t xb = {0, 0, 0};
+            metrics::StageTrace::local().begin();
+            uint64_t start_ns = metrics::now_ns();
+            Asn1Status status;
+            try {
+                if (!codec.decode_messageframe_bytes(data, length, &xb, status)) {
+                    free(xb.buffer);
+                    registry.error(static_cast<std::size_t>(status.error_type()));
+                    response = status.message();
+                    return ipc::IpcCode::ERROR;
+                }
+            } catch (const std::exception& e) {
+                free(xb.buffer);
+                registry.error(static_cast<std::size_t>(Asn1ErrorType::FAILURE));
+                response = e.what();
+                return ipc::IpcCode::ERROR;
+            }
+            registry.latency(metrics::Latency::DECODE, metrics::now_ns() - start_ns);
+            metrics::StageTrace::local().commit(metrics::Direction::DECODE);
+            response.assign(xb.buffer, xb.buffer_size);
+            free(xb.buffer);
+            registry.increment(metrics::Counter::MESSAGES_PUBLISHED);
+            registry.increment(metrics::Counter::BYTES_PUBLISHED, response.size());
+            return ipc::IpcCode::OK;
+        }
+
+        default:
+            response = "Unknown IPC operation code: " + std::to_string(code);
+            return ipc::IpcCode::ERROR;
+    }
+}
+
+bool Ipc_Server::open_socket() {
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        logger.error("IPC socket path is too long: " + socket_path);
+        return false;
+    }
+    std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        logger.error("Cannot create the IPC socket: " + std::string(std::strerror(errno)));
+        return false;
+    }
+
+    // a stale socket file from a previous run prevents bind.
+    unlink(socket_path.c_str());
+
+    if (bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        logger.error("Cannot bind the IPC socket " + socket_path + ": " + std::string(std::strerror(errno)));
+        return false;
+    }
+
+    // the workers share the listening socket; accept must not block the ones another worker beat to a connection.
+    if (fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK) != 0) {
+        logger.error("Cannot make the IPC socket non-blocking: " + std::string(std::strerror(errno)));
+        return false;
+    }
+
+    if (listen(listen_fd, SOMAXCONN) != 0) {
+        logger.error("Cannot listen on the IPC socket " + socket_path + ": " + std::string(std::strerror(errno)));
+        return false;
+    }
+
+    return true;
+}
+
+bool Ipc_Server::serve_connection(Connection& connection, std::string& response) {
+    std::vector<char>& buffer = connection.buffer;
+    std::size_t held = buffer.size();
+    buffer.resize(held + kReadChunk);
+    ssize_t n = recv(connection.fd, buffer.data() + held, kReadChunk, MSG_DONTWAIT);
+    buffer.resize(held + (n > 0 ? static_cast<std::size_t>(n) : 0));
+    if (n == 0) return false;
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    // a frame that is not whole yet stays in the buffer until the rest of it arrives.
+    std::size_t pos = 0;
+    while (buffer.size() - pos >= kFrameHeaderSize) {
+        uint32_t nlen;
+        std::memcpy(&nlen, buffer.data() + pos, sizeof(nlen));
+        uint32_t length = ntohl(nlen);
+        uint8_t code = static_cast<uint8_t>(buffer[pos + 4]);
+
+        if (length > max_frame_size) {
+            // the stream cannot be resynchronized after a bad length; tell the producer and drop it.
+            logger.error("IPC frame of " + std::to_string(length) + " bytes exceeds the maximum of " + std::to_string(max_frame_size));
+            write_frame(connection.fd, static_cast<uint8_t>(ipc::IpcCode::ERROR), "Frame exceeds the maximum frame size.");
+            return false;
+        }
+        if (buffer.size() - pos - kFrameHeaderSize < length) break;
+
+        ipc::IpcCode rc = process_frame(code, buffer.data() + pos + kFrameHeaderSize, length, response);
+        if (rc == ipc::IpcCode::ERROR) {
+            logger.error("IPC request failed: " + response);
+        }
+
+        if (!write_frame(connection.fd, static_cast<uint8_t>(rc), response)) return false;
+        pos += kFrameHeaderSize + length;
+    }
+
+    buffer.erase(buffer.begin(), buffer.begin() + pos);
+    return true;
+}
+
+void Ipc_Server::socket_worker(int worker_id) {
+    std::vector<Connection> connections;
+    std::vector<struct pollfd> pfds;
+    std::string response;
+
+    while (running.load(std::memory_order_relaxed)) {
+        pfds.clear();
+        pfds.push_back({ listen_fd, POLLIN, 0 });
+        for (const auto& connection : connections) pfds.push_back({ connection.fd, POLLIN, 0 });
+
+        int pr = poll(pfds.data(), pfds.size(), kPollTimeoutMs);
+        if (pr <= 0) continue;
+
+        // every worker polls the same listening socket; it does not block, so the workers that lose a connection to
+        // another one move on.
+        if (pfds[0].revents & POLLIN) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd >= 0) {
+                struct timeval timeout = { kSendTimeoutSeconds, 0 };
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                connections.push_back(Connection{ fd, {} });
+                logger.trace("IPC worker " + std::to_string(worker_id) + " accepted a connection; serving " + std::to_string(connections.size()) + ".");
+            }
+        }
+
+        // pfds[i] polled connections[i - 1]; connections accepted above are polled next time around.
+        for (std::size_t i = 1; i < pfds.size(); ++i) {
+            if (pfds[i].revents == 0) continue;
+            Connection& connection = connections[i - 1];
+            if (!serve_connection(connection, response)) {
+                close(connection.fd);
+                connection.fd = -1;
+            }
+        }
+        connections.erase(std::remove_if(connections.begin(), connections.end(),
+                [](const Connection& connection) { return connection.fd < 0; }), connections.end());
+    }
+
+    for (auto& connection : connections) close(connection.fd);
+}
+
+void Ipc_Server::shm_worker(ipc::ShmSegment& segment, int worker_id) {
+    std::string response;
+    std::vector<bool> dropped(segment.channel_count(), false);
+    int idle = 0;
+
+    while (running.load(std::memory_order_relaxed)) {
+        bool did_work = false;
+
+        for (std::size_t c = worker_id; c < segment.channel_count(); c += concurrency) {
+            if (dropped[c]) continue;
+            ipc::Channel& ch = segment.channel(c);
+
+            // the producer owns draining its responses; a channel whose ring is full waits while the others go on.
+            if (ch.responses.full()) continue;
+
+            uint8_t code;
+            const char* data;
+            uint32_t length;
+
+            ipc::SlotState state = ch.requests.peek(code, data, length);
+            if (state == ipc::SlotState::EMPTY) continue;
+            if (state == ipc::SlotState::CORRUPT) {
+                // the producer wrote a length past its slot; nothing after it in the ring can be trusted.
+                logger.error("IPC shared memory channel " + std::to_string(c) + " has a request longer than its slot; dropping the channel.");
+                response = "Request exceeds the shared memory slot size.";
+                ch.responses.try_push(static_cast<uint8_t>(ipc::IpcCode::ERROR), response.data(), response.size());
+                dropped[c] = true;
+                continue;
+            }
+
+            // process straight out of the slot; it is only released after the codec is done with it.
+            ipc::IpcCode rc = process_frame(code, data, length, response);
+            ch.requests.release();
+
+            if (response.size() > ch.responses.capacity()) {
+                rc = ipc::IpcCode::ERROR;
+                response = "Response exceeds the shared memory slot size.";
+            }
+
+            // only this worker pushes responses to the channel, so the room found above is still there.
+            ch.responses.try_push(static_cast<uint8_t>(rc), response.data(), response.size());
+
+            did_work = true;
+        }
+
+        if (did_work) {
+            idle = 0;
+        } else if (++idle > kSpinRounds) {
+            // back off once the channels have been quiet long enough that spinning only burns a core.
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        } else if (idle > kSpinRounds / 2) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+ * Runs the IPC server until SIGINT or SIGTERM.
+ *
+ * Environment variables:
+ *
+ *     ACM_IPC_SOCKET_PATH       Unix domain socket path; default /tmp/acm.sock
+ *     ACM_IPC_CONCURRENCY       worker threads for each transport; default 4
+ *     ACM_IPC_MAX_FRAME_SIZE    largest accepted socket frame body in bytes; default 1 MiB
+ *     ACM_IPC_SHM_NAME          shared memory segment name, e.g. /acm; shared memory is disabled when unset
+ *     ACM_IPC_SHM_CHANNELS      number of producer channels in the segment; default 4
+ *     ACM_IPC_SHM_SLOTS         slots per ring, a power of two; default 256
+ *     ACM_IPC_SHM_SLOT_SIZE     bytes per slot, a multiple of 64; default 8192
+ */
+bool Ipc_Server::ipc_server() {
+    running = true;
+    signal(SIGINT, sigterm);
+    signal(SIGTERM, sigterm);
+    // a producer that disconnects mid-response must not kill the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    if (concurrency < 1) concurrency = 1;
+
+    if (!open_socket()) {
+        return EXIT_FAILURE;
+    }
+
+    ipc::ShmSegment segment;
+    bool use_shm = !shm_name.empty();
+
+    if (use_shm && !segment.create(shm_name, shm_channels, shm_slots, shm_slot_size)) {
+        logger.error("Cannot create the IPC shared memory segment " + shm_name + "; check the channel, slot count and slot size settings.");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < concurrency; ++i) {
+        workers.emplace_back(&Ipc_Server::socket_worker, this, i);
+    }
+
+    if (use_shm) {
+        for (int i = 0; i < concurrency && i < static_cast<int>(shm_channels); ++i) {
+            workers.emplace_back(&Ipc_Server::shm_worker, this, std::ref(segment), i);
+        }
+        logger.info("Serving " + std::to_string(shm_channels) + " shared memory channels on " + shm_name + ".");
+    }
+
+    logger.info("Starting IPC server on " + socket_path + ", using " + std::to_string(concurrency) + " threads.");
+
+    for (auto& t : workers) {
+        t.join();
+    }
+
+    logger.info("IPC server shutting down.");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,349 @@
+#include "json_encoder.hpp"
+
+#include "BIT_STRING.h"
+#include "BOOLEAN.h"
+#include "ENUMERATED.h"
+#include "GraphicString.h"
+#include "IA5String.h"
+#include "INTEGER.h"
+#include "NULL.h"
+#include "NativeEnumerated.h"
+#include "NativeInteger.h"
+#include "OCTET_STRING.h"
+#include "OPEN_TYPE.h"
+#include "ObjectDescriptor.h"
+#include "UTF8String.h"
+#include "asn_SET_OF.h"
+#include "constr_CHOICE.h"
+#include "constr_SEQUENCE.h"
+#include "constr_SEQUENCE_OF.h"
+#include "constr_SET_OF.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace jer {
+
+namespace {
+
+constexpr std::size_t kFlushBytes = 4096;      ///< text kept before it is given to the callback.
+
+/**
+ * Builds the text in a buffer and hands it to the asn1c style callback a few kilobytes at a time, so a budgeted sink can
+ * stop an oversized encoding early.
+ */
+class Writer {
+    public:
+        Writer( asn_app_consume_bytes_f* cb, void* app_key ) : cb_{ cb }, app_key_{ app_key } {
+            out.reserve( 2 * kFlushBytes );
+        }
+
+        bool flush() {
+            if ( out.empty() ) return true;
+            if ( cb_( out.data(), out.size(), app_key_ ) < 0 ) return false;
+            encoded_ += out.size();
+            out.clear();
+            return true;
+        }
+
+        bool maybe_flush() {
+            return out.size() < kFlushBytes || flush();
+        }
+
+        ssize_t encoded() const { return static_cast<ssize_t>( encoded_ ); }
+
+        std::string out;
+
+    private:
+        asn_app_consume_bytes_f* cb_;
+        void* app_key_;
+        std::size_t encoded_ = 0;
+};
+
+int append_to_string( const void* buffer, std::size_t size, void* app_key ) {
+    static_cast<std::string*>( app_key )->append( static_cast<const char*>( buffer ), size );
+    return 0;
+}
+
+bool is_text( const asn_TYPE_descriptor_t* type ) {
+    return type->op == &asn_OP_IA5String || type->op == &asn_OP_UTF8String || type->op == &asn_OP_GraphicString
+            || type->op == &asn_OP_ObjectDescriptor;
+}
+
+void append_hex( std::string& out, const uint8_t* buf, std::size_t size ) {
+    static const char hex[] = "0123456789ABCDEF";
+
+    out += '"';
+    for ( std::size_t i = 0; i < size; ++i ) {
+        out += hex[ buf[i] >> 4 ];
+        out += hex[ buf[i] & 0x0F ];
+    }
+    out += '"';
+}
+
+/// A member of a SEQUENCE or CHOICE: null when an OPTIONAL member is absent.
+const void* member_value( const asn_TYPE_member_t& member, const void* structure ) {
+    const char* field = static_cast<const char*>( structure ) + member.memb_offset;
+    if ( member.flags & ATF_POINTER ) return *reinterpret_cast<const void* const*>( field );
+    return field;
+}
+
+bool append_value( Writer& w, const asn_TYPE_descriptor_t* type, const void* value );
+
+bool append_sequence( Writer& w, const asn_TYPE_descriptor_t* type, const void* value ) {
+    w.out += '{';
+    bool first = true;
+
+    for ( unsigned i = 0; i < type->elements_count; ++i ) {
+        const asn_TYPE_member_t& member = type->elements[i];
+        const void* member_ptr = member_value( member, value );
+        void* default_value = nullptr;
+
+        if ( !member_ptr ) {
+            // XER writes an absent DEFAULT member with its default value; so does this.
+            if ( member.default_value_set ) {
+                if ( member.default_value_set( &default_value ) ) return false;
+                member_ptr = default_value;
+            } else if ( member.optional ) {
+                continue;
+            } else {
+                return false;
+            }
+        }
+
+        if ( !first ) w.out += ',';
+        first = false;
+        append_string( w.out, member.name );
+        w.out += ':';
+
+        bool ok = append_value( w, member.type, member_ptr );
+        if ( default_value ) ASN_STRUCT_FREE( *member.type, default_value );
+        if ( !ok ) return false;
+    }
+
+    w.out += '}';
+    return true;
+}
+
+/// CHOICE, and open types, which asn1c lays out as a CHOICE of the types they may hold.
+bool append_choice( Writer& w, const asn_TYPE_descriptor_t* type, const void* value ) {
+    unsigned present = CHOICE_variant_get_presence( type, value );
+    if ( present == 0 || present > type->elements_count ) return false;
+
+    const asn_TYPE_member_t& member = type->elements[present - 1];
+    const void* member_ptr = member_value( member, value );
+    if ( !member_ptr ) return false;
+
+    w.out += '{';
+    append_string( w.out, member.name );
+    w.out += ':';
+    if ( !append_value( w, member.type, member_ptr ) ) return false;
+    w.out += '}';
+    return true;
+}
+
+bool append_list( Writer& w, const asn_TYPE_descriptor_t* type, const void* value ) {
+    const asn_anonymous_set_* list = _A_CSET_FROM_VOID( value );
+    const asn_TYPE_member_t& member = type->elements[0];
+
+    w.out += '[';
+    bool first = true;
+    for ( int i = 0; i < list->count; ++i ) {
+        if ( !list->array[i] ) continue;
+        if ( !first ) w.out += ',';
+        first = false;
+        if ( !append_value( w, member.type, list->array[i] ) ) return false;
+    }
+    w.out += ']';
+    return true;
+}
+
+bool append_enumerated( Writer& w, const asn_TYPE_descriptor_t* type, long value ) {
+    const asn_INTEGER_enum_map_t* item = INTEGER_map_value2enum( static_cast<const asn_INTEGER_specifics_t*>( type->specifics ), value );
+    if ( !item ) return false;              // as XER: an unknown ENUMERATED value cannot be written.
+    append_string( w.out, item->enum_name, item->enum_len );
+    return true;
+}
+
+bool append_integer( Writer& w, const asn_TYPE_descriptor_t* type, const INTEGER_t* value ) {
+    const asn_INTEGER_specifics_t* specs = static_cast<const asn_INTEGER_specifics_t*>( type->specifics );
+    char digits[24];
+
+    if ( specs && specs->field_unsigned ) {
+        uintmax_t u;
+        if ( asn_INTEGER2umax( value, &u ) ) return false;
+        std::snprintf( digits, sizeof(digits), "%" PRIuMAX, u );
+    } else {
+        intmax_t i;
+        if ( asn_INTEGER2imax( value, &i ) ) return false;
+        std::snprintf( digits, sizeof(digits), "%" PRIdMAX, i );
+    }
+    w.out += digits;
+    return true;
+}
+
+void append_bits( Writer& w, const BIT_STRING_t* value ) {
+    w.out += '"';
+    std::size_t bits = value->size * 8 - static_cast<std::size_t>( value->size ? value->bits_unused : 0 );
+    for ( std::size_t bit = 0; bit < bits; ++bit ) {
+        w.out += ( value->buf[bit / 8] & ( 0x80 >> ( bit % 8 ) ) ) ? '1' : '0';
+    }
+    w.out += '"';
+}
+
+/// Types without a JSON form of their own are written as the strings XER writes for them, e.g., 1.3.6.1 for an OID.
+bool append_xer_text( Writer& w, const asn_TYPE_descriptor_t* type, const void* value ) {
+    std::string text;
+    asn_enc_rval_t rval = type->op->xer_encoder( type, value, 1, XER_F_CANONICAL, append_to_string, &text );
+    if ( rval.encoded < 0 ) return false;
+    append_string( w.out, text.data(), text.size() );
+    return true;
+}
+
+bool append_value( Writer& w, const asn_TYPE_descriptor_t* type, const void* value ) {
+    if ( !value || !w.maybe_flush() ) return false;
+
+    const asn_TYPE_operation_t* op = type->op;
+
+    if ( op == &asn_OP_SEQUENCE ) return append_sequence( w, type, value );
+    if ( op == &asn_OP_CHOICE || op == &asn_OP_OPEN_TYPE ) return append_choice( w, type, value );
+    if ( op == &asn_OP_SEQUENCE_OF || op == &asn_OP_SET_OF ) return append_list( w, type, value );
+
+    if ( op == &asn_OP_NativeInteger ) {
+        const asn_INTEGER_specifics_t* specs = static_cast<const asn_INTEGER_specifics_t*>( type->specifics );
+        long n = *static_cast<const long*>( value );
+        w.out += specs && specs->field_unsigned ? std::to_string( static_cast<unsigned long>( n ) ) : std::to_string( n );
+        return true;
+    }
+
+    if ( op == &asn_OP_NativeEnumerated ) return append_enumerated( w, type, *static_cast<const long*>( value ) );
+    if ( op == &asn_OP_INTEGER ) return append_integer( w, type, static_cast<const INTEGER_t*>( value ) );
+
+    if ( op == &asn_OP_ENUMERATED ) {
+        long n;
+        return asn_INTEGER2long( static_cast<const ENUMERATED_t*>( value ), &n ) == 0 && append_enumerated( w, type, n );
+    }
+
+    if ( op == &asn_OP_BOOLEAN ) {
+        w.out += *static_cast<const BOOLEAN_t*>( value ) ? "true" : "false";
+        return true;
+    }
+
+    if ( op == &asn_OP_NULL ) {
+        w.out += "null";
+        return true;
+    }
+
+    if ( op == &asn_OP_OCTET_STRING ) {
+        const OCTET_STRING_t* octets = static_cast<const OCTET_STRING_t*>( value );
+        append_hex( w.out, octets->buf, octets->size );
+        return true;
+    }
+
+    if ( is_text( type ) ) {
+        const OCTET_STRING_t* text = static_cast<const OCTET_STRING_t*>( value );
+        append_string( w.out, reinterpret_cast<const char*>( text->buf ), text->size );
+        return true;
+    }
+
+    if ( op == &asn_OP_BIT_STRING ) {
+        append_bits( w, static_cast<const BIT_STRING_t*>( value ) );
+        return true;
+    }
+
+    return append_xer_text( w, type, value );
+}
+
+}  // end namespace.
+
+asn_enc_rval_t encode( const asn_TYPE_descriptor_t* type, const void* structure, asn_app_consume_bytes_f* cb, void* app_key ) {
+    asn_enc_rval_t rval{ -1, type, structure };
+    Writer w{ cb, app_key };
+
+    w.out += '{';
+    append_string( w.out, type->xml_tag );
+    w.out += ':';
+    if ( !append_value( w, type, structure ) ) return rval;
+    w.out += '}';
+    if ( !w.flush() ) return rval;
+
+    rval.encoded = w.encoded();
+    rval.failed_type = nullptr;
+    rval.structure_ptr = nullptr;
+    return rval;
+}
+
+void append_string( std::string& out, const char* text, std::size_t size ) {
+    static const char hex[] = "0123456789abcdef";
+
+    out += '"';
+    for ( std::size_t i = 0; i < size; ++i ) {
+        char c = text[i];
+        switch ( c ) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ( static_cast<unsigned char>( c ) < 0x20 ) {
+                    out += "\\u00";
+                    out += hex[ ( c >> 4 ) & 0xF ];
+                    out += hex[ c & 0xF ];
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+void append_string( std::string& out, const char* text ) {
+    append_string( out, text, std::strlen( text ) );
+}
+
+void append_element( std::string& out, const pugi::xml_node& element, const pugi::xml_node& splice, const std::string& splice_json ) {
+    if ( element == splice ) {
+        out += splice_json;
+        return;
+    }
+
+    if ( !element.find_child( []( const pugi::xml_node& child ) { return child.type() == pugi::node_element; } ) ) {
+        append_string( out, element.child_value() );
+        return;
+    }
+
+    // each name once, in the order it first appears; the ODE envelope repeats few names, so a scan is enough.
+    std::vector<const pugi::char_t*> written;
+    out += '{';
+    for ( pugi::xml_node child = element.first_child(); child; child = child.next_sibling() ) {
+        if ( child.type() != pugi::node_element ) continue;
+
+        const pugi::char_t* name = child.name();
+        bool seen = false;
+        for ( const pugi::char_t* w : written ) seen = seen || std::strcmp( w, name ) == 0;
+        if ( seen ) continue;
+
+        if ( !written.empty() ) out += ',';
+        written.push_back( name );
+        append_string( out, name );
+        out += ':';
+
+        if ( !child.next_sibling( name ) ) {
+            append_element( out, child, splice, splice_json );
+            continue;
+        }
+
+        out += '[';
+        for ( pugi::xml_node same = child; same; same = same.next_sibling( name ) ) {
+            if ( same != child ) out += ',';
+            append_element( out, same, splice, splice_json );
+        }
+        out += ']';
+    }
+    out += '}';
+}
+
+}  // end namespace.
@@ -0,0 +1,220 @@
+#include "json_envelope.hpp"
+
+#include "rapidjson/error/en.h"
+#include "rapidjson/writer.h"
+
+#include <cstring>
+
+namespace {
+
+/// Lets the rapidjson writer append to a string, so the output is built in place.
+class String_Stream {
+    public:
+        typedef char Ch;
+
+        explicit String_Stream( std::string& out ) : out_{ out } {}
+
+        void Put( char c ) { out_ += c; }
+        void Flush() {}
+
+    private:
+        std::string& out_;
+};
+
+typedef rapidjson::Writer<String_Stream> Writer;
+
+const char* string_member( const rapidjson::Value& object, const char* name ) {
+    rapidjson::Value::ConstMemberIterator member = object.FindMember( name );
+    return member != object.MemberEnd() && member->value.IsString() ? member->value.GetString() : nullptr;
+}
+
+const rapidjson::Value* object_member( const rapidjson::Value& object, const char* name ) {
+    rapidjson::Value::ConstMemberIterator member = object.FindMember( name );
+    return member != object.MemberEnd() && member->value.IsObject() ? &member->value : nullptr;
+}
+
+bool is( const rapidjson::Value& name, const char* expected ) {
+    return std::strcmp( name.GetString(), expected ) == 0;
+}
+
+void write_key( Writer& writer, const rapidjson::Value& name ) {
+    writer.Key( name.GetString(), name.GetStringLength() );
+}
+
+void write_metadata( Writer& writer, const rapidjson::Value& metadata, const Json_Envelope::Changes& changes ) {
+    writer.StartObject();
+    for ( rapidjson::Value::ConstMemberIterator m = metadata.MemberBegin(); m != metadata.MemberEnd(); ++m ) {
+        write_key( writer, m->name );
+        if ( changes.payload_type && is( m->name, "payloadType" ) ) {
+            writer.String( changes.payload_type );
+        } else if ( changes.generated_at && is( m->name, "generatedAt" ) ) {
+            writer.String( changes.generated_at );
+        } else {
+            m->value.Accept( writer );
+        }
+    }
+    writer.EndObject();
+}
+
+void write_payload( Writer& writer, const rapidjson::Value& payload, const Json_Envelope::Changes& changes ) {
+    bool data_type = false;
+    bool data = false;
+
+    writer.StartObject();
+    for ( rapidjson::Value::ConstMemberIterator m = payload.MemberBegin(); m != payload.MemberEnd(); ++m ) {
+        write_key( writer, m->name );
+        if ( changes.data_type && is( m->name, "dataType" ) ) {
+            writer.String( changes.data_type );
+            data_type = true;
+        } else if ( changes.data && is( m->name, "data" ) ) {
+            writer.RawValue( changes.data->data(), changes.data->size(), rapidjson::kObjectType );
+            data = true;
+        } else {
+            m->value.Accept( writer );
+        }
+    }
+
+    if ( changes.data_type && !data_type ) {
+        writer.Key( "dataType" );
+        writer.String( changes.data_type );
+    }
+    if ( changes.data && !data ) {
+        writer.Key( "data" );
+        writer.RawValue( changes.data->data(), changes.data->size(), rapidjson::kObjectType );
+    }
+    writer.EndObject();
+}
+
+}  // end namespace.
+
+Json_Envelope::Json_Envelope() :
+    buffer_{}
+    , pool_( 16 * 1024 )
+    , allocator_{ pool_.data(), pool_.size() }
+    , document_{ &allocator_ }
+    , envelope_{ nullptr }
+    , data_{ nullptr }
+    , encodings_{}
+    , has_encodings_{ false }
+{
+}
+
+bool Json_Envelope::detect( const char* data, std::size_t size ) {
+    for ( std::size_t i = 0; i < size; ++i ) {
+        switch ( data[i] ) {
+            case ' ': case '\t': case '\r': case '\n':
+                continue;
+            default:
+                return data[i] == '{';
+        }
+    }
+    return false;
+}
+
+bool Json_Envelope::parse( const char* data, std::size_t size, std::string& error ) {
+    envelope_ = nullptr;
+    data_ = nullptr;
+    encodings_.clear();
+    has_encodings_ = false;
+
+    // the values of the last envelope go with the pool's chunks; the first chunk stays for this one.
+    document_.SetNull();
+    allocator_.Clear();
+
+    buffer_.assign( data, data + size );
+    buffer_.push_back( '\0' );
+    document_.ParseInsitu( buffer_.data() );
+
+    if ( document_.HasParseError() ) {
+        error = std::string{ rapidjson::GetParseError_En( document_.GetParseError() ) } + " at offset " + std::to_string( document_.GetErrorOffset() );
+        return false;
+    }
+
+    if ( !document_.IsObject() ) {
+        error = "the envelope is not an object.";
+        return false;
+    }
+
+    envelope_ = &document_;
+    const rapidjson::Value* wrapped = object_member( document_, "OdeAsn1Data" );
+    if ( wrapped && document_.MemberCount() == 1 ) {
+        envelope_ = wrapped;
+    }
+
+    if ( const rapidjson::Value* metadata = object_member( *envelope_, "metadata" ) ) {
+        rapidjson::Value::ConstMemberIterator member = metadata->FindMember( "encodings" );
+        if ( member != metadata->MemberEnd() ) {
+            const rapidjson::Value* encodings = &member->value;
+
+            // XML converted to JSON keeps the repeated <encodings> elements inside the outer one.
+            if ( encodings->IsObject() ) {
+                rapidjson::Value::ConstMemberIterator inner = encodings->FindMember( "encodings" );
+                if ( inner != encodings->MemberEnd() ) encodings = &inner->value;
+            }
+
+            has_encodings_ = true;
+            if ( encodings->IsArray() ) {
+                for ( rapidjson::Value::ConstValueIterator e = encodings->Begin(); e != encodings->End(); ++e ) {
+                    if ( !e->IsObject() ) continue;
+                    const char* element_type = string_member( *e, "elementType" );
+                    encodings_.push_back( Encoding{ element_type ? element_type : "", string_member( *e, "encodingRule" ) } );
+                }
+            } else if ( encodings->IsObject() ) {
+                const char* element_type = string_member( *encodings, "elementType" );
+                encodings_.push_back( Encoding{ element_type ? element_type : "", string_member( *encodings, "encodingRule" ) } );
+            }
+        }
+    }
+
+    if ( const rapidjson::Value* payload = object_member( *envelope_, "payload" ) ) {
+        rapidjson::Value::ConstMemberIterator member = payload->FindMember( "data" );
+        if ( member != payload->MemberEnd() ) {
+            data_ = &member->value;
+        }
+    }
+
+    return true;
+}
+
+const std::vector<Json_Envelope::Encoding>* Json_Envelope::encodings() const {
+    return has_encodings_ ? &encodings_ : nullptr;
+}
+
+const char* Json_Envelope::data_bytes() const {
+    return data_ && data_->IsObject() ? string_member( *data_, "bytes" ) : nullptr;
+}
+
+const char* Json_Envelope::data_text( std::size_t& size ) const {
+    if ( !data_ || !data_->IsString() ) return nullptr;
+    size = data_->GetStringLength();
+    return data_->GetString();
+}
+
+void Json_Envelope::write( std::string& out, const Changes& changes ) const {
+    if ( !envelope_ ) return;
+
+    String_Stream stream{ out };
+    Writer writer{ stream };
+
+    if ( envelope_ != &document_ ) {
+        writer.StartObject();
+        writer.Key( "OdeAsn1Data" );
+    }
+
+    writer.StartObject();
+    for ( rapidjson::Value::ConstMemberIterator m = envelope_->MemberBegin(); m != envelope_->MemberEnd(); ++m ) {
+        write_key( writer, m->name );
+        if ( is( m->name, "metadata" ) && m->value.IsObject() ) {
+            write_metadata( writer, m->value, changes );
+        } else if ( is( m->name, "payload" ) && m->value.IsObject() ) {
+            write_payload( writer, m->value, changes );
+        } else {
+            m->value.Accept( writer );
+        }
+    }
+    writer.EndObject();
+
+    if ( envelope_ != &document_ ) {
+        writer.EndObject();
+    }
+}
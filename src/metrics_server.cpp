@@ -0,0 +1,107 @@
+#include "metrics_server.hpp"
+#include "acm_metrics.hpp"
+#include "crow/crow_all.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+constexpr int kStartTimeoutMs = 250;        // how long a server that failed to start has to say so.
+
+/**
+ * crow binds on its own thread and its errors never reach the caller; try the port here first.
+ *
+ * @return an empty string if the port can be bound, otherwise why not.
+ */
+string bind_error(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return strerror(errno);
+
+    // crow reuses the address too, so a socket in TIME_WAIT does not count as taken.
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+
+    string error;
+    if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) error = strerror(errno);
+    close(fd);
+    return error;
+}
+
+}
+
+Metrics_Server::Metrics_Server() :
+    logger("metrics_server")
+{
+}
+
+Metrics_Server::~Metrics_Server()
+{
+    stop();
+}
+
+bool Metrics_Server::start(int port) {
+    if (app) return true;
+
+    app.reset(new crow::SimpleApp);
+
+    CROW_ROUTE((*app), "/metrics")
+        ([]() {
+            crow::response res{ metrics::Registry::instance().prometheus() };
+            res.set_header("Content-Type", "text/plain; version=0.0.4");
+            return res;
+        });
+
+    ostringstream msg;
+    msg << "Starting metrics server on port " << port;
+    logger.info(msg.str());
+
+    string error = bind_error(port);
+    if (!error.empty()) {
+        logger.error("Failed to start the metrics server: cannot bind port " + to_string(port) + ": " + error);
+        app.reset();
+        return false;
+    }
+
+    // signal_clear keeps crow from replacing the ASN1_Codec SIGINT/SIGTERM handlers.
+    runner = app->port(port)
+        .concurrency(1)
+        .signal_clear()
+        .loglevel(crow::LogLevel::Warning)
+        .run_async();
+
+    // run only returns once the server stops; one that returns this soon did not start.
+    if (runner.wait_for(chrono::milliseconds(kStartTimeoutMs)) == future_status::ready) {
+        try {
+            runner.get();
+            logger.error("Failed to start the metrics server: it stopped as it started.");
+        } catch (exception& e) {
+            logger.error("Failed to start the metrics server: " + string(e.what()));
+        }
+        app.reset();
+        return false;
+    }
+
+    return true;
+}
+
+void Metrics_Server::stop() {
+    if (!app) return;
+
+    app->stop();
+    if (runner.valid()) runner.wait();
+    app.reset();
+}
@@ -0,0 +1,169 @@
+#include "output_renderer.hpp"
+#include "json_encoder.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+/**
+ * Appends what pugixml writes to a string, so a rendering is built in place instead of through a stream.
+ */
+class String_Writer : public pugi::xml_writer {
+    public:
+        explicit String_Writer( std::string& out ) : out_{ out } {}
+
+        void write( const void* data, std::size_t size ) override {
+            out_.append( static_cast<const char*>( data ), size );
+        }
+
+    private:
+        std::string& out_;
+};
+
+/// XER INTEGER content; digit strings with leading zeros are BIT STRINGs or the like and stay strings.
+bool is_integer( const char* text ) {
+    if ( *text == '-' ) ++text;
+    if ( !*text || ( text[0] == '0' && text[1] ) ) return false;
+    for ( ; *text; ++text ) {
+        if ( *text < '0' || *text > '9' ) return false;
+    }
+    return true;
+}
+
+void append_json_value( std::string& out, const char* text ) {
+    if ( is_integer( text ) ) {
+        out += text;
+    } else {
+        jer::append_string( out, text );
+    }
+}
+
+/// The decoded PDU is the element that replaced the payload bytes.
+pugi::xml_node decoded_pdu( const pugi::xml_node& payload ) {
+    for ( pugi::xml_node child = payload.first_child(); child; child = child.next_sibling() ) {
+        if ( child.type() == pugi::node_element ) return child;
+    }
+    return pugi::xml_node{};
+}
+
+}  // end namespace.
+
+bool Output_Renderer::parse( const std::string& name, Format& format ) {
+    for ( Format f : { Format::ENVELOPE, Format::MESSAGEFRAME, Format::PROJECTION } ) {
+        if ( name == Output_Renderer::name( f ) ) {
+            format = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* Output_Renderer::name( Format format ) {
+    switch ( format ) {
+        case Format::ENVELOPE: return "envelope";
+        case Format::MESSAGEFRAME: return "messageframe";
+        case Format::PROJECTION: return "projection";
+    }
+    return "unknown";
+}
+
+bool Output_Renderer::configure( Format format, const std::string& fields, std::string& error ) {
+    std::vector<Field> parsed;
+
+    std::istringstream items{ fields };
+    std::string item;
+    while ( std::getline( items, item, ',' ) ) {
+        item.erase( std::remove( item.begin(), item.end(), ' ' ), item.end() );
+        if ( item.empty() ) continue;
+
+        std::size_t equals = item.find( '=' );
+        if ( equals == 0 || equals == std::string::npos || equals + 1 == item.size() ) {
+            error = "expected name=path, not " + item;
+            return false;
+        }
+
+        try {
+            parsed.push_back( Field{ item.substr( 0, equals ), std::make_shared<const pugi::xpath_query>( item.substr( equals + 1 ).c_str() ) } );
+        } catch ( const pugi::xpath_exception& e ) {
+            error = "bad path in " + item + ": " + e.what();
+            return false;
+        }
+    }
+
+    if ( format == Format::PROJECTION && parsed.empty() ) {
+        error = "a projection needs fields.";
+        return false;
+    }
+
+    if ( format != Format::PROJECTION && !parsed.empty() ) {
+        error = std::string{ "fields are for projections, not " } + name( format ) + ".";
+        return false;
+    }
+
+    format_ = format;
+    fields_ = std::move( parsed );
+    return true;
+}
+
+Output_Renderer::Format Output_Renderer::format() const {
+    return format_;
+}
+
+bool Output_Renderer::render( const pugi::xml_document& envelope, const pugi::xml_node& payload, const std::string* pdu_json, std::string& out ) const {
+    String_Writer writer{ out };
+
+    if ( pdu_json && format_ == Format::MESSAGEFRAME ) {
+        out += *pdu_json;
+        return !pdu_json->empty();
+    }
+
+    if ( pdu_json && format_ == Format::ENVELOPE ) {
+        // the metadata come from the input XML; the payload data is the decoded PDU's own JSON.
+        pugi::xml_node root = envelope.document_element();
+        out += '{';
+        jer::append_string( out, root.name() );
+        out += ':';
+        jer::append_element( out, root, pdu_json->empty() ? pugi::xml_node{} : payload, *pdu_json );
+        out += '}';
+        return true;
+    }
+
+    if ( format_ == Format::ENVELOPE ) {
+        envelope.save( writer, "", pugi::format_raw );
+        return true;
+    }
+
+    pugi::xml_node pdu = decoded_pdu( payload );
+    if ( !pdu ) return false;
+
+    if ( format_ == Format::MESSAGEFRAME ) {
+        pdu.print( writer, "", pugi::format_raw );
+        return true;
+    }
+
+    out += '{';
+    for ( std::size_t i = 0; i < fields_.size(); ++i ) {
+        if ( i > 0 ) out += ',';
+        jer::append_string( out, fields_[i].name.c_str() );
+        out += ':';
+
+        pugi::xpath_node selected = fields_[i].query->evaluate_node( pdu );
+        if ( selected.attribute() ) {
+            append_json_value( out, selected.attribute().value() );
+        } else if ( pugi::xml_text text = selected.node().text() ) {
+            append_json_value( out, text.get() );
+        } else if ( pugi::xml_node value = selected.node().first_child() ) {
+            // XER writes ENUMERATED and BOOLEAN values as empty elements, e.g., <transmission><unavailable/></transmission>
+            if ( value.type() == pugi::node_element && !value.first_child() ) {
+                jer::append_string( out, value.name() );
+            } else {
+                out += "null";
+            }
+        } else {
+            out += "null";
+        }
+    }
+    out += '}';
+    return true;
+}
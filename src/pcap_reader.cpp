@@ -0,0 +1,403 @@
+#include "pcap_reader.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+namespace pcap {
+
+namespace {
+
+constexpr uint32_t kPcapMagicMicro = 0xA1B2C3D4;
+constexpr uint32_t kPcapMagicNano = 0xA1B23C4D;
+constexpr std::size_t kPcapHeaderBytes = 24;
+constexpr std::size_t kPcapRecordBytes = 16;
+
+constexpr uint32_t kSectionHeaderBlock = 0x0A0D0D0A;
+constexpr uint32_t kInterfaceDescriptionBlock = 1;
+constexpr uint32_t kObsoletePacketBlock = 2;
+constexpr uint32_t kSimplePacketBlock = 3;
+constexpr uint32_t kEnhancedPacketBlock = 6;
+constexpr uint32_t kByteOrderMagic = 0x1A2B3C4D;
+constexpr uint16_t kOptionEnd = 0;
+constexpr uint16_t kOptionTsresol = 9;
+
+constexpr uint16_t ETHERTYPE_VLAN = 0x8100;
+constexpr uint8_t kWsmpVersion = 3;
+
+uint32_t bswap32(uint32_t v) {
+    return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+}
+
+uint16_t be16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint16_t le16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+std::size_t align4(std::size_t n) {
+    return (n + 3) & ~static_cast<std::size_t>(3);
+}
+
+uint64_t to_nanoseconds(uint64_t timestamp, uint64_t units_per_second) {
+    uint64_t seconds = timestamp / units_per_second;
+    uint64_t fraction = timestamp % units_per_second;
+    if (units_per_second <= 1000000000 && 1000000000 % units_per_second == 0) {
+        return seconds * 1000000000 + fraction * (1000000000 / units_per_second);
+    }
+    return seconds * 1000000000 + static_cast<uint64_t>(static_cast<long double>(fraction) * 1e9L / units_per_second);
+}
+
+/**
+ * A WSMP VarLengthNumber: 0xxxxxxx or 10xxxxxx xxxxxxxx.
+ */
+bool var_length_number(const uint8_t* p, std::size_t size, std::size_t& i, std::size_t& value) {
+    if (i >= size) return false;
+    if ((p[i] & 0x80) == 0) {
+        value = p[i++];
+        return true;
+    }
+    if ((p[i] & 0xC0) == 0x80 && i + 2 <= size) {
+        value = be16(p + i) & 0x3FFF;
+        i += 2;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * A p-encoded PSID (IEEE 1609.12): the leading 1 bits of the first octet give the number of octets that follow.
+ */
+bool psid(const uint8_t* p, std::size_t size, std::size_t& i, uint32_t& value) {
+    if (i >= size) return false;
+    std::size_t length = (p[i] & 0x80) == 0 ? 1 : (p[i] & 0xC0) == 0x80 ? 2 : (p[i] & 0xE0) == 0xC0 ? 3 : (p[i] & 0xF0) == 0xE0 ? 4 : 0;
+    if (length == 0 || i + length > size) return false;
+    value = 0;
+    for (std::size_t k = 0; k < length; ++k) value = (value << 8) | p[i++];
+    return true;
+}
+
+bool skip_extensions(const uint8_t* p, std::size_t size, std::size_t& i) {
+    std::size_t count, length;
+    if (!var_length_number(p, size, i, count)) return false;
+    for (std::size_t n = 0; n < count; ++n) {
+        ++i;                                        // WAVE element id.
+        if (!var_length_number(p, size, i, length) || i + length > size) return false;
+        i += length;
+    }
+    return true;
+}
+
+/**
+ * WSMP-N-Header, WSMP-T-Header, and WSM data (IEEE 1609.3-2016, 8.3).
+ */
+bool wsmp(const uint8_t* p, std::size_t size, Wsm& wsm) {
+    std::size_t i = 0;
+    if (size < 1 || (p[0] & 0x07) != kWsmpVersion) return false;
+
+    bool n_header_options = (p[i++] & 0x08) != 0;
+    if (n_header_options && !skip_extensions(p, size, i)) return false;
+
+    if (i >= size) return false;
+    uint8_t tpid = p[i++];
+
+    wsm.psid = 0;
+    switch (tpid) {
+        case 0:
+        case 2:
+            if (!psid(p, size, i, wsm.psid)) return false;
+            break;
+        case 1:
+        case 3:
+            i += 4;                                 // source and destination port.
+            break;
+        default:
+            return false;                           // LSI based transport headers are not carried over the air.
+    }
+
+    if ((tpid == 2 || tpid == 3) && !skip_extensions(p, size, i)) return false;
+
+    std::size_t length;
+    if (!var_length_number(p, size, i, length) || i + length > size) return false;
+
+    wsm.data = p + i;
+    wsm.length = length;
+    return length > 0;
+}
+
+/**
+ * The 802.11 data frame header followed by LLC/SNAP with the WSMP EtherType.
+ */
+bool ieee802_11(const uint8_t* p, std::size_t size, Wsm& wsm) {
+    static const uint8_t snap_wsmp[] = { 0xAA, 0xAA, 0x03, 0x00, 0x00, 0x00, 0x88, 0xDC };
+
+    if (size < 24) return false;
+    uint8_t fc0 = p[0], fc1 = p[1];
+    if (((fc0 >> 2) & 0x03) != 2) return false;     // not a data frame.
+    if (fc1 & 0x40) return false;                   // protected frame.
+
+    std::size_t header = 24;
+    if ((fc1 & 0x03) == 0x03) header += 6;          // four address format.
+    if (fc0 & 0x80) {                               // QoS data.
+        header += 2;
+        if (fc1 & 0x80) header += 4;                // HT control.
+    }
+
+    if (size < header + sizeof(snap_wsmp) || std::memcmp(p + header, snap_wsmp, sizeof(snap_wsmp)) != 0) return false;
+    return wsmp(p + header + sizeof(snap_wsmp), size - header - sizeof(snap_wsmp), wsm);
+}
+
+}  // end namespace.
+
+Reader::Reader(const char* data, std::size_t length) :
+    base{ reinterpret_cast<const uint8_t*>(data) },
+    size{ length }
+{
+    if (size < 4) {
+        fail("too short to be a capture file.");
+        return;
+    }
+
+    uint32_t magic;
+    std::memcpy(&magic, base, sizeof(magic));
+
+    if (magic == kSectionHeaderBlock) {
+        ng = true;
+        section_header();
+        return;
+    }
+
+    if (magic == kPcapMagicMicro || magic == kPcapMagicNano) {
+        swapped = false;
+    } else if (bswap32(magic) == kPcapMagicMicro || bswap32(magic) == kPcapMagicNano) {
+        swapped = true;
+        magic = bswap32(magic);
+    } else {
+        fail("not a pcap or pcapng file.");
+        return;
+    }
+
+    if (size < kPcapHeaderBytes) {
+        fail("truncated pcap file header.");
+        return;
+    }
+
+    units_per_second = magic == kPcapMagicNano ? 1000000000 : 1000000;
+    link_type = read32(20) & 0x0FFFFFFF;            // the upper bits hold the FCS length.
+    pos = kPcapHeaderBytes;
+}
+
+bool Reader::ok() const {
+    return error_.empty();
+}
+
+const std::string& Reader::error() const {
+    return error_;
+}
+
+std::size_t Reader::position() const {
+    return pos;
+}
+
+bool Reader::fail(const std::string& reason) {
+    error_ = reason + " (at byte " + std::to_string(pos) + ")";
+    return false;
+}
+
+uint16_t Reader::read16(std::size_t offset) const {
+    uint16_t v;
+    std::memcpy(&v, base + offset, sizeof(v));
+    return swapped ? static_cast<uint16_t>((v >> 8) | (v << 8)) : v;
+}
+
+uint32_t Reader::read32(std::size_t offset) const {
+    uint32_t v;
+    std::memcpy(&v, base + offset, sizeof(v));
+    return swapped ? bswap32(v) : v;
+}
+
+bool Reader::section_header() {
+    if (size - pos < 28) return fail("truncated pcapng section header.");
+
+    uint32_t order;
+    std::memcpy(&order, base + pos + 8, sizeof(order));
+    if (order == kByteOrderMagic) {
+        swapped = false;
+    } else if (bswap32(order) == kByteOrderMagic) {
+        swapped = true;
+    } else {
+        return fail("bad pcapng byte order magic.");
+    }
+
+    uint32_t total = read32(pos + 4);
+    if (total < 28 || total % 4 != 0 || total > size - pos) return fail("bad pcapng section header length.");
+
+    interfaces.clear();                             // interface ids are per section.
+    pos += total;
+    return true;
+}
+
+bool Reader::interface_description(std::size_t body, std::size_t body_length) {
+    if (body_length < 8) return fail("truncated pcapng interface description.");
+
+    Interface interface{ read16(body), 1000000 };
+
+    // options: code, length, value padded to 4 bytes.
+    for (std::size_t o = body + 8; o + 4 <= body + body_length;) {
+        uint16_t code = read16(o);
+        uint16_t length = read16(o + 2);
+        if (code == kOptionEnd || o + 4 + length > body + body_length) break;
+
+        if (code == kOptionTsresol && length >= 1) {
+            uint8_t resolution = base[o + 4];
+            uint8_t exponent = resolution & 0x7F;
+            if ((resolution & 0x80) ? exponent > 63 : exponent > 19) return fail("unsupported if_tsresol.");
+            interface.units_per_second = 1;
+            for (uint8_t e = 0; e < exponent; ++e) interface.units_per_second *= (resolution & 0x80) ? 2 : 10;
+        }
+        o += 4 + align4(length);
+    }
+
+    interfaces.push_back(interface);
+    return true;
+}
+
+bool Reader::next(Packet& packet) {
+    if (!ok()) return false;
+
+    if (!ng) {
+        if (pos == size) return false;
+        if (size - pos < kPcapRecordBytes) return fail("truncated pcap record header.");
+
+        uint32_t seconds = read32(pos);
+        uint32_t fraction = read32(pos + 4);
+        uint32_t captured = read32(pos + 8);
+        if (captured > size - pos - kPcapRecordBytes) return fail("truncated pcap record.");
+
+        packet.number = ++packets;
+        packet.timestamp_ns = to_nanoseconds(static_cast<uint64_t>(seconds) * units_per_second + fraction, units_per_second);
+        packet.link_type = link_type;
+        packet.data = base + pos + kPcapRecordBytes;
+        packet.length = captured;
+        pos += kPcapRecordBytes + captured;
+        return true;
+    }
+
+    while (pos < size) {
+        if (size - pos < 12) return fail("truncated pcapng block.");
+
+        uint32_t type;
+        std::memcpy(&type, base + pos, sizeof(type));
+        if (type == kSectionHeaderBlock) {
+            if (!section_header()) return false;
+            continue;
+        }
+
+        type = read32(pos);
+        uint32_t total = read32(pos + 4);
+        if (total < 12 || total % 4 != 0 || total > size - pos) return fail("bad pcapng block length.");
+
+        std::size_t body = pos + 8;
+        std::size_t body_length = total - 12;
+        std::size_t block = pos;
+        pos += total;
+
+        switch (type) {
+            case kInterfaceDescriptionBlock:
+                if (!interface_description(body, body_length)) return false;
+                break;
+
+            case kEnhancedPacketBlock:
+            case kObsoletePacketBlock: {
+                if (body_length < 20) {
+                    pos = block;
+                    return fail("truncated pcapng packet block.");
+                }
+
+                uint32_t id = type == kEnhancedPacketBlock ? read32(body) : read16(body);
+                uint32_t captured = read32(body + 12);
+                if (id >= interfaces.size() || captured > body_length - 20) {
+                    pos = block;
+                    return fail("bad pcapng packet block.");
+                }
+
+                uint64_t timestamp = (static_cast<uint64_t>(read32(body + 4)) << 32) | read32(body + 8);
+                packet.number = ++packets;
+                packet.timestamp_ns = to_nanoseconds(timestamp, interfaces[id].units_per_second);
+                packet.link_type = interfaces[id].link_type;
+                packet.data = base + body + 20;
+                packet.length = captured;
+                return true;
+            }
+
+            case kSimplePacketBlock: {
+                if (body_length < 4 || interfaces.empty()) {
+                    pos = block;
+                    return fail("bad pcapng simple packet block.");
+                }
+
+                uint32_t original = read32(body);
+                packet.number = ++packets;
+                packet.timestamp_ns = 0;            // simple packet blocks carry no timestamp.
+                packet.link_type = interfaces[0].link_type;
+                packet.data = base + body + 4;
+                packet.length = original < body_length - 4 ? original : body_length - 4;
+                return true;
+            }
+
+            default:
+                break;                              // statistics, name resolution, custom blocks, etc.
+        }
+    }
+    return false;
+}
+
+bool extract_wsm(const Packet& packet, Wsm& wsm) {
+    const uint8_t* p = packet.data;
+    std::size_t size = packet.length;
+
+    switch (packet.link_type) {
+        case LINKTYPE_ETHERNET: {
+            std::size_t type_at = 12;
+            while (size >= type_at + 2 && be16(p + type_at) == ETHERTYPE_VLAN) type_at += 4;
+            if (size < type_at + 2 || be16(p + type_at) != ETHERTYPE_WSMP) return false;
+            return wsmp(p + type_at + 2, size - type_at - 2, wsm);
+        }
+
+        case LINKTYPE_LINUX_SLL:
+            if (size < 16 || be16(p + 14) != ETHERTYPE_WSMP) return false;
+            return wsmp(p + 16, size - 16, wsm);
+
+        case LINKTYPE_LINUX_SLL2:
+            if (size < 20 || be16(p) != ETHERTYPE_WSMP) return false;
+            return wsmp(p + 20, size - 20, wsm);
+
+        case LINKTYPE_IEEE802_11:
+            return ieee802_11(p, size, wsm);
+
+        case LINKTYPE_IEEE802_11_RADIOTAP: {
+            if (size < 4) return false;
+            std::size_t radiotap = le16(p + 2);
+            if (radiotap > size) return false;
+            return ieee802_11(p + radiotap, size - radiotap, wsm);
+        }
+
+        default:
+            return false;
+    }
+}
+
+std::string iso8601(uint64_t timestamp_ns) {
+    std::time_t seconds = static_cast<std::time_t>(timestamp_ns / 1000000000);
+    std::tm utc;
+    gmtime_r(&seconds, &utc);
+
+    char buffer[40];
+    std::size_t n = std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &utc);
+    std::snprintf(buffer + n, sizeof(buffer) - n, ".%09lluZ", static_cast<unsigned long long>(timestamp_ns % 1000000000));
+    return buffer;
+}
+
+}  // end namespace pcap.
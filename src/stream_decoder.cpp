@@ -0,0 +1,198 @@
+#include "stream_decoder.hpp"
+#include "acm_metrics.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+constexpr std::size_t kErrbufSize = 128;            // as ASN1_Codec::max_errbuf_size.
+
+int append_to_string(const void* buffer, size_t size, void* app_key) {
+    static_cast<std::string*>(app_key)->append(static_cast<const char*>(buffer), size);
+    return 0;
+}
+
+}  // end namespace.
+
+Stream_Decoder::Stream_Decoder(Pdu pdu, enum asn_transfer_syntax transfer_syntax) :
+    type{ pdu == Pdu::MESSAGEFRAME ? &asn_DEF_MessageFrame : &asn_DEF_Ieee1609Dot2Data },
+    syntax{ transfer_syntax },
+    restartable{ transfer_syntax == ATS_BER || transfer_syntax == ATS_DER || transfer_syntax == ATS_CER
+                 || transfer_syntax == ATS_BASIC_OER || transfer_syntax == ATS_CANONICAL_OER }
+{
+}
+
+Stream_Decoder::~Stream_Decoder() {
+    if (pdu) ASN_STRUCT_FREE(*type, pdu);
+}
+
+void Stream_Decoder::set_constraints(const Constraint_Policy& policy) {
+    constraints = policy;
+}
+
+void Stream_Decoder::set_max_pdu_size(std::size_t bytes) {
+    max_pdu_size = bytes ? bytes : kMaxPduSize;
+}
+
+uint64_t Stream_Decoder::offset() const {
+    return position;
+}
+
+std::size_t Stream_Decoder::pending() const {
+    return pdu_consumed + partial.size();
+}
+
+std::size_t Stream_Decoder::feed(const char* data, std::size_t size, const Emit& emit, Asn1Status& status) {
+    if (failed) {
+        status.at(metrics::Stage::ASN_DECODE).codec("stream decoder used after the stream held bad data.");
+        return 0;
+    }
+
+    std::size_t emitted = 0;
+    std::size_t used = 0;
+
+    if (partial.empty()) {
+        // the common case decodes straight from the caller's buffer; only an incomplete tail is copied.
+        emitted = decode_all(data, size, used, emit, status);
+        if (failed) return emitted;
+        partial.assign(data + used, data + size);
+    } else {
+        partial.insert(partial.end(), data, data + size);
+
+        // PER starts a held PDU over from its first byte; waiting for twice the bytes keeps the retries linear.
+        if (!restartable && partial.size() < retry_size) return 0;
+
+        emitted = decode_all(partial.data(), partial.size(), used, emit, status);
+        if (failed) return emitted;
+        partial.erase(partial.begin(), partial.begin() + used);
+    }
+
+    // a PDU that needs more than the maximum never ends as far as this decoder can tell; give up on it.
+    if (pending() >= max_pdu_size) {
+        std::ostringstream erroross;
+        erroross << "PDU of element " << type->name << " at stream offset " << position << " is longer than the maximum of "
+                 << max_pdu_size << " bytes.";
+        fail(status, erroross.str());
+    }
+
+    return emitted;
+}
+
+bool Stream_Decoder::finish(const Emit& emit, Asn1Status& status) {
+    if (failed) {
+        return status.at(metrics::Stage::ASN_DECODE).codec("stream decoder used after the stream held bad data.");
+    }
+
+    // a PER PDU waiting for more bytes gets its last try.
+    if (!restartable && !partial.empty() && partial.size() < retry_size) {
+        std::size_t used = 0;
+        decode_all(partial.data(), partial.size(), used, emit, status);
+        if (failed) return false;
+        partial.erase(partial.begin(), partial.begin() + used);
+    }
+
+    if (pending() == 0) return true;
+
+    std::ostringstream erroross;
+    erroross << "stream of " << type->name << " ends inside a PDU: " << pending() << " bytes at offset " << position << ".";
+    return fail(status, erroross.str());
+}
+
+bool Stream_Decoder::fail(Asn1Status& status, const std::string& reason) {
+    if (pdu) ASN_STRUCT_FREE(*type, pdu);
+    pdu = nullptr;
+    pdu_consumed = 0;
+    partial.clear();
+    failed = true;
+    return status.at(metrics::Stage::ASN_DECODE).codec(reason);
+}
+
+std::size_t Stream_Decoder::decode_all(const char* data, std::size_t size, std::size_t& used, const Emit& emit, Asn1Status& status) {
+    std::size_t emitted = 0;
+    used = 0;
+    while (used < size) {
+        std::size_t consumed = 0;
+        bool decoded = decode_one(data + used, size - used, consumed, emit, status);
+        used += consumed;
+        if (!decoded) break;
+        ++emitted;
+    }
+    return emitted;
+}
+
+bool Stream_Decoder::decode_one(const char* data, std::size_t size, std::size_t& consumed, const Emit& emit, Asn1Status& status) {
+    asn_dec_rval_t decode_rval;
+    consumed = 0;
+
+    {
+        metrics::ScopedStage stage{ metrics::Stage::ASN_DECODE };
+        decode_rval = asn_decode(0, syntax, type, &pdu, data, size);
+    }
+
+    if (decode_rval.code == RC_WMORE) {
+        if (restartable) {
+            // the decoder keeps its place in pdu; only the bytes it did not take are held for the next feed.
+            consumed = decode_rval.consumed;
+            pdu_consumed += decode_rval.consumed;
+        } else {
+            // the PER decoder is not restartable; drop the partial structure and decode again with more input.
+            ASN_STRUCT_FREE(*type, pdu);
+            pdu = nullptr;
+            retry_size = std::min(2 * size, max_pdu_size);
+        }
+        return false;
+    }
+
+    if (decode_rval.code != RC_OK || pdu_consumed + decode_rval.consumed == 0) {
+        std::ostringstream erroross;
+        erroross << "failed ASN.1 binary decoding of element " << type->name << " at stream offset " << position << ": bad data.";
+        return fail(status, erroross.str());
+    }
+
+    consumed = decode_rval.consumed;
+    Output output{ position, pdu_consumed + decode_rval.consumed, false, std::string{} };
+    position += output.length;
+    pdu_consumed = 0;
+    retry_size = 0;
+
+    long message_id = -1;
+    if (type == &asn_DEF_MessageFrame) {
+        message_id = static_cast<MessageFrame_t*>(pdu)->messageId;
+        metrics::Registry::instance().message_id( message_id );
+        metrics::StageTrace::local().message_id( message_id );
+    }
+
+    char errbuf[kErrbufSize];
+    std::size_t errlen(kErrbufSize);
+    int constraint_rval = 0;
+    if (constraints.check(false)) {
+        metrics::ScopedStage stage{ metrics::Stage::CONSTRAINT_CHECK };
+        constraint_rval = asn_check_constraints(type, pdu, errbuf, &errlen);
+        metrics::Registry::instance().increment( metrics::Counter::CONSTRAINT_CHECKS );
+    } else {
+        metrics::Registry::instance().increment( metrics::Counter::CONSTRAINT_CHECKS_SKIPPED );
+    }
+
+    if (constraint_rval) {
+        metrics::Registry::instance().constraint_violation( message_id );
+        output.text = "failed ASN.1 constraints check of element " + std::string{ type->name } + ": " + std::string{ errbuf, errlen };
+    } else {
+        asn_enc_rval_t encode_rval;
+        {
+            metrics::ScopedStage stage{ metrics::Stage::XER_ENCODE };
+            encode_rval = xer_encode(type, pdu, XER_F_CANONICAL, append_to_string, static_cast<void*>(&output.text));
+        }
+
+        if (encode_rval.encoded == -1) {
+            output.text = "failed ASN.1 XML encoding of element " + std::string{ encode_rval.failed_type->name };
+        } else {
+            output.ok = true;
+        }
+    }
+
+    ASN_STRUCT_FREE(*type, pdu);
+    pdu = nullptr;
+    emit(output);
+    return true;
+}
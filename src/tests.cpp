@@ -1,12 +1,32 @@
 #define CATCH_CONFIG_MAIN
 #include <http_server.hpp>
+#include <ipc_server.hpp>
+#include <bulk_converter.hpp>
+#include <stream_decoder.hpp>
+#include <pcap_reader.hpp>
+#include <dead_letter.hpp>
+#include <topic_router.hpp>
+#include <output_renderer.hpp>
+#include <json_encoder.hpp>
+#include <acm_metrics.hpp>
+#include <metrics_server.hpp>
 #include <crow/crow_all.h>
+#include <librdkafka/rdkafka_mock.h>
 
 #include "catch.hpp"
 
 #include "acm.hpp"
 #include "utilities.hpp"
 
+#include <thread>
+#include <fstream>
+#include <iterator>
+
+#include <getopt.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
 
 bool loadTestCases( const std::string& case_file, StrVector& case_data ) {
 
@@ -37,7 +57,23 @@ pugi::xml_node payload_node;
 pugi::xml_node byte_node;
 ASN1_Codec asn1_codec{"ASN1_Codec","ASN1 Processing Module"};
 
+/**
+ * A codec of a test's own, configured as asn1_codec is, for settings the other tests must not see.
+ */
+struct Test_Codec : ASN1_Codec {
+    Test_Codec() : ASN1_Codec{"ASN1_Codec","ASN1 Processing Module"} {
+        asn1_codec.setup_logger_for_testing();
+        share_configuration(asn1_codec);
+    }
+};
+
+std::string readFile( const std::string& path ) {
+    std::ifstream file{ path, std::ios::binary };
+    return std::string{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+}
+
 const char *BSM_HEX = "001480AD562FA8400039E8E717090F9665FE1BACC37FFFFFFFF0003BBAFDFA1FA1007FFF8000000000020214C1C100417FFFFFFE824E100A3FFFFFFFE8942102047FFFFFFE922A1026A40143FFE95D610423405D7FFEA75610322C0599FFEADFA10391C06B5FFEB7E6103CB40A03FFED2121033BC08ADFFED9A6102E8408E5FFEDE2E102BDC0885FFEDF0A1000BC019BFFF7F321FFFFC005DFFFC55A1FFFFFFFFFFFFDD1A100407FFFFFFFE1A2FFFE0000";
+const char *BSM_COER_HEX = "00001481FF4058BEA10000E7A31889291FC1822A3800004986FFFFFFFF0700003BBA7F07D107D18100008000000000000000000001010081CB3000010F00000000820001FFFF07FF412800000001470001FFFF07FF44A200000004080001FFFF07FF491600000004D4000000A107FF4AEC0000000846000002EB07FF53AC0000000645000002CC07FF56FE00000007230000035A07FF5BF400000007960000050107FF690A00000006770000045607FF6CD400000005D00000047207FF6F18000000057B0000044207FF6F860000000017000000CD07FFBF9A000001FFFF0000002E07FFE2AE000001FFFF0001FFFF07FFEE8E00000000800001FFFF07FFF0D2007FFF00";
 const char *TIM_HEX = "001f85fe7591fd9e4f4354455420535452124c16b4fa4e724f43ef73d2f04fd7ad0ff09260b5a7d2a6249ba8936ffa29bac57176dadf5389a4000a2001c3a03dc06ba5067b8404632ae6a0503389c06966bc120c5900f771c1c6306a9a6bf319901630a0f2403124536d3e8476d9af77a7bf218901103a881122806195dcc32733526fe545fa217f819306eff7fdceaafa0230c87f355e98cb516360080a0002f348c72a3f584b11e4be99002ad4a0d12394d435cfda9fe80267e176eb96a2ff07260b5a7f4b9d40747f5ffe014b670db5da84587b200050400f55bfce9e9bc9d913782889646ff0126933eacd08beff7f5447df8cf48052da9a01005a0001bc2fa39c11fc2e7046450f0952d4dfe024ddb71fd2d3b502b9b2551e1d3f8b210e3c4000b00020c2dd46d113a3f21710e9416b92d5bfc14982d60dc94824a8e5c5095c1007d4e362e82720800270a04182240bda99c42bb6d94ff5f9a52a3014cd051a29843d4489d71d4150ae35b7533039e58186a0608ac0fc05f4bf24a4e851d3d0a801880f339e17e05ca32567a49b73b932580eecfc46064078a2e0120158f22817d1fb85eee4e66a4dfca8bf442fcca15810716140920643215dc607f829305ac1b92904951cb8a12b8200fa9c6c5d04e410004c0a0671380d2cd782418b201eee3838c60d534d7e633202c6141e4806248a6da7d08edb35eef4f7e431202207510224500c32bb9864e66a4dfca8bf442ff05260b5837252092a397142570401f538d8ba09c820009976b50fc6379b168326f9bdfe0a4c16b06e4a4125472e284ae0803ea71b1741390400132ed63059cde2d064df37c448db82d49305ad3e949305ad3e88bf939305ad3010933071674e428880448e75d46d038a29245b0b778f7001044f43ef73d2f04fd7ad0ff09260b5a7d2a6249ba8936ffa29bac57176dadf5389a4000a2001c3a03dc06ba5067b8404632ae6a0503389c06966bc120c5900f771c1c6306a9a6bf319901630a0f2403124536d3e8476d9af77a7bf218901103a881122806195dcc32733526fe545fa217f819306eff7fdceaafa0230c87f355e98cb516360080a0002f348c72a3f584b11e4be99002ad4a0d12394d435cfda9fe80267e176eb96a2ff07260b5a7f4b9d40747f5ffe014b670db5da84587b200050400f55bfce9e9bc9d913782889646ff0126933eacd08beff7f5447df8cf48052da9a01005a0001bc2fa39c11fc2e7046450f0952d4dfe024ddb71fd2d3b502b9b2551e1d3f8b210e3c4000b00020c2dd46d113a3f21710e9416b92d5bfc14982d60dc94824a8e5c5095c1007d4e362e82720800270a04182240bda99c42bb6d94ff5f9a52a3014cd051a29843d4489d71d4150ae35b7533039e58186a0608ac0fc05f4bf24a4e851d3d0a801880f339e17e05ca32567a49b73b932580eecfc46064078a2e0120158f22817d1fb85eee4e66a4dfca8bf442fcca15810716140920643215dc607f829305ac1b92904951cb8a12b8200fa9c6c5d04e410004c0a0671380d2cd782418b201eee3838c60d534d7e633202c6141e4806248a6da7d08edb35eef4f7e431202207510224500c32bb9864e66a4dfca8bf442ff05260b5837252092a397142570401f538d8ba09c820009976b50fc6379b168326f9bdfe0a4c16b06e4a4125472e284ae0803ea71b1741390400132ed63059cde2d064df37c4401b705a049305ad3e9024982d69f445fc9c982d69808499838b3a7214440224738ea3681c514922d85bbc7b8008227a1f7b9e97827ebd607f8093499f566845f7fbfaa23efc67a40296d4d00802d0000de17d1ce08fe173823228784a96a711136e0b524c16b4fa524c16b4fa22fe4e4c16b4c0424cc1c59d390a22011239df51b40e28a4916c2dde3dc004113d0fbdcf4bc13f5eb03fc049a4cfab3422fbfdfd511f7e33d2014b6a680401680006f0be8e7047f0b9c119143c254b538899b705a9260b5a7d29260b5a7d117f27260b5a60212660e2ce9c851100891cefa8da07145248b616ef1ee002089e87dee7a5e09faf581fe024d267d59a117dfefea88fbf19e900a5b5340200b40003785f473823f85ce08c8a1e12a5a9c450db82d49305ad3e949305ad3e88bf939305ad3010933071674e4288804480";
 const char *SRM_HEX = "001d697125b7da9aa31b97b0fb3ec9148495a40fed6be3446a4e5b70ec1a2752b710fbfaf5ac086673396a81677da981b16a6b4905771f424e51683a70adb0afd713837a81719aed3fa8d4e347ef1b40e42d024585c757787442477e73341aae24982d69f40e4c16b4c428d8";
 const char *SSM_HEX = "001e817b65e539dc93b843af683249404f9e0fc6b04fd122cf2ce89941dc1ab4d3d288394b59be74b1c04cfdee07bc9868311d2c1caa51f03dc764f993d0d511779e9ef22be1121c093e1af96b1d141a1ba967c329e47cf884b8beb3268e790f72270ca44c2519740d31d85f3a0e91a6bca5145e560e920d281085568f931b7067cc9e86a88b8f5957847ac6b4fa9d1b07fc2cd2e6a91f327a1aa229d5e21e478318d630a67bd8ffd0ce05537cf12267f5df5fc2794ff0804001a150fe00a679ce1c7934b4a6891be64f435445f9206bc5ff8e09b516244086367d14aef993d0d51175f310f233515cb0082fa6f907e861f0be64f435445412a1bcae64260fe3aa2470ea9ccf666f993d0d5114a9c22f0ba4406960b0cc40a0bd244e285bce95385017cefcbbac8d3070a7819776806012dd1dd66d719a089f3d143c9b843e001e4439710aacb223e510b9397770640941fcec2f9fc6a4cba57da12f160011a4d7c2fc0f7f10429d2be7409299a6cd9053c256161af6572d28cf07d9bdc620";
@@ -305,6 +341,596 @@ TEST_CASE("Decode BSM with VehicleEventFlags (jackknife event)", "[decoding]") {
     CHECK(bitstring == expected_bitstring);
 }
 
+TEST_CASE("Decode errors are reported by status", "[decoding][errors]") {
+    std::cout << "=== Decode errors are reported by status ===" << std::endl;
+
+    // prepare
+    asn1_codec.setup_logger_for_testing();
+
+    buffer_structure_t xb = {0, 0, 0};
+    std::string truncated = std::string(BSM_HEX).substr(0, 16);
+    Asn1Status status;
+    CHECK_FALSE(asn1_codec.decode_messageframe_data(truncated, &xb, status));
+    CHECK(status.kind() == Asn1Status::Kind::CODEC);
+    CHECK(status.error_type() == Asn1ErrorType::DATA);
+    CHECK(status.message().find("MessageFrame") != std::string::npos);
+    free(xb.buffer);
+
+    // the overloads without a status still throw.
+    xb = {0, 0, 0};
+    truncated = std::string(BSM_HEX).substr(0, 16);
+    CHECK_THROWS_AS(asn1_codec.decode_messageframe_data(truncated, &xb), Asn1CodecError);
+    free(xb.buffer);
+
+    // bad payload bytes come back in the input document, with the error in place of the bytes.
+    std::string envelope = readFile("data/InputData.decoding.bsm.xml");
+    std::size_t begin = envelope.find("<bytes>");
+    std::size_t end = envelope.find("</bytes>");
+    REQUIRE(begin != std::string::npos);
+    REQUIRE(end != std::string::npos);
+    envelope.replace(begin + 7, end - begin - 7, "00145144AD0B");
+
+    std::stringstream out;
+    CHECK_FALSE(asn1_codec.process_envelope(envelope.data(), envelope.size(), out, false));
+    parse_result = output_doc.load(out, pugi::parse_default | pugi::parse_declaration | pugi::parse_doctype | pugi::parse_trim_pcdata);
+    CHECK(parse_result);
+    payload_node = ode_payload_query.evaluate_node(output_doc).node();
+    REQUIRE(payload_node);
+    CHECK(std::string(payload_node.child("code").text().get()) == "INVALID_DATA_TYPE_ERROR");
+    CHECK_FALSE(payload_node.child("bytes"));
+}
+
+TEST_CASE("Codec budgets stop oversized messages", "[decoding][errors]") {
+    std::cout << "=== Codec budgets stop oversized messages ===" << std::endl;
+
+    // prepare
+    Test_Codec codec;
+
+    buffer_structure_t xb = {0, 0, 0};
+    std::string hex = BSM_HEX;
+    Asn1Status status;
+    CHECK(codec.decode_messageframe_data(hex, &xb, status));
+    free(xb.buffer);
+
+    // the decoded XML is far larger than 100 bytes.
+    Codec_Budget limits;
+    limits.max_output_bytes = 100;
+    codec.set_codec_budget(limits);
+    xb = {0, 0, 0};
+    hex = BSM_HEX;
+    status = Asn1Status{};
+    CHECK_FALSE(codec.decode_messageframe_data(hex, &xb, status));
+    CHECK(status.kind() == Asn1Status::Kind::BUDGET);
+    CHECK(status.stage() == metrics::Stage::XER_ENCODE);
+    free(xb.buffer);
+
+    // oversized input is refused before it is converted.
+    limits = Codec_Budget{};
+    limits.max_input_bytes = 10;
+    codec.set_codec_budget(limits);
+    xb = {0, 0, 0};
+    hex = BSM_HEX;
+    status = Asn1Status{};
+    CHECK_FALSE(codec.decode_messageframe_data(hex, &xb, status));
+    CHECK(status.kind() == Asn1Status::Kind::BUDGET);
+    CHECK(status.stage() == metrics::Stage::HEX_CONVERSION);
+    CHECK(std::string(status.name()) == "Asn1BudgetExceeded");
+    free(xb.buffer);
+
+    // the time budget of each call starts with its own status, so threads sharing the codec measure their own message.
+    limits = Codec_Budget{};
+    limits.max_time_ns = 10ull * 1000 * 1000 * 1000;
+    codec.set_codec_budget(limits);
+    std::atomic<int> failures{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&codec, &failures]() {
+            for (int i = 0; i < 200; ++i) {
+                buffer_structure_t txb = {0, 0, 0};
+                std::string thex = BSM_HEX;
+                Asn1Status tstatus;
+                if (!codec.decode_messageframe_data(thex, &txb, tstatus) || tstatus.start_ns() == 0) ++failures;
+                free(txb.buffer);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    CHECK(failures == 0);
+}
+
+TEST_CASE("Constraint checking policy", "[decoding]") {
+    std::cout << "=== Constraint checking policy ===" << std::endl;
+
+    Constraint_Policy::Mode mode = Constraint_Policy::Mode::FULL;
+    CHECK(Constraint_Policy::parse("encode-only", mode));
+    CHECK(mode == Constraint_Policy::Mode::ENCODE_ONLY);
+    CHECK_FALSE(Constraint_Policy::parse("sometimes", mode));
+    CHECK(mode == Constraint_Policy::Mode::ENCODE_ONLY);
+
+    CHECK(Constraint_Policy{}.check(false));
+    CHECK_FALSE(Constraint_Policy{ Constraint_Policy::Mode::OFF }.check(true));
+    CHECK(Constraint_Policy{ Constraint_Policy::Mode::ENCODE_ONLY }.check(true));
+    CHECK_FALSE(Constraint_Policy{ Constraint_Policy::Mode::ENCODE_ONLY }.check(false));
+
+    Constraint_Policy sampled{ Constraint_Policy::Mode::SAMPLED, 4 };
+    int checked = 0;
+    for (int i = 0; i < 40; ++i) checked += sampled.check(false);
+    CHECK(checked == 10);
+
+    // decoding a BSM with the check off skips it.
+    Test_Codec codec;
+    codec.set_constraints(Constraint_Policy{ Constraint_Policy::Mode::OFF });
+
+    metrics::Registry& registry = metrics::Registry::instance();
+    uint64_t skipped = registry.total(metrics::Counter::CONSTRAINT_CHECKS_SKIPPED);
+    uint64_t checks = registry.total(metrics::Counter::CONSTRAINT_CHECKS);
+    buffer_structure_t xb = {0, 0, 0};
+    std::string hex = BSM_HEX;
+    Asn1Status status;
+    CHECK(codec.decode_messageframe_data(hex, &xb, status));
+    CHECK(registry.total(metrics::Counter::CONSTRAINT_CHECKS_SKIPPED) == skipped + 1);
+    CHECK(registry.total(metrics::Counter::CONSTRAINT_CHECKS) == checks);
+    free(xb.buffer);
+}
+
+TEST_CASE("Header peek and pre-decode message filter", "[decoding][filter]") {
+    std::cout << "=== Header peek and pre-decode message filter ===" << std::endl;
+
+    uint8_t prefix[32];
+    peek::Header header;
+    REQUIRE(peek::hex_prefix(BSM_HEX, prefix, sizeof(prefix)) == sizeof(prefix));
+    CHECK(peek::messageframe(prefix, sizeof(prefix), header));
+    CHECK(header.message_id == 20);
+    header = peek::Header{};
+    CHECK(peek::messageframe(reinterpret_cast<const uint8_t*>("\x00\x1f"), 2, header));
+    CHECK(header.message_id == 31);
+
+    // signedData carrying an unsecured BSM: the messageId from a prefix, the psid from the whole PDU.
+    std::string hex = readFile("data/Ieee1609Dot2Data.unsecuredData.Bsm.coer.bah.hex");
+    std::vector<uint8_t> bytes(hex.size() / 2);
+    bytes.resize(peek::hex_prefix(hex, bytes.data(), bytes.size()));
+    header = peek::Header{};
+    CHECK(peek::ieee1609dot2(bytes.data(), 12, header));
+    CHECK(header.content == 1);
+    CHECK(header.message_id == 20);
+    CHECK(header.psid == -1);
+    CHECK(peek::ieee1609dot2(bytes.data(), bytes.size(), header));
+    CHECK(header.psid == 0x20);
+    CHECK_FALSE(peek::ieee1609dot2(prefix, sizeof(prefix), header));
+
+    Message_Filter filter;
+    std::string error;
+    CHECK_FALSE(filter.configure("256", "", error));
+    CHECK_FALSE(filter.configure("", "20", error));
+    CHECK_FALSE(filter.active());
+    REQUIRE(filter.configure("18, 19", "20:4", error));
+    int passed = 0;
+    for (int i = 0; i < 40; ++i) passed += filter.decide(20) == Message_Filter::Action::PASS;
+    CHECK(passed == 10);
+    CHECK(filter.decide(19) == Message_Filter::Action::DROP);
+    CHECK(filter.decide(31) == Message_Filter::Action::PASS);
+    CHECK(filter.decide(-1) == Message_Filter::Action::PASS);
+
+    // a dropped envelope writes nothing and is not an error.
+    Test_Codec codec;
+    REQUIRE(filter.configure("20", "", error));
+    codec.set_message_filter(filter);
+
+    std::string envelope = readFile("data/InputData.decoding.bsm.xml");
+    std::stringstream out;
+    CHECK(codec.process_envelope(envelope.data(), envelope.size(), out, false));
+    CHECK(codec.filtered());
+    CHECK(out.str().empty());
+
+    // the peek reads UPER; a COER BSM, whose first two bytes read as messageId 0 there, passes the filter unread.
+    REQUIRE(filter.configure("0", "", error));
+    codec.set_message_filter(filter);
+    std::vector<char> coer;
+    REQUIRE(codec.hex_to_bytes_(BSM_COER_HEX, coer));
+    std::stringstream decoded;
+    CHECK(codec.process_raw(coer.data(), coer.size(), "MessageFrame:COER", decoded, false));
+    CHECK_FALSE(codec.filtered());
+    CHECK(codec.message_id() == 20);
+}
+
+TEST_CASE("Output routing by messageId and error class", "[routing]") {
+    std::cout << "=== Output routing by messageId and error class ===" << std::endl;
+
+    Topic_Router router{ "j2735asn1xer" };
+    std::string error;
+    REQUIRE(router.add("19", "topic.spat", error));
+    REQUIRE(router.add("20", "topic.bsm", error));
+    REQUIRE(router.add("error.Asn1BudgetExceeded", "topic.budget", error));
+    REQUIRE(router.add("error", "topic.errors", error));
+    REQUIRE(router.add("31", "topic.bsm", error));
+    CHECK_FALSE(router.add("256", "topic.other", error));
+    CHECK_FALSE(router.add("error.NoSuchError", "topic.other", error));
+    CHECK_FALSE(router.add("20", "", error));
+
+    CHECK(router.topics().size() == 5);
+    CHECK(router.topic(router.route(20L)) == "topic.bsm");
+    CHECK(router.route(31L) == router.route(20L));
+    CHECK(router.topic(router.route(19L)) == "topic.spat");
+    CHECK(router.route(18L) == Topic_Router::kDefaultRoute);
+    CHECK(router.route(-1L) == Topic_Router::kDefaultRoute);
+    CHECK(router.topic(Topic_Router::kDefaultRoute) == "j2735asn1xer");
+
+    Asn1Status status;
+    status.codec("bad data");
+    CHECK(router.topic(router.route(status)) == "topic.errors");
+    status.budget("too big");
+    CHECK(router.topic(router.route(status)) == "topic.budget");
+
+    // the codec keeps the messageId it decoded, so routing needs no parsing of its own.
+    Test_Codec codec;
+    std::string envelope = readFile("data/InputData.decoding.bsm.xml");
+    std::stringstream out;
+    CHECK(codec.process_envelope(envelope.data(), envelope.size(), out, false));
+    CHECK(codec.message_id() == 20);
+}
+
+TEST_CASE("Fan-out renderings of one decode", "[decoding][fanout]") {
+    std::cout << "=== Fan-out renderings of one decode ===" << std::endl;
+
+    Output_Renderer envelope, frame, projection;
+    std::string error;
+    REQUIRE(envelope.configure(Output_Renderer::Format::ENVELOPE, "", error));
+    REQUIRE(frame.configure(Output_Renderer::Format::MESSAGEFRAME, "", error));
+    REQUIRE(projection.configure(Output_Renderer::Format::PROJECTION,
+            "messageId=messageId, id=value/BasicSafetyMessage/coreData/id, lat=value/BasicSafetyMessage/coreData/lat,"
+            "transmission=value/BasicSafetyMessage/coreData/transmission, flags=value/BasicSafetyMessage/coreData/flags,"
+            "speed=value/BasicSafetyMessage/coreData/speed", error));
+    CHECK_FALSE(projection.configure(Output_Renderer::Format::PROJECTION, "", error));
+    CHECK_FALSE(frame.configure(Output_Renderer::Format::MESSAGEFRAME, "id=messageId", error));
+    CHECK_FALSE(projection.configure(Output_Renderer::Format::PROJECTION, "id", error));
+
+    Output_Renderer::Format format;
+    CHECK(Output_Renderer::parse("messageframe", format));
+    CHECK(format == Output_Renderer::Format::MESSAGEFRAME);
+    CHECK_FALSE(Output_Renderer::parse("jer", format));
+
+    pugi::xml_document doc;
+    REQUIRE(doc.load_string("<OdeAsn1Data><payload><data><MessageFrame><messageId>20</messageId><value><BasicSafetyMessage>"
+            "<coreData><id>0A1B2C3D</id><lat>-411642143</lat><transmission><neutral/></transmission><flags>0010</flags></coreData>"
+            "</BasicSafetyMessage></value></MessageFrame></data></payload></OdeAsn1Data>"));
+    pugi::xml_node payload = doc.child("OdeAsn1Data").child("payload").child("data");
+
+    std::string out;
+    REQUIRE(projection.render(doc, payload, nullptr, out));
+    CHECK(out == R"({"messageId":20,"id":"0A1B2C3D","lat":-411642143,"transmission":"neutral","flags":"0010","speed":null})");
+
+    out.clear();
+    REQUIRE(frame.render(doc, payload, nullptr, out));
+    CHECK(out.compare(0, 14, "<MessageFrame>") == 0);
+
+    // nothing decoded, nothing to render but the envelope.
+    pugi::xml_document undecoded;
+    REQUIRE(undecoded.load_string("<OdeAsn1Data><payload><data><bytes>0014</bytes></data></payload></OdeAsn1Data>"));
+    payload = undecoded.child("OdeAsn1Data").child("payload").child("data");
+    payload.remove_child("bytes");
+    CHECK_FALSE(frame.render(undecoded, payload, nullptr, out));
+    CHECK(envelope.render(undecoded, payload, nullptr, out));
+
+    // the codec decodes once and renders each output from the same document.
+    Test_Codec single;
+    Test_Codec codec;
+    codec.set_outputs({ envelope, frame, projection });
+
+    std::string input = readFile("data/InputData.decoding.bsm.xml");
+    std::stringstream expected, fanned;
+    REQUIRE(single.process_envelope(input.data(), input.size(), expected, false));
+    REQUIRE(codec.process_envelope(input.data(), input.size(), fanned, false));
+    CHECK(fanned.str().empty());
+
+    std::vector<std::string> rendered(3);
+    for (std::size_t output = 0; output < rendered.size(); ++output) {
+        CHECK(codec.render_output(output, rendered[output]));
+    }
+    CHECK(rendered[0] == expected.str());
+    CHECK(expected.str().find(rendered[1]) != std::string::npos);
+    CHECK(rendered[2].compare(0, 16, R"({"messageId":20,)") == 0);
+}
+
+TEST_CASE("Decoded records written as JSON", "[decoding][json]") {
+    std::cout << "=== Decoded records written as JSON ===" << std::endl;
+
+    Test_Codec codec;
+    codec.set_output_encoding(Text_Encoding::JSON);
+
+    std::string input = readFile("data/InputData.decoding.bsm.xml");
+    std::stringstream output;
+    REQUIRE(codec.process_envelope(input.data(), input.size(), output, false));
+    CHECK(output.str().compare(0, 15, R"({"OdeAsn1Data":)") == 0);
+    CHECK(output.str().find(R"("MessageFrame":{"messageId":20,"value":{"BasicSafetyMessage":{"coreData":{)") != std::string::npos);
+    CHECK(output.str().find("<MessageFrame>") == std::string::npos);
+
+    // the same MessageFrame, alone, as the HTTP jer endpoint returns it.
+    std::string hex{ BSM_HEX };
+    buffer_structure_t xb = {0, 0, 0};
+    Asn1Status status;
+    REQUIRE(codec.decode_messageframe_data(hex, &xb, status, Text_Encoding::JSON));
+    std::string json{ xb.buffer, xb.buffer_size };
+    std::free(xb.buffer);
+    CHECK(json.compare(0, 32, R"({"MessageFrame":{"messageId":20,)") == 0);
+    CHECK(json.back() == '}');
+}
+
+TEST_CASE("JSON input envelopes", "[decoding][encoding][json]") {
+    std::cout << "=== JSON input envelopes ===" << std::endl;
+
+    Test_Codec codec;
+
+    // decoded, the bytes become the MessageFrame's JSON; the rest of the envelope is written as it came.
+    std::string envelope = std::string{ R"({"metadata":{"recordType":"bsmTx","encodings":[{"elementName":"unsecuredData","elementType":"MessageFrame","encodingRule":"UPER"}]},)" }
+        + R"("payload":{"dataType":"us.dot.its.jpo.ode.model.OdeHexByteArray","data":{"bytes":")" + BSM_HEX + R"("}}})";
+    std::stringstream decoded;
+    REQUIRE(codec.process_envelope(envelope.data(), envelope.size(), decoded, false));
+    CHECK(decoded.str().compare(0, 33, R"({"metadata":{"recordType":"bsmTx")") == 0);
+    CHECK(decoded.str().find(R"("payload":{"dataType":"MessageFrame","data":{"MessageFrame":{"messageId":20,)") != std::string::npos);
+    CHECK(codec.message_id() == 20);
+
+    // encoded, the XER given as the data string becomes bytes again.
+    std::string hex{ BSM_HEX };
+    buffer_structure_t xb = {0, 0, 0};
+    Asn1Status status;
+    REQUIRE(codec.decode_messageframe_data(hex, &xb, status));
+    std::string xer{ xb.buffer, xb.buffer_size };
+    std::free(xb.buffer);
+
+    envelope = R"({"OdeAsn1Data":{"metadata":{"encodings":[{"elementName":"MessageFrame","elementType":"MessageFrame","encodingRule":"UPER"}]},"payload":{"dataType":"MessageFrame","data":)";
+    jer::append_string(envelope, xer.data(), xer.size());
+    envelope += "}}}";
+    std::stringstream encoded;
+    REQUIRE(codec.process_envelope(envelope.data(), envelope.size(), encoded, true));
+    CHECK(encoded.str() == std::string{ R"({"OdeAsn1Data":{"metadata":{"encodings":[{"elementName":"MessageFrame","elementType":"MessageFrame","encodingRule":"UPER"}]},)" }
+        + R"("payload":{"dataType":"us.dot.its.jpo.ode.model.OdeHexByteArray","data":{"MessageFrame":{"bytes":")" + BSM_HEX + R"("}}}}})");
+
+    // codec errors replace the data, as in an XML envelope; an envelope that does not parse gets the XML error document.
+    envelope = R"({"metadata":{"payloadType":"x","encodings":[{"elementType":"MessageFrame","encodingRule":"UPER"}]},"payload":{"data":{"bytes":"00145144AD0B"}}})";
+    std::stringstream failed;
+    CHECK_FALSE(codec.process_envelope(envelope.data(), envelope.size(), failed, false));
+    CHECK(failed.str().compare(0, 62, R"({"metadata":{"payloadType":"us.dot.its.jpo.ode.model.OdeAsn1Pa)") == 0);
+    CHECK(failed.str().find(R"("data":{"code":)") != std::string::npos);
+
+    envelope = R"({"metadata":)";
+    std::stringstream unparsed;
+    CHECK_FALSE(codec.process_envelope(envelope.data(), envelope.size(), unparsed, false));
+    CHECK(unparsed.str().compare(0, 1, "{") != 0);
+}
+
+TEST_CASE("Raw records with their encodings in a header", "[decoding][encoding][raw]") {
+    std::cout << "=== Raw records with their encodings in a header ===" << std::endl;
+
+    Test_Codec codec;
+
+    // decoded, the bytes become the PDU's XER alone; there is no envelope around it.
+    std::vector<char> bytes;
+    REQUIRE(codec.hex_to_bytes_(BSM_HEX, bytes));
+    std::stringstream decoded;
+    REQUIRE(codec.process_raw(bytes.data(), bytes.size(), "MessageFrame:UPER", decoded, false));
+    CHECK(decoded.str().compare(0, 14, "<MessageFrame>") == 0);
+    CHECK(decoded.str().find("<BasicSafetyMessage>") != std::string::npos);
+    CHECK(codec.message_id() == 20);
+
+    std::vector<char> signed_bytes;
+    REQUIRE(codec.hex_to_bytes_(ONE609_BSM_HEX, signed_bytes));
+    std::stringstream unsecured;
+    REQUIRE(codec.process_raw(signed_bytes.data(), signed_bytes.size(), " Ieee1609Dot2Data:COER, MessageFrame:UPER ", unsecured, false));
+    CHECK(unsecured.str() == decoded.str());
+
+    // encoded, the XER becomes the bytes of the outermost element, not hex.
+    std::stringstream encoded;
+    REQUIRE(codec.process_raw(decoded.str().data(), decoded.str().size(), "MessageFrame:UPER", encoded, true));
+    CHECK(encoded.str() == std::string(bytes.data(), bytes.size()));
+
+    // an encoding stack the codec does not know is not decoded.
+    std::stringstream failed;
+    CHECK_FALSE(codec.process_raw(bytes.data(), bytes.size(), "MessageFrame:XYZ", failed, false));
+    CHECK_FALSE(codec.process_raw(bytes.data(), bytes.size(), "", failed, false));
+}
+
+TEST_CASE("Output record keys from the decoded entity", "[decoding][encoding][kafka]") {
+    std::cout << "=== Output record keys from the decoded entity ===" << std::endl;
+
+    Test_Codec codec;
+
+    std::vector<char> bytes;
+    REQUIRE(codec.hex_to_bytes_(BSM_HEX, bytes));
+    std::stringstream decoded;
+
+    // keyed by the input record, nothing is derived.
+    REQUIRE(codec.process_raw(bytes.data(), bytes.size(), "MessageFrame:UPER", decoded, false));
+    CHECK(codec.entity_key().empty());
+
+    // a BSM is keyed by its TemporaryID, decoded or encoded; MAP and SPaT by their intersection.
+    codec.set_output_key(Output_Key::ENTITY);
+    decoded.str("");
+    REQUIRE(codec.process_raw(bytes.data(), bytes.size(), "MessageFrame:UPER", decoded, false));
+    CHECK(codec.entity_key() == "BEA10000");
+
+    std::stringstream encoded;
+    REQUIRE(codec.process_raw(decoded.str().data(), decoded.str().size(), "MessageFrame:UPER", encoded, true));
+    CHECK(codec.entity_key() == "BEA10000");
+
+    REQUIRE(codec.hex_to_bytes_(MAP_HEX, bytes));
+    REQUIRE(codec.process_raw(bytes.data(), bytes.size(), "MessageFrame:UPER", decoded, false));
+    CHECK(codec.entity_key() == "33467.36540");
+
+    // a TIM is not about one entity, so it has no key; the input record's key is used for it.
+    REQUIRE(codec.hex_to_bytes_(TIM_HEX, bytes));
+    REQUIRE(codec.process_raw(bytes.data(), bytes.size(), "MessageFrame:UPER", decoded, false));
+    CHECK(codec.entity_key().empty());
+
+    // the HTTP and IPC servers share one codec: what a call learns goes to its status, and the codec keeps its own.
+    buffer_structure_t xb = {0, 0, 0};
+    std::string hex = BSM_HEX;
+    Asn1Status status;
+    REQUIRE(codec.decode_messageframe_data(hex, &xb, status));
+    free(xb.buffer);
+    CHECK(status.message_id() == 20);
+    CHECK(status.entity_key() == "BEA10000");
+    CHECK(codec.message_id() == 31);
+    CHECK(codec.entity_key().empty());
+}
+
+TEST_CASE("Pipelines read from acm.pipelines", "[kafka]") {
+    std::cout << "=== Pipelines read from acm.pipelines ===" << std::endl;
+
+    Test_Codec codec;
+
+    std::unordered_map<std::string, std::string> properties{
+        { "acm.pipeline.bsm.topic.consumer", "topic.Asn1DecoderInput" },
+        { "acm.pipeline.bsm.topic.producer", "topic.Asn1DecoderOutput" },
+        { "acm.pipeline.bsm.workers", "3" },
+        { "acm.pipeline.tim.type", "encode" },
+        { "acm.pipeline.tim.topic.consumer", "topic.Asn1EncoderInput" },
+        { "acm.pipeline.tim.topic.producer", "topic.Asn1EncoderOutput" },
+        { "acm.pipeline.tim.group.id", "tim_encoders" },
+        { "acm.pipeline.tim.route.20", "topic.Asn1EncoderBsm" },
+    };
+
+    // a pipeline's group is derived from the process's, unless it names its own.
+    REQUIRE(codec.configure_pipelines(" bsm, tim ,", properties, "asn1_codec"));
+    const std::vector<Pipeline_Config>& pipelines = codec.pipeline_configs();
+    REQUIRE(pipelines.size() == 2);
+    CHECK(pipelines[0].name == "bsm");
+    CHECK(pipelines[0].decode);
+    CHECK(pipelines[0].consumer_topic == "topic.Asn1DecoderInput");
+    CHECK(pipelines[0].producer_topic == "topic.Asn1DecoderOutput");
+    CHECK(pipelines[0].group_id == "asn1_codec.bsm");
+    CHECK(pipelines[0].workers == 3);
+    CHECK_FALSE(pipelines[1].decode);
+    CHECK(pipelines[1].group_id == "tim_encoders");
+    CHECK(pipelines[1].workers == 1);
+    CHECK(pipelines[1].routes.at("20") == "topic.Asn1EncoderBsm");
+
+    REQUIRE(codec.configure_pipelines("bsm", properties, ""));
+    REQUIRE(codec.pipeline_configs().size() == 1);
+    CHECK(codec.pipeline_configs()[0].group_id == "asn1_codec.bsm");
+
+    // no pipelines, a pipeline without both topics, an unknown type, or no workers.
+    CHECK_FALSE(codec.configure_pipelines(" , ", properties, "asn1_codec"));
+    CHECK_FALSE(codec.configure_pipelines("bsm,psm", properties, "asn1_codec"));
+
+    properties.erase("acm.pipeline.bsm.topic.producer");
+    CHECK_FALSE(codec.configure_pipelines("bsm", properties, "asn1_codec"));
+    properties["acm.pipeline.bsm.topic.producer"] = "topic.Asn1DecoderOutput";
+
+    properties["acm.pipeline.bsm.type"] = "transcode";
+    CHECK_FALSE(codec.configure_pipelines("bsm", properties, "asn1_codec"));
+    properties["acm.pipeline.bsm.type"] = "decode";
+
+    for (const char* workers : { "0", "-2", "many" }) {
+        properties["acm.pipeline.bsm.workers"] = workers;
+        CHECK_FALSE(codec.configure_pipelines("bsm", properties, "asn1_codec"));
+    }
+}
+
+TEST_CASE("Partition workers follow the consumer's assignment", "[kafka][partition]") {
+    std::cout << "=== Partition workers follow the consumer's assignment ===" << std::endl;
+
+    const std::string input_topic = "acm.test.partitions.input";
+    const std::string output_topic = "acm.test.partitions.output";
+    const int partitions = 3;
+    const int records = 2;
+    std::string error_string;
+
+    // a producer created with test.mock.num.brokers owns an in-process mock cluster, as in acm_kafka_bench.
+    std::unique_ptr<RdKafka::Conf> cluster_conf{ RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL) };
+    REQUIRE(cluster_conf->set("test.mock.num.brokers", "1", error_string) == RdKafka::Conf::CONF_OK);
+    std::unique_ptr<RdKafka::Producer> cluster_producer{ RdKafka::Producer::create(cluster_conf.get(), error_string) };
+    REQUIRE(cluster_producer);
+    rd_kafka_mock_cluster_t* cluster = rd_kafka_handle_mock_cluster(cluster_producer->c_ptr());
+    REQUIRE(cluster);
+    const std::string bootstraps = rd_kafka_mock_cluster_bootstraps(cluster);
+    REQUIRE(rd_kafka_mock_topic_create(cluster, input_topic.c_str(), partitions, 1) == RD_KAFKA_RESP_ERR_NO_ERROR);
+    REQUIRE(rd_kafka_mock_topic_create(cluster, output_topic.c_str(), 1, 1) == RD_KAFKA_RESP_ERR_NO_ERROR);
+
+    std::vector<char> bsm;
+    REQUIRE(asn1_codec.hex_to_bytes_(BSM_HEX, bsm));
+    for (int p = 0; p < partitions; ++p) {
+        for (int r = 0; r < records; ++r) {
+            RdKafka::Headers* headers = RdKafka::Headers::create();
+            headers->add("acm-encodings", "MessageFrame:UPER");
+            REQUIRE(cluster_producer->produce(input_topic, p, RdKafka::Producer::RK_MSG_COPY, bsm.data(), bsm.size(),
+                    NULL, 0, 0, headers, NULL) == RdKafka::ERR_NO_ERROR);
+        }
+    }
+    REQUIRE(cluster_producer->flush(10000) == RdKafka::ERR_NO_ERROR);
+
+    char config_path[] = "/tmp/acm_tests_partitions.XXXXXX";
+    int fd = mkstemp(config_path);
+    REQUIRE(fd >= 0);
+    close(fd);
+    {
+        std::ofstream config{ config_path };
+        config << "asn1.topic.consumer=" << input_topic << "\n"
+               << "asn1.topic.producer=" << output_topic << "\n"
+               << "asn1.consumer.timeout.ms=100\n"
+               << "metadata.broker.list=" << bootstraps << "\n"
+               << "group.id=acm-tests-partitions\n"
+               << "acm.raw.header=acm-encodings\n"
+               << "acm.kafka.partition.parallel=true\n";
+    }
+
+    ASN1_Codec codec{"ASN1_Codec","ASN1 Processing Module"};
+    codec.addOption('c', "config", "Configuration file name and path.", true);
+    codec.addOption('x', "exit", "Exit consumer when last message in partition has been received.", false);
+    std::vector<std::string> args{ "acm_tests", "-c", config_path, "-x" };
+    std::vector<char*> argv;
+    for (auto& a : args) argv.push_back(&a[0]);
+    argv.push_back(nullptr);
+    optind = 0;
+    REQUIRE(codec.parseArgs(static_cast<int>(args.size()), argv.data()));
+    codec.setup_logger_for_testing();
+    REQUIRE(codec.configure());
+    REQUIRE(codec.launch_producer());
+    std::remove(config_path);
+
+    // this thread plays the consumer's: it hands the codec the assignment and the revocation a group would.
+    std::unique_ptr<RdKafka::Conf> consumer_conf{ RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL) };
+    REQUIRE(consumer_conf->set("metadata.broker.list", bootstraps, error_string) == RdKafka::Conf::CONF_OK);
+    REQUIRE(consumer_conf->set("group.id", "acm-tests-partitions", error_string) == RdKafka::Conf::CONF_OK);
+    REQUIRE(consumer_conf->set("auto.offset.reset", "earliest", error_string) == RdKafka::Conf::CONF_OK);
+    REQUIRE(consumer_conf->set("enable.partition.eof", "true", error_string) == RdKafka::Conf::CONF_OK);
+    REQUIRE(consumer_conf->set("enable.auto.offset.store", "false", error_string) == RdKafka::Conf::CONF_OK);
+    REQUIRE(consumer_conf->set("enable.auto.commit", "false", error_string) == RdKafka::Conf::CONF_OK);
+    std::unique_ptr<RdKafka::KafkaConsumer> consumer{ RdKafka::KafkaConsumer::create(consumer_conf.get(), error_string) };
+    REQUIRE(consumer);
+
+    std::vector<RdKafka::TopicPartition*> assignment;
+    for (int p = 0; p < partitions; ++p) assignment.push_back(RdKafka::TopicPartition::create(input_topic, p));
+
+    metrics::Registry& registry = metrics::Registry::instance();
+    uint64_t received = registry.total(metrics::Counter::MESSAGES_RECEIVED);
+    uint64_t published = registry.total(metrics::Counter::MESSAGES_PUBLISHED);
+
+    // assigned, each partition gets a worker; consuming stops once all of them have reached their end.
+    AcmRebalanceCb rebalance{ codec };
+    rebalance.rebalance_cb(consumer.get(), RdKafka::ERR__ASSIGN_PARTITIONS, assignment);
+    CHECK(codec.partition_worker_count() == partitions);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (codec.consuming() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    CHECK_FALSE(codec.consuming());
+    CHECK(registry.total(metrics::Counter::MESSAGES_RECEIVED) == received + partitions * records);
+
+    // revoked, the workers stop, and the offsets stored after each output are committed for the next owner.
+    rebalance.rebalance_cb(consumer.get(), RdKafka::ERR__REVOKE_PARTITIONS, assignment);
+    CHECK(codec.partition_worker_count() == 0);
+    CHECK(registry.total(metrics::Counter::MESSAGES_PUBLISHED) == published + partitions * records);
+
+    REQUIRE(consumer->committed(assignment, 5000) == RdKafka::ERR_NO_ERROR);
+    for (RdKafka::TopicPartition* partition : assignment) {
+        CHECK(partition->offset() == records);
+    }
+
+    RdKafka::TopicPartition::destroy(assignment);
+    consumer->close();
+}
+
 /*
  * Utilities for VehicleEventFlags tests
  */
@@ -538,4 +1164,441 @@ TEST_CASE("Http_Server::post_batch (application/x-ndjson)", "[decoding][http_ser
     CHECK(response.body.find("<RTCMcorrections>") != std::string::npos);
     CHECK(response.body.find("<SensorDataSharingMessage>") != std::string::npos);
     CHECK(response.body.find("<RoadSafetyMessage>") != std::string::npos);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Ipc_Server::process_frame: Decode BSM", "[decoding][ipc_server]") {
+    std::cout << "=== Ipc_Server::process_frame: Decode BSM ===" << std::endl;
+
+    Ipc_Server server(asn1_codec);
+
+    std::vector<char> bytes;
+    REQUIRE(asn1_codec.hex_to_bytes_(BSM_HEX, bytes));
+
+    std::string response;
+    ipc::IpcCode rc = server.process_frame(static_cast<uint8_t>(ipc::IpcCode::DECODE_UPER_MESSAGEFRAME), bytes.data(), bytes.size(), response);
+    CHECK(rc == ipc::IpcCode::OK);
+    CHECK(response.find("<BasicSafetyMessage>") != std::string::npos);
+
+    // truncated input must come back as an error frame, not an exception.
+    rc = server.process_frame(static_cast<uint8_t>(ipc::IpcCode::DECODE_UPER_MESSAGEFRAME), bytes.data(), 4, response);
+    CHECK(rc == ipc::IpcCode::ERROR);
+}
+
+TEST_CASE("SpscRing push and pop in order", "[ipc_server]") {
+    std::cout << "=== SpscRing push and pop in order ===" << std::endl;
+
+    constexpr uint32_t slots = 4;
+    constexpr uint32_t slot_size = 64;
+    alignas(ipc::kCacheLine) static char memory[sizeof(ipc::RingControl) + slots * slot_size];
+
+    ipc::SpscRing ring{ memory, slots, slot_size };
+    ring.initialize();
+
+    for (uint32_t i = 0; i < slots; ++i) {
+        std::string body = "message " + std::to_string(i);
+        CHECK(ring.try_push(static_cast<uint8_t>(ipc::IpcCode::OK), body.data(), body.size()));
+    }
+
+    // the ring is full; a fifth message is refused rather than overwriting.
+    CHECK_FALSE(ring.try_push(static_cast<uint8_t>(ipc::IpcCode::OK), "x", 1));
+
+    uint8_t code;
+    std::string out;
+    for (uint32_t i = 0; i < slots; ++i) {
+        REQUIRE(ring.try_pop(code, out));
+        CHECK(out == "message " + std::to_string(i));
+    }
+    CHECK_FALSE(ring.try_pop(code, out));
+
+    // a slot is written by another process; one claiming more than the slot holds is refused, not read.
+    REQUIRE(ring.try_push(static_cast<uint8_t>(ipc::IpcCode::OK), "x", 1));
+    ipc::SlotHeader* header = reinterpret_cast<ipc::SlotHeader*>(memory + sizeof(ipc::RingControl));     // slot 4 & 3.
+    header->length = ring.capacity() + 1;
+    const char* data = nullptr;
+    uint32_t length = 0;
+    CHECK(ring.peek(code, data, length) == ipc::SlotState::CORRUPT);
+    CHECK(data == nullptr);
+    CHECK_FALSE(ring.try_pop(code, out));
+}
+
+TEST_CASE("ShmSegment attach checks the segment geometry", "[ipc_server]") {
+    std::cout << "=== ShmSegment attach checks the segment geometry ===" << std::endl;
+
+    const std::string name = "/acm_tests_shm_" + std::to_string(getpid());
+    ipc::ShmSegment segment;
+    REQUIRE(segment.create(name, 2, 4, 128));
+
+    ipc::ShmSegment attached;
+    CHECK(attached.attach(name));
+    CHECK(attached.channel_count() == 2);
+
+    // a header claiming more channels than the segment holds would lay rings out past the mapping.
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    REQUIRE(fd >= 0);
+    void* base = mmap(nullptr, sizeof(ipc::SegmentHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    REQUIRE(base != MAP_FAILED);
+    ipc::SegmentHeader* header = static_cast<ipc::SegmentHeader*>(base);
+
+    header->channel_count = 3;
+    ipc::ShmSegment too_many;
+    CHECK_FALSE(too_many.attach(name));
+
+    header->channel_count = 2;
+    header->slot_size = 1u << 30;
+    ipc::ShmSegment too_big;
+    CHECK_FALSE(too_big.attach(name));
+
+    munmap(base, sizeof(ipc::SegmentHeader));
+}
+
+TEST_CASE("HistogramSnapshot percentiles", "[metrics]") {
+    std::cout << "=== HistogramSnapshot percentiles ===" << std::endl;
+
+    // every value maps into a bucket whose bounds contain it.
+    for (uint64_t v : { 0ULL, 7ULL, 8ULL, 15ULL, 16ULL, 17ULL, 1000ULL, 123456789ULL, ~0ULL }) {
+        std::size_t i = metrics::bucket_index(v);
+        REQUIRE(i < metrics::kBucketCount);
+        CHECK(metrics::bucket_lower(i) <= v);
+        CHECK(metrics::bucket_upper(i) >= v);
+    }
+
+    metrics::HistogramSnapshot h;
+    for (uint64_t v = 1; v <= 1000; ++v) h.record(v * 1000);
+
+    CHECK(h.count == 1000);
+    CHECK(h.max == 1000000);
+    // log-linear buckets with 8 sub-buckets stay within 12.5% of the true value.
+    CHECK(h.percentile(0.5) >= 500000 * 875 / 1000);
+    CHECK(h.percentile(0.5) <= 500000 * 1125 / 1000);
+    CHECK(h.percentile(0.99) >= 990000 * 875 / 1000);
+    CHECK(h.percentile(1.0) == 1000000);
+}
+
+TEST_CASE("Registry renders Prometheus text", "[metrics]") {
+    std::cout << "=== Registry renders Prometheus text ===" << std::endl;
+
+    metrics::Registry& registry = metrics::Registry::instance();
+    uint64_t received = registry.total(metrics::Counter::MESSAGES_RECEIVED);
+
+    // counts from another thread are visible once it has finished.
+    std::thread writer{ [&registry]() {
+        registry.increment(metrics::Counter::MESSAGES_RECEIVED, 3);
+        registry.message_id(20);
+        registry.latency(metrics::Latency::DECODE, 5000);
+    } };
+    writer.join();
+
+    CHECK(registry.total(metrics::Counter::MESSAGES_RECEIVED) == received + 3);
+
+    std::string text = registry.prometheus();
+    CHECK(text.find("# TYPE acm_messages_received_total counter") != std::string::npos);
+    CHECK(text.find("acm_messages_by_id_total{message_id=\"20\"}") != std::string::npos);
+    CHECK(text.find("acm_decode_latency_seconds_bucket{le=\"+Inf\"}") != std::string::npos);
+    CHECK(text.find("acm_decode_latency_seconds_count") != std::string::npos);
+}
+
+TEST_CASE("Registry reuses the shards of finished threads", "[metrics]") {
+    std::cout << "=== Registry reuses the shards of finished threads ===" << std::endl;
+
+    metrics::Registry& registry = metrics::Registry::instance();
+    uint64_t filtered = registry.total(metrics::Counter::MESSAGES_FILTERED);
+
+    std::thread first{ [&registry]() { registry.increment(metrics::Counter::MESSAGES_FILTERED); } };
+    first.join();
+    std::size_t shards = registry.shard_count();
+
+    // one thread after another: each takes the shard the last one left, and the counts carry on.
+    for (int i = 0; i < 8; ++i) {
+        std::thread writer{ [&registry]() { registry.increment(metrics::Counter::MESSAGES_FILTERED); } };
+        writer.join();
+    }
+
+    CHECK(registry.shard_count() == shards);
+    CHECK(registry.total(metrics::Counter::MESSAGES_FILTERED) == filtered + 9);
+}
+
+TEST_CASE("Metrics server reports a port it cannot bind", "[metrics]") {
+    std::cout << "=== Metrics server reports a port it cannot bind ===" << std::endl;
+
+    // hold a port the kernel picks, so the server has to fail on it.
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(fd >= 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    socklen_t addr_len = sizeof(addr);
+    REQUIRE(bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+    REQUIRE(listen(fd, 1) == 0);
+    REQUIRE(getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &addr_len) == 0);
+    int port = ntohs(addr.sin_port);
+
+    Metrics_Server taken;
+    CHECK_FALSE(taken.start(port));
+    close(fd);
+
+    Metrics_Server server;
+    CHECK(server.start(port));
+    server.stop();
+}
+
+TEST_CASE("Error rate limiter per error class", "[metrics][errors]") {
+    std::cout << "=== Error rate limiter per error class ===" << std::endl;
+
+    const uint64_t second = 1000000000ULL;
+    Error_Rate_Limiter limiter{ 2 };
+
+    // a burst of one second's worth, then nothing until the bucket refills.
+    CHECK(limiter.allow(Asn1Status::Kind::CODEC, 10 * second));
+    CHECK(limiter.allow(Asn1Status::Kind::CODEC, 10 * second));
+    CHECK_FALSE(limiter.allow(Asn1Status::Kind::CODEC, 10 * second));
+    CHECK_FALSE(limiter.allow(Asn1Status::Kind::CODEC, 10 * second + second / 4));
+
+    // classes are limited separately.
+    CHECK(limiter.allow(Asn1Status::Kind::UNPARSEABLE_INPUT, 10 * second));
+
+    CHECK(limiter.allow(Asn1Status::Kind::CODEC, 10 * second + second / 2));
+    CHECK(limiter.take_suppressed(Asn1Status::Kind::CODEC) == 2);
+    CHECK(limiter.take_suppressed(Asn1Status::Kind::CODEC) == 0);
+    CHECK(limiter.take_suppressed(Asn1Status::Kind::UNPARSEABLE_INPUT) == 0);
+
+    Error_Rate_Limiter unlimited;
+    for (int i = 0; i < 1000; ++i) REQUIRE(unlimited.allow(Asn1Status::Kind::CODEC, 0));
+}
+
+TEST_CASE("Per-stage latency for a decoded BSM", "[metrics][decoding]") {
+    std::cout << "=== Per-stage latency for a decoded BSM ===" << std::endl;
+
+    metrics::Registry& registry = metrics::Registry::instance();
+    uint64_t before = registry.stage_snapshot(metrics::Direction::DECODE, 20, metrics::Stage::ASN_DECODE).count;
+
+    std::vector<char> bytes;
+    REQUIRE(asn1_codec.hex_to_bytes_(BSM_HEX, bytes));
+    Ipc_Server server(asn1_codec);
+    std::string response;
+
+    // disabled: nothing is recorded.
+    metrics::enable_stages(false);
+    server.process_frame(static_cast<uint8_t>(ipc::IpcCode::DECODE_UPER_MESSAGEFRAME), bytes.data(), bytes.size(), response);
+    CHECK(registry.stage_snapshot(metrics::Direction::DECODE, 20, metrics::Stage::ASN_DECODE).count == before);
+
+    metrics::enable_stages(true);
+    server.process_frame(static_cast<uint8_t>(ipc::IpcCode::DECODE_UPER_MESSAGEFRAME), bytes.data(), bytes.size(), response);
+    metrics::enable_stages(false);
+
+    CHECK(registry.stage_snapshot(metrics::Direction::DECODE, 20, metrics::Stage::ASN_DECODE).count == before + 1);
+    CHECK(registry.stage_snapshot(metrics::Direction::DECODE, 20, metrics::Stage::XER_ENCODE).count == before + 1);
+    CHECK(registry.prometheus().find("stage=\"asn_decode\",quantile=\"0.99\"") != std::string::npos);
+    CHECK_FALSE(registry.stage_report().empty());
+}
+
+TEST_CASE("Bulk conversion of hex and ndjson records", "[decoding][bulk]") {
+    std::cout << "=== Bulk conversion of hex and ndjson records ===" << std::endl;
+
+    Bulk_Converter::Format format;
+    CHECK(Bulk_Converter::parse_format("ndjson", format));
+    CHECK(format == Bulk_Converter::Format::NDJSON);
+    CHECK_FALSE(Bulk_Converter::parse_format("csv", format));
+
+    std::string hex{ BSM_HEX };
+    std::string output;
+
+    Bulk_Converter hex_converter(asn1_codec, Bulk_Converter::Format::HEX);
+    CHECK(hex_converter.convert_record(asn1_codec, hex.data(), hex.size(), output));
+    CHECK(output.find("<MessageFrame><messageId>20</messageId>") != std::string::npos);
+    CHECK(output.back() == '\n');
+
+    // a bad record still gets its line, so output lines match input lines.
+    output.clear();
+    CHECK_FALSE(hex_converter.convert_record(asn1_codec, "00ZZ", 4, output));
+    CHECK(output == "\n");
+
+    Bulk_Converter ndjson_converter(asn1_codec, Bulk_Converter::Format::NDJSON);
+    std::string record = "{\"id\":7,\"hex\":\"" + hex + "\"}";
+    output.clear();
+    CHECK(ndjson_converter.convert_record(asn1_codec, record.data(), record.size(), output));
+    CHECK(output.find("\"id\":7") != std::string::npos);
+    CHECK(output.find("\"xer\":\"<MessageFrame>") != std::string::npos);
+
+    output.clear();
+    CHECK_FALSE(ndjson_converter.convert_record(asn1_codec, "{\"id\":8}", 8, output));
+    CHECK(output.find("\"error\":") != std::string::npos);
+
+    // streamed formats have no records to hand over one at a time.
+    Bulk_Converter uper_converter(asn1_codec, Bulk_Converter::Format::UPER);
+    output.clear();
+    CHECK_FALSE(uper_converter.convert_record(asn1_codec, hex.data(), hex.size(), output));
+    CHECK(output == "\n");
+}
+
+TEST_CASE("Bulk conversion past a block with nothing to write", "[decoding][bulk]") {
+    std::cout << "=== Bulk conversion past a block with nothing to write ===" << std::endl;
+
+    char input_dir[] = "/tmp/acm_tests_bulk.XXXXXX";
+    REQUIRE(mkdtemp(input_dir));
+    const std::string input{ input_dir };
+    const std::string output = input + "/out";
+    std::ofstream{ input + "/a.hex" } << BSM_HEX << "\n";
+    std::ofstream{ input + "/b.hex" } << "\n\n\n";
+    std::ofstream{ input + "/c.hex" } << BSM_HEX << "\n";
+    std::ofstream{ input + "/acm.properties" };
+
+    // the blank file is a block of no records; the writer must move on to the file after it.
+    ASN1_Codec codec{"ASN1_Codec","ASN1 Processing Module"};
+    codec.addOption('c', "config", "Configuration file name and path.", true);
+    codec.addOption('f', "format", "Bulk input format.", true);
+    codec.addOption('j', "jobs", "Bulk conversion threads.", true);
+    codec.addOption('O', "output-dir", "Bulk output directory.", true);
+    std::vector<std::string> args{ "acm_tests", "-c", input + "/acm.properties", "-f", "hex", "-j", "1", "-O", output,
+                                   input + "/a.hex", input + "/b.hex", input + "/c.hex" };
+    std::vector<char*> argv;
+    for (auto& a : args) argv.push_back(&a[0]);
+    argv.push_back(nullptr);
+    optind = 0;
+    REQUIRE(codec.parseArgs(static_cast<int>(args.size()), argv.data()));
+    codec.setup_logger_for_testing();
+
+    Bulk_Converter converter(codec);
+    CHECK(converter.bulk_converter() == EXIT_SUCCESS);
+
+    for (const char* name : { "/a.hex.xer", "/c.hex.xer" }) {
+        std::string xer = readFile(output + name);
+        CHECK(xer.find("<MessageFrame><messageId>20</messageId>") != std::string::npos);
+    }
+
+    for (const char* name : { "/a.hex.xer", "/b.hex.xer", "/c.hex.xer" }) std::remove((output + name).c_str());
+    rmdir(output.c_str());
+    for (const char* name : { "/a.hex", "/b.hex", "/c.hex", "/acm.properties" }) std::remove((input + name).c_str());
+    rmdir(input_dir);
+}
+
+TEST_CASE("Stream decoding of concatenated PDUs", "[decoding][stream]") {
+    std::cout << "=== Stream decoding of concatenated PDUs ===" << std::endl;
+
+    std::string uper = readFile("data/examples/j2735.MessageFrame.128.bsms.uper");
+    REQUIRE(uper.size() == 16000);
+
+    std::size_t decoded = 0;
+    uint64_t next_offset = 0;
+    auto emit = [&](const Stream_Decoder::Output& pdu) {
+        CHECK(pdu.ok);
+        CHECK(pdu.offset == next_offset);
+        CHECK(pdu.text.find("<MessageFrame><messageId>20</messageId>") == 0);
+        next_offset = pdu.offset + pdu.length;
+        ++decoded;
+    };
+
+    // small pieces make most PDUs span feeds, so they come back RC_WMORE and are decoded again.
+    Asn1Status status;
+    Stream_Decoder messageframes{ Stream_Decoder::Pdu::MESSAGEFRAME, ATS_UNALIGNED_BASIC_PER };
+    for (std::size_t p = 0; p < uper.size(); p += 7) {
+        messageframes.feed(uper.data() + p, std::min<std::size_t>(7, uper.size() - p), emit, status);
+    }
+    CHECK(messageframes.finish(emit, status));
+    CHECK(status.ok());
+    CHECK(decoded == 128);
+    CHECK(messageframes.offset() == uper.size());
+
+    std::vector<char> frame;
+    REQUIRE(asn1_codec.hex_to_bytes_(ONE609_BSM_HEX, frame));
+    std::string coer;
+    for (int i = 0; i < 3; ++i) coer.append(frame.data(), frame.size());
+
+    // OER decoding is restartable: the third PDU goes on from where the first feed left it.
+    auto ok = [](const Stream_Decoder::Output& pdu) { CHECK(pdu.ok); };
+    Stream_Decoder ieee1609{ Stream_Decoder::Pdu::IEEE1609DOT2, ATS_CANONICAL_OER };
+    std::size_t count = ieee1609.feed(coer.data(), coer.size() - 10, ok, status);
+    CHECK(count == 2);
+    CHECK(ieee1609.pending() == frame.size() - 10);
+    CHECK(ieee1609.feed(coer.data() + coer.size() - 10, 10, ok, status) == 1);
+    CHECK(ieee1609.pending() == 0);
+    CHECK(ieee1609.finish(ok, status));
+    CHECK(status.ok());
+
+    Stream_Decoder truncated{ Stream_Decoder::Pdu::IEEE1609DOT2, ATS_CANONICAL_OER };
+    truncated.feed(coer.data(), coer.size() - 10, ok, status);
+    CHECK_FALSE(truncated.finish(ok, status));
+    CHECK(status.kind() == Asn1Status::Kind::CODEC);
+
+    // a PDU that needs more than the maximum is given up on rather than held.
+    status.clear();
+    Stream_Decoder capped{ Stream_Decoder::Pdu::IEEE1609DOT2, ATS_CANONICAL_OER };
+    capped.set_max_pdu_size(frame.size() / 2);
+    CHECK(capped.feed(coer.data(), frame.size() / 2, ok, status) == 0);
+    CHECK(status.kind() == Asn1Status::Kind::CODEC);
+    CHECK(capped.pending() == 0);
+
+    // bad data ends the stream.
+    status.clear();
+    Stream_Decoder bad{ Stream_Decoder::Pdu::IEEE1609DOT2, ATS_CANONICAL_OER };
+    const char garbage[] = { '\x7f', '\x7f', '\x7f', '\x7f' };
+    CHECK(bad.feed(garbage, sizeof(garbage), [](const Stream_Decoder::Output&) {}, status) == 0);
+    CHECK(status.kind() == Asn1Status::Kind::CODEC);
+    CHECK(bad.feed(coer.data(), coer.size(), ok, status) == 0);
+}
+
+TEST_CASE("Read WSMP packets from a pcap capture", "[decoding][pcap]") {
+    std::cout << "=== Read WSMP packets from a pcap capture ===" << std::endl;
+
+    std::vector<char> frame;
+    REQUIRE(asn1_codec.hex_to_bytes_(ONE609_BSM_HEX, frame));
+
+    auto le32 = [](std::string& out, uint32_t v) {
+        for (int i = 0; i < 4; ++i) out += static_cast<char>((v >> (8 * i)) & 0xFF);
+    };
+
+    // Ethernet, WSMP version 3 with no N-header options, TPID 0, PSID 0x20, two byte length.
+    std::string wsmp_frame = std::string(12, '\x02') + "\x88\xDC" + std::string{ "\x03\x00\x20", 3 };
+    wsmp_frame += static_cast<char>(0x80 | (frame.size() >> 8));
+    wsmp_frame += static_cast<char>(frame.size() & 0xFF);
+    wsmp_frame.append(frame.data(), frame.size());
+    std::string ipv4_frame = std::string(12, '\x02') + "\x08\x00" + std::string(20, '\x45');
+
+    std::string capture;
+    le32(capture, 0xA1B2C3D4);
+    capture += std::string{ "\x02\x00\x04\x00", 4 } + std::string(12, '\0');
+    le32(capture, pcap::LINKTYPE_ETHERNET);
+    for (const std::string* packet : { &wsmp_frame, &ipv4_frame }) {
+        le32(capture, 1714564800);
+        le32(capture, 250000);
+        le32(capture, static_cast<uint32_t>(packet->size()));
+        le32(capture, static_cast<uint32_t>(packet->size()));
+        capture += *packet;
+    }
+
+    pcap::Reader reader{ capture.data(), capture.size() };
+    REQUIRE(reader.ok());
+
+    pcap::Packet packet;
+    pcap::Wsm wsm;
+    REQUIRE(reader.next(packet));
+    CHECK(packet.number == 1);
+    CHECK(pcap::iso8601(packet.timestamp_ns) == "2024-05-01T12:00:00.250000000Z");
+    REQUIRE(pcap::extract_wsm(packet, wsm));
+    CHECK(wsm.psid == 0x20);
+    REQUIRE(wsm.length == frame.size());
+    CHECK(std::memcmp(wsm.data, frame.data(), frame.size()) == 0);
+
+    // the WSM goes through the codec's 1609.2 and MessageFrame decoders, as a raw record would.
+    buffer_structure_t xb = {0, 0, 0};
+    Asn1Status status;
+    bool is_signed = true;
+    CHECK(asn1_codec.decode_1609dot2_messageframe_bytes(reinterpret_cast<const char*>(wsm.data), wsm.length, &xb, is_signed, status));
+    CHECK_FALSE(is_signed);
+    CHECK(std::string(xb.buffer, xb.buffer_size).find("<MessageFrame><messageId>20</messageId>") == 0);
+    free(xb.buffer);
+
+    REQUIRE(reader.next(packet));
+    CHECK_FALSE(pcap::extract_wsm(packet, wsm));
+    CHECK_FALSE(reader.next(packet));
+    CHECK(reader.ok());
+
+    // a record that runs past the end of the file stops the reader with an error.
+    pcap::Reader truncated{ capture.data(), capture.size() - 10 };
+    CHECK(truncated.next(packet));
+    CHECK_FALSE(truncated.next(packet));
+    CHECK_FALSE(truncated.ok());
+
+    CHECK_FALSE(pcap::Reader{ "not a capture", 13 }.ok());
+}
@@ -220,6 +220,11 @@ bool Tool::hasOperands() const
     return !operands.empty();
 }
 
+const std::vector<std::string>& Tool::getOperands() const
+{
+    return operands;
+}
+
 void Tool::help()
 {
     os_ << name_ << "\n" << description_ << "\n";
@@ -0,0 +1,83 @@
+#include "topic_router.hpp"
+
+#include <algorithm>
+
+Topic_Router::Topic_Router( const std::string& default_topic ) :
+    topics_{ default_topic }
+{
+}
+
+std::size_t Topic_Router::route_of( const std::string& topic ) {
+    auto it = std::find( topics_.begin(), topics_.end(), topic );
+    if ( it != topics_.end() ) return static_cast<std::size_t>( it - topics_.begin() );
+    topics_.push_back( topic );
+    return topics_.size() - 1;
+}
+
+bool Topic_Router::add( const std::string& key, const std::string& topic, std::string& error ) {
+    if ( topic.empty() ) {
+        error = "acm.route." + key + " has no topic.";
+        return false;
+    }
+
+    if ( topics_.size() >= metrics::kMaxRoutes && std::find( topics_.begin(), topics_.end(), topic ) == topics_.end() ) {
+        error = "more than " + std::to_string( metrics::kMaxRoutes ) + " output topics.";
+        return false;
+    }
+
+    const std::string errors = "error";
+    if ( key == errors ) {
+        std::size_t route = route_of( topic );
+        for ( std::size_t kind = 1; kind < Asn1Status::kKinds; ++kind ) {
+            // a rule for one class wins over the rule for all of them, whatever the order they are read in.
+            if ( by_error_[kind] == kDefaultRoute ) by_error_[kind] = static_cast<uint16_t>( route );
+        }
+        return true;
+    }
+
+    if ( key.compare( 0, errors.size() + 1, errors + "." ) == 0 ) {
+        std::string name = key.substr( errors.size() + 1 );
+        for ( std::size_t kind = 1; kind < Asn1Status::kKinds; ++kind ) {
+            if ( name == Asn1Status::name( static_cast<Asn1Status::Kind>( kind ) ) ) {
+                by_error_[kind] = static_cast<uint16_t>( route_of( topic ) );
+                return true;
+            }
+        }
+        error = "unknown error class: " + name;
+        return false;
+    }
+
+    try {
+        std::size_t used;
+        unsigned long id = std::stoul( key, &used );
+        if ( used == key.size() && id < Message_Filter::kMessageIds ) {
+            by_message_id_[id] = static_cast<uint16_t>( route_of( topic ) );
+            return true;
+        }
+    } catch ( std::exception& ) {
+    }
+
+    error = "acm.route." + key + ": expected a messageId below " + std::to_string( Message_Filter::kMessageIds ) + ", error, or error.<class>.";
+    return false;
+}
+
+std::size_t Topic_Router::output( const std::string& topic ) {
+    return route_of( topic );
+}
+
+std::size_t Topic_Router::route( long message_id ) const {
+    if ( message_id < 0 || message_id >= static_cast<long>( Message_Filter::kMessageIds ) ) return kDefaultRoute;
+    return by_message_id_[message_id];
+}
+
+std::size_t Topic_Router::route( const Asn1Status& status ) const {
+    return by_error_[ std::min( static_cast<std::size_t>( status.kind() ), Asn1Status::kKinds - 1 ) ];
+}
+
+const std::string& Topic_Router::topic( std::size_t route ) const {
+    return topics_[ route < topics_.size() ? route : kDefaultRoute ];
+}
+
+const std::vector<std::string>& Topic_Router::topics() const {
+    return topics_;
+}